@@ -1,8 +1,46 @@
 #include "pch.h"
 #include "../matrix_3_0/matrix.hpp"
+#include "../matrix_3_0/versioned_matrix.hpp"
+#include "../matrix_3_0/linalg.hpp"
+#include "../matrix_3_0/matrix_functions.hpp"
+#include "../matrix_3_0/products.hpp"
+#include "../matrix_3_0/prefix_sum.hpp"
+#include "../matrix_3_0/stencil.hpp"
+#include "../matrix_3_0/resample.hpp"
+#include "../matrix_3_0/complex_matrix.hpp"
+#include "../matrix_3_0/modular_matrix.hpp"
+#include "../matrix_3_0/bit_matrix.hpp"
+#include "../matrix_3_0/random.hpp"
+#include "../matrix_3_0/sketch.hpp"
+#include "../matrix_3_0/hodlr_matrix.hpp"
+#include "../matrix_3_0/compressed_matrix.hpp"
+#include "../matrix_3_0/memory_budget.hpp"
+#include "../matrix_3_0/out_of_core.hpp"
+#include "../matrix_3_0/async_io.hpp"
+#include "../matrix_3_0/shm_matrix.hpp"
+#include "../matrix_3_0/matrix_view.hpp"
+#include "../matrix_3_0/transport.hpp"
+#include "../matrix_3_0/distributed.hpp"
+#include "../matrix_3_0/checkpoint.hpp"
+#include "../matrix_3_0/autotune.hpp"
+#include "../matrix_3_0/reduce.hpp"
+#include "../matrix_3_0/matrix_c.h"
+#include "../matrix_3_0/dyn_matrix.hpp"
+#include "../matrix_3_0/tensor.hpp"
 
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
 #include <numeric>
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 template<typename T>
 void ExpectAllEqualTo(const matrix<T>& mtx, const T& val) {
@@ -14,6 +52,17 @@ void ExpectAllEqualTo(const matrix<T>& mtx, const T& val) {
 	}
 }
 
+template<typename T>
+void ExpectAllNear(const matrix<T>& lhs, const matrix<T>& rhs, double eps) {
+	ASSERT_EQ(lhs.size().rows, rhs.size().rows);
+	ASSERT_EQ(lhs.size().cols, rhs.size().cols);
+	for (std::size_t row = 0; row < lhs.size().rows; ++row) {
+		for (std::size_t col = 0; col < lhs.size().cols; ++col) {
+			EXPECT_NEAR(lhs[row][col], rhs[row][col], eps);
+		}
+	}
+}
+
 template<typename T>
 void ExpectEqualState(const matrix<T>& lhs, const matrix<T>& rhs) {
 	EXPECT_EQ(lhs.size(), rhs.size());
@@ -300,4 +349,1657 @@ TEST(AccessByIndexes, Exceptions) {
 
 	EXPECT_THROW(mtx(3, 4), std::out_of_range);
 	EXPECT_THROW(mtx(-1, 0), std::out_of_range);
-}
\ No newline at end of file
+}
+
+TEST(VersionedMatrix, SnapshotSeesOldValues) {
+	versioned_matrix<int> mtx(matrix<int>(3, { 1, 2, 3, 4, 5, 6, 7, 8, 9 }));
+	EXPECT_EQ(mtx.row_buffers(), 3);
+
+	auto snap = mtx.take_snapshot();
+	mtx.set(1, 1, 50);
+	mtx.set(1, 2, 60);
+
+	EXPECT_EQ(mtx(1, 1), 50);
+	EXPECT_EQ(snap(1, 1), 5);
+	EXPECT_EQ(snap(1, 2), 6);
+
+	// only the changed row was copied, unchanged rows are shared
+	EXPECT_EQ(mtx.row_buffers(), 4);
+	EXPECT_EQ(snap[0], mtx[0]);
+	EXPECT_NE(snap[1], mtx[1]);
+	EXPECT_THROW(snap(3, 0), std::out_of_range);
+}
+
+TEST(VersionedMatrix, CollectGarbage) {
+	versioned_matrix<int> mtx(2, 2, 0);
+
+	auto snap1 = mtx.take_snapshot();
+	mtx.set(0, 0, 1);
+	auto snap2 = mtx.take_snapshot();
+	mtx.set(0, 0, 2);
+	EXPECT_EQ(mtx.row_buffers(), 4);
+
+	EXPECT_EQ(mtx.collect_garbage(), 0);
+	EXPECT_EQ(snap1(0, 0), 0);
+	EXPECT_EQ(snap2(0, 0), 1);
+
+	snap1.release();
+	EXPECT_EQ(mtx.collect_garbage(), 1);
+	EXPECT_EQ(snap2(0, 0), 1);
+
+	snap2.release();
+	EXPECT_EQ(mtx.collect_garbage(), 1);
+	EXPECT_EQ(mtx.row_buffers(), 2);
+	EXPECT_EQ(mtx(0, 0), 2);
+
+	// no live snapshots - writes go in place
+	mtx.set(1, 1, 7);
+	EXPECT_EQ(mtx.row_buffers(), 2);
+}
+
+TEST(VersionedMatrix, SnapshotOutlivesMatrix) {
+	versioned_matrix<std::string>::snapshot snap;
+	{
+		versioned_matrix<std::string> mtx(2, 2, "a");
+		snap = mtx.take_snapshot();
+		mtx.set(0, 1, "b");
+	}
+	EXPECT_EQ(snap(0, 1), "a");
+	EXPECT_EQ(snap.to_matrix()(1, 1), "a");
+}
+
+TEST(Linalg, GemmAndTranspose) {
+	matrix<double> a(2, { 1, 2, 3, 4, 5, 6 });
+	matrix<double> b(3, { 1, 0, 2, 0, 1, 3 });
+	matrix<double> c(3, 3, 1.0);
+
+	gemm(2.0, a, b, 1.0, c);
+	ExpectAllNear(c, matrix<double>(3, { 3, 5, 17, 7, 9, 37, 11, 13, 57 }), 1e-12);
+
+	ExpectAllNear(transpose(a), matrix<double>(3, { 1, 3, 5, 2, 4, 6 }), 0.0);
+	EXPECT_THROW(multiply(a, a), std::invalid_argument);
+}
+
+TEST(Linalg, RankOneUpdates) {
+	const std::vector<double> x = { 1, 2, 3 };
+	const std::vector<double> y = { 4, 5, 6 };
+
+	matrix<double> a(3, 3, 0.0);
+	ger(1.0, x, y, a);
+	ExpectAllNear(a, matrix<double>(3, { 4, 5, 6, 8, 10, 12, 12, 15, 18 }), 1e-12);
+
+	matrix<double> s(3, 3, 1.0);
+	syr(2.0, x, s);
+	ExpectAllNear(s, matrix<double>(3, { 3, 5, 7, 5, 9, 13, 7, 13, 19 }), 1e-12);
+
+	matrix<double> s2(3, 3, 0.0);
+	syr2(1.0, x, y, s2);
+	ExpectAllNear(s2, matrix<double>(3, { 8, 13, 18, 13, 20, 27, 18, 27, 36 }), 1e-12);
+	ExpectAllNear(s2, transpose(s2), 0.0);
+
+	matrix<double> xk(2, { 1, 2, 3, 4, 5, 6 });
+	matrix<double> yk(2, { 1, 0, 0, 1, 1, 1 });
+	matrix<double> r(3, 3, 0.0);
+	rank_k_update(1.0, xk, yk, r);
+	ExpectAllNear(r, multiply(xk, transpose(yk)), 1e-12);
+}
+
+TEST(Linalg, InverseUpdates) {
+	matrix<double> a(3, { 4, 1, 0, 1, 3, 1, 0, 1, 2 });
+	matrix<double> a_inv = inverse(a);
+
+	matrix<double> identity(3, 3, 0.0);
+	for (std::size_t i = 0; i < 3; ++i)
+		identity[i][i] = 1.0;
+	ExpectAllNear(multiply(a, a_inv), identity, 1e-12);
+
+	const std::vector<double> u = { 1, 0, 2 };
+	const std::vector<double> v = { 0.5, 1, 0 };
+	sherman_morrison_update(a_inv, u, v);
+	ger(1.0, u, v, a);
+	ExpectAllNear(a_inv, inverse(a), 1e-12);
+
+	matrix<double> uk(2, { 1, 0, 0, 1, 1, 1 });
+	matrix<double> vk(2, { 0.5, 0, 0, 0.25, 1, 0 });
+	woodbury_update(a_inv, uk, vk);
+	rank_k_update(1.0, uk, vk, a);
+	ExpectAllNear(a_inv, inverse(a), 1e-12);
+	EXPECT_THROW(woodbury_update(a_inv, uk, matrix<double>(1, { 1, 2, 3, 4, 5, 6 })), std::invalid_argument);
+
+	EXPECT_THROW(inverse(matrix<double>(2, 2, 1.0)), std::domain_error);
+}
+
+TEST(Parallel, ParallelForCoversRange) {
+	thread_pool pool(4);
+	std::vector<int> hits(1000, 0);
+	pool.parallel_for(0, hits.size(), 10, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i)
+			++hits[i];
+	});
+	EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), 1000);
+
+	EXPECT_THROW(pool.parallel_for(0, 100, 1, [](std::size_t, std::size_t) { throw std::runtime_error{ "fail" }; }),
+		std::runtime_error);
+}
+
+TEST(MatrixFunctions, MatrixPower) {
+	matrix<std::int64_t> fib(2, { 1, 1, 1, 0 });
+	const auto fib_90 = matrix_power(fib, 90);
+	EXPECT_EQ(fib_90[0][1], 2880067194370816120);
+
+	const auto identity = matrix_power(fib, 0);
+	EXPECT_EQ(identity[0][0], 1);
+	EXPECT_EQ(identity[0][1], 0);
+
+	matrix<double> a(2, { 0.5, 0.25, 0.125, 1 });
+	ExpectAllNear(matrix_power(a, 5), multiply(multiply(multiply(a, a), multiply(a, a)), a), 1e-12);
+	EXPECT_THROW(matrix_power(matrix<double>(2, 3), 2), std::invalid_argument);
+}
+
+TEST(MatrixFunctions, Expm) {
+	// exp of a rotation generator is a rotation; 0.1 and 3 take unscaled approximants, 40 needs squaring
+	for (double angle : { 0.1, 3.0, 40.0 }) {
+		matrix<double> gen(2, { 0, -angle, angle, 0 });
+		matrix<double> rot(2, { std::cos(angle), -std::sin(angle), std::sin(angle), std::cos(angle) });
+		ExpectAllNear(expm(gen), rot, 1e-10);
+	}
+
+	// nilpotent: exp(N) = I + N + N^2 / 2
+	matrix<double> nil(3, { 0, 1, 2, 0, 0, 3, 0, 0, 0 });
+	ExpectAllNear(expm(nil), matrix<double>(3, { 1, 1, 3.5, 0, 1, 3, 0, 0, 1 }), 1e-12);
+}
+
+TEST(MatrixFunctions, Sqrtm) {
+	matrix<double> b(3, { 4, 1, 0, 1, 3, 1, 0, 1, 2 });
+	const auto a = multiply(b, b);
+	ExpectAllNear(sqrtm(a), b, 1e-10);
+
+	matrix<double> rotation(2, { 0, -1, 1, 0 });
+	EXPECT_THROW(sqrtm(multiply(rotation, rotation), 20), std::exception);
+}
+
+template<class M1, class M2, class = void>
+struct can_kron : std::false_type {};
+template<class M1, class M2>
+struct can_kron<M1, M2, std::void_t<decltype(kron(std::declval<M1>(), std::declval<M2>()))>> : std::true_type {};
+
+TEST(Products, KroneckerLazyAndMaterialized) {
+	static_assert(can_kron<const matrix<double>&, const matrix<double>&>::value, "lvalue operands");
+	static_assert(!can_kron<matrix<double>, const matrix<double>&>::value, "temporary operand would dangle");
+	static_assert(!can_kron<matrix<double>, matrix<double>>::value, "temporary operands would dangle");
+
+	matrix<double> a(2, { 1, 2, 3, 4, 5, 6 });
+	matrix<double> b(3, { 0, 1, 2, 1, 0, -1 });
+
+	const auto k = kron(a, b);
+	EXPECT_EQ(k.size(), matrix_size_type(6, 6));
+
+	const auto dense = k.to_matrix();
+	EXPECT_EQ(dense[0][4], 2.0);
+	EXPECT_EQ(dense[5][5], -6.0);
+	EXPECT_EQ(k(3, 4), dense[3][4]);
+	EXPECT_THROW(k(6, 0), std::out_of_range);
+
+	std::vector<double> x(6);
+	std::iota(x.begin(), x.end(), 1.0);
+	std::vector<double> expected(6);
+	gemv(1.0, dense, x, 0.0, expected);
+	const auto y = k * x;
+	for (std::size_t i = 0; i < y.size(); ++i)
+		EXPECT_NEAR(y[i], expected[i], 1e-12);
+
+	matrix<double> m(2, { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 });
+	ExpectAllNear(k * m, multiply(dense, m), 1e-12);
+}
+
+TEST(Products, HadamardAndOuter) {
+	matrix<int> a(2, { 1, 2, 3, 4 });
+	matrix<int> b(2, { 5, 6, 7, 8 });
+	const auto h = hadamard(a, b);
+	EXPECT_EQ(h[1][1], 32);
+
+	hadamard_assign(a, b);
+	EXPECT_EQ(a[0][1], 12);
+	EXPECT_THROW(hadamard(a, matrix<int>(1, 2)), std::invalid_argument);
+
+	const auto o = outer(std::vector<int>{ 1, 2, 3 }, std::vector<int>{ 4, 5 });
+	EXPECT_EQ(o.size(), matrix_size_type(3, 2));
+	EXPECT_EQ(o[2][1], 15);
+}
+
+TEST(PrefixSum, SummedAreaTableAndFenwick) {
+	std::vector<std::int64_t> values(7 * 5);
+	std::iota(values.begin(), values.end(), -10);
+	matrix<std::int64_t> a(5, values.begin(), values.end());
+
+	auto brute_sum = [&](std::size_t r0, std::size_t c0, std::size_t r1, std::size_t c1) {
+		std::int64_t sum = 0;
+		for (std::size_t i = r0; i < r1; ++i)
+			for (std::size_t j = c0; j < c1; ++j)
+				sum += a[i][j];
+		return sum;
+	};
+
+	summed_area_table<std::int64_t> sat(a);
+	fenwick_tree_2d<std::int64_t> fenwick(a);
+	for (std::size_t r0 = 0; r0 <= 7; ++r0)
+		for (std::size_t r1 = r0; r1 <= 7; ++r1)
+			for (std::size_t c0 = 0; c0 <= 5; ++c0)
+				for (std::size_t c1 = c0; c1 <= 5; ++c1) {
+					EXPECT_EQ(sat.range_sum(r0, c0, r1, c1), brute_sum(r0, c0, r1, c1));
+					EXPECT_EQ(fenwick.range_sum(r0, c0, r1, c1), brute_sum(r0, c0, r1, c1));
+				}
+
+	EXPECT_THROW(sat.range_sum(0, 0, 8, 1), std::out_of_range);
+	EXPECT_THROW(sat.range_sum(2, 0, 1, 1), std::out_of_range);
+
+	fenwick.add(3, 2, 100);
+	a[3][2] += 100;
+	EXPECT_EQ(fenwick.range_sum(1, 1, 6, 4), brute_sum(1, 1, 6, 4));
+	EXPECT_EQ(fenwick.prefix_sum(7, 5), brute_sum(0, 0, 7, 5));
+	EXPECT_THROW(fenwick.add(7, 0, 1), std::out_of_range);
+}
+
+TEST(PrefixSum, CumulativeSums) {
+	matrix<int> a(3, { 1, 2, 3, 4, 5, 6 });
+	const auto down = cumsum(a, matrix_axis::rows);
+	const auto along = cumsum(a, matrix_axis::cols);
+	EXPECT_EQ(down[1][0], 5);
+	EXPECT_EQ(down[1][2], 9);
+	EXPECT_EQ(along[0][2], 6);
+	EXPECT_EQ(along[1][2], 15);
+}
+
+TEST(Stencil, FivePointAndTimeStepping) {
+	matrix<float> grid(4, 5, 0.0f);
+	grid[1][2] = 8.0f;
+
+	auto laplace_sum = [](const std::array<float, 5>& v) { return v[1] + v[2] + v[3] + v[4] - 4.0f * v[0]; };
+
+	matrix<float> out(4, 5);
+	apply_stencil<five_point_stencil>(grid, out, laplace_sum, boundary_mode::constant);
+	EXPECT_EQ(out[1][2], -32.0f);
+	EXPECT_EQ(out[0][2], 8.0f);
+	EXPECT_EQ(out[1][3], 8.0f);
+	EXPECT_EQ(out[3][4], 0.0f);
+
+	// periodic halo wraps row 0 onto the last row
+	grid[0][0] = 1.0f;
+	apply_stencil<five_point_stencil>(grid, out, laplace_sum, boundary_mode::periodic);
+	EXPECT_EQ(out[3][0], 1.0f);
+	EXPECT_EQ(out[0][4], 1.0f);
+
+	// averaging with clamped borders keeps a constant field constant
+	matrix<float> field(37, 600, 2.5f);
+	const auto rows_before = field.data();
+	run_stencil<nine_point_stencil>(field, 3, [](const std::array<float, 9>& v) {
+		float sum = 0.0f;
+		for (float x : v)
+			sum += x;
+		return sum / 9.0f;
+	});
+	EXPECT_NE(field.data(), rows_before);
+	for (std::size_t i = 0; i < 37; ++i)
+		for (std::size_t j = 0; j < 600; ++j)
+			EXPECT_NEAR(field[i][j], 2.5f, 1e-5f);
+}
+
+TEST(Stencil, SlidingMaxMin) {
+	std::vector<int> values = { 3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8, 9, 7, 9, 3, 2, 3, 8, 4 };
+	matrix<int> a(5, values.begin(), values.end());
+
+	for (std::size_t h = 1; h <= 4; ++h) {
+		for (std::size_t w = 1; w <= 5; ++w) {
+			const auto max = sliding_max(a, h, w);
+			const auto min = sliding_min(a, h, w);
+			ASSERT_EQ(max.size().rows, 4 - h + 1);
+			ASSERT_EQ(max.size().cols, 5 - w + 1);
+			for (std::size_t i = 0; i + h <= 4; ++i) {
+				for (std::size_t j = 0; j + w <= 5; ++j) {
+					int expected_max = a[i][j];
+					int expected_min = a[i][j];
+					for (std::size_t r = i; r < i + h; ++r) {
+						for (std::size_t c = j; c < j + w; ++c) {
+							expected_max = std::max(expected_max, a[r][c]);
+							expected_min = std::min(expected_min, a[r][c]);
+						}
+					}
+					EXPECT_EQ(max[i][j], expected_max);
+					EXPECT_EQ(min[i][j], expected_min);
+				}
+			}
+		}
+	}
+	EXPECT_THROW(sliding_max(a, 5, 1), std::invalid_argument);
+}
+
+TEST(Resample, FlipsAndRotations) {
+	matrix<int> a(3, { 1, 2, 3, 4, 5, 6 });
+
+	const auto cw = rotate_90_clockwise(a);
+	EXPECT_EQ(cw.size(), matrix_size_type(3, 2));
+	EXPECT_EQ(cw[0][0], 4);
+	EXPECT_EQ(cw[0][1], 1);
+	EXPECT_EQ(cw[2][0], 6);
+
+	const auto ccw = rotate_90_counterclockwise(a);
+	EXPECT_EQ(ccw[0][0], 3);
+	EXPECT_EQ(ccw[2][1], 4);
+
+	const auto row0 = a[0];
+	flip_vertical(a);
+	EXPECT_EQ(a[1], row0);
+
+	rotate_180(a);
+	EXPECT_EQ(a[0][0], 3);
+	EXPECT_EQ(a[1][2], 4);
+
+	std::vector<std::uint8_t> bytes(2 * 100);
+	std::iota(bytes.begin(), bytes.end(), std::uint8_t{ 0 });
+	matrix<std::uint8_t> frame(100, bytes.begin(), bytes.end());
+	flip_horizontal(frame);
+	for (std::size_t j = 0; j < 100; ++j) {
+		EXPECT_EQ(frame[0][j], 99 - j);
+		EXPECT_EQ(frame[1][j], 199 - j);
+	}
+}
+
+TEST(Resample, BilinearAndArea) {
+	std::vector<std::uint8_t> bytes(37 * 53);
+	for (std::size_t i = 0; i < bytes.size(); ++i)
+		bytes[i] = static_cast<std::uint8_t>((i * 7919) % 256);
+	matrix<std::uint8_t> frame(53, bytes.begin(), bytes.end());
+	matrix<float> frame_f(53, bytes.begin(), bytes.end());
+
+	for (auto target : { matrix_size_type(80, 101), matrix_size_type(20, 31), matrix_size_type(37, 53) }) {
+		const auto resized = resize_bilinear(frame, target.rows, target.cols);
+		const auto resized_f = resize_bilinear(frame_f, target.rows, target.cols);
+		for (std::size_t i = 0; i < target.rows; ++i)
+			for (std::size_t j = 0; j < target.cols; ++j)
+				EXPECT_NEAR(resized[i][j], resized_f[i][j], 1.0);
+
+		const auto area = resize_area(frame, target.rows, target.cols);
+		const auto area_f = resize_area(frame_f, target.rows, target.cols);
+		for (std::size_t i = 0; i < target.rows; ++i)
+			for (std::size_t j = 0; j < target.cols; ++j)
+				EXPECT_NEAR(area[i][j], area_f[i][j], 1.0);
+	}
+
+	matrix<std::uint8_t> block(4, { 0, 2, 10, 10, 4, 6, 10, 10, 255, 255, 1, 1, 255, 255, 1, 2 });
+	const auto halved = resize_area(block, 2, 2);
+	EXPECT_EQ(halved[0][0], 3);
+	EXPECT_EQ(halved[0][1], 10);
+	EXPECT_EQ(halved[1][0], 255);
+	EXPECT_EQ(halved[1][1], 1);
+
+	EXPECT_THROW(resize_bilinear(block, 0, 2), std::invalid_argument);
+}
+
+template<class M, class = void>
+struct can_adjoint : std::false_type {};
+template<class M>
+struct can_adjoint<M, std::void_t<decltype(adjoint(std::declval<M>()))>> : std::true_type {};
+
+TEST(ComplexMatrix, Gemm3MAndLayouts) {
+	static_assert(can_adjoint<const matrix<std::complex<double>>&>::value, "lvalue operand");
+	static_assert(!can_adjoint<matrix<std::complex<double>>>::value, "temporary operand would dangle");
+	using cd = std::complex<double>;
+	std::vector<cd> a_values, b_values;
+	for (int i = 0; i < 12; ++i) {
+		a_values.emplace_back(i * 0.5 - 2, 1.0 / (i + 1));
+		b_values.emplace_back(3 - i, i * 0.25);
+	}
+	matrix<cd> a(4, a_values.begin(), a_values.end());
+	matrix<cd> b(3, b_values.begin(), b_values.end());
+
+	const auto c = gemm_3m(a, b);
+	const auto expected = multiply(a, b);
+	ASSERT_EQ(c.size(), matrix_size_type(3, 3));
+	for (std::size_t i = 0; i < 3; ++i) {
+		for (std::size_t j = 0; j < 3; ++j) {
+			EXPECT_NEAR(c[i][j].real(), expected[i][j].real(), 1e-12);
+			EXPECT_NEAR(c[i][j].imag(), expected[i][j].imag(), 1e-12);
+		}
+	}
+
+	planar_complex_matrix<double> planar(a);
+	EXPECT_EQ(planar(1, 2), a[1][2]);
+	const auto back = planar.to_interleaved();
+	EXPECT_EQ(back[2][3], a[2][3]);
+
+	const auto h = adjoint(a);
+	EXPECT_EQ(h.size(), matrix_size_type(4, 3));
+	EXPECT_EQ(h(3, 1), std::conj(a[1][3]));
+	const auto h_dense = h.to_matrix();
+	const auto h_planar = adjoint(planar);
+	for (std::size_t i = 0; i < 4; ++i) {
+		for (std::size_t j = 0; j < 3; ++j) {
+			EXPECT_EQ(h_dense[i][j], std::conj(a[j][i]));
+			EXPECT_EQ(h_planar(i, j), std::conj(a[j][i]));
+		}
+	}
+}
+
+TEST(ComplexMatrix, SimdHadamard) {
+	using cf = std::complex<float>;
+	std::vector<cf> values;
+	for (int i = 0; i < 3 * 11; ++i)
+		values.emplace_back(i * 0.5f, 2.0f - i);
+	matrix<cf> a(11, values.begin(), values.end());
+	matrix<cf> b(11, values.rbegin(), values.rend());
+
+	const auto h = hadamard(a, b);
+	const auto hp = hadamard(planar_complex_matrix<float>(a), planar_complex_matrix<float>(b));
+	for (std::size_t i = 0; i < 3; ++i) {
+		for (std::size_t j = 0; j < 11; ++j) {
+			const cf expected = a[i][j] * b[i][j];
+			EXPECT_NEAR(h[i][j].real(), expected.real(), 1e-3f);
+			EXPECT_NEAR(h[i][j].imag(), expected.imag(), 1e-3f);
+			EXPECT_NEAR(hp(i, j).real(), expected.real(), 1e-3f);
+		}
+	}
+
+	matrix<std::complex<double>> d(2, { { 1, 2 }, { 3, 4 }, { 5, 6 }, { 7, 8 } });
+	hadamard_assign(d, d);
+	EXPECT_EQ(d[1][1], std::complex<double>(-15, 112));
+}
+
+TEST(ModularMatrix, LazyGemmAndPower) {
+	constexpr std::uint64_t prime = 1000000007;
+	std::vector<std::uint64_t> values(40 * 40);
+	for (std::size_t i = 0; i < values.size(); ++i)
+		values[i] = (i * 2654435761u) % prime;
+	matrix<std::uint64_t> raw(40, values.begin(), values.end());
+
+	modular_matrix<runtime_modulus> a(raw, runtime_modulus(prime));
+	modular_matrix<static_modulus<prime>> a_static(raw);
+
+	const auto c = multiply(a, a);
+	const auto c_static = multiply(a_static, a_static);
+	for (std::size_t i = 0; i < 40; ++i) {
+		for (std::size_t j = 0; j < 40; ++j) {
+			std::uint64_t expected = 0;
+			for (std::size_t p = 0; p < 40; ++p)
+				expected = (expected + raw[i][p] * raw[p][j] % prime) % prime;
+			EXPECT_EQ(c[i][j], expected);
+			EXPECT_EQ(c_static[i][j], expected);
+		}
+	}
+
+	// Fibonacci numbers mod p: F(90) mod p
+	modular_matrix<static_modulus<prime>> fib(matrix<int>(2, { 1, 1, 1, 0 }));
+	EXPECT_EQ(matrix_power(fib, 90)(0, 1), 2880067194370816120ull % prime);
+
+	const auto a3 = matrix_power(a, 3);
+	const auto a3_expected = multiply(multiply(a, a), a);
+	EXPECT_EQ(a3(17, 23), a3_expected(17, 23));
+	EXPECT_THROW(runtime_modulus(1ull << 32), std::invalid_argument);
+}
+
+TEST(ModularMatrix, EliminationRankInverse) {
+	using mod7 = static_modulus<7>;
+	modular_matrix<mod7> singular(matrix<int>(3, { 1, 2, 3, 2, 4, 6, 0, 1, 5 }));
+	EXPECT_EQ(rank(singular), 2);
+	EXPECT_EQ(determinant(singular), 0);
+	EXPECT_THROW(inverse(singular), std::domain_error);
+
+	modular_matrix<mod7> a(matrix<int>(3, { 2, -1, 0, 1, 3, 4, 0, 5, 6 }));
+	EXPECT_EQ(a(0, 1), 6);
+	EXPECT_EQ(rank(a), 3);
+	// det = 2 * (18 - 20) + 1 * (6 - 0) = 2 = 2 mod 7
+	EXPECT_EQ(determinant(a), 2);
+
+	const auto product = multiply(a, inverse(a));
+	for (std::size_t i = 0; i < 3; ++i)
+		for (std::size_t j = 0; j < 3; ++j)
+			EXPECT_EQ(product(i, j), i == j ? 1u : 0u);
+}
+
+TEST(BitMatrix, FourRussiansMultiply) {
+	// sizes chosen so rows span several words and the last slice of 8 rows is partial
+	const std::size_t m = 37, k = 131, n = 70;
+	bit_matrix a(m, k);
+	bit_matrix b(k, n);
+	std::uint32_t state = 12345;
+	auto next_bit = [&state]() { state = state * 1103515245u + 12345u; return ((state >> 16) & 1u) != 0; };
+	for (std::size_t i = 0; i < m; ++i)
+		for (std::size_t j = 0; j < k; ++j)
+			a.set(i, j, next_bit());
+	for (std::size_t i = 0; i < k; ++i)
+		for (std::size_t j = 0; j < n; ++j)
+			b.set(i, j, next_bit());
+
+	const auto c = multiply(a, b);
+	for (std::size_t i = 0; i < m; ++i) {
+		for (std::size_t j = 0; j < n; ++j) {
+			bool expected = false;
+			for (std::size_t p = 0; p < k; ++p)
+				expected ^= a(i, p) && b(p, j);
+			EXPECT_EQ(c(i, j), expected);
+		}
+	}
+
+	const auto same = multiply(a, bit_matrix::identity(k));
+	for (std::size_t i = 0; i < m; ++i)
+		EXPECT_TRUE(std::equal(a[i], a[i] + a.words_per_row(), same[i]));
+	EXPECT_THROW(multiply(a, a), std::invalid_argument);
+	EXPECT_THROW(a.set(m, 0, true), std::out_of_range);
+}
+
+TEST(BitMatrix, EliminationNullspaceSolve) {
+	// rows 2 and 3 are combinations of rows 0 and 1 so the rank is 3
+	const std::size_t cols = 100;
+	bit_matrix a(5, cols);
+	for (std::size_t j = 0; j < cols; j += 3)
+		a.set(0, j, true);
+	for (std::size_t j = 1; j < cols; j += 7)
+		a.set(1, j, true);
+	for (std::size_t j = 0; j < cols; ++j) {
+		a.set(2, j, a(0, j) != a(1, j));
+		a.set(3, j, a(0, j));
+	}
+	a.set(4, 99, true);
+	EXPECT_EQ(rank(a), 3);
+	EXPECT_EQ(rank(bit_matrix::identity(70)), 70);
+
+	const auto basis = nullspace(a);
+	EXPECT_EQ(basis.size().rows, cols - 3);
+	const auto zero = multiply(a, [&] {
+		bit_matrix t(cols, basis.size().rows);
+		for (std::size_t i = 0; i < basis.size().rows; ++i)
+			for (std::size_t j = 0; j < cols; ++j)
+				t.set(j, i, basis(i, j));
+		return t;
+	}());
+	for (std::size_t i = 0; i < zero.size().rows; ++i)
+		for (std::size_t j = 0; j < zero.size().cols; ++j)
+			EXPECT_FALSE(zero(i, j));
+
+	std::vector<bool> b = { true, false, true, true, true };
+	const auto x = solve(a, b);
+	for (std::size_t i = 0; i < 5; ++i) {
+		bool lhs = false;
+		for (std::size_t j = 0; j < cols; ++j)
+			lhs ^= a(i, j) && x[j];
+		EXPECT_EQ(lhs, b[i]);
+	}
+
+	b[3] = false;  // row 3 equals row 0, so the right-hand sides must match
+	EXPECT_THROW(solve(a, b), std::domain_error);
+}
+
+TEST(Random, PhiloxAndFillers) {
+	// known-answer vector of the reference Philox4x32-10
+	const auto zero = philox4x32::generate({ 0u, 0u, 0u, 0u }, { 0u, 0u });
+	EXPECT_EQ(zero, (philox4x32::counter_type{ 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u }));
+
+	// values depend only on seed and position: an odd column count misaligns rows with Philox blocks
+	matrix<double> a(301, 77);
+	matrix<double> b(301, 77);
+	random_uniform(a, 42, -2.0, 3.0);
+	random_uniform(b, 42, -2.0, 3.0);
+	double sum = 0.0;
+	for (std::size_t i = 0; i < 301; ++i) {
+		for (std::size_t j = 0; j < 77; ++j) {
+			EXPECT_EQ(a[i][j], b[i][j]);
+			EXPECT_GE(a[i][j], -2.0);
+			EXPECT_LT(a[i][j], 3.0);
+			sum += a[i][j];
+		}
+	}
+	EXPECT_NEAR(sum / (301 * 77), 0.5, 0.05);
+	random_uniform(b, 43, -2.0, 3.0);
+	EXPECT_NE(a[100][5], b[100][5]);
+
+	matrix<double> n(200, 101);
+	random_normal(n, 7, 1.0, 2.0);
+	double mean = 0.0, sq = 0.0;
+	for (std::size_t i = 0; i < 200; ++i)
+		for (std::size_t j = 0; j < 101; ++j) {
+			mean += n[i][j];
+			sq += n[i][j] * n[i][j];
+		}
+	mean /= 200 * 101;
+	EXPECT_NEAR(mean, 1.0, 0.05);
+	EXPECT_NEAR(sq / (200 * 101) - mean * mean, 4.0, 0.2);
+
+	matrix<float> coins(100, 100);
+	random_bernoulli(coins, 3, 0.25);
+	float ones = 0;
+	for (std::size_t i = 0; i < 100; ++i)
+		for (std::size_t j = 0; j < 100; ++j)
+			ones += coins[i][j];
+	EXPECT_NEAR(ones / 10000, 0.25, 0.02);
+	EXPECT_THROW(random_bernoulli(coins, 3, 1.5), std::invalid_argument);
+}
+
+TEST(Random, OrthogonalAndSparse) {
+	const auto q = random_orthogonal(60, 11);
+	matrix<double> identity(60, 60);
+	for (std::size_t i = 0; i < 60; ++i)
+		identity[i][i] = 1.0;
+	ExpectAllNear(multiply(transpose(q), q), identity, 1e-12);
+
+	matrix<double> a(50, 20);
+	random_normal(a, 5);
+	matrix<double> qa, r;
+	qr(a, qa, r);
+	ExpectAllNear(multiply(qa, r), a, 1e-12);
+	for (std::size_t i = 1; i < 20; ++i)
+		for (std::size_t j = 0; j < i; ++j)
+			EXPECT_EQ(r[i][j], 0.0);
+
+	const auto s = random_sparse(100, 100, 0.1, 9);
+	matrix<double> dense(100, 100);
+	random_normal(dense, 9);
+	std::size_t nonzeros = 0;
+	for (std::size_t i = 0; i < 100; ++i)
+		for (std::size_t j = 0; j < 100; ++j)
+			if (s[i][j] != 0.0) {
+				++nonzeros;
+				EXPECT_EQ(s[i][j], dense[i][j]);
+			}
+	EXPECT_NEAR(nonzeros / 10000.0, 0.1, 0.02);
+}
+
+TEST(Sketch, StreamingAndOperators) {
+	matrix<double> a(100, 30);
+	random_normal(a, 1);
+
+	// a sketch built from row chunks in any order equals the one-shot sketch
+	for (const auto kind : { sketch_kind::gaussian, sketch_kind::count }) {
+		streaming_sketch<double> stream(20, 30, kind, 99);
+		const std::array<std::pair<std::size_t, std::size_t>, 3> chunks{ { { 60, 100 }, { 0, 25 }, { 25, 60 } } };
+		for (const auto& [first, last] : chunks) {
+			matrix<double> chunk(last - first, 30);
+			for (std::size_t i = first; i < last; ++i)
+				std::copy_n(a[i], 30, chunk[i - first]);
+			stream.add_rows(chunk, first);
+		}
+		const auto whole = kind == sketch_kind::gaussian ? gaussian_sketch(a, 20, 99) : count_sketch(a, 20, 99);
+		ExpectAllNear(stream.result(), whole, 1e-12);
+	}
+
+	// every data row lands in one sketch row with a sign, so column sums of |Y| never exceed those of |A|
+	const auto count = count_sketch(a, 10, 5);
+	for (std::size_t j = 0; j < 30; ++j) {
+		double sketched = 0.0, original = 0.0;
+		for (std::size_t i = 0; i < 10; ++i)
+			sketched += std::abs(count[i][j]);
+		for (std::size_t i = 0; i < 100; ++i)
+			original += std::abs(a[i][j]);
+		EXPECT_LE(sketched, original + 1e-9);
+	}
+
+	// keeping all 128 rows of the padded SRHT is an orthogonal transform: Y^T Y = A^T A
+	const auto y = srht_sketch(a, 128, 3);
+	ExpectAllNear(multiply(transpose(y), y), multiply(transpose(a), a), 1e-9);
+	EXPECT_THROW(srht_sketch(a, 129, 3), std::invalid_argument);
+}
+
+TEST(Sketch, RandomizedSvdAndNystrom) {
+	// rank 5 matrix (80 x 60)
+	matrix<double> x(80, 5), w(5, 60);
+	random_normal(x, 10);
+	random_normal(w, 11);
+	const auto a = multiply(x, w);
+
+	const auto svd = randomized_svd(a, 5, 21);
+	matrix<double> us = svd.u;
+	for (std::size_t i = 0; i < 80; ++i)
+		for (std::size_t j = 0; j < 5; ++j)
+			us[i][j] *= svd.singular_values[j];
+	ExpectAllNear(multiply(us, svd.vt), a, 1e-9);
+	for (std::size_t j = 1; j < 5; ++j)
+		EXPECT_GE(svd.singular_values[j - 1], svd.singular_values[j]);
+	matrix<double> identity(5, 5);
+	for (std::size_t i = 0; i < 5; ++i)
+		identity[i][i] = 1.0;
+	ExpectAllNear(multiply(transpose(svd.u), svd.u), identity, 1e-12);
+	EXPECT_EQ(approximate_rank(a, 1e-10, 20, 4), 5);
+
+	// positive semidefinite rank 4 matrix is recovered from 10 directions
+	matrix<double> g(50, 4);
+	random_normal(g, 12);
+	const auto psd = multiply(g, transpose(g));
+	const auto f = nystrom_approximation(psd, 10, 13);
+	ExpectAllNear(multiply(f, transpose(f)), psd, 1e-8);
+
+	const auto l = cholesky(multiply(transpose(x), x));
+	ExpectAllNear(multiply(l, transpose(l)), multiply(transpose(x), x), 1e-10);
+	EXPECT_THROW(cholesky(psd), std::domain_error);
+}
+
+TEST(HodlrMatrix, MultiplyAndSolve) {
+	// smooth kernel on sorted points: off-diagonal blocks are numerically low rank
+	const std::size_t n = 700;
+	auto kernel = [n](std::size_t i, std::size_t j) {
+		const double xi = static_cast<double>(i) / n;
+		const double xj = static_cast<double>(j) / n;
+		return 1.0 / (1.0 + 25.0 * (xi - xj) * (xi - xj)) + (i == j ? 2.0 : 0.0);
+	};
+	hodlr_matrix<double> h(n, kernel, 1e-12, 32);
+	EXPECT_LT(h.max_rank(), 20);
+	EXPECT_LT(h.stored_elements(), n * n / 3);
+
+	std::vector<double> x(n);
+	for (std::size_t i = 0; i < n; ++i)
+		x[i] = std::sin(0.1 * i);
+	const auto y = h.multiply(x);
+	for (std::size_t i = 0; i < n; ++i) {
+		double expected = 0.0;
+		for (std::size_t j = 0; j < n; ++j)
+			expected += kernel(i, j) * x[j];
+		EXPECT_NEAR(y[i], expected, 1e-9);
+	}
+
+	EXPECT_FALSE(h.factorized());
+	const auto solved = h.solve(y);
+	EXPECT_TRUE(h.factorized());
+	for (std::size_t i = 0; i < n; ++i)
+		EXPECT_NEAR(solved[i], x[i], 1e-8);
+	EXPECT_THROW(h.multiply(std::vector<double>(n + 1)), std::invalid_argument);
+}
+
+TEST(CompressedMatrix, QuantizedRowsAndGemv) {
+	matrix<double> a(200, 101);
+	random_uniform(a, 8, -3.0, 5.0);
+
+	for (const auto& [codec, bound] : { std::pair<row_codec, double>{ row_codec::int8, 8.0 / 255 }, { row_codec::int4, 8.0 / 15 } }) {
+		const compressed_matrix<double> c(a, codec);
+		EXPECT_EQ(c.codec_of_row(0), codec);
+		const auto decoded = c.to_matrix();
+		for (std::size_t i = 0; i < 200; ++i)
+			for (std::size_t j = 0; j < 101; ++j)
+				EXPECT_LE(std::abs(decoded[i][j] - a[i][j]), bound / 2 + 1e-12);
+		EXPECT_NEAR(c(7, 3), decoded[7][3], 0.0);
+
+		// the on-the-fly product equals the product with the decoded matrix
+		std::vector<double> x(101), y(200, 1.0), expected(200, 1.0);
+		for (std::size_t j = 0; j < 101; ++j)
+			x[j] = std::cos(0.3 * j);
+		gemv(2.0, c, x, 0.5, y);
+		gemv(2.0, decoded, x, 0.5, expected);
+		for (std::size_t i = 0; i < 200; ++i)
+			EXPECT_NEAR(y[i], expected[i], 1e-9);
+	}
+	EXPECT_GT(compressed_matrix<double>(a, row_codec::int4).compression_ratio(), 9.0);
+	EXPECT_EQ(compressed_matrix<double>(matrix<double>()).compression_ratio(), 1.0);
+
+	// automatic: the tolerance rules int4 out but admits int8, raw keeps everything
+	const compressed_matrix<double> automatic(a, row_codec::automatic, 0.02);
+	EXPECT_EQ(automatic.codec_of_row(150), row_codec::int8);
+	const compressed_matrix<double> exact(a);
+	EXPECT_EQ(exact.codec_of_row(150), row_codec::raw);
+	EXPECT_EQ(exact(150, 100), a[150][100]);
+}
+
+TEST(CompressedMatrix, FrameOfReference) {
+	// integer columns with a small range around a large base pack into 6 bits, losslessly
+	matrix<int> ids(130, 64);
+	for (std::size_t i = 0; i < 130; ++i)
+		for (std::size_t j = 0; j < 64; ++j)
+			ids[i][j] = 1000000 + static_cast<int>((i * 7 + j * 13) % 50) - (i == 129 ? 2000000 : 0);
+
+	const compressed_matrix<int> c(ids);
+	EXPECT_EQ(c.codec_of_row(0), row_codec::frame_of_reference);
+	EXPECT_GT(c.compression_ratio(), 3.0);
+	const auto decoded = c.to_matrix();
+	for (std::size_t i = 0; i < 130; ++i)
+		for (std::size_t j = 0; j < 64; ++j)
+			EXPECT_EQ(decoded[i][j], ids[i][j]);
+
+	std::vector<int> x(64, 1), y(130);
+	gemv(1, c, x, 0, y);
+	EXPECT_EQ(y[129], std::accumulate(ids[129], ids[129] + 64, 0));
+	EXPECT_THROW(compressed_matrix<int>(ids, row_codec::int8), std::invalid_argument);
+
+	matrix<double> fractional(2, { 1.0, 2.5, 3.0, 4.0 });
+	EXPECT_THROW(compressed_matrix<double>(fractional, row_codec::frame_of_reference), std::invalid_argument);
+}
+
+TEST(MemoryBudget, BudgetedAllocatorAccounting) {
+	memory_budget budget(64 * 1024, 0.5);
+	std::size_t pressure_events = 0;
+	budget.add_pressure_callback([&](std::size_t used, std::size_t limit) {
+		EXPECT_GE(used, limit / 2);
+		++pressure_events;
+	});
+
+	{
+		memory_budget::scope scope(budget);
+		matrix<double, budgeted_allocator<double>> a(100, 20, 1.0);
+		EXPECT_EQ(budget.used(), 100 * 20 * sizeof(double) + 100 * sizeof(double*));
+		EXPECT_EQ(pressure_events, 0u);
+
+		matrix<double, budgeted_allocator<double>> b(100, 30, 2.0);
+		EXPECT_EQ(pressure_events, 1u);
+		EXPECT_THROW((matrix<double, budgeted_allocator<double>>(100, 100)), std::bad_alloc);
+	}
+	EXPECT_EQ(budget.used(), 0u);
+	EXPECT_GE(budget.metrics().peak_bytes, 100 * 50 * sizeof(double));
+
+	// outside the scope allocators charge the global budget again
+	budgeted_allocator<int> global_alloc;
+	EXPECT_EQ(&global_alloc.budget(), &memory_budget::global());
+}
+
+TEST(MemoryBudget, BudgetedMatrixOutlivesScope) {
+	using budgeted = matrix<double, budgeted_allocator<double>>;
+	memory_budget tenant(1 << 20);
+	const std::size_t bytes = 10 * 10 * sizeof(double) + 10 * sizeof(double*);
+
+	// rows charged inside the scope are returned to the tenant, not to the budget of the matrix they end up in
+	budgeted assigned;
+	{
+		memory_budget::scope scope(tenant);
+		assigned = budgeted(10, 10, 1.0);
+	}
+	EXPECT_EQ(tenant.used(), bytes);
+	assigned = budgeted();
+	EXPECT_EQ(tenant.used(), 0u);
+
+	{
+		std::unique_ptr<budgeted> moved;
+		{
+			memory_budget::scope scope(tenant);
+			budgeted m(10, 10, 2.0);
+			moved = std::make_unique<budgeted>(std::move(m));
+		}
+		EXPECT_EQ(tenant.used(), bytes);
+
+		// a copy made elsewhere charges the same budget as its source
+		budgeted copy(*moved);
+		EXPECT_EQ(tenant.used(), 2 * bytes);
+		EXPECT_EQ(copy(9, 9), 2.0);
+	}
+	EXPECT_EQ(tenant.used(), 0u);
+}
+
+TEST(MemoryBudget, SpillAndFault) {
+	// 16 blocks of 8 KiB under a 40 KiB budget: at most 5 can be resident
+	memory_budget budget(40 * 1024);
+	spillable_matrix<double> m(256, 64, budget, 16);
+	for (std::size_t i = 0; i < 256; ++i) {
+		auto row = m.row(i);
+		for (std::size_t j = 0; j < 64; ++j)
+			row[j] = static_cast<double>(i * 64 + j);
+	}
+	EXPECT_LE(m.resident_blocks(), 5u);
+	EXPECT_LE(budget.used(), 40u * 1024);
+
+	for (std::size_t i = 256; i-- > 0;)
+		EXPECT_EQ(m.get(i, 5), static_cast<double>(i * 64 + 5));
+
+	const auto metrics = budget.metrics();
+	EXPECT_GE(metrics.spill_count, 11u);
+	EXPECT_GE(metrics.fault_count, 11u);
+	EXPECT_EQ(metrics.faulted_bytes, metrics.fault_count * 16 * 64 * sizeof(double));
+	EXPECT_GT(metrics.total_fault_time.count(), 0);
+
+	// a plain budgeted matrix pushes the spillable blocks out; pinned blocks stay
+	auto pinned = m.read_row(0);
+	{
+		memory_budget::scope scope(budget);
+		matrix<double, budgeted_allocator<double>> big(30, 128);
+		EXPECT_EQ(m.resident_blocks(), 1u);
+		EXPECT_EQ(pinned[3], 3.0);
+	}
+	EXPECT_EQ(m.get(255, 63), 255.0 * 64 + 63);
+}
+
+TEST(OutOfCore, TiledGemm) {
+	const auto dir = std::filesystem::temp_directory_path();
+	const std::string a_path = (dir / "ooc_gemm_a.bin").string();
+	const std::string b_path = (dir / "ooc_gemm_b.bin").string();
+	const std::string c_path = (dir / "ooc_gemm_c.bin").string();
+	matrix<double> a(70, 50), b(50, 45), c(70, 45);
+	random_uniform(a, 1);
+	random_uniform(b, 2);
+	random_uniform(c, 3);
+	{
+		file_matrix<double> fa(a_path, 70, 50, file_mode::create);
+		file_matrix<double> fb(b_path, 50, 45, file_mode::create);
+		file_matrix<double> fc(c_path, 70, 45, file_mode::create);
+		fa.assign(a);
+		fb.assign(b);
+		fc.assign(c);
+		// six 16 x 16 tiles of doubles fit, 17 x 17 do not
+		out_of_core_gemm(2.0, fa, fb, 0.5, fc, 6 * 16 * 16 * sizeof(double) + 100);
+	}
+	matrix<double> expected = c;
+	gemm(2.0, a, b, 0.5, expected);
+
+	file_matrix<double> result(c_path, 70, 45);
+	ExpectAllNear(result.to_matrix(), expected, 1e-10);
+	EXPECT_THROW(out_of_core_gemm(1.0, result, result, 0.0, result, 1 << 20), std::invalid_argument);
+	EXPECT_THROW(file_matrix<double>((dir / "ooc_missing.bin").string(), 2, 2), std::runtime_error);
+
+	std::filesystem::remove(a_path);
+	std::filesystem::remove(b_path);
+	std::filesystem::remove(c_path);
+}
+
+TEST(OutOfCore, TiledCholesky) {
+	const std::string path = (std::filesystem::temp_directory_path() / "ooc_cholesky.bin").string();
+	matrix<double> g(67, 67);
+	random_normal(g, 4, 0.0, 1.0);
+	matrix<double> spd(67, 67);
+	gemm(1.0, g, transpose(g), 0.0, spd);
+	for (std::size_t i = 0; i < 67; ++i)
+		spd(i, i) += 67.0;
+
+	matrix<double> result(67, 67);
+	{
+		file_matrix<double> f(path, 67, 67, file_mode::create);
+		f.assign(spd);
+		EXPECT_THROW(out_of_core_cholesky(f, 6 * sizeof(double)), std::invalid_argument);
+		out_of_core_cholesky(f, 7 * 10 * 10 * sizeof(double));
+		result = f.to_matrix();
+	}
+	const matrix<double> expected = cholesky(spd);
+	for (std::size_t i = 0; i < 67; ++i)
+		for (std::size_t j = 0; j <= i; ++j)
+			EXPECT_NEAR(result(i, j), expected(i, j), 1e-9);
+	std::filesystem::remove(path);
+}
+
+TEST(AsyncIo, RowBlocksOnEveryBackend) {
+	const std::string path = (std::filesystem::temp_directory_path() / "async_rows.bin").string();
+	// 37 doubles per row: blocks are never page-aligned, so direct reads are widened and writes buffered
+	matrix<double> a(300, 37);
+	random_uniform(a, 5);
+
+	for (const bool pool : { false, true }) {
+		for (const bool direct : { false, true }) {
+			async_io_options options;
+			options.force_thread_pool = pool;
+			options.direct = direct;
+			options.batch_size = 3;
+			{
+				async_row_file<double> file(path, 300, 37, file_mode::create, options);
+				if (pool) {
+					EXPECT_EQ(file.backend(), io_backend::thread_pool);
+				}
+
+				std::vector<std::future<void>> writes;
+				for (std::size_t first = 0; first < 300; first += 64)
+					writes.push_back(file.write_rows(first, std::min<std::size_t>(64, 300 - first), a, first));
+				file.submit();
+				for (auto& w : writes)
+					w.get();
+
+				ExpectAllNear(file.load(50).get(), a, 0.0);
+
+				matrix<double> block(10, 37);
+				auto read = file.read_rows(123, 8, block, 2);
+				file.submit();
+				read.get();
+				EXPECT_EQ(block(2, 0), a(123, 0));
+				EXPECT_EQ(block(9, 36), a(130, 36));
+				EXPECT_THROW(file.read_rows(295, 8, block), std::out_of_range);
+			}
+			// same layout as file_matrix
+			file_matrix<double> plain(path, 300, 37);
+			ExpectAllNear(plain.to_matrix(), a, 0.0);
+		}
+	}
+	std::filesystem::remove(path);
+}
+
+TEST(AsyncIo, StreamRowsIntoSketch) {
+	const std::string path = (std::filesystem::temp_directory_path() / "async_stream.bin").string();
+	matrix<double> a(1000, 24);
+	random_normal(a, 6, 0.0, 1.0);
+	{
+		file_matrix<double> f(path, 1000, 24, file_mode::create);
+		f.assign(a);
+	}
+
+	async_row_file<double> file(path, 1000, 24);
+	streaming_sketch<double> stream(16, 24, sketch_kind::count, 7);
+	std::size_t expected_first = 0;
+	stream_rows(file, 96, [&](const matrix<double>& block, std::size_t first_row) {
+		EXPECT_EQ(first_row, expected_first);
+		expected_first += block.size().rows;
+		stream.add_rows(block, first_row);
+	}, 3);
+	EXPECT_EQ(expected_first, 1000u);
+	ExpectAllNear(stream.result(), count_sketch(a, 16, 7), 1e-12);
+
+	// a consumer that throws leaves only after the reads ahead of it have landed, on both backends
+	for (bool pool : { false, true }) {
+		async_io_options options;
+		options.force_thread_pool = pool;
+		async_row_file<double> ahead(path, 1000, 24, file_mode::open, options);
+		std::size_t consumed = 0;
+		EXPECT_THROW(stream_rows(ahead, 16, [&](const matrix<double>&, std::size_t) {
+			if (++consumed == 2)
+				throw std::runtime_error{ "consumer failed" };
+		}, 8), std::runtime_error);
+		EXPECT_EQ(consumed, 2u);
+	}
+	std::filesystem::remove(path);
+}
+
+TEST(ShmMatrix, NamedObjectSharedBetweenMappings) {
+	const std::string name = "matrix_test_shm";
+	shm_matrix<double>::remove(name);
+	auto owner = shm_matrix<double>::create(name, 40, 13);
+	EXPECT_EQ(owner.size(), (matrix_size_type{ 40, 13 }));
+	EXPECT_EQ(owner.type(), dtype::float64);
+	EXPECT_EQ(owner(39, 12), 0.0);
+
+	matrix<double> a(40, 13);
+	random_uniform(a, 8);
+	owner.assign(a);
+	EXPECT_EQ(owner.version(), 1u);
+
+	// a second mapping sees the same rows at another address
+	auto other = shm_matrix<double>::open(name);
+	EXPECT_NE(other[0], owner[0]);
+	ExpectAllNear(other.to_matrix(), a, 0.0);
+	EXPECT_THROW(shm_matrix<float>::open(name), std::invalid_argument);
+	EXPECT_THROW(shm_matrix<double>::create(name, 2, 2), std::system_error);
+
+#if !defined(_WIN32)
+	// a child process updates the matrix through its own mapping
+	const pid_t child = fork();
+	if (child == 0) {
+		auto mapped = shm_matrix<double>::open(name);
+		mapped.write([](shm_matrix<double>& m) { m[5][7] = -1.0; });
+		_exit(0);
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	EXPECT_EQ(owner(5, 7), -1.0);
+	EXPECT_EQ(other.version(), 2u);
+#endif
+	shm_matrix<double>::remove(name);
+}
+
+#if defined(__linux__)
+TEST(ShmMatrix, SeqlockReadersSeeWholeWrites) {
+	auto writer_view = shm_matrix<std::int64_t>::anonymous(4, 257);
+	auto reader_view = shm_matrix<std::int64_t>::from_fd(writer_view.fd());
+	EXPECT_EQ(reader_view.size(), (matrix_size_type{ 4, 257 }));
+	EXPECT_THROW(shm_matrix<std::int32_t>::from_fd(writer_view.fd()), std::invalid_argument);
+
+	// every write fills a row with one value; a torn read would see two values
+	std::atomic<bool> done{ false };
+	std::thread writer([&] {
+		for (std::int64_t k = 1; k <= 2000; ++k) {
+			writer_view.write([k](shm_matrix<std::int64_t>& m) {
+				std::fill_n(m[static_cast<std::size_t>(k % 4)], 257, k);
+			});
+		}
+		done = true;
+	});
+
+	std::size_t torn = 0;
+	std::size_t reads = 0;
+	while (!done || reads < 100) {
+		const auto row = reader_view.read([&](const shm_matrix<std::int64_t>& m) {
+			std::array<std::int64_t, 257> copy{};
+			std::copy_n(m[reads % 4], 257, copy.begin());
+			return copy;
+		});
+		torn += std::any_of(row.begin(), row.end(), [&](std::int64_t v) { return v != row[0]; }) ? 1 : 0;
+		++reads;
+	}
+	writer.join();
+	EXPECT_EQ(torn, 0u);
+	EXPECT_EQ(reader_view.version(), 2000u);
+	EXPECT_EQ(reader_view(1, 256), 1997);
+}
+#endif
+
+TEST(MatrixView, BlocksShareRows) {
+	matrix<int> m(4, 5);
+	for (std::size_t i = 0; i < 4; ++i)
+		for (std::size_t j = 0; j < 5; ++j)
+			m(i, j) = static_cast<int>(10 * i + j);
+
+	auto rows = row_block(m, 1, 2);
+	EXPECT_EQ(rows.size(), (matrix_size_type{ 2, 5 }));
+	EXPECT_EQ(rows(1, 4), 24);
+
+	auto inner = rows.block(1, 2, 1, 3);
+	inner(0, 0) = -1;
+	EXPECT_EQ(m(2, 2), -1);
+	EXPECT_THROW(inner(0, 3), std::out_of_range);
+	EXPECT_THROW(rows.block(1, 0, 2, 1), std::out_of_range);
+
+	matrix_view<const int> read_only = inner;
+	ExpectAllNear(to_matrix(read_only), matrix<int>(3, { -1, 23, 24 }), 0);
+
+	// gemm on views updates just the viewed block
+	matrix<double> a(2, 3, 1.0), b(3, 2, 2.0), c(4, 4, 0.0);
+	gemm(1.0, view(std::as_const(a)), view(std::as_const(b)), 0.0, block(c, 1, 1, 2, 2));
+	ExpectAllNear(c, matrix<double>(4, { 0, 0, 0, 0, 0, 6, 6, 0, 0, 6, 6, 0, 0, 0, 0, 0 }), 0.0);
+}
+
+namespace {
+	// C = 0.5 * A * B + 2 * C on grid with every rank holding its blocks, compared on every rank
+	bool run_summa(transport& t, process_grid grid) {
+		const std::size_t m = 37, k = 29, n = 41, nb = 5;
+		matrix<double> a(m, k), b(k, n), c(m, n);
+		random_uniform(a, 11);
+		random_uniform(b, 12);
+		random_uniform(c, 13);
+
+		block_cyclic_matrix<double> da(m, k, nb, grid, t.rank());
+		block_cyclic_matrix<double> db(k, n, nb, grid, t.rank());
+		block_cyclic_matrix<double> dc(m, n, nb, grid, t.rank());
+		da.assign(a);
+		db.assign(b);
+		dc.assign(c);
+		summa_gemm(0.5, da, db, 2.0, dc, t);
+
+		gemm(0.5, a, b, 2.0, c);
+		const matrix<double> result = dc.gather(t);
+		for (std::size_t i = 0; i < m; ++i)
+			for (std::size_t j = 0; j < n; ++j)
+				if (std::abs(result(i, j) - c(i, j)) > 1e-12)
+					return false;
+		return true;
+	}
+}
+
+TEST(Distributed, SummaOverLocalTransport) {
+	const process_grid grid{ 2, 3 };
+	auto transports = local_transport::group(grid.size());
+
+	block_cyclic_matrix<double> layout(37, 41, 5, grid, 4);
+	EXPECT_EQ(layout.local_size(), (matrix_size_type{ 17, 15 }));
+	EXPECT_EQ(layout.owner(12, 36), grid.rank_of(0, 1));
+
+	std::vector<std::thread> ranks;
+	std::atomic<int> passed{ 0 };
+	for (auto& t : transports)
+		ranks.emplace_back([&] { passed += run_summa(t, grid) ? 1 : 0; });
+	for (auto& r : ranks)
+		r.join();
+	EXPECT_EQ(passed, grid.size());
+}
+
+#if !defined(_WIN32)
+TEST(Distributed, SummaAcrossProcesses) {
+	const process_grid grid{ 2, 2 };
+	socket_mesh mesh(grid.size());
+	std::vector<pid_t> children;
+	for (int rank = 1; rank < grid.size(); ++rank) {
+		const pid_t child = fork();
+		if (child == 0) {
+			bool ok = false;
+			{
+				auto t = mesh.attach(rank);
+				ok = run_summa(*t, grid);
+			}
+			_exit(ok ? 0 : 1);
+		}
+		children.push_back(child);
+	}
+
+	auto t = mesh.attach(0);
+	EXPECT_TRUE(run_summa(*t, grid));
+	for (const pid_t child : children) {
+		int status = 0;
+		waitpid(child, &status, 0);
+		EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+}
+#endif
+
+TEST(Checkpoint, IncrementalWritesOnlyChangedRows) {
+	const std::string path = (std::filesystem::temp_directory_path() / "matrix_checkpoint.bin").string();
+	matrix<double> m(200, 64);
+	random_uniform(m, 21);
+
+	checkpoint_options options;
+	options.full_every = 2;
+	checkpoint_writer<double> writer(path, m, options);
+	const checkpoint_stats first = writer.checkpoint();
+	EXPECT_TRUE(first.full);
+	EXPECT_EQ(first.rows_written, 200u);
+
+	// 5 changed rows cost well under a tenth of a full checkpoint
+	for (std::size_t i : { 3, 50, 51, 120, 199 })
+		m(i, 7) += 1.0;
+	const checkpoint_stats second = writer.checkpoint();
+	EXPECT_FALSE(second.full);
+	EXPECT_EQ(second.rows_written, 5u);
+	EXPECT_LT(second.bytes_written * 10, first.bytes_written);
+
+	m(0, 0) = -5.0;
+	EXPECT_EQ(writer.checkpoint().rows_written, 1u);
+	restore_stats stats;
+	ExpectAllNear(restore_checkpoint<double>(path, &stats), m, 0.0);
+	EXPECT_EQ(stats.generation, 3u);
+	EXPECT_EQ(stats.records_applied, 2u);
+	EXPECT_FALSE(stats.torn_tail);
+
+	// after full_every incremental checkpoints the log is folded into a new base
+	m(10, 10) = 4.0;
+	const checkpoint_stats compacted = writer.checkpoint();
+	EXPECT_TRUE(compacted.full);
+	EXPECT_EQ(std::filesystem::file_size(writer.log_path()), 0u);
+	ExpectAllNear(restore_checkpoint<double>(path, &stats), m, 0.0);
+	EXPECT_EQ(stats.records_applied, 0u);
+	EXPECT_EQ(writer.checkpoint().rows_written, 0u);
+	EXPECT_THROW(restore_checkpoint<float>(path), std::invalid_argument);
+
+	std::filesystem::remove(path);
+	std::filesystem::remove(writer.log_path());
+}
+
+TEST(Checkpoint, TornWritesAreDetected) {
+	const std::string path = (std::filesystem::temp_directory_path() / "matrix_checkpoint_torn.bin").string();
+	const std::string log_path = path + ".log";
+	matrix<std::int32_t> m(50, 33, 1);
+	matrix<std::int32_t> before_last(50, 33);
+	{
+		checkpoint_writer<std::int32_t> writer(path, m);
+		writer.checkpoint();
+		m(7, 7) = 2;
+		writer.checkpoint();
+		before_last = m;
+		m(8, 8) = 3;
+		m(9, 9) = 4;
+		writer.checkpoint();
+	}
+
+	// a record cut off in the middle is dropped, the ones before it survive
+	std::filesystem::resize_file(log_path, std::filesystem::file_size(log_path) - 10);
+	restore_stats stats;
+	ExpectAllNear(restore_checkpoint<std::int32_t>(path, &stats), before_last, 0);
+	EXPECT_TRUE(stats.torn_tail);
+	EXPECT_EQ(stats.generation, 2u);
+
+	// a new writer continues past every generation in the set, so the stale log cannot be replayed over its base
+	{
+		checkpoint_writer<std::int32_t> writer(path, m);
+		EXPECT_EQ(writer.checkpoint().generation, 4u);
+	}
+	ExpectAllNear(restore_checkpoint<std::int32_t>(path), m, 0);
+
+	// damage inside the base is an error
+	{
+		std::FILE* f = std::fopen(path.c_str(), "r+b");
+		std::fseek(f, 4096 + 5 * 160 + 3, SEEK_SET);
+		std::fputc(0x5a, f);
+		std::fclose(f);
+	}
+	EXPECT_THROW(restore_checkpoint<std::int32_t>(path), std::runtime_error);
+
+	std::filesystem::remove(path);
+	std::filesystem::remove(log_path);
+}
+
+TEST(Autotune, TunedKernelsMatchDefaults) {
+	// integer-valued entries keep every summation order exact
+	matrix<double> a(37, 53), b(53, 41), x_mat(45, 29);
+	for (std::size_t i = 0; i < 53; ++i) {
+		for (std::size_t j = 0; j < 53; ++j) {
+			if (i < 37)
+				a[i][j] = static_cast<double>((i * 3 + j * 7) % 11) - 5.0;
+			if (j < 41)
+				b[i][j] = static_cast<double>((i * 5 + j) % 9) - 4.0;
+		}
+	}
+	for (std::size_t i = 0; i < 45; ++i) {
+		for (std::size_t j = 0; j < 29; ++j)
+			x_mat[i][j] = static_cast<double>((i + 2 * j) % 7);
+	}
+	a[3][10] = 0.0;		// zero runs exercise the skip of the unrolled passes
+	a[3][11] = 0.0;
+	std::vector<double> x(45, 1.0);
+
+	const kernel_tuning previous = kernel_tuning::current();
+	const matrix<double> c_ref = multiply(a, b);
+	const matrix<double> t_ref = transpose(x_mat);
+	const matrix<double> s_ref = cumsum(x_mat, matrix_axis::rows);
+	std::vector<double> y_ref(29, 0.0);
+	gemv_transposed(1.0, x_mat, x, 0.0, y_ref);
+
+	for (std::size_t unroll : { 1, 2, 4 }) {
+		kernel_tuning t;
+		t.gemm_block_k = 7;
+		t.gemm_block_n = 16;
+		t.gemm_unroll = unroll;
+		t.transpose_block = 5;
+		t.column_grain = 3;
+		t.threads = 2;
+		kernel_tuning::install(t);
+		EXPECT_EQ(kernel_tuning::current(), t);
+
+		ExpectAllNear(multiply(a, b), c_ref, 0);
+		ExpectAllNear(transpose(x_mat), t_ref, 0);
+		ExpectAllNear(cumsum(x_mat, matrix_axis::rows), s_ref, 0);
+		std::vector<double> y(29, 0.0);
+		gemv_transposed(1.0, x_mat, x, 0.0, y);
+		EXPECT_EQ(y, y_ref);
+	}
+
+	kernel_tuning bad;
+	bad.gemm_unroll = 3;
+	EXPECT_THROW(kernel_tuning::install(bad), std::invalid_argument);
+	kernel_tuning::install(previous);
+}
+
+TEST(Autotune, ProfileIsTunedOnceAndReloaded) {
+	const std::string path = (std::filesystem::temp_directory_path() / "matrix_tuning_profile_test.txt").string();
+	{
+		std::ofstream out(path, std::ios::trunc);
+		out << "[Some Other CPU (4 threads)]\ngemm_block_k = 64\n";
+	}
+	const kernel_tuning previous = kernel_tuning::current();
+
+	autotune_options options;
+	options.profile_path = path;
+	options.problem_size = 64;
+	options.repeats = 1;
+	const kernel_tuning tuned = autotune(options);
+	EXPECT_TRUE(tuned.valid());
+	EXPECT_EQ(kernel_tuning::current(), tuned);
+
+	kernel_tuning loaded;
+	ASSERT_TRUE(load_tuning_profile(path, cpu_model(), loaded));
+	EXPECT_EQ(loaded, tuned);
+	kernel_tuning other;
+	ASSERT_TRUE(load_tuning_profile(path, "Some Other CPU (4 threads)", other));
+	EXPECT_EQ(other.gemm_block_k, 64u);
+
+	// later runs take the stored winners as they are, without timing anything
+	kernel_tuning edited = tuned;
+	edited.gemm_block_k = 7;
+	save_tuning_profile(path, cpu_model(), edited);
+	EXPECT_EQ(autotune(options), edited);
+
+	// a damaged section is tuned again
+	{
+		std::ofstream out(path, std::ios::trunc);
+		out << "[" << cpu_model() << "]\ngemm_unroll = 3\n";
+	}
+	EXPECT_FALSE(load_tuning_profile(path, cpu_model(), loaded));
+	EXPECT_TRUE(autotune(options).valid());
+	EXPECT_TRUE(load_tuning_profile(path, cpu_model(), loaded));
+
+	kernel_tuning::install(previous);
+	std::filesystem::remove(path);
+}
+
+TEST(Reduce, AlongEitherAxisAndOverAll) {
+	matrix<double> a(3, { 1, -2, 3, 4, 5, -6, 7, 8, 9 });
+	EXPECT_EQ(reduce(a, reduce_op::sum, matrix_axis::rows), (std::vector<double>{ 12, 11, 6 }));
+	EXPECT_EQ(reduce(a, reduce_op::min, matrix_axis::rows), (std::vector<double>{ 1, -2, -6 }));
+	EXPECT_EQ(reduce(a, reduce_op::max, matrix_axis::cols), (std::vector<double>{ 3, 5, 9 }));
+	EXPECT_EQ(reduce(a, reduce_op::mean, matrix_axis::cols), (std::vector<double>{ 2.0 / 3, 1, 8 }));
+	EXPECT_DOUBLE_EQ(reduce_all(a, reduce_op::sum), 29.0);
+	EXPECT_DOUBLE_EQ(reduce_all(a, reduce_op::min), -6.0);
+	EXPECT_DOUBLE_EQ(reduce_all(a, reduce_op::mean), 29.0 / 9);
+
+	// blocks reduce only what they see; wide inputs are split over column slices
+	EXPECT_EQ(reduce(block(a, 1, 1, 2, 2), reduce_op::max, matrix_axis::rows), (std::vector<double>{ 8, 9 }));
+	matrix<std::int64_t> wide(5, 3000);
+	for (std::size_t i = 0; i < 5; ++i) {
+		for (std::size_t j = 0; j < 3000; ++j)
+			wide[i][j] = static_cast<std::int64_t>(i * j);
+	}
+	const auto col_sums = reduce(wide, reduce_op::sum, matrix_axis::rows);
+	EXPECT_EQ(col_sums[2999], 10 * 2999);
+	EXPECT_EQ(reduce_all(wide, reduce_op::max), 4 * 2999);
+
+	EXPECT_THROW(reduce_all(matrix<double>(), reduce_op::min), std::invalid_argument);
+	EXPECT_EQ(reduce_all(matrix<double>(), reduce_op::sum), 0.0);
+}
+
+TEST(CApi, WrapsForeignBuffersWithoutCopy) {
+	EXPECT_EQ(matrix_abi_version(), MATRIX_C_ABI_VERSION);
+
+	// a 2 x 3 matrix inside rows of 4, the way a strided NumPy array hands it over
+	double a_buf[8] = { 1, 2, 3, -1, 4, 5, 6, -1 };
+	double b_buf[6] = { 1, 0, 0, 1, 1, 1 };
+	matrix_handle a = nullptr, b = nullptr, c = nullptr;
+	ASSERT_EQ(matrix_wrap(MATRIX_FLOAT64, a_buf, 2, 3, 4, &a), MATRIX_OK);
+	ASSERT_EQ(matrix_wrap(MATRIX_FLOAT64, b_buf, 3, 2, 2, &b), MATRIX_OK);
+	ASSERT_EQ(matrix_create(MATRIX_FLOAT64, 2, 2, &c), MATRIX_OK);
+
+	ASSERT_EQ(matrix_gemm(1.0, a, b, 0.0, c), MATRIX_OK);
+	void* c_data = nullptr;
+	std::size_t c_stride = 0;
+	ASSERT_EQ(matrix_data(c, &c_data, &c_stride), MATRIX_OK);
+	const double* c_out = static_cast<const double*>(c_data);
+	EXPECT_EQ(c_stride, 2u);
+	EXPECT_EQ((std::vector<double>(c_out, c_out + 4)), (std::vector<double>{ 4, 5, 10, 11 }));
+
+	// writes through a wrapped handle land in the caller's buffer
+	a_buf[0] = 2;
+	ASSERT_EQ(matrix_gemm(1.0, a, b, 0.0, c), MATRIX_OK);
+	EXPECT_EQ(c_out[0], 5.0);
+
+	matrix_handle sums = nullptr;
+	ASSERT_EQ(matrix_create(MATRIX_FLOAT64, 3, 1, &sums), MATRIX_OK);
+	ASSERT_EQ(matrix_reduce(a, MATRIX_REDUCE_SUM, MATRIX_AXIS_ROWS, sums), MATRIX_OK);
+	void* s_data = nullptr;
+	matrix_data(sums, &s_data, nullptr);
+	EXPECT_EQ((std::vector<double>(static_cast<double*>(s_data), static_cast<double*>(s_data) + 3)), (std::vector<double>{ 6, 7, 9 }));
+
+	matrix_destroy(sums);
+	matrix_destroy(c);
+	matrix_destroy(b);
+	matrix_destroy(a);
+}
+
+TEST(CApi, ErrorsBecomeStatusCodes) {
+	float sq[4] = { 1, 2, 2, 4 };
+	float rhs[2] = { 1, 1 };
+	float x_buf[2] = {};
+	matrix_handle a = nullptr, b = nullptr, x = nullptr, d = nullptr;
+	ASSERT_EQ(matrix_wrap(MATRIX_FLOAT32, sq, 2, 2, 2, &a), MATRIX_OK);
+	ASSERT_EQ(matrix_wrap(MATRIX_FLOAT32, rhs, 2, 1, 1, &b), MATRIX_OK);
+	ASSERT_EQ(matrix_wrap(MATRIX_FLOAT32, x_buf, 2, 1, 1, &x), MATRIX_OK);
+
+	EXPECT_EQ(matrix_solve(a, b, x), MATRIX_ERROR_NUMERICAL);
+	EXPECT_STREQ(matrix_last_error(), "matrix is singular");
+	sq[3] = 3;
+	ASSERT_EQ(matrix_solve(a, b, x), MATRIX_OK);
+	EXPECT_NEAR(x_buf[0], -1.0f, 1e-6f);
+	EXPECT_NEAR(x_buf[1], 1.0f, 1e-6f);
+	EXPECT_STREQ(matrix_last_error(), "");
+
+	ASSERT_EQ(matrix_create(MATRIX_FLOAT64, 2, 2, &d), MATRIX_OK);
+	EXPECT_EQ(matrix_gemm(1.0, a, a, 0.0, d), MATRIX_ERROR_SIZE_MISMATCH);
+	EXPECT_EQ(matrix_gemm(1.0, a, b, 0.0, a), MATRIX_ERROR_INVALID_ARGUMENT);
+	EXPECT_EQ(matrix_gemm(1.0, a, a, 0.0, b), MATRIX_ERROR_SIZE_MISMATCH);
+	EXPECT_EQ(matrix_solve(b, b, x), MATRIX_ERROR_SIZE_MISMATCH);
+	matrix_handle second_row = nullptr;
+	ASSERT_EQ(matrix_wrap(MATRIX_FLOAT32, sq + 2, 1, 2, 2, &second_row), MATRIX_OK);
+	EXPECT_EQ(matrix_gemm(1.0, a, a, 0.0, second_row), MATRIX_ERROR_INVALID_ARGUMENT);
+	matrix_destroy(second_row);
+	EXPECT_EQ(matrix_shape(nullptr, nullptr, nullptr), MATRIX_ERROR_INVALID_ARGUMENT);
+	EXPECT_EQ(matrix_wrap(MATRIX_FLOAT32, sq, 2, 2, 1, &d), MATRIX_ERROR_INVALID_ARGUMENT);
+	EXPECT_EQ(matrix_create(static_cast<matrix_dtype>(3), 2, 2, &d), MATRIX_ERROR_INVALID_ARGUMENT);
+	EXPECT_STREQ(matrix_status_string(MATRIX_ERROR_NUMERICAL), "numerical error");
+
+	matrix_destroy(d);
+	matrix_destroy(x);
+	matrix_destroy(b);
+	matrix_destroy(a);
+	matrix_destroy(nullptr);
+}
+
+TEST(DynMatrix, TypedMatricesMoveInAndOutWithoutCopy) {
+	matrix<float> m(2, { 1, 2, 3, 4 });
+	const float* first_row = m[0];
+	dyn_matrix d(std::move(m));
+	EXPECT_EQ(d.element_type(), dtype::float32);
+	EXPECT_TRUE(d.holds<float>());
+	EXPECT_EQ(d.size(), matrix_size_type(2, 2));
+	EXPECT_EQ(d.get<float>()[0], first_row);
+	EXPECT_THROW(d.get<double>(), std::invalid_argument);
+
+	d.view<float>()(1, 1) = 5;
+	matrix<float> back = d.release<float>();
+	EXPECT_EQ(back[0], first_row);
+	EXPECT_EQ(back(1, 1), 5.0f);
+	EXPECT_EQ(d.element_type(), dtype::unknown);
+	EXPECT_TRUE(d.empty());
+
+	// views of typed matrices go into the same kernels without a copy
+	matrix<double> a(3, { 1, 2, 3, 4, 5, 6, 7, 8, 9 });
+	const dyn_matrix p = multiply(block(a, 0, 0, 2, 3), transpose(dyn_view(block(a, 0, 0, 2, 3))));
+	EXPECT_EQ(p.element_type(), dtype::float64);
+	ExpectAllNear(p.get<double>(), matrix<double>(2, { 14, 32, 32, 77 }), 1e-12);
+	EXPECT_THROW(multiply(dyn_view(a), dyn_view(back)), std::invalid_argument);
+
+	const dyn_matrix sums = reduce(dyn_view(a), reduce_op::sum, matrix_axis::rows);
+	EXPECT_EQ(sums.size(), matrix_size_type(1, 3));
+	EXPECT_EQ(sums.get<double>()(0, 2), 18.0);
+}
+
+TEST(DynMatrix, AstypeCastsOncePerOperation) {
+	matrix<double> a(4, { 1.75, -2.5, 300.0, std::nan(""), -1e30, 1e30, 65535.9, -0.5 });
+	const dyn_matrix i8 = astype(dyn_view(a), dtype::int8);
+	EXPECT_EQ(i8.get<std::int8_t>()(0, 0), 1);
+	EXPECT_EQ(i8.get<std::int8_t>()(0, 1), -2);
+	EXPECT_EQ(i8.get<std::int8_t>()(0, 2), 127);
+	EXPECT_EQ(i8.get<std::int8_t>()(0, 3), 0);
+	EXPECT_EQ(i8.get<std::int8_t>()(1, 0), -128);
+
+	const dyn_matrix u16 = astype(dyn_view(a), dtype::uint16);
+	EXPECT_EQ(u16.get<std::uint16_t>()(1, 1), 65535);
+	EXPECT_EQ(u16.get<std::uint16_t>()(1, 2), 65535);
+	EXPECT_EQ(u16.get<std::uint16_t>()(1, 3), 0);
+
+	// round trip through float32 and every cast into existing storage
+	const dyn_matrix f = astype(i8.view(), dtype::float32);
+	EXPECT_EQ(f.get<float>()(0, 2), 127.0f);
+	dyn_matrix wide(dtype::int64, 2, 4);
+	convert(f.view(), wide);
+	EXPECT_EQ(wide.get<std::int64_t>()(1, 0), -128);
+	dyn_matrix wrong(dtype::int64, 4, 2);
+	EXPECT_THROW(convert(f.view(), wrong), std::invalid_argument);
+	EXPECT_THROW(astype(dyn_view(a), dtype::unknown), std::invalid_argument);
+
+	const dyn_matrix none = astype(dyn_view(matrix<double>()), dtype::int32);
+	EXPECT_EQ(none.element_type(), dtype::int32);
+	EXPECT_TRUE(none.get<std::int32_t>().empty());
+	EXPECT_THROW(astype(dyn_view(matrix<double>()), dtype::unknown), std::invalid_argument);
+}
+
+TEST(Tensor, BatchSlicesAreMatrixViewsWithoutCopy) {
+	// three 2 x 3 matrices in one allocation
+	tensor<double, 3> batch({ 3, 2, 3 });
+	std::iota(batch.data(), batch.data() + batch.size(), 0.0);
+	EXPECT_EQ(batch(1, 0, 2), 8.0);
+	EXPECT_THROW(batch(3, 0, 0), std::out_of_range);
+
+	const tensor_matrix_view<double> second = batch.view().matrix_slice(1, 2, { 1, 0, 0 });
+	matrix_view<double> m = second;
+	EXPECT_EQ(m.size(), matrix_size_type(2, 3));
+	EXPECT_EQ(&m(0, 0), batch.data() + 6);
+	m(1, 1) = -1;
+	EXPECT_EQ(batch(1, 1, 1), -1.0);
+
+	matrix<double> id(3, { 1, 0, 0, 0, 1, 0, 0, 0, 1 });
+	matrix<double> p(2, 3);
+	gemm(1.0, matrix_view<const double>(second), matrix_view<const double>(view(id)), 0.0, view(p));
+	EXPECT_EQ(p(1, 1), -1.0);
+	EXPECT_EQ(p(0, 2), 8.0);
+
+	// permuting moves strides only; columns that are no longer contiguous cannot be a matrix view
+	const tensor_view<double, 3> t = batch.view().permute({ 0, 2, 1 });
+	EXPECT_EQ(t.shape(), (tensor_shape<3>{ 3, 3, 2 }));
+	EXPECT_EQ(&t(2, 1, 0), &batch(2, 0, 1));
+	EXPECT_FALSE(t.contiguous());
+	EXPECT_THROW(t.reshape(tensor_shape<2>{ 9, 2 }), std::invalid_argument);
+	EXPECT_THROW(t.index(0, 0).as_matrix(), std::invalid_argument);
+	const tensor<double, 3> packed = contiguous(t);
+	EXPECT_EQ(packed(2, 1, 0), batch(2, 0, 1));
+	const tensor_matrix_view<const double> plane = packed.view().index(0, 1).as_matrix();
+	EXPECT_EQ(plane.view()(1, 0), batch(1, 0, 1));
+	static_assert(std::is_convertible_v<const tensor_matrix_view<double>&, matrix_view<const double>>, "named slice");
+	static_assert(!std::is_convertible_v<tensor_matrix_view<double>, matrix_view<double>>, "temporary row table");
+
+	const tensor_view<double, 2> flat = batch.view().reshape(tensor_shape<2>{ 6, 3 });
+	EXPECT_EQ(&flat(5, 2), batch.data() + 17);
+	const tensor_view<double, 3> every_other = batch.view().slice(2, 0, 2, 2);
+	EXPECT_EQ(every_other.shape(), (tensor_shape<3>{ 3, 2, 2 }));
+	EXPECT_EQ(every_other(2, 1, 1), batch(2, 1, 2));
+	EXPECT_THROW(batch.view().slice(2, 1, 2, 2), std::out_of_range);
+}
+
+TEST(Tensor, ReducesAlongAnyAxis) {
+	tensor<int, 3> t({ 2, 3, 4 });
+	for (std::size_t i = 0; i < 2; ++i)
+		for (std::size_t j = 0; j < 3; ++j)
+			for (std::size_t k = 0; k < 4; ++k)
+				t(i, j, k) = static_cast<int>(100 * i + 10 * j + k);
+
+	for (std::size_t axis = 0; axis < 3; ++axis) {
+		for (reduce_op op : { reduce_op::sum, reduce_op::min, reduce_op::max, reduce_op::mean }) {
+			const tensor<int, 2> r = reduce(t, op, axis);
+			const tensor_view<const int, 3> moved = t.view().permute(axis == 0 ? tensor_shape<3>{ 1, 2, 0 } : axis == 1 ? tensor_shape<3>{ 0, 2, 1 } : tensor_shape<3>{ 0, 1, 2 });
+			ASSERT_EQ(r.shape(), (tensor_shape<2>{ moved.extent(0), moved.extent(1) }));
+			for (std::size_t a = 0; a < moved.extent(0); ++a) {
+				for (std::size_t b = 0; b < moved.extent(1); ++b) {
+					int expected = moved(a, b, 0);
+					for (std::size_t c = 1; c < moved.extent(2); ++c) {
+						const int v = moved(a, b, c);
+						expected = (op == reduce_op::min) ? std::min(expected, v) : (op == reduce_op::max) ? std::max(expected, v) : expected + v;
+					}
+					if (op == reduce_op::mean)
+						expected /= static_cast<int>(moved.extent(2));
+					EXPECT_EQ(r(a, b), expected);
+				}
+			}
+		}
+	}
+
+	// permuted input reduces the same as its contiguous copy
+	const tensor_view<const int, 3> p = t.view().permute({ 2, 0, 1 });
+	const tensor<int, 2> direct = reduce(p, reduce_op::sum, 2);
+	const tensor<int, 2> copied = reduce(contiguous(p), reduce_op::sum, 2);
+	EXPECT_EQ(std::vector<int>(direct.data(), direct.data() + direct.size()), std::vector<int>(copied.data(), copied.data() + copied.size()));
+	EXPECT_EQ(reduce_all(t, reduce_op::max), 123);
+	EXPECT_EQ(reduce_all(p.slice(0, 1, 2, 2), reduce_op::sum), 744);
+
+	const tensor<float, 2> empty({ 0, 3 });
+	EXPECT_EQ(reduce(empty, reduce_op::sum, 0).shape(), (tensor_shape<1>{ 3 }));
+	EXPECT_THROW(reduce(empty, reduce_op::max, 0), std::invalid_argument);
+}
+
+#if defined(MATRIX_EXTERN_TEMPLATES)
+// built against matrix_lib: the dispatched row kernels (AVX2 where the CPU has it) against the templates
+template<typename T>
+void ExpectKernelsMatchPortable() {
+	for (std::size_t n : { 0, 1, 3, 4, 7, 64, 1001 }) {
+		std::vector<T> x(n), y(n), z(n), w(n);
+		for (std::size_t j = 0; j < n; ++j) {
+			x[j] = static_cast<T>(std::sin(0.37 * j + 0.1));
+			y[j] = static_cast<T>(std::cos(1.13 * j) / (1.0 + j));
+			z[j] = static_cast<T>(0.5 - 0.001 * j);
+			w[j] = static_cast<T>(std::sqrt(1.0 + j));
+		}
+		const T* rows[4] = { x.data(), y.data(), z.data(), w.data() };
+		const T coefs[4] = { T(0.3), T(-1.7), T(2.25), T(1e-3) };
+
+		EXPECT_EQ(impl::dot_row(x.data(), y.data(), n), impl::dot_row<T>(x.data(), y.data(), n));
+
+		std::vector<T> fast(w), portable(w);
+		impl::axpy_row(T(0.7), x.data(), fast.data(), n);
+		impl::axpy_row<T>(T(0.7), x.data(), portable.data(), n);
+		impl::axpy2_row(T(1.5), y.data(), T(-0.25), z.data(), fast.data(), n);
+		impl::axpy2_row<T>(T(1.5), y.data(), T(-0.25), z.data(), portable.data(), n);
+		impl::axpy4_row(coefs, rows, fast.data(), n);
+		impl::axpy4_row<T>(coefs, rows, portable.data(), n);
+		EXPECT_EQ(fast, portable);
+	}
+}
+
+TEST(MatrixLib, DispatchedKernelsMatchPortableBitForBit) {
+	ExpectKernelsMatchPortable<float>();
+	ExpectKernelsMatchPortable<double>();
+}
+#endif
@@ -0,0 +1,738 @@
+#pragma once
+#ifndef ASYNC_IO_HPP
+#define ASYNC_IO_HPP
+
+#include "matrix.hpp"
+#include "memory_budget.hpp"
+#include "out_of_core.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define MATRIX_HAS_IO_URING 1
+#endif
+#endif
+
+
+// Asynchronous reads and writes of matrix row blocks.
+// On Linux requests go to an io_uring instance driven through raw syscalls: requests are queued as
+// submission entries and handed to the kernel in batches by submit(), a completion thread reaps them and
+// completes the futures. Where io_uring is missing (older kernels, Windows, seccomp) the same interface
+// runs blocking reads and writes on a small private thread pool.
+// With direct I/O the file is also opened with O_DIRECT; requests whose offset, length and buffer are
+// page-aligned bypass the page cache, others use the buffered descriptor. Row blocks are staged in
+// page-aligned buffers so that aligned blocks always qualify.
+enum class io_backend { io_uring, thread_pool };
+
+struct async_io_options {
+	std::size_t queue_depth = 64;		// submission queue entries
+	std::size_t batch_size = 16;		// queued requests that trigger a submit on their own
+	std::size_t threads = 4;			// workers of the thread pool fallback
+	bool direct = false;				// O_DIRECT where the file system supports it
+	bool force_thread_pool = false;
+};
+
+namespace impl {
+
+	constexpr std::size_t io_alignment = 4096;
+
+	constexpr std::uint64_t align_down(std::uint64_t value) noexcept { return value / io_alignment * io_alignment; }
+	constexpr std::uint64_t align_up(std::uint64_t value) noexcept { return (value + io_alignment - 1) / io_alignment * io_alignment; }
+
+	// page-aligned byte buffer, size rounded up to whole pages
+	class aligned_buffer {
+	public:
+		explicit aligned_buffer(std::size_t bytes)
+			: size_(static_cast<std::size_t>(align_up(std::max<std::size_t>(bytes, 1))))
+			, data_(static_cast<unsigned char*>(::operator new(size_, std::align_val_t(io_alignment))))
+		{
+		}
+		~aligned_buffer() { ::operator delete(data_, std::align_val_t(io_alignment)); }
+
+		aligned_buffer(const aligned_buffer&) = delete;
+		aligned_buffer& operator=(const aligned_buffer&) = delete;
+
+		unsigned char* data() noexcept { return data_; }
+		const unsigned char* data() const noexcept { return data_; }
+		std::size_t size() const noexcept { return size_; }
+
+	private:
+		std::size_t size_;
+		unsigned char* data_;
+	};
+
+	enum class io_op { read, write };
+
+	// file opened for positional reads and writes, optionally with a second O_DIRECT descriptor
+	class native_file {
+	public:
+		native_file(const std::string& path, file_mode mode, std::uint64_t bytes, bool direct)
+		{
+#if defined(_WIN32)
+			(void)direct;
+			file_ = std::fopen(path.c_str(), mode == file_mode::create ? "w+b" : "r+b");
+			if (file_ == nullptr)
+				throw std::runtime_error{ "cannot open matrix file " + path };
+			if (mode == file_mode::create && bytes > 0) {
+				const char zero = 0;
+				seek_file(file_, bytes - 1);
+				if (std::fwrite(&zero, 1, 1, file_) != 1) {
+					std::fclose(file_);
+					throw std::runtime_error{ "cannot size matrix file " + path };
+				}
+			}
+#else
+			const int flags = O_RDWR | O_CLOEXEC | (mode == file_mode::create ? O_CREAT | O_TRUNC : 0);
+			fd_ = ::open(path.c_str(), flags, 0644);
+			if (fd_ < 0)
+				throw std::system_error{ errno, std::generic_category(), "cannot open matrix file " + path };
+			if (mode == file_mode::create && ::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+				const int error = errno;
+				::close(fd_);
+				throw std::system_error{ error, std::generic_category(), "cannot size matrix file " + path };
+			}
+#if defined(O_DIRECT)
+			// fails on file systems without direct I/O (tmpfs); buffered I/O is used then
+			if (direct)
+				direct_fd_ = ::open(path.c_str(), O_RDWR | O_CLOEXEC | O_DIRECT);
+#else
+			(void)direct;
+#endif
+#endif
+		}
+
+		~native_file()
+		{
+#if defined(_WIN32)
+			std::fclose(file_);
+#else
+			::close(fd_);
+			if (direct_fd_ >= 0)
+				::close(direct_fd_);
+#endif
+		}
+
+		native_file(const native_file&) = delete;
+		native_file& operator=(const native_file&) = delete;
+
+		bool direct() const noexcept { return direct_fd_ >= 0; }
+
+		// descriptor for a request: the direct one if the request is fully aligned
+		int descriptor(std::uint64_t offset, const void* buffer, std::size_t bytes) const noexcept
+		{
+			const bool aligned = offset % io_alignment == 0 && bytes % io_alignment == 0
+				&& reinterpret_cast<std::uintptr_t>(buffer) % io_alignment == 0;
+			return (direct_fd_ >= 0 && aligned) ? direct_fd_ : fd_;
+		}
+
+		// blocking transfer of the whole range; bytes done (short only at end of file) or -errno
+		std::int64_t transfer(io_op op, std::uint64_t offset, void* buffer, std::size_t bytes)
+		{
+#if defined(_WIN32)
+			std::lock_guard<std::mutex> lock(mutex_);
+			seek_file(file_, offset);
+			const std::size_t done = (op == io_op::read)
+				? std::fread(buffer, 1, bytes, file_)
+				: std::fwrite(buffer, 1, bytes, file_);
+			if (op == io_op::write && done != bytes)
+				return -EIO;
+			return static_cast<std::int64_t>(done);
+#else
+			const int fd = descriptor(offset, buffer, bytes);
+			auto* bytes_ptr = static_cast<unsigned char*>(buffer);
+			std::size_t done = 0;
+			while (done < bytes) {
+				const ssize_t n = (op == io_op::read)
+					? ::pread(fd, bytes_ptr + done, bytes - done, static_cast<off_t>(offset + done))
+					: ::pwrite(fd, bytes_ptr + done, bytes - done, static_cast<off_t>(offset + done));
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n < 0)
+					return -errno;
+				if (n == 0)
+					break;
+				done += static_cast<std::size_t>(n);
+			}
+			return static_cast<std::int64_t>(done);
+#endif
+		}
+
+	private:
+#if defined(_WIN32)
+		std::FILE* file_ = nullptr;
+		std::mutex mutex_;
+#endif
+		int fd_ = -1;
+		int direct_fd_ = -1;
+	};
+
+#if defined(MATRIX_HAS_IO_URING)
+	// submission and completion rings of one io_uring instance, mapped from the kernel;
+	// the caller serializes access to the submission side, only one thread reaps completions
+	class io_uring_ring {
+	public:
+		explicit io_uring_ring(unsigned entries)
+		{
+			io_uring_params params{};
+			fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+			if (fd_ < 0)
+				throw std::system_error{ errno, std::generic_category(), "io_uring_setup failed" };
+
+			sq_bytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cq_bytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (single_mmap)
+				sq_bytes_ = cq_bytes_ = std::max(sq_bytes_, cq_bytes_);
+
+			sq_ring_ = map(sq_bytes_, IORING_OFF_SQ_RING);
+			cq_ring_ = single_mmap ? sq_ring_ : map(cq_bytes_, IORING_OFF_CQ_RING);
+			sqes_bytes_ = params.sq_entries * sizeof(io_uring_sqe);
+			sqes_ = static_cast<io_uring_sqe*>(map(sqes_bytes_, IORING_OFF_SQES));
+
+			auto* sq = static_cast<unsigned char*>(sq_ring_);
+			sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+			sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+			sq_entries_ = params.sq_entries;
+
+			auto* cq = static_cast<unsigned char*>(cq_ring_);
+			cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+			cq_entries_ = params.cq_entries;
+		}
+
+		~io_uring_ring() { release(); }
+
+		io_uring_ring(const io_uring_ring&) = delete;
+		io_uring_ring& operator=(const io_uring_ring&) = delete;
+
+		unsigned cq_entries() const noexcept { return cq_entries_; }
+
+		// false if the submission queue is full
+		bool push(std::uint8_t opcode, int fd, std::uint64_t offset, const iovec* iov, std::uint64_t user_data) noexcept
+		{
+			const unsigned tail = *sq_tail_;
+			if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+				return false;
+
+			const unsigned index = tail & sq_mask_;
+			io_uring_sqe& sqe = sqes_[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = opcode;
+			sqe.fd = fd;
+			sqe.off = offset;
+			sqe.addr = reinterpret_cast<std::uint64_t>(iov);
+			sqe.len = iov != nullptr ? 1 : 0;
+			sqe.user_data = user_data;
+			sq_array_[index] = index;
+			__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+			++unsubmitted_;
+			return true;
+		}
+
+		// hands all pushed entries to the kernel
+		void submit()
+		{
+			while (unsubmitted_ > 0) {
+				const long submitted = ::syscall(__NR_io_uring_enter, fd_, unsubmitted_, 0, 0, nullptr, 0);
+				if (submitted < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+					continue;
+				if (submitted < 0)
+					throw std::system_error{ errno, std::generic_category(), "io_uring_enter failed" };
+				unsubmitted_ -= static_cast<unsigned>(submitted);
+			}
+		}
+
+		// blocks until a completion is available and takes it
+		io_uring_cqe wait()
+		{
+			for (;;) {
+				const unsigned head = *cq_head_;
+				if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+					const io_uring_cqe cqe = cqes_[head & cq_mask_];
+					__atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+					return cqe;
+				}
+				const long result = ::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+				if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+					throw std::system_error{ errno, std::generic_category(), "io_uring_enter failed" };
+			}
+		}
+
+	private:
+		void* map(std::size_t bytes, off_t offset)
+		{
+			void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+			if (p == MAP_FAILED) {
+				const int error = errno;
+				release();
+				throw std::system_error{ error, std::generic_category(), "io_uring ring mapping failed" };
+			}
+			return p;
+		}
+
+		void release() noexcept
+		{
+			if (sqes_ != nullptr)
+				::munmap(sqes_, sqes_bytes_);
+			if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+				::munmap(cq_ring_, cq_bytes_);
+			if (sq_ring_ != nullptr)
+				::munmap(sq_ring_, sq_bytes_);
+			if (fd_ >= 0)
+				::close(fd_);
+			sqes_ = nullptr;
+			cq_ring_ = sq_ring_ = nullptr;
+			fd_ = -1;
+		}
+
+		int fd_ = -1;
+		void* sq_ring_ = nullptr;
+		void* cq_ring_ = nullptr;
+		io_uring_sqe* sqes_ = nullptr;
+		std::size_t sq_bytes_ = 0;
+		std::size_t cq_bytes_ = 0;
+		std::size_t sqes_bytes_ = 0;
+		unsigned* sq_head_ = nullptr;
+		unsigned* sq_tail_ = nullptr;
+		unsigned* sq_array_ = nullptr;
+		unsigned sq_mask_ = 0;
+		unsigned sq_entries_ = 0;
+		unsigned unsubmitted_ = 0;
+		unsigned* cq_head_ = nullptr;
+		unsigned* cq_tail_ = nullptr;
+		io_uring_cqe* cqes_ = nullptr;
+		unsigned cq_mask_ = 0;
+		unsigned cq_entries_ = 0;
+	};
+#endif
+}
+
+// Queue of asynchronous reads and writes on one file. Requests are batched: they reach the
+// kernel (or the fallback pool) when submit() is called or batch_size requests are waiting,
+// so a future must not be waited on before the batch holding its request is submitted.
+class async_io_queue {
+public:
+	// done receives the bytes transferred or -errno; it runs on the completion thread and must not throw
+	using completion = std::function<void(std::int64_t)>;
+
+	explicit async_io_queue(const std::string& path, file_mode mode, std::uint64_t file_bytes, const async_io_options& options = {})
+		: options_(options), file_(path, mode, file_bytes, options.direct)
+	{
+		options_.batch_size = std::max<std::size_t>(options_.batch_size, 1);
+#if defined(MATRIX_HAS_IO_URING)
+		if (!options_.force_thread_pool) {
+			try {
+				ring_ = std::make_unique<impl::io_uring_ring>(static_cast<unsigned>(std::max<std::size_t>(options_.queue_depth, 1)));
+				capacity_ = ring_->cq_entries();
+				reaper_ = std::thread([this] { reap(); });
+				return;
+			}
+			catch (const std::system_error&) {
+				// io_uring unavailable or forbidden here: use the pool
+				ring_.reset();
+			}
+		}
+#endif
+		pool_ = std::make_unique<thread_pool>(std::max<std::size_t>(options_.threads, 1) + 1);
+	}
+
+	~async_io_queue()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		flush_locked();
+		idle_.wait(lock, [this] { return in_flight_ == 0; });
+#if defined(MATRIX_HAS_IO_URING)
+		if (ring_) {
+			// a no-op with user data 0 stops the completion thread
+			while (!ring_->push(IORING_OP_NOP, -1, 0, nullptr, 0))
+				ring_->submit();
+			ring_->submit();
+			lock.unlock();
+			reaper_.join();
+		}
+#endif
+	}
+
+	async_io_queue(const async_io_queue&) = delete;
+	async_io_queue& operator=(const async_io_queue&) = delete;
+
+	io_backend backend() const noexcept { return pool_ ? io_backend::thread_pool : io_backend::io_uring; }
+	bool direct() const noexcept { return file_.direct(); }
+
+	// reads bytes at offset into buffer; the future holds the bytes read (short at end of file)
+	std::future<std::size_t> read(std::uint64_t offset, void* buffer, std::size_t bytes)
+	{
+		return transfer(impl::io_op::read, offset, buffer, bytes);
+	}
+
+	// writes bytes from buffer at offset; buffer must stay valid until the future is ready
+	std::future<std::size_t> write(std::uint64_t offset, const void* buffer, std::size_t bytes)
+	{
+		return transfer(impl::io_op::write, offset, const_cast<void*>(buffer), bytes);
+	}
+
+	void enqueue(impl::io_op op, std::uint64_t offset, void* buffer, std::size_t bytes, completion done)
+	{
+		auto request = std::make_unique<pending_request>();
+		request->op = op;
+		request->offset = offset;
+		request->buffer = buffer;
+		request->bytes = bytes;
+		request->done = std::move(done);
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (in_flight_ >= capacity_) {
+			flush_locked();
+			idle_.wait(lock, [this] { return in_flight_ < capacity_; });
+		}
+		++in_flight_;
+		batch_.push_back(std::move(request));
+		if (batch_.size() >= options_.batch_size)
+			flush_locked();
+	}
+
+	// hands all queued requests over in one batch
+	void submit()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		flush_locked();
+	}
+
+private:
+	struct pending_request {
+		impl::io_op op;
+		std::uint64_t offset;
+		void* buffer;
+		std::size_t bytes;
+		completion done;
+#if defined(MATRIX_HAS_IO_URING)
+		iovec iov;
+#endif
+	};
+
+	std::future<std::size_t> transfer(impl::io_op op, std::uint64_t offset, void* buffer, std::size_t bytes)
+	{
+		auto promise = std::make_shared<std::promise<std::size_t>>();
+		auto result = promise->get_future();
+		enqueue(op, offset, buffer, bytes, [promise](std::int64_t done) {
+			if (done < 0)
+				promise->set_exception(std::make_exception_ptr(std::system_error{ static_cast<int>(-done), std::generic_category(), "matrix file I/O failed" }));
+			else
+				promise->set_value(static_cast<std::size_t>(done));
+		});
+		return result;
+	}
+
+	void flush_locked()
+	{
+		if (batch_.empty())
+			return;
+
+#if defined(MATRIX_HAS_IO_URING)
+		if (ring_) {
+			for (auto& request : batch_) {
+				pending_request* p = request.release();
+				p->iov.iov_base = p->buffer;
+				p->iov.iov_len = p->bytes;
+				const auto opcode = static_cast<std::uint8_t>(p->op == impl::io_op::read ? IORING_OP_READV : IORING_OP_WRITEV);
+				const int fd = file_.descriptor(p->offset, p->buffer, p->bytes);
+				while (!ring_->push(opcode, fd, p->offset, &p->iov, reinterpret_cast<std::uint64_t>(p)))
+					ring_->submit();
+			}
+			batch_.clear();
+			ring_->submit();
+			return;
+		}
+#endif
+		for (auto& request : batch_) {
+			pending_request* p = request.release();
+			pool_->submit([this, p] {
+				complete(p, file_.transfer(p->op, p->offset, p->buffer, p->bytes));
+			});
+		}
+		batch_.clear();
+	}
+
+	void complete(pending_request* p, std::int64_t result)
+	{
+		std::unique_ptr<pending_request> request(p);
+		request->done(result);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			--in_flight_;
+		}
+		idle_.notify_all();
+	}
+
+#if defined(MATRIX_HAS_IO_URING)
+	void reap()
+	{
+		for (;;) {
+			const io_uring_cqe cqe = ring_->wait();
+			if (cqe.user_data == 0)
+				return;
+			// the kernel orders the completion after the submission but is no synchronization to
+			// the language; flush_locked fills and submits under mutex_, so taking it here makes
+			// the request's fields visible to this thread
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+			}
+			auto* p = reinterpret_cast<pending_request*>(cqe.user_data);
+			std::int64_t result = cqe.res;
+			// a short transfer in the middle of the file is finished synchronously
+			if (result >= 0 && static_cast<std::size_t>(result) < p->bytes) {
+				const std::int64_t rest = file_.transfer(p->op, p->offset + result,
+					static_cast<unsigned char*>(p->buffer) + result, p->bytes - static_cast<std::size_t>(result));
+				result = rest < 0 ? rest : result + rest;
+			}
+			complete(p, result);
+		}
+	}
+#endif
+
+	async_io_options options_;
+	impl::native_file file_;
+	std::mutex mutex_;
+	std::condition_variable idle_;
+	std::vector<std::unique_ptr<pending_request>> batch_;
+	std::size_t in_flight_ = 0;
+	std::size_t capacity_ = static_cast<std::size_t>(-1);
+#if defined(MATRIX_HAS_IO_URING)
+	std::unique_ptr<impl::io_uring_ring> ring_;
+	std::thread reaper_;
+#endif
+	std::unique_ptr<thread_pool> pool_;
+};
+
+// rows x cols matrix stored row-major in a file (the file_matrix layout) with asynchronous row-block I/O.
+// Blocks are staged in page-aligned buffers, so the matrix rows may be reused as soon as write_rows returns.
+template<class T>
+class async_row_file {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+
+	static_assert(std::is_trivially_copyable_v<T>, "file matrices are read and written byte by byte");
+
+	explicit async_row_file(const std::string& path, size_type rows, size_type cols, file_mode mode = file_mode::open,
+		const async_io_options& options = {})
+		: sz_{ rows, cols }
+		, queue_(path, mode, checked_bytes(rows, cols), options)
+	{
+	}
+
+	matrix_size_type size() const noexcept { return sz_; }
+	io_backend backend() const noexcept { return queue_.backend(); }
+	bool direct() const noexcept { return queue_.direct(); }
+
+	// dst[dst_row:dst_row + count] = this[first_row:first_row + count]; dst must outlive the future
+	template<class A>
+	std::future<void> read_rows(size_type first_row, size_type count, matrix<T, A>& dst, size_type dst_row = 0)
+	{
+		auto promise = std::make_shared<std::promise<void>>();
+		auto result = promise->get_future();
+		enqueue_read(first_row, count, dst, dst_row, [promise](bool ok) {
+			if (ok)
+				promise->set_value();
+			else
+				promise->set_exception(std::make_exception_ptr(std::runtime_error{ "matrix file read failed" }));
+		});
+		return result;
+	}
+
+	// this[first_row:first_row + count] = src[src_row:src_row + count]
+	template<class A>
+	std::future<void> write_rows(size_type first_row, size_type count, const matrix<T, A>& src, size_type src_row = 0)
+	{
+		check_rows(first_row, count);
+		if (src.size().cols != sz_.cols || src_row + count > src.size().rows)
+			throw std::invalid_argument{ "matrix sizes do not match" };
+
+		const std::size_t row_bytes = sz_.cols * sizeof(T);
+		const std::size_t bytes = count * row_bytes;
+		auto staging = std::make_shared<impl::aligned_buffer>(bytes);
+		for (size_type i = 0; i < count; ++i)
+			std::memcpy(staging->data() + i * row_bytes, src[src_row + i], row_bytes);
+
+		auto promise = std::make_shared<std::promise<void>>();
+		auto result = promise->get_future();
+		queue_.enqueue(impl::io_op::write, row_offset(first_row), staging->data(), bytes,
+			[staging, promise, bytes](std::int64_t done) {
+				if (done < 0 || static_cast<std::size_t>(done) != bytes)
+					promise->set_exception(std::make_exception_ptr(std::runtime_error{ "matrix file write failed" }));
+				else
+					promise->set_value();
+			});
+		return result;
+	}
+
+	void submit() { queue_.submit(); }
+
+	// whole matrix, read as blocks of block_rows rows submitted in one batch
+	std::future<matrix<T>> load(size_type block_rows = 256)
+	{
+		struct load_state {
+			load_state(matrix_size_type sz, size_type blocks) : result(sz.rows, sz.cols), remaining(blocks) {}
+			matrix<T> result;
+			std::promise<matrix<T>> promise;
+			std::atomic<size_type> remaining;
+			std::atomic<bool> failed{ false };
+		};
+
+		block_rows = std::max<size_type>(block_rows, 1);
+		auto state = std::make_shared<load_state>(sz_, (sz_.rows + block_rows - 1) / block_rows);
+		auto result = state->promise.get_future();
+		for (size_type first = 0; first < sz_.rows; first += block_rows) {
+			enqueue_read(first, std::min(block_rows, sz_.rows - first), state->result, first, [state](bool ok) {
+				if (!ok)
+					state->failed.store(true, std::memory_order_relaxed);
+				if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+					return;
+				if (state->failed.load(std::memory_order_relaxed))
+					state->promise.set_exception(std::make_exception_ptr(std::runtime_error{ "matrix file read failed" }));
+				else
+					state->promise.set_value(std::move(state->result));
+			});
+		}
+		submit();
+		return result;
+	}
+
+private:
+	static std::uint64_t checked_bytes(size_type rows, size_type cols)
+	{
+		if (rows == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+		if (cols == 0)
+			throw std::invalid_argument{ "cols count must be greater than zero" };
+		return static_cast<std::uint64_t>(rows) * cols * sizeof(T);
+	}
+
+	std::uint64_t row_offset(size_type row) const noexcept
+	{
+		return static_cast<std::uint64_t>(row) * sz_.cols * sizeof(T);
+	}
+
+	void check_rows(size_type first_row, size_type count) const
+	{
+		if (first_row + count > sz_.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+	}
+
+	// queues the read of a row block; finished(ok) runs on the completion thread after the copy into dst
+	template<class A, class Func>
+	void enqueue_read(size_type first_row, size_type count, matrix<T, A>& dst, size_type dst_row, Func finished)
+	{
+		check_rows(first_row, count);
+		if (dst.size().cols != sz_.cols || dst_row + count > dst.size().rows)
+			throw std::invalid_argument{ "matrix sizes do not match" };
+
+		// direct reads are widened to whole pages, the block is cut out on completion
+		const std::uint64_t begin = row_offset(first_row);
+		const std::uint64_t end = row_offset(first_row + count);
+		const std::uint64_t first = queue_.direct() ? impl::align_down(begin) : begin;
+		const std::uint64_t last = queue_.direct() ? impl::align_up(end) : end;
+		auto staging = std::make_shared<impl::aligned_buffer>(static_cast<std::size_t>(last - first));
+
+		const size_type cols = sz_.cols;
+		queue_.enqueue(impl::io_op::read, first, staging->data(), static_cast<std::size_t>(last - first),
+			[staging, finished, &dst, dst_row, count, cols, skip = begin - first, needed = end - first](std::int64_t done) {
+				if (done < 0 || static_cast<std::uint64_t>(done) < needed) {
+					finished(false);
+					return;
+				}
+				const unsigned char* source = staging->data() + skip;
+				for (size_type i = 0; i < count; ++i)
+					std::memcpy(dst[dst_row + i], source + i * cols * sizeof(T), cols * sizeof(T));
+				finished(true);
+			});
+	}
+
+	matrix_size_type sz_;
+	async_io_queue queue_;
+};
+
+// Streams the rows of file through consume(block, first_row) in order, blocks of block_rows rows;
+// up to depth blocks are read ahead while consume works on the current one.
+template<class T, class Func>
+void stream_rows(async_row_file<T>& file, std::size_t block_rows, Func&& consume, std::size_t depth = 2)
+{
+	const std::size_t rows = file.size().rows;
+	const std::size_t cols = file.size().cols;
+	block_rows = std::max<std::size_t>(block_rows, 1);
+	depth = std::max<std::size_t>(depth, 1);
+
+	struct block {
+		block(std::size_t first, std::size_t rows, std::size_t cols) : first_row(first), data(rows, cols) {}
+		std::size_t first_row;
+		matrix<T> data;
+		std::future<void> ready;
+	};
+
+	// deque keeps the matrices in place while their reads are in flight; whatever leaves this
+	// function, consume or a read throwing included, first waits for every read still writing into them
+	std::deque<block> blocks;
+	struct wait_for_reads {
+		std::deque<block>& blocks;
+		~wait_for_reads()
+		{
+			for (auto& b : blocks)
+				if (b.ready.valid())
+					b.ready.wait();
+		}
+	} guard{ blocks };
+	std::size_t next = 0;
+	auto issue = [&] {
+		while (next < rows && blocks.size() < depth) {
+			auto& b = blocks.emplace_back(next, std::min(block_rows, rows - next), cols);
+			b.ready = file.read_rows(next, b.data.size().rows, b.data);
+			next += b.data.size().rows;
+		}
+		file.submit();
+	};
+
+	issue();
+	while (!blocks.empty()) {
+		blocks.front().ready.get();
+		consume(static_cast<const matrix<T>&>(blocks.front().data), blocks.front().first_row);
+		blocks.pop_front();
+		issue();
+	}
+}
+
+
+#endif // !ASYNC_IO_HPP
@@ -0,0 +1,374 @@
+#pragma once
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+
+// Measured kernel_tuning for the CPU at hand.
+// Candidates are timed on the real kernels, one parameter at a time with the winners so far
+// fixed: thread count, then the k and n blocks, the unroll of the GEMM row kernel, the transpose
+// block and the column grain (gemv_transposed, column prefix sums and sketches). Winners go to a
+// text profile with one section per CPU model, so every machine sharing a home directory keeps
+// its own; autotune() installs the stored section if there is one and tunes only otherwise.
+// Call it once at startup, or define MATRIX_AUTOTUNE_AT_STARTUP to have it run while static
+// objects are constructed.
+struct autotune_options {
+	std::string profile_path;			// empty for default_tuning_profile_path()
+	std::size_t problem_size = 1024;	// order of the benchmark matrices
+	std::size_t repeats = 3;			// each candidate scores its best of this many runs
+	bool force = false;					// tune even if the profile has this CPU
+};
+
+namespace impl {
+
+	inline std::string environment(const char* name) {
+#if defined(_MSC_VER)
+		char* value = nullptr;
+		std::size_t length = 0;
+		if (_dupenv_s(&value, &length, name) != 0 || value == nullptr)
+			return std::string();
+		std::string result(value);
+		std::free(value);
+		return result;
+#else
+		const char* value = std::getenv(name);
+		return value ? std::string(value) : std::string();
+#endif
+	}
+
+	inline std::string trim(const std::string& s) {
+		const auto first = s.find_first_not_of(" \t\r\n");
+		if (first == std::string::npos)
+			return std::string();
+		const auto last = s.find_last_not_of(" \t\r\n");
+		return s.substr(first, last - first + 1);
+	}
+
+	// processor brand string, e.g. "AMD Ryzen 9 7950X 16-Core Processor"; empty if unknown
+	inline std::string cpu_brand() {
+		std::string brand;
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int regs[4];
+		__cpuid(regs, 0x80000000);
+		if (static_cast<unsigned>(regs[0]) >= 0x80000004u) {
+			char text[49] = {};
+			for (int leaf = 0; leaf < 3; ++leaf) {
+				__cpuid(regs, 0x80000002 + leaf);
+				std::memcpy(text + 16 * leaf, regs, 16);
+			}
+			brand = text;
+		}
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+		unsigned regs[4];
+		if (__get_cpuid_max(0x80000000u, nullptr) >= 0x80000004u) {
+			char text[49] = {};
+			for (unsigned leaf = 0; leaf < 3; ++leaf) {
+				__get_cpuid(0x80000002u + leaf, &regs[0], &regs[1], &regs[2], &regs[3]);
+				std::memcpy(text + 16 * leaf, regs, 16);
+			}
+			brand = text;
+		}
+#endif
+#if defined(__linux__)
+		if (trim(brand).empty()) {
+			// other architectures name the part in /proc/cpuinfo
+			std::ifstream cpuinfo("/proc/cpuinfo");
+			std::string line;
+			const char* keys[] = { "model name", "Model", "Hardware", "cpu model", "CPU part" };
+			for (const char* key : keys) {
+				cpuinfo.clear();
+				cpuinfo.seekg(0);
+				while (std::getline(cpuinfo, line)) {
+					const auto colon = line.find(':');
+					if (colon != std::string::npos && trim(line.substr(0, colon)) == key) {
+						brand = line.substr(colon + 1);
+						break;
+					}
+				}
+				if (!trim(brand).empty())
+					break;
+			}
+		}
+#endif
+		// collapse runs of spaces, brand strings are padded with them
+		std::string result;
+		for (char ch : trim(brand)) {
+			if (ch == '[' || ch == ']' || ch == '\t')
+				ch = ' ';
+			if (ch != ' ' || (!result.empty() && result.back() != ' '))
+				result += ch;
+		}
+		return result;
+	}
+
+	// fastest of repeats runs of kernel, after one untimed run to warm caches and the pool
+	template<typename Func>
+	double best_seconds(Func&& kernel, std::size_t repeats) {
+		kernel();
+		double best = std::numeric_limits<double>::infinity();
+		for (std::size_t r = 0; r < std::max<std::size_t>(repeats, 1); ++r) {
+			const auto start = std::chrono::steady_clock::now();
+			kernel();
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+		}
+		return best;
+	}
+
+	// candidates not above n; n itself stands in when all of them are
+	inline std::vector<std::size_t> block_candidates(std::vector<std::size_t> candidates, std::size_t n) {
+		candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [n](std::size_t v) { return v > n; }), candidates.end());
+		if (candidates.empty())
+			candidates.push_back(n);
+		return candidates;
+	}
+
+	inline void write_tuning(std::ostream& out, const kernel_tuning& t) {
+		out << "gemm_block_k = " << t.gemm_block_k << '\n'
+			<< "gemm_block_n = " << t.gemm_block_n << '\n'
+			<< "gemm_unroll = " << t.gemm_unroll << '\n'
+			<< "transpose_block = " << t.transpose_block << '\n'
+			<< "column_grain = " << t.column_grain << '\n'
+			<< "threads = " << t.threads << '\n';
+	}
+
+	// false for an unknown key or a malformed value
+	inline bool read_tuning_line(const std::string& key, const std::string& value, kernel_tuning& t) {
+		std::size_t kernel_tuning::* fields[] = { &kernel_tuning::gemm_block_k, &kernel_tuning::gemm_block_n, &kernel_tuning::gemm_unroll,
+			&kernel_tuning::transpose_block, &kernel_tuning::column_grain, &kernel_tuning::threads };
+		const char* names[] = { "gemm_block_k", "gemm_block_n", "gemm_unroll", "transpose_block", "column_grain", "threads" };
+		for (std::size_t f = 0; f < 6; ++f) {
+			if (key != names[f])
+				continue;
+			if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+				return false;
+			try {
+				t.*fields[f] = static_cast<std::size_t>(std::stoull(value));
+			}
+			catch (const std::out_of_range&) {
+				return false;
+			}
+			return true;
+		}
+		return false;
+	}
+}
+
+// name of this processor and its thread count, the key of a profile section
+inline std::string cpu_model()
+{
+	std::string brand = impl::cpu_brand();
+	if (brand.empty())
+		brand = "unknown cpu";
+	return brand + " (" + std::to_string(std::max(std::thread::hardware_concurrency(), 1u)) + " threads)";
+}
+
+// MATRIX_TUNING_PROFILE if set, else a file in the per-user cache directory
+inline std::string default_tuning_profile_path()
+{
+	const std::string configured = impl::environment("MATRIX_TUNING_PROFILE");
+	if (!configured.empty())
+		return configured;
+
+#if defined(_WIN32)
+	std::filesystem::path base = impl::environment("LOCALAPPDATA");
+#else
+	std::filesystem::path base = impl::environment("XDG_CACHE_HOME");
+	if (base.empty() && !impl::environment("HOME").empty())
+		base = std::filesystem::path(impl::environment("HOME")) / ".cache";
+#endif
+	if (base.empty())
+		return "matrix_tuning_profile.txt";
+	return (base / "matrix_3_0" / "tuning_profile.txt").string();
+}
+
+// section of model in the profile at path; false if the file or the section is missing or damaged
+inline bool load_tuning_profile(const std::string& path, const std::string& model, kernel_tuning& t)
+{
+	std::ifstream in(path);
+	if (!in)
+		return false;
+
+	const std::string header = "[" + model + "]";
+	kernel_tuning result;
+	bool found = false;
+	std::string line;
+	while (std::getline(in, line)) {
+		line = impl::trim(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+		if (line[0] == '[') {
+			if (found)
+				break;
+			found = (line == header);
+			continue;
+		}
+		if (!found)
+			continue;
+		const auto eq = line.find('=');
+		if (eq == std::string::npos || !impl::read_tuning_line(impl::trim(line.substr(0, eq)), impl::trim(line.substr(eq + 1)), result))
+			return false;
+	}
+	if (!found || !result.valid())
+		return false;
+	t = result;
+	return true;
+}
+
+// replaces (or adds) the section of model in the profile at path, keeping those of other CPUs
+inline void save_tuning_profile(const std::string& path, const std::string& model, const kernel_tuning& t)
+{
+	const std::string header = "[" + model + "]";
+	std::vector<std::string> kept;
+	{
+		std::ifstream in(path);
+		std::string line;
+		bool skipping = false;
+		while (std::getline(in, line)) {
+			const std::string trimmed = impl::trim(line);
+			if (!trimmed.empty() && trimmed[0] == '[')
+				skipping = (trimmed == header);
+			if (!skipping)
+				kept.push_back(line);
+		}
+	}
+	if (kept.empty())
+		kept.push_back("# kernel tuning profiles, one section per CPU model");
+
+	const std::filesystem::path target(path);
+	if (target.has_parent_path())
+		std::filesystem::create_directories(target.parent_path());
+
+	// a concurrent reader sees the old profile or the new one, never half of it
+	const std::string temp = path + ".tmp";
+	{
+		std::ofstream out(temp, std::ios::trunc);
+		for (const auto& line : kept)
+			out << line << '\n';
+		out << header << '\n';
+		impl::write_tuning(out, t);
+		out.flush();
+		if (!out)
+			throw std::runtime_error{ "cannot write tuning profile" };
+	}
+	std::filesystem::rename(temp, target);
+}
+
+// times the candidates and returns the winners; the installed tuning is left as it was
+inline kernel_tuning benchmark_tuning(const autotune_options& options = {})
+{
+	const std::size_t n = std::max<std::size_t>(options.problem_size, 16);
+	const std::size_t m = n / 4;
+
+	// nonzero entries, so the zero skip of the GEMM kernel never shortens a run
+	matrix<double> a(m, n), b(n, n), c(m, n), bt(n, n);
+	for (std::size_t i = 0; i < n; ++i) {
+		for (std::size_t j = 0; j < n; ++j) {
+			b[i][j] = 0.25 + static_cast<double>((i * 7 + j * 13) % 17) / 17.0;
+			if (i < m)
+				a[i][j] = 0.5 + static_cast<double>((i * 11 + j * 5) % 19) / 19.0;
+		}
+	}
+	std::vector<double> x(n, 1.0), y(n, 0.0);
+
+	auto gemm_kernel = [&] { gemm(1.0, a, b, 0.0, c); };
+	auto transpose_kernel = [&] { impl::transpose_into(b, bt); };
+	auto columns_kernel = [&] { gemv_transposed(1.0, b, x, 0.0, y); };
+
+	const kernel_tuning previous = kernel_tuning::current();
+	kernel_tuning best;
+	auto pick = [&](std::size_t kernel_tuning::* field, const std::vector<std::size_t>& candidates, auto&& kernel) {
+		double best_time = std::numeric_limits<double>::infinity();
+		std::size_t best_value = best.*field;
+		for (std::size_t value : candidates) {
+			kernel_tuning t = best;
+			t.*field = value;
+			kernel_tuning::install(t);
+			const double seconds = impl::best_seconds(kernel, options.repeats);
+			if (seconds < best_time) {
+				best_time = seconds;
+				best_value = value;
+			}
+		}
+		best.*field = best_value;
+	};
+
+	try {
+		// 1, 2, 4, ... threads and the whole pool, which is stored as 0 so the profile means "all"
+		const std::size_t pool = thread_pool::instance().size();
+		std::vector<std::size_t> threads;
+		for (std::size_t t = 1; t < pool; t *= 2)
+			threads.push_back(t);
+		threads.push_back(0);
+
+		pick(&kernel_tuning::threads, threads, gemm_kernel);
+		pick(&kernel_tuning::gemm_block_k, impl::block_candidates({ 64, 128, 256, 512, 1024 }, n), gemm_kernel);
+		pick(&kernel_tuning::gemm_block_n, impl::block_candidates({ 256, 512, 1024, 2048, 4096 }, n), gemm_kernel);
+		pick(&kernel_tuning::gemm_unroll, { 1, 2, 4 }, gemm_kernel);
+		pick(&kernel_tuning::transpose_block, impl::block_candidates({ 8, 16, 32, 64, 128 }, n), transpose_kernel);
+		pick(&kernel_tuning::column_grain, impl::block_candidates({ 64, 128, 256, 512, 1024 }, n), columns_kernel);
+	}
+	catch (...) {
+		kernel_tuning::install(previous);
+		throw;
+	}
+	kernel_tuning::install(previous);
+	return best;
+}
+
+// installs the profile section of this CPU, tuning and storing it first if there is none
+inline kernel_tuning autotune(const autotune_options& options = {})
+{
+	const std::string path = options.profile_path.empty() ? default_tuning_profile_path() : options.profile_path;
+	const std::string model = cpu_model();
+
+	kernel_tuning t;
+	if (options.force || !load_tuning_profile(path, model, t)) {
+		t = benchmark_tuning(options);
+		save_tuning_profile(path, model, t);
+	}
+	kernel_tuning::install(t);
+	return t;
+}
+
+#if defined(MATRIX_AUTOTUNE_AT_STARTUP)
+namespace impl {
+
+	// a profile that cannot be read or written leaves the default tuning in place
+	inline kernel_tuning autotune_at_startup() noexcept {
+		try {
+			return autotune();
+		}
+		catch (...) {
+			return kernel_tuning::current();
+		}
+	}
+
+	inline const kernel_tuning startup_tuning = autotune_at_startup();
+}
+#endif
+
+
+#endif // !AUTOTUNE_HPP
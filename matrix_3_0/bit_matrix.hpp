@@ -0,0 +1,319 @@
+#pragma once
+#ifndef BIT_MATRIX_HPP
+#define BIT_MATRIX_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+
+// Dense matrix over GF(2): every row is a run of 64-bit words (bit j lives in word j / 64,
+// bit j % 64), kept in a matrix<uint64_t> so the row table can be permuted by swapping pointers.
+// Bits past the last column are always zero.
+class bit_matrix {
+public:
+	using size_type = std::size_t;
+	using word_type = std::uint64_t;
+
+	static constexpr size_type word_bits = 64;
+
+	explicit bit_matrix(size_type rows, size_type cols) : words_(rows, words_for(cols), word_type{ 0 }), cols_{ cols }
+	{
+		if (rows == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+
+		if (cols == 0)
+			throw std::invalid_argument{ "cols count must be greater than zero" };
+	}
+
+	static bit_matrix identity(size_type n)
+	{
+		bit_matrix result(n, n);
+		for (size_type i = 0; i < n; ++i)
+			result.set(i, i, true);
+		return result;
+	}
+
+	bool operator()(size_type row, size_type col) const { check_index(row, col); return get(row, col); }
+
+	bool get(size_type row, size_type col) const noexcept { return (words_[row][col / word_bits] >> (col % word_bits)) & 1u; }
+	void set(size_type row, size_type col, bool value)
+	{
+		check_index(row, col);
+		const word_type mask = word_type{ 1 } << (col % word_bits);
+		word_type& word = words_[row][col / word_bits];
+		word = value ? (word | mask) : (word & ~mask);
+	}
+	void flip(size_type row, size_type col)
+	{
+		check_index(row, col);
+		words_[row][col / word_bits] ^= word_type{ 1 } << (col % word_bits);
+	}
+
+	word_type* operator[](size_type row) noexcept { return words_[row]; }
+	const word_type* operator[](size_type row) const noexcept { return words_[row]; }
+
+	matrix_size_type size() const noexcept { return matrix_size_type{ words_.size().rows, cols_ }; }
+	size_type words_per_row() const noexcept { return words_.size().cols; }
+
+	// row dst ^= row src, a word at a time
+	void xor_row(size_type dst, size_type src) noexcept { xor_words(words_[dst], words_[src], words_per_row()); }
+
+	// pivoting exchanges row pointers, never row contents
+	void swap_rows(size_type lhs, size_type rhs) noexcept { std::swap(words_.data()[lhs], words_.data()[rhs]); }
+
+	static void xor_words(word_type* dst, const word_type* src, size_type n) noexcept
+	{
+		for (size_type w = 0; w < n; ++w)
+			dst[w] ^= src[w];
+	}
+
+private:
+	static size_type words_for(size_type cols) noexcept { return (cols + word_bits - 1) / word_bits; }
+
+	void check_index(size_type row, size_type col) const
+	{
+		if (row >= words_.size().rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+
+		if (col >= cols_)
+			throw std::out_of_range{ "col is out of this matrix" };
+	}
+
+	matrix<word_type> words_;
+	size_type cols_;
+};
+
+namespace impl {
+
+	// rows combined per Four Russians table; 8 bits index a 256-entry table and never straddle a word
+	constexpr std::size_t m4r_bits = 8;
+	constexpr std::size_t m4r_entries = std::size_t{ 1 } << m4r_bits;
+
+	inline unsigned m4r_chunk(const std::uint64_t* row, std::size_t first_col) noexcept {
+		return static_cast<unsigned>((row[first_col / 64] >> (first_col % 64)) & (m4r_entries - 1));
+	}
+
+	inline unsigned lowest_bit_index(unsigned value) noexcept {
+		unsigned index = 0;
+		while ((value & 1u) == 0) {
+			value >>= 1;
+			++index;
+		}
+		return index;
+	}
+
+	// table[mask] = XOR of the rows whose bit is set in mask: each entry is the entry without its
+	// lowest set bit, filled earlier since it is smaller, XORed with the row of that bit
+	inline void build_m4r_table(const std::vector<const std::uint64_t*>& rows, std::size_t words,
+		std::size_t first_word, matrix<std::uint64_t>& table) {
+
+		const std::size_t entries = std::size_t{ 1 } << rows.size();
+		std::fill_n(table[0] + first_word, words - first_word, std::uint64_t{ 0 });
+		for (std::size_t mask = 1; mask < entries; ++mask) {
+			const std::size_t base = mask & (mask - 1);
+			const std::uint64_t* src = rows[lowest_bit_index(static_cast<unsigned>(mask))];
+			std::uint64_t* dst = table[mask];
+			const std::uint64_t* prev = table[base];
+			for (std::size_t w = first_word; w < words; ++w)
+				dst[w] = prev[w] ^ src[w];
+		}
+	}
+}
+
+// C = A * B over GF(2) by the Method of Four Russians (M4RM):
+// for every 8-row slice of B all 256 combinations are tabulated once,
+// then each row of A picks its combination with one table lookup and one row XOR
+inline bit_matrix multiply(const bit_matrix& a, const bit_matrix& b)
+{
+	if (a.size().cols != b.size().rows)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	const std::size_t m = a.size().rows;
+	const std::size_t k = a.size().cols;
+	const std::size_t words = b.words_per_row();
+	bit_matrix c(m, b.size().cols);
+	matrix<std::uint64_t> table(impl::m4r_entries, words, std::uint64_t{ 0 });
+	std::vector<const std::uint64_t*> slice;
+
+	for (std::size_t first = 0; first < k; first += impl::m4r_bits) {
+		const std::size_t count = std::min(impl::m4r_bits, k - first);
+		slice.clear();
+		for (std::size_t p = first; p < first + count; ++p)
+			slice.push_back(b[p]);
+		impl::build_m4r_table(slice, words, 0, table);
+
+		parallel_for(0, m, impl::rows_grain * 4, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) {
+				const unsigned mask = impl::m4r_chunk(a[i], first);
+				if (mask != 0)
+					bit_matrix::xor_words(c[i], table[mask], words);
+			}
+		});
+	}
+	return c;
+}
+
+// In-place reduction to reduced row echelon form by the Method of Four Russians (M4RI).
+// Columns are taken 8 at a time: pivots of the slice are found and reduced against each other
+// with a handful of row XORs, then every other row is cleared on the pivot columns with a
+// single lookup in the table of pivot row combinations. Returns the rank; pivot_cols
+// (if given) receives the pivot column of each of the first rank rows.
+inline std::size_t echelonize(bit_matrix& a, std::vector<std::size_t>* pivot_cols = nullptr)
+{
+	const std::size_t rows = a.size().rows;
+	const std::size_t cols = a.size().cols;
+	const std::size_t words = a.words_per_row();
+	matrix<std::uint64_t> table(impl::m4r_entries, words, std::uint64_t{ 0 });
+	std::vector<const std::uint64_t*> pivot_rows;
+	std::vector<std::size_t> pivots;
+
+	std::size_t rank = 0;
+	for (std::size_t first = 0; first < cols && rank < rows; first += impl::m4r_bits) {
+		const std::size_t width = std::min(impl::m4r_bits, cols - first);
+		std::vector<std::size_t> block_pivots;  // columns relative to first
+
+		// Step 1: find pivots of the slice; candidate rows are reduced only on the 8-bit slice
+		auto reduced_chunk = [&](std::size_t row) {
+			unsigned chunk = impl::m4r_chunk(a[row], first);
+			for (std::size_t j = 0; j < block_pivots.size(); ++j) {
+				if (chunk & (1u << block_pivots[j]))
+					chunk ^= impl::m4r_chunk(a[rank + j], first);
+			}
+			return chunk;
+		};
+
+		std::size_t scan_from = rank;
+		for (std::size_t bit = 0; bit < width && rank + block_pivots.size() < rows; ++bit) {
+			const std::size_t target = rank + block_pivots.size();
+			std::size_t found = rows;
+			for (std::size_t row = std::max(scan_from, target); row < rows; ++row) {
+				if (reduced_chunk(row) & (1u << bit)) {
+					found = row;
+					break;
+				}
+			}
+			if (found == rows)
+				continue;
+
+			a.swap_rows(found, target);
+			// reduce the new pivot row by the earlier ones, then clear its column in them
+			for (std::size_t j = 0; j < block_pivots.size(); ++j) {
+				if (a.get(target, first + block_pivots[j]))
+					a.xor_row(target, rank + j);
+			}
+			for (std::size_t j = 0; j < block_pivots.size(); ++j) {
+				if (a.get(rank + j, first + bit))
+					a.xor_row(rank + j, target);
+			}
+			block_pivots.push_back(bit);
+			scan_from = target + 1;
+		}
+
+		if (block_pivots.empty())
+			continue;
+
+		// Step 2: table of all combinations of the pivot rows, from the slice's word onwards
+		const std::size_t count = block_pivots.size();
+		pivot_rows.clear();
+		for (std::size_t j = 0; j < count; ++j)
+			pivot_rows.push_back(a[rank + j]);
+		const std::size_t first_word = first / 64;
+		impl::build_m4r_table(pivot_rows, words, first_word, table);
+
+		// Step 3: clear the pivot columns in every other row with one table lookup each
+		parallel_for(0, rows, impl::rows_grain * 4, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t row = begin; row < end; ++row) {
+				if (row >= rank && row < rank + count)
+					continue;
+
+				const unsigned chunk = impl::m4r_chunk(a[row], first);
+				unsigned mask = 0;
+				for (std::size_t j = 0; j < count; ++j) {
+					if (chunk & (1u << block_pivots[j]))
+						mask |= 1u << j;
+				}
+				if (mask != 0)
+					bit_matrix::xor_words(a[row] + first_word, table[mask] + first_word, words - first_word);
+			}
+		});
+
+		for (std::size_t bit : block_pivots)
+			pivots.push_back(first + bit);
+		rank += count;
+	}
+
+	if (pivot_cols != nullptr)
+		*pivot_cols = std::move(pivots);
+	return rank;
+}
+
+inline std::size_t rank(const bit_matrix& a)
+{
+	bit_matrix work = a;
+	return echelonize(work);
+}
+
+// basis of {x : A x = 0}, one vector per row of the result; throws if A has full column rank
+inline bit_matrix nullspace(const bit_matrix& a)
+{
+	bit_matrix work = a;
+	std::vector<std::size_t> pivots;
+	const std::size_t r = echelonize(work, &pivots);
+	const std::size_t cols = a.size().cols;
+	if (r == cols)
+		throw std::domain_error{ "nullspace is trivial" };
+
+	std::vector<bool> is_pivot(cols, false);
+	for (std::size_t col : pivots)
+		is_pivot[col] = true;
+
+	bit_matrix basis(cols - r, cols);
+	std::size_t vec = 0;
+	for (std::size_t free_col = 0; free_col < cols; ++free_col) {
+		if (is_pivot[free_col])
+			continue;
+
+		// x[free_col] = 1, x[pivot_j] = RREF[j][free_col]
+		basis.set(vec, free_col, true);
+		for (std::size_t j = 0; j < r; ++j) {
+			if (work.get(j, free_col))
+				basis.set(vec, pivots[j], true);
+		}
+		++vec;
+	}
+	return basis;
+}
+
+// one solution of A x = b; throws std::domain_error if the system is inconsistent
+inline std::vector<bool> solve(const bit_matrix& a, const std::vector<bool>& b)
+{
+	const auto sz = a.size();
+	if (b.size() != sz.rows)
+		throw std::invalid_argument{ "vector size does not match matrix size" };
+
+	bit_matrix augmented(sz.rows, sz.cols + 1);
+	for (std::size_t i = 0; i < sz.rows; ++i) {
+		std::copy_n(a[i], a.words_per_row(), augmented[i]);
+		if (b[i])
+			augmented.set(i, sz.cols, true);
+	}
+
+	std::vector<std::size_t> pivots;
+	const std::size_t r = echelonize(augmented, &pivots);
+	if (r > 0 && pivots[r - 1] == sz.cols)
+		throw std::domain_error{ "system has no solution" };
+
+	std::vector<bool> x(sz.cols, false);
+	for (std::size_t j = 0; j < r; ++j)
+		x[pivots[j]] = augmented.get(j, sz.cols);
+	return x;
+}
+
+
+#endif // !BIT_MATRIX_HPP
@@ -0,0 +1,519 @@
+#pragma once
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "matrix.hpp"
+#include "dtype.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Incremental checkpoints of a matrix.
+// A checkpoint set is two files: the base (path) holds a full copy, the log (path + ".log") holds
+// the rows changed since. The base is laid out for mapping: a header, a table of per-row checksums,
+// then the rows at a page-aligned offset, each padded to a cache line. Log records carry a
+// generation, the indices, checksums and contents of the changed rows, and checksums of their own.
+// The writer finds changed rows by comparing row checksums with those of the last checkpoint,
+// so the matrix needs no write tracking. Every few checkpoints (or when the log has grown
+// against the base) it compacts: a new base is written to a temp file, synced and renamed over the
+// old one, then the log is cut. Restore maps the base, then replays log records newer than the base
+// up to the first one whose checksums fail, which is where a torn write ends the log.
+struct checkpoint_options {
+	std::size_t full_every = 16;	// incremental checkpoints between two full ones
+	double max_log_ratio = 1.0;		// compact once the log outgrows this fraction of the base
+};
+
+struct checkpoint_stats {
+	std::uint64_t generation = 0;
+	std::size_t rows_written = 0;
+	std::uint64_t bytes_written = 0;
+	bool full = false;
+};
+
+struct restore_stats {
+	std::uint64_t generation = 0;
+	std::size_t records_applied = 0;
+	bool torn_tail = false;		// the log ended in a partial or corrupt record
+};
+
+namespace impl {
+
+	constexpr std::uint64_t checkpoint_magic = 0x45534142544b4331ull;			// base file
+	constexpr std::uint64_t checkpoint_record_magic = 0x474f4c5f544b4331ull;	// log record
+	constexpr std::uint32_t checkpoint_layout_version = 1;
+	constexpr std::uint64_t checkpoint_page = 4096;
+	constexpr std::uint64_t checkpoint_row_alignment = 64;
+
+	// 64-bit checksum in the style of xxHash64: four multiply-rotate lanes over 8-byte words
+	inline std::uint64_t checksum64(const void* data, std::size_t bytes, std::uint64_t seed = 0) noexcept {
+		constexpr std::uint64_t p1 = 0x9E3779B185EBCA87ull;
+		constexpr std::uint64_t p2 = 0xC2B2AE3D27D4EB4Full;
+		constexpr std::uint64_t p3 = 0x165667B19E3779F9ull;
+		auto rotl = [](std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+		auto round = [&](std::uint64_t acc, std::uint64_t word) { return rotl(acc + word * p2, 31) * p1; };
+
+		const auto* p = static_cast<const unsigned char*>(data);
+		std::uint64_t lanes[4] = { seed + p1 + p2, seed + p2, seed, seed - p1 };
+		std::size_t i = 0;
+		for (; i + 32 <= bytes; i += 32) {
+			for (int lane = 0; lane < 4; ++lane) {
+				std::uint64_t word;
+				std::memcpy(&word, p + i + 8 * lane, 8);
+				lanes[lane] = round(lanes[lane], word);
+			}
+		}
+		std::uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18) + bytes;
+		for (; i + 8 <= bytes; i += 8) {
+			std::uint64_t word;
+			std::memcpy(&word, p + i, 8);
+			h = rotl(h ^ round(0, word), 27) * p1 + p3;
+		}
+		for (; i < bytes; ++i)
+			h = rotl(h ^ (p[i] * p3), 11) * p1;
+
+		h ^= h >> 33;
+		h *= p2;
+		h ^= h >> 29;
+		h *= p3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	struct checkpoint_header {
+		std::uint64_t magic;
+		std::uint32_t layout_version;
+		dtype type;
+		std::uint32_t element_size;
+		std::uint32_t reserved;
+		std::uint64_t rows;
+		std::uint64_t cols;
+		std::uint64_t row_stride;
+		std::uint64_t checksums_offset;
+		std::uint64_t data_offset;
+		std::uint64_t generation;
+		std::uint64_t header_checksum;	// of all fields above
+	};
+
+	struct checkpoint_record_header {
+		std::uint64_t magic;
+		std::uint64_t generation;
+		std::uint64_t row_count;
+		std::uint64_t payload_checksum;	// of the (index, checksum) pairs and the rows
+		std::uint64_t header_checksum;	// of the fields above
+	};
+
+	template<typename H>
+	std::uint64_t header_checksum(const H& h) noexcept {
+		return checksum64(&h, sizeof(H) - sizeof(std::uint64_t));
+	}
+
+	inline bool skip_bytes(std::FILE* file, std::uint64_t bytes) {
+#if defined(_MSC_VER)
+		return _fseeki64(file, static_cast<__int64>(bytes), SEEK_CUR) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(bytes), SEEK_CUR) == 0;
+#endif
+	}
+
+	// newest generation named by an existing checkpoint set (its base and intact log headers), 0 if none
+	inline std::uint64_t checkpoint_generation(const std::string& path) {
+		std::uint64_t generation = 0;
+		if (std::FILE* base = std::fopen(path.c_str(), "rb")) {
+			checkpoint_header header{};
+			if (std::fread(&header, sizeof(header), 1, base) == 1 && header.magic == checkpoint_magic
+				&& header.header_checksum == header_checksum(header))
+				generation = header.generation;
+			std::fclose(base);
+			if (generation == 0)
+				return 0;
+
+			if (std::FILE* log = std::fopen((path + ".log").c_str(), "rb")) {
+				const std::uint64_t row_bytes = header.cols * header.element_size;
+				checkpoint_record_header record{};
+				while (std::fread(&record, sizeof(record), 1, log) == 1 && record.magic == checkpoint_record_magic
+					&& record.header_checksum == header_checksum(record)) {
+					generation = std::max(generation, record.generation);
+					if (!skip_bytes(log, record.row_count * (2 * sizeof(std::uint64_t) + row_bytes)))
+						break;
+				}
+				std::fclose(log);
+			}
+		}
+		return generation;
+	}
+
+	inline void write_bytes(std::FILE* file, const void* data, std::size_t bytes) {
+		if (bytes != 0 && std::fwrite(data, 1, bytes, file) != bytes)
+			throw std::runtime_error{ "checkpoint write failed" };
+	}
+
+	inline bool read_bytes(std::FILE* file, void* data, std::size_t bytes) {
+		return bytes == 0 || std::fread(data, 1, bytes, file) == bytes;
+	}
+
+	// flushes and waits until the data is on stable storage
+	inline void sync_file(std::FILE* file) {
+		if (std::fflush(file) != 0)
+			throw std::runtime_error{ "checkpoint write failed" };
+#if defined(_WIN32)
+		const int failed = _commit(_fileno(file));
+#else
+		const int failed = ::fsync(fileno(file));
+#endif
+		if (failed != 0)
+			throw std::runtime_error{ "checkpoint sync failed" };
+	}
+
+	// makes a rename in the directory of path durable; a no-op on Windows, which has no directory fsync
+	inline void sync_directory(const std::string& path) {
+#if !defined(_WIN32)
+		std::string dir = std::filesystem::path(path).parent_path().string();
+		if (dir.empty())
+			dir = ".";
+		const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			throw std::runtime_error{ "cannot open checkpoint directory " + dir };
+		const int failed = ::fsync(fd);
+		::close(fd);
+		if (failed != 0)
+			throw std::runtime_error{ "checkpoint sync failed" };
+#else
+		(void)path;
+#endif
+	}
+
+	struct file_closer {
+		void operator()(std::FILE* file) const noexcept { std::fclose(file); }
+	};
+	using file_handle = std::unique_ptr<std::FILE, file_closer>;
+
+	inline file_handle open_file(const std::string& path, const char* mode) {
+		file_handle file(std::fopen(path.c_str(), mode));
+		if (!file)
+			throw std::runtime_error{ "cannot open checkpoint file " + path };
+		return file;
+	}
+}
+
+template<class T>
+class checkpoint_writer {
+public:
+	using size_type = std::size_t;
+
+	static_assert(std::is_trivially_copyable_v<T>, "checkpoints store raw row bytes");
+
+	// checkpoints of m under path; m must stay alive and keep its size while the writer is used.
+	// The first checkpoint is a full one and replaces whatever checkpoint set was at path;
+	// generations continue from that set so none of its records can be replayed over the new base.
+	template<class A>
+	explicit checkpoint_writer(const std::string& path, const matrix<T, A>& m, checkpoint_options options = {})
+		: path_(path), options_(options), sz_(m.size()), rows_(m.data()), checksums_(m.size().rows)
+		, generation_(impl::checkpoint_generation(path))
+	{
+		if (sz_.rows == 0 || sz_.cols == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+	}
+
+	const std::string& path() const noexcept { return path_; }
+	std::string log_path() const { return path_ + ".log"; }
+	std::uint64_t generation() const noexcept { return generation_; }
+
+	// writes the rows changed since the last checkpoint, or everything when compaction is due
+	checkpoint_stats checkpoint()
+	{
+		if (!log_ || incremental_since_full_ >= options_.full_every
+			|| static_cast<double>(log_bytes_) > options_.max_log_ratio * static_cast<double>(base_bytes()))
+			return compact();
+
+		std::vector<std::uint64_t> entries;	// (index, checksum) pairs
+		for (size_type i = 0; i < sz_.rows; ++i) {
+			const std::uint64_t sum = impl::checksum64(rows_[i], row_bytes());
+			if (sum != checksums_[i]) {
+				entries.push_back(i);
+				entries.push_back(sum);
+			}
+		}
+
+		checkpoint_stats stats;
+		stats.generation = ++generation_;
+		stats.rows_written = entries.size() / 2;
+
+		impl::checkpoint_record_header header{};
+		header.magic = impl::checkpoint_record_magic;
+		header.generation = generation_;
+		header.row_count = stats.rows_written;
+		std::uint64_t payload = impl::checksum64(entries.data(), entries.size() * sizeof(std::uint64_t));
+		for (size_type e = 0; e < entries.size(); e += 2)
+			payload = impl::checksum64(rows_[entries[e]], row_bytes(), payload);
+		header.payload_checksum = payload;
+		header.header_checksum = impl::header_checksum(header);
+
+		// a torn record would hide every record appended after it, so a failed append drops the log
+		// and the next checkpoint starts over with a full base
+		std::FILE* log = log_.get();
+		try {
+			impl::write_bytes(log, &header, sizeof(header));
+			impl::write_bytes(log, entries.data(), entries.size() * sizeof(std::uint64_t));
+			for (size_type e = 0; e < entries.size(); e += 2)
+				impl::write_bytes(log, rows_[entries[e]], row_bytes());
+			impl::sync_file(log);
+		}
+		catch (...) {
+			log_.reset();
+			throw;
+		}
+
+		// only a durable record moves the comparison point
+		for (size_type e = 0; e < entries.size(); e += 2)
+			checksums_[entries[e]] = entries[e + 1];
+
+		stats.bytes_written = sizeof(header) + entries.size() * sizeof(std::uint64_t) + stats.rows_written * row_bytes();
+		log_bytes_ += stats.bytes_written;
+		++incremental_since_full_;
+		return stats;
+	}
+
+	// writes a full base and empties the log
+	checkpoint_stats compact()
+	{
+		checkpoint_stats stats;
+		stats.generation = ++generation_;
+		stats.rows_written = sz_.rows;
+		stats.full = true;
+
+		impl::checkpoint_header header{};
+		header.magic = impl::checkpoint_magic;
+		header.layout_version = impl::checkpoint_layout_version;
+		header.type = impl::dtype_of<T>();
+		header.element_size = sizeof(T);
+		header.rows = sz_.rows;
+		header.cols = sz_.cols;
+		header.row_stride = row_stride();
+		header.checksums_offset = sizeof(header);
+		header.data_offset = data_offset();
+		header.generation = generation_;
+		header.header_checksum = impl::header_checksum(header);
+
+		std::vector<std::uint64_t> sums(sz_.rows);
+		for (size_type i = 0; i < sz_.rows; ++i)
+			sums[i] = impl::checksum64(rows_[i], row_bytes());
+
+		// a torn base never replaces a good one: write aside, sync, then rename
+		const std::string temp = path_ + ".tmp";
+		{
+			impl::file_handle file = impl::open_file(temp, "wb");
+			impl::write_bytes(file.get(), &header, sizeof(header));
+			impl::write_bytes(file.get(), sums.data(), sums.size() * sizeof(std::uint64_t));
+			const std::vector<unsigned char> padding(static_cast<std::size_t>(std::max<std::uint64_t>(impl::checkpoint_page, row_stride() - row_bytes())), 0);
+			impl::write_bytes(file.get(), padding.data(), static_cast<std::size_t>(header.data_offset - sizeof(header) - sums.size() * sizeof(std::uint64_t)));
+			for (size_type i = 0; i < sz_.rows; ++i) {
+				impl::write_bytes(file.get(), rows_[i], row_bytes());
+				impl::write_bytes(file.get(), padding.data(), static_cast<std::size_t>(row_stride() - row_bytes()));
+			}
+			impl::sync_file(file.get());
+		}
+		std::filesystem::rename(temp, path_);
+		// the log is only emptied once the new base is sure to survive a crash
+		impl::sync_directory(path_);
+
+		// records up to this generation are now in the base; restore skips them even if the cut is lost
+		log_.reset();
+		log_ = impl::open_file(log_path(), "wb");
+		impl::sync_file(log_.get());
+
+		checksums_ = std::move(sums);
+		stats.bytes_written = base_bytes();
+		log_bytes_ = 0;
+		incremental_since_full_ = 0;
+		return stats;
+	}
+
+private:
+	std::uint64_t row_bytes() const noexcept { return sz_.cols * sizeof(T); }
+	std::uint64_t row_stride() const noexcept
+	{
+		return (row_bytes() + impl::checkpoint_row_alignment - 1) / impl::checkpoint_row_alignment * impl::checkpoint_row_alignment;
+	}
+	std::uint64_t data_offset() const noexcept
+	{
+		const std::uint64_t end = sizeof(impl::checkpoint_header) + sz_.rows * sizeof(std::uint64_t);
+		return (end + impl::checkpoint_page - 1) / impl::checkpoint_page * impl::checkpoint_page;
+	}
+	std::uint64_t base_bytes() const noexcept { return data_offset() + sz_.rows * row_stride(); }
+
+	std::string path_;
+	checkpoint_options options_;
+	matrix_size_type sz_;
+	const T* const* rows_;
+	std::vector<std::uint64_t> checksums_;	// of the rows as of the last checkpoint
+	impl::file_handle log_;
+	std::uint64_t log_bytes_ = 0;
+	std::uint64_t generation_ = 0;
+	std::size_t incremental_since_full_ = 0;
+};
+
+namespace impl {
+
+	// read-only view of a whole file: mapped where possible, read into memory otherwise
+	class mapped_file {
+	public:
+		explicit mapped_file(const std::string& path)
+		{
+#if defined(_WIN32)
+			file_handle file = open_file(path, "rb");
+			_fseeki64(file.get(), 0, SEEK_END);
+			const auto size = _ftelli64(file.get());
+			_fseeki64(file.get(), 0, SEEK_SET);
+			copy_.resize(static_cast<std::size_t>(size));
+			if (!read_bytes(file.get(), copy_.data(), copy_.size()))
+				throw std::runtime_error{ "checkpoint read failed" };
+			data_ = copy_.data();
+			size_ = copy_.size();
+#else
+			const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+				throw std::runtime_error{ "cannot open checkpoint file " + path };
+			struct stat st {};
+			if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+				::close(fd);
+				throw std::runtime_error{ "checkpoint is corrupt" };
+			}
+			size_ = static_cast<std::size_t>(st.st_size);
+			void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (p == MAP_FAILED)
+				throw std::runtime_error{ "cannot map checkpoint file " + path };
+			::madvise(p, size_, MADV_SEQUENTIAL);
+			data_ = static_cast<const unsigned char*>(p);
+#endif
+		}
+
+		~mapped_file()
+		{
+#if !defined(_WIN32)
+			::munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+		}
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		const unsigned char* data() const noexcept { return data_; }
+		std::size_t size() const noexcept { return size_; }
+
+	private:
+		const unsigned char* data_ = nullptr;
+		std::size_t size_ = 0;
+#if defined(_WIN32)
+		std::vector<unsigned char> copy_;
+#endif
+	};
+}
+
+// matrix as of the last durable checkpoint under path; throws std::runtime_error if the base is damaged
+template<class T, class A = std::allocator<T>>
+matrix<T, A> restore_checkpoint(const std::string& path, restore_stats* stats = nullptr)
+{
+	restore_stats result_stats;
+	const impl::mapped_file base(path);
+	impl::checkpoint_header header{};
+	if (base.size() < sizeof(header))
+		throw std::runtime_error{ "checkpoint is corrupt" };
+	std::memcpy(&header, base.data(), sizeof(header));
+	if (header.magic != impl::checkpoint_magic || header.header_checksum != impl::header_checksum(header)
+		|| header.layout_version != impl::checkpoint_layout_version)
+		throw std::runtime_error{ "checkpoint is corrupt" };
+	if (header.type != impl::dtype_of<T>() || header.element_size != sizeof(T))
+		throw std::invalid_argument{ "checkpoint element type does not match" };
+	if (header.rows == 0 || header.cols == 0 || header.data_offset + header.rows * header.row_stride > base.size()
+		|| header.checksums_offset + header.rows * sizeof(std::uint64_t) > header.data_offset)
+		throw std::runtime_error{ "checkpoint is corrupt" };
+
+	const auto rows = static_cast<std::size_t>(header.rows);
+	const auto cols = static_cast<std::size_t>(header.cols);
+	const std::size_t row_bytes = cols * sizeof(T);
+	matrix<T, A> result(rows, cols);
+	for (std::size_t i = 0; i < rows; ++i) {
+		std::uint64_t expected;
+		std::memcpy(&expected, base.data() + header.checksums_offset + i * sizeof(std::uint64_t), sizeof(expected));
+		const unsigned char* row = base.data() + header.data_offset + i * header.row_stride;
+		if (impl::checksum64(row, row_bytes) != expected)
+			throw std::runtime_error{ "checkpoint is corrupt" };
+		std::memcpy(result[i], row, row_bytes);
+	}
+	result_stats.generation = header.generation;
+
+	std::FILE* raw_log = std::fopen((path + ".log").c_str(), "rb");
+	if (raw_log != nullptr) {
+		const impl::file_handle log(raw_log);
+		std::vector<std::uint64_t> entries;
+		std::vector<unsigned char> payload;
+		for (;;) {
+			impl::checkpoint_record_header record{};
+			const std::size_t got = std::fread(&record, 1, sizeof(record), log.get());
+			if (got == 0 && std::feof(log.get()))
+				break;
+			if (got != sizeof(record)) {
+				result_stats.torn_tail = true;
+				break;
+			}
+			if (record.magic != impl::checkpoint_record_magic || record.header_checksum != impl::header_checksum(record)
+				|| record.row_count > rows) {
+				result_stats.torn_tail = true;
+				break;
+			}
+
+			const auto count = static_cast<std::size_t>(record.row_count);
+			entries.resize(2 * count);
+			payload.resize(count * row_bytes);
+			if (!impl::read_bytes(log.get(), entries.data(), entries.size() * sizeof(std::uint64_t))
+				|| !impl::read_bytes(log.get(), payload.data(), payload.size())) {
+				result_stats.torn_tail = true;
+				break;
+			}
+			std::uint64_t sum = impl::checksum64(entries.data(), entries.size() * sizeof(std::uint64_t));
+			for (std::size_t r = 0; r < count; ++r)
+				sum = impl::checksum64(payload.data() + r * row_bytes, row_bytes, sum);
+			bool valid = sum == record.payload_checksum;
+			for (std::size_t r = 0; valid && r < count; ++r)
+				valid = entries[2 * r] < rows;
+			if (!valid) {
+				result_stats.torn_tail = true;
+				break;
+			}
+
+			// records already folded into the base are left from a compaction cut short
+			if (record.generation <= result_stats.generation)
+				continue;
+			for (std::size_t r = 0; r < count; ++r)
+				std::memcpy(result[static_cast<std::size_t>(entries[2 * r])], payload.data() + r * row_bytes, row_bytes);
+			result_stats.generation = record.generation;
+			++result_stats.records_applied;
+		}
+	}
+
+	if (stats != nullptr)
+		*stats = result_stats;
+	return result;
+}
+
+
+#endif // !CHECKPOINT_HPP
@@ -0,0 +1,297 @@
+#pragma once
+#ifndef COMPLEX_MATRIX_HPP
+#define COMPLEX_MATRIX_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+#include "products.hpp"
+
+#include <complex>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+
+// Complex matrices come in two layouts:
+//  - interleaved: matrix<std::complex<T>>, re/im pairs next to each other (the default layout);
+//  - planar: planar_complex_matrix<T>, separate real and imaginary matrix<T>,
+//    which turns complex kernels into plain real ones.
+namespace impl {
+
+	// out[j] = a[j] * b[j] for interleaved complex rows
+	template<typename T>
+	void complex_multiply_row(const std::complex<T>* a, const std::complex<T>* b, std::complex<T>* out, std::size_t n) noexcept {
+		std::size_t j = 0;
+#if defined(__AVX__)
+		// std::complex<T> is layout-compatible with T[2]
+		if constexpr (std::is_same_v<T, double>) {
+			const double* pa = reinterpret_cast<const double*>(a);
+			const double* pb = reinterpret_cast<const double*>(b);
+			double* po = reinterpret_cast<double*>(out);
+			for (; j + 2 <= n; j += 2) {
+				const __m256d va = _mm256_loadu_pd(pa + 2 * j);
+				const __m256d vb = _mm256_loadu_pd(pb + 2 * j);
+				const __m256d b_re = _mm256_movedup_pd(vb);          // br br
+				const __m256d b_im = _mm256_permute_pd(vb, 0xF);     // bi bi
+				const __m256d a_swap = _mm256_permute_pd(va, 0x5);   // ai ar
+				// (ar*br - ai*bi, ai*br + ar*bi)
+				_mm256_storeu_pd(po + 2 * j, _mm256_addsub_pd(_mm256_mul_pd(va, b_re), _mm256_mul_pd(a_swap, b_im)));
+			}
+		}
+		else if constexpr (std::is_same_v<T, float>) {
+			const float* pa = reinterpret_cast<const float*>(a);
+			const float* pb = reinterpret_cast<const float*>(b);
+			float* po = reinterpret_cast<float*>(out);
+			for (; j + 4 <= n; j += 4) {
+				const __m256 va = _mm256_loadu_ps(pa + 2 * j);
+				const __m256 vb = _mm256_loadu_ps(pb + 2 * j);
+				const __m256 b_re = _mm256_moveldup_ps(vb);
+				const __m256 b_im = _mm256_movehdup_ps(vb);
+				const __m256 a_swap = _mm256_permute_ps(va, 0xB1);
+				_mm256_storeu_ps(po + 2 * j, _mm256_addsub_ps(_mm256_mul_ps(va, b_re), _mm256_mul_ps(a_swap, b_im)));
+			}
+		}
+#endif
+		for (; j < n; ++j) {
+			const T ar = a[j].real();
+			const T ai = a[j].imag();
+			const T br = b[j].real();
+			const T bi = b[j].imag();
+			out[j] = std::complex<T>(ar * br - ai * bi, ai * br + ar * bi);
+		}
+	}
+}
+
+template<class T, class Allocator = std::allocator<T>>
+class planar_complex_matrix {
+public:
+	using value_type = std::complex<T>;
+	using size_type = std::size_t;
+
+	static_assert(std::is_floating_point_v<T>, "planar_complex_matrix requires floating point parts");
+
+	explicit planar_complex_matrix() = default;
+	explicit planar_complex_matrix(size_type rows, size_type cols) : re_(rows, cols, T()), im_(rows, cols, T()) {}
+	explicit planar_complex_matrix(matrix<T, Allocator> re, matrix<T, Allocator> im) : re_(std::move(re)), im_(std::move(im))
+	{
+		if (re_.size().rows != im_.size().rows || re_.size().cols != im_.size().cols)
+			throw std::invalid_argument{ "matrix sizes do not match" };
+	}
+
+	// splits an interleaved matrix
+	template<class CA>
+	explicit planar_complex_matrix(const matrix<std::complex<T>, CA>& mtx) : re_(mtx.size().rows, mtx.size().cols), im_(mtx.size().rows, mtx.size().cols)
+	{
+		const auto sz = mtx.size();
+		parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				const std::complex<T>* src = mtx[i];
+				T* re = re_[i];
+				T* im = im_[i];
+				for (std::size_t j = 0; j < sz.cols; ++j) {
+					re[j] = src[j].real();
+					im[j] = src[j].imag();
+				}
+			}
+		});
+	}
+
+	matrix<T, Allocator>& real() noexcept { return re_; }
+	const matrix<T, Allocator>& real() const noexcept { return re_; }
+	matrix<T, Allocator>& imag() noexcept { return im_; }
+	const matrix<T, Allocator>& imag() const noexcept { return im_; }
+
+	std::complex<T> operator()(size_type row, size_type col) const { return std::complex<T>(re_(row, col), im_(row, col)); }
+	void set(size_type row, size_type col, const std::complex<T>& value)
+	{
+		re_(row, col) = value.real();
+		im_(row, col) = value.imag();
+	}
+
+	bool empty() const noexcept { return re_.empty(); }
+	matrix_size_type size() const noexcept { return re_.size(); }
+
+	// joins back into the interleaved layout
+	matrix<std::complex<T>> to_interleaved() const
+	{
+		const auto sz = size();
+		matrix<std::complex<T>> result(sz.rows, sz.cols);
+		parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				const T* re = re_[i];
+				const T* im = im_[i];
+				std::complex<T>* dst = result[i];
+				for (std::size_t j = 0; j < sz.cols; ++j)
+					dst[j] = std::complex<T>(re[j], im[j]);
+			}
+		});
+		return result;
+	}
+
+	void swap(planar_complex_matrix& other) noexcept
+	{
+		re_.swap(other.re_);
+		im_.swap(other.im_);
+	}
+
+private:
+	matrix<T, Allocator> re_;
+	matrix<T, Allocator> im_;
+};
+
+// C = A * B with three real products instead of four (3M method):
+// T1 = Ar Br, T2 = Ai Bi, T3 = (Ar + Ai)(Br + Bi); Cr = T1 - T2, Ci = T3 - T1 - T2
+template<class T, class A>
+planar_complex_matrix<T, A> gemm_3m(const planar_complex_matrix<T, A>& a, const planar_complex_matrix<T, A>& b)
+{
+	const auto a_sz = a.size();
+	const auto b_sz = b.size();
+	if (a_sz.cols != b_sz.rows)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	auto sum_parts = [](const planar_complex_matrix<T, A>& m) {
+		matrix<T, A> sum = m.real();
+		for (std::size_t i = 0; i < m.size().rows; ++i)
+			impl::axpy_row(T(1), m.imag()[i], sum[i], m.size().cols);
+		return sum;
+	};
+
+	matrix<T, A> t1(a_sz.rows, b_sz.cols);
+	matrix<T, A> t2(a_sz.rows, b_sz.cols);
+	matrix<T, A> t3(a_sz.rows, b_sz.cols);
+	gemm(T(1), a.real(), b.real(), T(), t1);
+	gemm(T(1), a.imag(), b.imag(), T(), t2);
+	gemm(T(1), sum_parts(a), sum_parts(b), T(), t3);
+
+	// t3 becomes the imaginary part and t1 the real one, in place
+	parallel_for(0, a_sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			T* r1 = t1[i];
+			const T* r2 = t2[i];
+			T* r3 = t3[i];
+			for (std::size_t j = 0; j < b_sz.cols; ++j) {
+				r3[j] -= r1[j] + r2[j];
+				r1[j] -= r2[j];
+			}
+		}
+	});
+	return planar_complex_matrix<T, A>(std::move(t1), std::move(t3));
+}
+
+// interleaved operands are split, multiplied by the 3M method and joined: O(n^2) extra work for O(n^3)
+template<class T, class A>
+matrix<std::complex<T>> gemm_3m(const matrix<std::complex<T>, A>& a, const matrix<std::complex<T>, A>& b)
+{
+	return gemm_3m(planar_complex_matrix<T>(a), planar_complex_matrix<T>(b)).to_interleaved();
+}
+
+// Lazy conjugate transpose A^H of an interleaved matrix; holds a reference to it.
+template<class T, class A = std::allocator<std::complex<T>>>
+class adjoint_view {
+public:
+	explicit adjoint_view(const matrix<std::complex<T>, A>& mtx) : mtx_{ mtx } {}
+
+	matrix_size_type size() const noexcept { return matrix_size_type{ mtx_.size().cols, mtx_.size().rows }; }
+
+	std::complex<T> operator()(std::size_t row, std::size_t col) const { return std::conj(mtx_(col, row)); }
+
+	matrix<std::complex<T>, A> to_matrix() const
+	{
+		matrix<std::complex<T>, A> result(mtx_.size().cols, mtx_.size().rows);
+		impl::transpose_into(mtx_, result);
+		const auto sz = result.size();
+		parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				T* parts = reinterpret_cast<T*>(result[i]);
+				for (std::size_t j = 1; j < 2 * sz.cols; j += 2)
+					parts[j] = -parts[j];
+			}
+		});
+		return result;
+	}
+
+private:
+	const matrix<std::complex<T>, A>& mtx_;
+};
+
+template<class T, class A>
+adjoint_view<T, A> adjoint(const matrix<std::complex<T>, A>& mtx)
+{
+	return adjoint_view<T, A>(mtx);
+}
+
+// the view would outlive a temporary matrix
+template<class T, class A>
+void adjoint(matrix<std::complex<T>, A>&& mtx) = delete;
+
+// planar adjoint: transpose both parts and negate the imaginary one
+template<class T, class A>
+planar_complex_matrix<T, A> adjoint(const planar_complex_matrix<T, A>& mtx)
+{
+	matrix<T, A> re = transpose(mtx.real());
+	matrix<T, A> im = transpose(mtx.imag());
+	for (std::size_t i = 0; i < im.size().rows; ++i)
+		impl::scale_row(T(-1), im[i], im.size().cols);
+	return planar_complex_matrix<T, A>(std::move(re), std::move(im));
+}
+
+// element-wise products with the SIMD complex multiply
+template<class T, class A>
+matrix<std::complex<T>, A> hadamard(const matrix<std::complex<T>, A>& a, const matrix<std::complex<T>, A>& b)
+{
+	const auto sz = a.size();
+	if (sz.rows != b.size().rows || sz.cols != b.size().cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	matrix<std::complex<T>, A> result(sz.rows, sz.cols);
+	parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i)
+			impl::complex_multiply_row(a[i], b[i], result[i], sz.cols);
+	});
+	return result;
+}
+
+template<class T, class A>
+void hadamard_assign(matrix<std::complex<T>, A>& a, const matrix<std::complex<T>, A>& b)
+{
+	const auto sz = a.size();
+	if (sz.rows != b.size().rows || sz.cols != b.size().cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i)
+			impl::complex_multiply_row(a[i], b[i], a[i], sz.cols);
+	});
+}
+
+template<class T, class A>
+planar_complex_matrix<T, A> hadamard(const planar_complex_matrix<T, A>& a, const planar_complex_matrix<T, A>& b)
+{
+	const auto sz = a.size();
+	if (sz.rows != b.size().rows || sz.cols != b.size().cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	planar_complex_matrix<T, A> result(sz.rows, sz.cols);
+	parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			const T* ar = a.real()[i];
+			const T* ai = a.imag()[i];
+			const T* br = b.real()[i];
+			const T* bi = b.imag()[i];
+			T* cr = result.real()[i];
+			T* ci = result.imag()[i];
+			for (std::size_t j = 0; j < sz.cols; ++j) {
+				cr[j] = ar[j] * br[j] - ai[j] * bi[j];
+				ci[j] = ai[j] * br[j] + ar[j] * bi[j];
+			}
+		}
+	});
+	return result;
+}
+
+
+#endif // !COMPLEX_MATRIX_HPP
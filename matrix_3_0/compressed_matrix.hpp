@@ -0,0 +1,364 @@
+#pragma once
+#ifndef COMPRESSED_MATRIX_HPP
+#define COMPRESSED_MATRIX_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Read-only compressed copy of a matrix.
+// Every coded row is stored as value_j = offset + scale * code_j with unsigned codes packed at a fixed
+// bit width: int8 / int4 quantization (scale and zero point, offset = -zero_point * scale) for floating
+// point data, and frame of reference (offset = row minimum, scale = 1, codes as narrow as the row's range)
+// for integer valued data, which is lossless. Rows that fit no codec are kept raw.
+// The codec is chosen per block of rows; products decode on the fly and never expand a row:
+// dot(row, x) = offset * sum(x) + scale * sum(code_j * x_j).
+enum class row_codec { automatic, raw, int8, int4, frame_of_reference };
+
+template<class T, class Allocator = std::allocator<T>>
+class compressed_matrix {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+
+	static_assert(std::is_arithmetic_v<T>, "compressed_matrix requires an arithmetic type");
+
+	// tolerance is the largest absolute error allowed for lossy codecs; automatic picks, block by block,
+	// the smallest codec that meets it. Integral types accept lossless codecs only.
+	template<class A>
+	explicit compressed_matrix(const matrix<T, A>& a, row_codec codec = row_codec::automatic,
+		T tolerance = T(), size_type block_rows = 64)
+		: sz_{ a.size() }, block_rows_{ block_rows }, rows_(a.size().rows)
+	{
+		if (block_rows == 0)
+			throw std::invalid_argument{ "block rows count must be greater than zero" };
+		if (std::is_integral_v<T> && (codec == row_codec::int8 || codec == row_codec::int4))
+			throw std::invalid_argument{ "integral matrices support lossless codecs only" };
+
+		blocks_.resize((sz_.rows + block_rows - 1) / block_rows);
+		parallel_for(0, blocks_.size(), 1, [&](size_type first, size_type last) {
+			for (size_type b = first; b < last; ++b)
+				encode_block(a, b, codec, tolerance);
+		});
+	}
+
+	matrix_size_type size() const noexcept { return sz_; }
+
+	row_codec codec_of_row(size_type row) const
+	{
+		check_row(row);
+		return blocks_[row / block_rows_].codec;
+	}
+
+	// bytes held by codes, raw rows and per-row parameters
+	size_type stored_bytes() const noexcept
+	{
+		size_type bytes = rows_.size() * sizeof(row_params);
+		for (const auto& block : blocks_)
+			bytes += block.codes.size() + block.raw.size() * sizeof(T);
+		return bytes;
+	}
+
+	// raw bytes per stored byte, 1 for an empty matrix
+	double compression_ratio() const noexcept
+	{
+		if (stored_bytes() == 0)
+			return 1.0;
+		return static_cast<double>(sz_.rows * sz_.cols * sizeof(T)) / static_cast<double>(stored_bytes());
+	}
+
+	T operator()(size_type row, size_type col) const
+	{
+		check_row(row);
+		if (col >= sz_.cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+
+		const row_params& p = rows_[row];
+		const block& blk = blocks_[row / block_rows_];
+		if (blk.codec == row_codec::raw)
+			return blk.raw[p.start + col];
+		return static_cast<T>(p.offset + p.scale * static_cast<T>(code_at(blk.codes.data() + p.start, p.bits, col)));
+	}
+
+	// writes the decoded row into out (cols elements)
+	void decode_row(size_type row, T* out) const
+	{
+		check_row(row);
+		const row_params& p = rows_[row];
+		const block& blk = blocks_[row / block_rows_];
+		if (blk.codec == row_codec::raw) {
+			std::copy_n(blk.raw.data() + p.start, sz_.cols, out);
+			return;
+		}
+		const std::uint8_t* codes = blk.codes.data() + p.start;
+		for (size_type j = 0; j < sz_.cols; ++j)
+			out[j] = static_cast<T>(p.offset + p.scale * static_cast<T>(code_at(codes, p.bits, j)));
+	}
+
+	template<class A = Allocator>
+	matrix<T, A> to_matrix() const
+	{
+		matrix<T, A> result(sz_.rows, sz_.cols);
+		parallel_for(0, sz_.rows, impl::rows_grain, [&](size_type first, size_type last) {
+			for (size_type i = first; i < last; ++i)
+				decode_row(i, result[i]);
+		});
+		return result;
+	}
+
+	// row . x decoded on the fly; x_sum must be the sum of x (shared by all rows of a product)
+	T dot(size_type row, const T* x, T x_sum) const noexcept
+	{
+		const row_params& p = rows_[row];
+		const block& blk = blocks_[row / block_rows_];
+		if (blk.codec == row_codec::raw)
+			return impl::dot_row(blk.raw.data() + p.start, x, sz_.cols);
+
+		const std::uint8_t* codes = blk.codes.data() + p.start;
+		const size_type n = sz_.cols;
+		T sum = T();
+		if (p.bits == 8) {
+			for (size_type j = 0; j < n; ++j)
+				sum += static_cast<T>(codes[j]) * x[j];
+		}
+		else if (p.bits == 4) {
+			const size_type pairs = n / 2;
+			for (size_type j = 0; j < pairs; ++j) {
+				sum += static_cast<T>(codes[j] & 0x0Fu) * x[2 * j];
+				sum += static_cast<T>(codes[j] >> 4) * x[2 * j + 1];
+			}
+			if (n % 2 != 0)
+				sum += static_cast<T>(codes[pairs] & 0x0Fu) * x[n - 1];
+		}
+		else if (p.bits != 0) {
+			for (size_type j = 0; j < n; ++j)
+				sum += static_cast<T>(code_at(codes, p.bits, j)) * x[j];
+		}
+		return p.offset * x_sum + p.scale * sum;
+	}
+
+private:
+	struct row_params {
+		T offset = T();
+		T scale = T(1);
+		std::uint32_t bits = 0;
+		size_type start = 0;   // first byte in codes, or first element in raw
+	};
+
+	struct block {
+		row_codec codec = row_codec::raw;
+		std::vector<std::uint8_t> codes;
+		std::vector<T> raw;
+	};
+
+	// codes are read as unaligned 64-bit loads, so code buffers carry this many bytes of padding
+	static constexpr size_type code_padding = sizeof(std::uint64_t);
+
+	static std::uint64_t code_at(const std::uint8_t* codes, std::uint32_t bits, size_type index) noexcept
+	{
+		if (bits == 0)
+			return 0;
+		const size_type bit = index * bits;
+		std::uint64_t word;
+		std::memcpy(&word, codes + bit / 8, sizeof(word));
+		return (word >> (bit % 8)) & ((std::uint64_t{ 1 } << bits) - 1);
+	}
+
+	static void put_code(std::uint8_t* codes, std::uint32_t bits, size_type index, std::uint64_t code) noexcept
+	{
+		const size_type bit = index * bits;
+		std::uint64_t word;
+		std::memcpy(&word, codes + bit / 8, sizeof(word));
+		word |= code << (bit % 8);
+		std::memcpy(codes + bit / 8, &word, sizeof(word));
+	}
+
+	static size_type code_bytes(size_type cols, std::uint32_t bits) noexcept { return (cols * bits + 7) / 8; }
+
+	void check_row(size_type row) const
+	{
+		if (row >= sz_.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+	}
+
+	// frame of reference: codes are value - min at the width of the row's range; only for integer
+	// valued rows whose range fits 32 bits. Returns false if the row does not qualify.
+	static bool frame_of_reference_params(const T* row, size_type cols, row_params& p)
+	{
+		const auto [lo, hi] = std::minmax_element(row, row + cols);
+		std::uint64_t range;
+		if constexpr (std::is_floating_point_v<T>) {
+			for (size_type j = 0; j < cols; ++j) {
+				if (row[j] != std::trunc(row[j]))
+					return false;
+			}
+			if (!(*hi - *lo < T(4294967296.0)))
+				return false;
+			range = static_cast<std::uint64_t>(*hi - *lo);
+		}
+		else {
+			// the difference is exact in the unsigned type; codes must also fit T itself
+			using unsigned_type = std::make_unsigned_t<T>;
+			range = static_cast<unsigned_type>(static_cast<unsigned_type>(*hi) - static_cast<unsigned_type>(*lo));
+			if (range > 0xFFFFFFFFull || range > static_cast<std::uint64_t>(std::numeric_limits<T>::max()))
+				return false;
+		}
+
+		std::uint32_t bits = 0;
+		while (bits < 32 && (range >> bits) != 0)
+			++bits;
+		p.offset = *lo;
+		p.scale = T(1);
+		p.bits = bits;
+		return true;
+	}
+
+	// asymmetric quantization to 2^bits levels with zero exactly representable;
+	// returns the largest absolute error of the row
+	static T quantize(const T* row, size_type cols, std::uint32_t bits, row_params& p, std::uint8_t* codes)
+	{
+		const auto [lo_it, hi_it] = std::minmax_element(row, row + cols);
+		const T lo = std::min(*lo_it, T());
+		const T hi = std::max(*hi_it, T());
+		const T levels = static_cast<T>((1u << bits) - 1);
+		T scale = (hi - lo) / levels;
+		if (!(scale > T()))
+			scale = T(1);
+		const T zero_point = std::min(levels, std::max(T(), std::round(-lo / scale)));
+
+		p.scale = scale;
+		p.offset = -zero_point * scale;
+		p.bits = bits;
+
+		T error = T();
+		for (size_type j = 0; j < cols; ++j) {
+			const T code = std::min(levels, std::max(T(), std::round(row[j] / scale) + zero_point));
+			if (codes != nullptr)
+				put_code(codes, bits, j, static_cast<std::uint64_t>(code));
+			error = std::max(error, std::abs(p.offset + scale * code - row[j]));
+		}
+		return error;
+	}
+
+	template<class A>
+	void encode_block(const matrix<T, A>& a, size_type b, row_codec requested, T tolerance)
+	{
+		const size_type first = b * block_rows_;
+		const size_type last = std::min(sz_.rows, first + block_rows_);
+		const size_type cols = sz_.cols;
+
+		// sizes of every codec that can represent the whole block, raw always can
+		size_type best_size = (last - first) * cols * sizeof(T);
+		row_codec codec = row_codec::raw;
+		auto consider = [&](row_codec candidate, size_type bytes) {
+			if (requested == candidate || (requested == row_codec::automatic && bytes < best_size)) {
+				best_size = bytes;
+				codec = candidate;
+			}
+		};
+
+		std::vector<row_params> params(last - first);
+		bool for_ok = true;
+		size_type for_bytes = 0;
+		for (size_type i = first; i < last && for_ok; ++i) {
+			for_ok = frame_of_reference_params(a[i], cols, params[i - first]);
+			for_bytes += code_bytes(cols, params[i - first].bits);
+		}
+		if (for_ok)
+			consider(row_codec::frame_of_reference, for_bytes);
+		else if (requested == row_codec::frame_of_reference)
+			throw std::invalid_argument{ "frame of reference requires integer valued rows" };
+
+		if constexpr (std::is_floating_point_v<T>) {
+			for (const auto& [candidate, bits] : { std::pair<row_codec, std::uint32_t>{ row_codec::int4, 4 }, { row_codec::int8, 8 } }) {
+				if (requested != candidate && requested != row_codec::automatic)
+					continue;
+				bool fits = requested == candidate;
+				if (!fits) {
+					row_params probe;
+					fits = true;
+					for (size_type i = first; i < last && fits; ++i)
+						fits = quantize(a[i], cols, bits, probe, nullptr) <= tolerance;
+				}
+				if (fits)
+					consider(candidate, (last - first) * code_bytes(cols, bits));
+			}
+		}
+		if (requested == row_codec::raw)
+			codec = row_codec::raw;
+
+		block& blk = blocks_[b];
+		blk.codec = codec;
+		if (codec == row_codec::raw) {
+			blk.raw.resize((last - first) * cols);
+			for (size_type i = first; i < last; ++i) {
+				rows_[i].start = (i - first) * cols;
+				std::copy_n(a[i], cols, blk.raw.data() + rows_[i].start);
+			}
+			return;
+		}
+
+		size_type total = 0;
+		for (size_type i = first; i < last; ++i) {
+			const std::uint32_t bits = codec == row_codec::frame_of_reference ? params[i - first].bits
+				: (codec == row_codec::int8 ? 8u : 4u);
+			rows_[i].start = total;
+			total += code_bytes(cols, bits);
+		}
+		blk.codes.assign(total + code_padding, 0);
+
+		for (size_type i = first; i < last; ++i) {
+			row_params& p = rows_[i];
+			std::uint8_t* codes = blk.codes.data() + p.start;
+			if (codec == row_codec::frame_of_reference) {
+				const size_type start = p.start;
+				p = params[i - first];
+				p.start = start;
+				for (size_type j = 0; j < cols; ++j) {
+					if (p.bits != 0)
+						put_code(codes, p.bits, j, static_cast<std::uint64_t>(a[i][j] - p.offset));
+				}
+			}
+			else if constexpr (std::is_floating_point_v<T>) {
+				quantize(a[i], cols, codec == row_codec::int8 ? 8u : 4u, p, codes);
+			}
+		}
+	}
+
+	matrix_size_type sz_;
+	size_type block_rows_;
+	std::vector<row_params> rows_;
+	std::vector<block> blocks_;
+};
+
+// y = alpha * A * x + beta * y with A decoded on the fly
+template<class T, class CA, class VA>
+void gemv(T alpha, const compressed_matrix<T, CA>& a, const std::vector<T, VA>& x, T beta, std::vector<T, VA>& y)
+{
+	const auto a_sz = a.size();
+	impl::check_vector_size(x, a_sz.cols);
+	impl::check_vector_size(y, a_sz.rows);
+
+	T x_sum = T();
+	for (const T& value : x)
+		x_sum += value;
+
+	parallel_for(0, a_sz.rows, impl::rows_grain * 4, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i)
+			y[i] = alpha * a.dot(i, x.data(), x_sum) + (beta == T() ? T() : beta * y[i]);
+	});
+}
+
+
+#endif // !COMPRESSED_MATRIX_HPP
@@ -0,0 +1,282 @@
+#pragma once
+#ifndef DISTRIBUTED_HPP
+#define DISTRIBUTED_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "matrix_view.hpp"
+#include "transport.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Dense matrices spread over the ranks of a transport in the 2D block-cyclic layout:
+// the ranks form a P x Q process grid (row-major), the matrix is cut into nb x nb blocks and
+// block (I, J) lives on grid position (I mod P, J mod Q). Every rank keeps its blocks packed
+// in one local matrix, so local block (i, j) is global block (i * P + p, j * Q + q).
+// summa_gemm multiplies such matrices with SUMMA: for every block column K of A, the owners
+// broadcast their panel of A along their grid row and the owners of block row K of B their panel
+// along their grid column; then every rank updates its part of C with one local GEMM.
+struct process_grid {
+	int rows = 1;
+	int cols = 1;
+
+	int size() const noexcept { return rows * cols; }
+	int row_of(int rank) const noexcept { return rank / cols; }
+	int col_of(int rank) const noexcept { return rank % cols; }
+	int rank_of(int row, int col) const noexcept { return row * cols + col; }
+
+	bool operator==(const process_grid& other) const noexcept { return rows == other.rows && cols == other.cols; }
+	bool operator!=(const process_grid& other) const noexcept { return !(*this == other); }
+};
+
+namespace impl {
+
+	// elements of a global extent n owned by grid coordinate p of procs
+	inline std::size_t block_cyclic_extent(std::size_t n, std::size_t nb, int p, int procs) noexcept {
+		const std::size_t blocks = n / nb;
+		const auto P = static_cast<std::size_t>(procs);
+		const auto q = static_cast<std::size_t>(p);
+		std::size_t extent = (blocks / P) * nb;
+		if (q < blocks % P)
+			extent += nb;
+		else if (q == blocks % P)
+			extent += n % nb;
+		return extent;
+	}
+
+	template<typename T>
+	matrix<T> make_local(std::size_t rows, std::size_t cols) {
+		return (rows == 0 || cols == 0) ? matrix<T>() : matrix<T>(rows, cols);
+	}
+
+	// matrix_view over a possibly empty matrix
+	template<typename T>
+	matrix_view<T> local_block(matrix<T>& m, std::size_t row, std::size_t col, std::size_t rows, std::size_t cols) {
+		return (rows == 0 || cols == 0) ? matrix_view<T>(nullptr, rows, 0, cols) : block(m, row, col, rows, cols);
+	}
+
+	template<typename T>
+	matrix_view<const T> local_block(const matrix<T>& m, std::size_t row, std::size_t col, std::size_t rows, std::size_t cols) {
+		return (rows == 0 || cols == 0) ? matrix_view<const T>(nullptr, rows, 0, cols) : block(m, row, col, rows, cols);
+	}
+
+	template<typename T>
+	std::vector<T> pack(const matrix_view<const T>& v) {
+		std::vector<T> buffer(v.size().rows * v.size().cols);
+		for (std::size_t i = 0; i < v.size().rows; ++i)
+			std::copy_n(v[i], v.size().cols, buffer.data() + i * v.size().cols);
+		return buffer;
+	}
+
+	template<typename T>
+	void unpack(const std::vector<T>& buffer, const matrix_view<T>& v) {
+		for (std::size_t i = 0; i < v.size().rows; ++i)
+			std::copy_n(buffer.data() + i * v.size().cols, v.size().cols, v[i]);
+	}
+
+	// tags above every SUMMA step
+	constexpr int gather_tag = 1 << 30;
+}
+
+template<class T>
+class block_cyclic_matrix {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+
+	static_assert(std::is_trivially_copyable_v<T>, "blocks are sent as raw bytes");
+
+	// zero matrix of rows x cols in blocks of block_size, local part of rank on grid
+	explicit block_cyclic_matrix(size_type rows, size_type cols, size_type block_size, process_grid grid, int rank)
+		: sz_(rows, cols), nb_(block_size), grid_(grid), rank_(rank)
+	{
+		if (rows == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+		if (cols == 0)
+			throw std::invalid_argument{ "cols count must be greater than zero" };
+		if (block_size == 0)
+			throw std::invalid_argument{ "block size must be greater than zero" };
+		if (grid.rows <= 0 || grid.cols <= 0 || rank < 0 || rank >= grid.size())
+			throw std::out_of_range{ "rank is out of this group" };
+
+		local_ = impl::make_local<T>(impl::block_cyclic_extent(rows, nb_, grid_row(), grid_.rows),
+			impl::block_cyclic_extent(cols, nb_, grid_col(), grid_.cols));
+	}
+
+	matrix_size_type size() const noexcept { return sz_; }
+	size_type block_size() const noexcept { return nb_; }
+	const process_grid& grid() const noexcept { return grid_; }
+	int rank() const noexcept { return rank_; }
+	int grid_row() const noexcept { return grid_.row_of(rank_); }
+	int grid_col() const noexcept { return grid_.col_of(rank_); }
+
+	// blocks of this rank, packed; empty when the rank owns none
+	matrix<T>& local() noexcept { return local_; }
+	const matrix<T>& local() const noexcept { return local_; }
+	matrix_size_type local_size() const noexcept { return local_rows_cols(rank_); }
+
+	// rank owning global element (row, col)
+	int owner(size_type row, size_type col) const noexcept
+	{
+		return grid_.rank_of(static_cast<int>((row / nb_) % grid_.rows), static_cast<int>((col / nb_) % grid_.cols));
+	}
+
+	// takes this rank's blocks out of a global matrix available on every rank
+	template<class A>
+	void assign(const matrix<T, A>& global)
+	{
+		if (!same_shape(global.size(), sz_))
+			throw std::invalid_argument{ "matrix sizes do not match" };
+		for_each_block(rank_, [&](size_type row, size_type col, size_type local_row, size_type local_col, size_type rows, size_type cols) {
+			copy(block(global, row, col, rows, cols), block(local_, local_row, local_col, rows, cols));
+		});
+	}
+
+	// whole matrix on every rank (all-gather of the local parts)
+	matrix<T> gather(transport& t) const
+	{
+		check_transport(t);
+		const std::vector<T> mine = impl::pack(impl::local_block(local_, 0, 0, local_size().rows, local_size().cols));
+		for (int peer = 0; peer < grid_.size(); ++peer) {
+			if (peer != rank_)
+				t.send(peer, impl::gather_tag, mine.data(), mine.size() * sizeof(T));
+		}
+
+		matrix<T> result(sz_.rows, sz_.cols);
+		for (int peer = 0; peer < grid_.size(); ++peer) {
+			const auto peer_size = local_rows_cols(peer);
+			matrix<T> part = impl::make_local<T>(peer_size.rows, peer_size.cols);
+			if (peer == rank_) {
+				part = local_;
+			}
+			else {
+				std::vector<T> buffer(peer_size.rows * peer_size.cols);
+				t.recv(peer, impl::gather_tag, buffer.data(), buffer.size() * sizeof(T));
+				impl::unpack(buffer, impl::local_block(part, 0, 0, peer_size.rows, peer_size.cols));
+			}
+			for_each_block(peer, [&](size_type row, size_type col, size_type local_row, size_type local_col, size_type rows, size_type cols) {
+				copy(block(std::as_const(part), local_row, local_col, rows, cols), block(result, row, col, rows, cols));
+			});
+		}
+		return result;
+	}
+
+	void check_transport(const transport& t) const
+	{
+		if (t.size() != grid_.size() || t.rank() != rank_)
+			throw std::invalid_argument{ "transport does not match the process grid" };
+	}
+
+private:
+	matrix_size_type local_rows_cols(int rank) const noexcept
+	{
+		return matrix_size_type(impl::block_cyclic_extent(sz_.rows, nb_, grid_.row_of(rank), grid_.rows),
+			impl::block_cyclic_extent(sz_.cols, nb_, grid_.col_of(rank), grid_.cols));
+	}
+
+	// fn(global_row, global_col, local_row, local_col, rows, cols) for every block of rank
+	template<class Func>
+	void for_each_block(int rank, Func&& fn) const
+	{
+		const auto p = static_cast<size_type>(grid_.row_of(rank));
+		const auto q = static_cast<size_type>(grid_.col_of(rank));
+		const auto P = static_cast<size_type>(grid_.rows);
+		const auto Q = static_cast<size_type>(grid_.cols);
+		for (size_type bi = p, li = 0; bi * nb_ < sz_.rows; bi += P, li += nb_) {
+			const size_type rows = std::min(nb_, sz_.rows - bi * nb_);
+			for (size_type bj = q, lj = 0; bj * nb_ < sz_.cols; bj += Q, lj += nb_)
+				fn(bi * nb_, bj * nb_, li, lj, rows, std::min(nb_, sz_.cols - bj * nb_));
+		}
+	}
+
+	matrix_size_type sz_;
+	size_type nb_;
+	process_grid grid_;
+	int rank_;
+	matrix<T> local_;
+};
+
+// C = alpha * A * B + beta * C; A, B and C share grid and block size and t connects the ranks.
+// Every rank of the grid calls this with its parts of the three matrices.
+template<class T>
+void summa_gemm(T alpha, const block_cyclic_matrix<T>& a, const block_cyclic_matrix<T>& b, T beta,
+	block_cyclic_matrix<T>& c, transport& t)
+{
+	if (a.size().cols != b.size().rows || c.size().rows != a.size().rows || c.size().cols != b.size().cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+	if (a.grid() != c.grid() || b.grid() != c.grid() || a.block_size() != c.block_size() || b.block_size() != c.block_size())
+		throw std::invalid_argument{ "matrices are not distributed alike" };
+	c.check_transport(t);
+
+	const process_grid grid = c.grid();
+	const int my_row = c.grid_row();
+	const int my_col = c.grid_col();
+	const std::size_t nb = c.block_size();
+	const std::size_t k = a.size().cols;
+	const std::size_t local_rows = c.local_size().rows;
+	const std::size_t local_cols = c.local_size().cols;
+
+	auto c_view = impl::local_block(c.local(), 0, 0, local_rows, local_cols);
+	for (std::size_t i = 0; i < local_rows; ++i)
+		impl::scale_row(beta, c_view[i], local_cols);
+
+	matrix<T> a_panel;
+	matrix<T> b_panel;
+	for (std::size_t kb = 0; kb * nb < k; ++kb) {
+		const std::size_t width = std::min(nb, k - kb * nb);
+		const int a_owner_col = static_cast<int>(kb % static_cast<std::size_t>(grid.cols));
+		const int b_owner_row = static_cast<int>(kb % static_cast<std::size_t>(grid.rows));
+		const int a_tag = static_cast<int>(2 * kb);
+		const int b_tag = a_tag + 1;
+
+		// panel of block column kb of A, over the rows of this grid row
+		matrix_view<const T> a_view;
+		if (my_col == a_owner_col) {
+			a_view = impl::local_block(a.local(), 0, (kb / static_cast<std::size_t>(grid.cols)) * nb, local_rows, width);
+			const std::vector<T> buffer = impl::pack(a_view);
+			for (int q = 0; q < grid.cols; ++q) {
+				if (q != my_col)
+					t.send(grid.rank_of(my_row, q), a_tag, buffer.data(), buffer.size() * sizeof(T));
+			}
+		}
+		else {
+			if (!same_shape(a_panel.size(), matrix_size_type(local_rows, width)))
+				a_panel = impl::make_local<T>(local_rows, width);
+			std::vector<T> buffer(local_rows * width);
+			t.recv(grid.rank_of(my_row, a_owner_col), a_tag, buffer.data(), buffer.size() * sizeof(T));
+			impl::unpack(buffer, impl::local_block(a_panel, 0, 0, local_rows, width));
+			a_view = impl::local_block(std::as_const(a_panel), 0, 0, local_rows, width);
+		}
+
+		// panel of block row kb of B, over the columns of this grid column
+		matrix_view<const T> b_view;
+		if (my_row == b_owner_row) {
+			b_view = impl::local_block(b.local(), (kb / static_cast<std::size_t>(grid.rows)) * nb, 0, width, local_cols);
+			const std::vector<T> buffer = impl::pack(b_view);
+			for (int p = 0; p < grid.rows; ++p) {
+				if (p != my_row)
+					t.send(grid.rank_of(p, my_col), b_tag, buffer.data(), buffer.size() * sizeof(T));
+			}
+		}
+		else {
+			if (!same_shape(b_panel.size(), matrix_size_type(width, local_cols)))
+				b_panel = impl::make_local<T>(width, local_cols);
+			std::vector<T> buffer(width * local_cols);
+			t.recv(grid.rank_of(b_owner_row, my_col), b_tag, buffer.data(), buffer.size() * sizeof(T));
+			impl::unpack(buffer, impl::local_block(b_panel, 0, 0, width, local_cols));
+			b_view = impl::local_block(std::as_const(b_panel), 0, 0, width, local_cols);
+		}
+
+		if (local_rows != 0 && local_cols != 0)
+			gemm(alpha, a_view, b_view, T(1), c_view);
+	}
+}
+
+
+#endif // !DISTRIBUTED_HPP
@@ -0,0 +1,61 @@
+#pragma once
+#ifndef DTYPE_HPP
+#define DTYPE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+
+// Element type tag stored in file and shared-memory headers, so that data written for one
+// element type is not read back as another.
+enum class dtype : std::uint32_t {
+	unknown = 0,
+	int8, int16, int32, int64,
+	uint8, uint16, uint32, uint64,
+	float32, float64
+};
+
+namespace impl {
+
+	template<class T>
+	constexpr dtype dtype_of() noexcept {
+		if constexpr (std::is_same_v<T, float>)
+			return dtype::float32;
+		else if constexpr (std::is_same_v<T, double>)
+			return dtype::float64;
+		else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+			return sizeof(T) == 1 ? dtype::int8 : sizeof(T) == 2 ? dtype::int16 : sizeof(T) == 4 ? dtype::int32 : dtype::int64;
+		else if constexpr (std::is_integral_v<T>)
+			return sizeof(T) == 1 ? dtype::uint8 : sizeof(T) == 2 ? dtype::uint16 : sizeof(T) == 4 ? dtype::uint32 : dtype::uint64;
+		else
+			return dtype::unknown;
+	}
+
+	template<class T>
+	struct type_tag {
+		using type = T;
+	};
+
+	// fn(type_tag<T>{}) for the element type T of t: one switch per operation, none per element
+	template<class Func>
+	decltype(auto) visit_dtype(dtype t, Func&& fn) {
+		switch (t) {
+		case dtype::int8: return fn(type_tag<std::int8_t>{});
+		case dtype::int16: return fn(type_tag<std::int16_t>{});
+		case dtype::int32: return fn(type_tag<std::int32_t>{});
+		case dtype::int64: return fn(type_tag<std::int64_t>{});
+		case dtype::uint8: return fn(type_tag<std::uint8_t>{});
+		case dtype::uint16: return fn(type_tag<std::uint16_t>{});
+		case dtype::uint32: return fn(type_tag<std::uint32_t>{});
+		case dtype::uint64: return fn(type_tag<std::uint64_t>{});
+		case dtype::float32: return fn(type_tag<float>{});
+		case dtype::float64: return fn(type_tag<double>{});
+		default: throw std::invalid_argument{ "unsupported dtype" };
+		}
+	}
+}
+
+
+#endif // !DTYPE_HPP
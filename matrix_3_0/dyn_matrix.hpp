@@ -0,0 +1,261 @@
+#pragma once
+#ifndef DYN_MATRIX_HPP
+#define DYN_MATRIX_HPP
+
+#include "matrix.hpp"
+#include "matrix_view.hpp"
+#include "dtype.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+#include "prefix_sum.hpp"
+#include "reduce.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+// Matrices whose element type is chosen at run time.
+// dyn_matrix owns a matrix<T> of one of the dtypes and dyn_view is a read-only view of one; both
+// dispatch once per operation (impl::visit_dtype) into the typed kernels. A typed matrix moves
+// into a dyn_matrix and back out without copying elements, and get<T>() / view<T>() hand out the
+// typed matrix or view in place. astype() and convert() cast with row kernels the compiler
+// vectorizes; integers wrap like static_cast, floating point to integer truncates and saturates
+// (NaN gives 0).
+namespace impl {
+
+	template<class T>
+	using owned_matrix = matrix<T>;
+
+	template<class T>
+	using const_view = matrix_view<const T>;
+
+	// alternatives in the order of the dtype enum, so the index of the held one is its dtype
+	template<template<class> class W>
+	using dtype_variant = std::variant<std::monostate,
+		W<std::int8_t>, W<std::int16_t>, W<std::int32_t>, W<std::int64_t>,
+		W<std::uint8_t>, W<std::uint16_t>, W<std::uint32_t>, W<std::uint64_t>,
+		W<float>, W<double>>;
+
+	inline void check_same_dtype(dtype a, dtype b) {
+		if (a != b)
+			throw std::invalid_argument{ "matrix dtypes do not match" };
+	}
+
+	template<typename S, typename D>
+	D convert_value(S v) noexcept {
+		if constexpr (std::is_floating_point_v<S> && std::is_integral_v<D>) {
+			if (!(v == v))
+				return D();
+			if (v <= static_cast<S>(std::numeric_limits<D>::lowest()))
+				return std::numeric_limits<D>::lowest();
+			if (v >= static_cast<S>(std::numeric_limits<D>::max()))
+				return std::numeric_limits<D>::max();
+		}
+		return static_cast<D>(v);
+	}
+
+	template<typename S, typename D>
+	void convert_row(const S* src, D* dst, std::size_t n) noexcept {
+		for (std::size_t j = 0; j < n; ++j)
+			dst[j] = convert_value<S, D>(src[j]);
+	}
+}
+
+class dyn_view {
+public:
+	using size_type = std::size_t;
+
+	dyn_view() = default;
+
+	template<class T>
+	dyn_view(const matrix_view<T>& v) : view_(matrix_view<const std::remove_const_t<T>>(v)) {}
+
+	template<class T, class A>
+	dyn_view(const matrix<T, A>& m) : view_(::view(m)) {}
+
+	dtype element_type() const noexcept { return static_cast<dtype>(view_.index()); }
+	matrix_size_type size() const noexcept { return visit_or(matrix_size_type(), [](const auto& v) { return v.size(); }); }
+	bool empty() const noexcept { return size().rows == 0 || size().cols == 0; }
+
+	template<class T>
+	matrix_view<const T> get() const
+	{
+		const auto* v = std::get_if<matrix_view<const T>>(&view_);
+		if (v == nullptr)
+			throw std::invalid_argument{ "matrix dtypes do not match" };
+		return *v;
+	}
+
+	// fn(matrix_view<const T>) for the element type T of this view
+	template<class Func>
+	decltype(auto) visit(Func&& fn) const
+	{
+		return impl::visit_dtype(element_type(), [&](auto tag) -> decltype(auto) {
+			using T = typename decltype(tag)::type;
+			return fn(get<T>());
+		});
+	}
+
+private:
+	template<class R, class Func>
+	R visit_or(R fallback, Func&& fn) const noexcept
+	{
+		return std::visit([&](const auto& v) -> R {
+			if constexpr (std::is_same_v<std::decay_t<decltype(v)>, std::monostate>)
+				return fallback;
+			else
+				return fn(v);
+		}, view_);
+	}
+
+	impl::dtype_variant<impl::const_view> view_;
+};
+
+class dyn_matrix {
+public:
+	using size_type = std::size_t;
+
+	dyn_matrix() = default;
+
+	// rows x cols zeros of type t; 0 x 0 gives an empty matrix of that type
+	explicit dyn_matrix(dtype t, size_type rows, size_type cols)
+	{
+		impl::visit_dtype(t, [&](auto tag) {
+			using T = typename decltype(tag)::type;
+			if (rows == 0 && cols == 0)
+				storage_ = matrix<T>();
+			else
+				storage_ = matrix<T>(rows, cols);
+		});
+	}
+
+	// takes the storage of m, no element is copied
+	template<class T>
+	dyn_matrix(matrix<T>&& m) : storage_(std::move(m)) {}
+
+	dtype element_type() const noexcept { return static_cast<dtype>(storage_.index()); }
+	matrix_size_type size() const noexcept { return view().size(); }
+	bool empty() const noexcept { return view().empty(); }
+
+	template<class T>
+	bool holds() const noexcept { return std::holds_alternative<matrix<T>>(storage_); }
+
+	template<class T>
+	matrix<T>& get()
+	{
+		auto* m = std::get_if<matrix<T>>(&storage_);
+		if (m == nullptr)
+			throw std::invalid_argument{ "matrix dtypes do not match" };
+		return *m;
+	}
+
+	template<class T>
+	const matrix<T>& get() const { return const_cast<dyn_matrix&>(*this).get<T>(); }
+
+	// moves the typed matrix out; this is left empty
+	template<class T>
+	matrix<T> release()
+	{
+		matrix<T> result = std::move(get<T>());
+		storage_ = std::monostate();
+		return result;
+	}
+
+	template<class T>
+	matrix_view<T> view() { return ::view(get<T>()); }
+
+	operator dyn_view() const { return view(); }
+
+	dyn_view view() const
+	{
+		return std::visit([](const auto& m) -> dyn_view {
+			if constexpr (std::is_same_v<std::decay_t<decltype(m)>, std::monostate>)
+				return dyn_view();
+			else
+				return dyn_view(m);
+		}, storage_);
+	}
+
+	// fn(matrix<T>&) for the element type T of this matrix
+	template<class Func>
+	decltype(auto) visit(Func&& fn)
+	{
+		return impl::visit_dtype(element_type(), [&](auto tag) -> decltype(auto) {
+			using T = typename decltype(tag)::type;
+			return fn(get<T>());
+		});
+	}
+
+private:
+	impl::dtype_variant<impl::owned_matrix> storage_;
+};
+
+// dst = src element-wise, cast to the dtype of dst; the sizes must match
+inline void convert(const dyn_view& src, dyn_matrix& dst)
+{
+	if (!same_shape(src.size(), dst.size()))
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	src.visit([&](const auto& s) {
+		dst.visit([&](auto& d) {
+			parallel_for(0, s.size().rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+				for (std::size_t i = first; i < last; ++i)
+					impl::convert_row(s[i], d[i], s.size().cols);
+			});
+		});
+	});
+}
+
+// copy of a with elements of type t
+inline dyn_matrix astype(const dyn_view& a, dtype t)
+{
+	// keeps the dtype; matrix holds every empty shape as 0 x 0
+	if (a.empty())
+		return dyn_matrix(t, 0, 0);
+	dyn_matrix result(t, a.size().rows, a.size().cols);
+	convert(a, result);
+	return result;
+}
+
+// a * b for operands of the same dtype
+inline dyn_matrix multiply(const dyn_view& a, const dyn_view& b)
+{
+	impl::check_same_dtype(a.element_type(), b.element_type());
+	return a.visit([&](const auto& av) {
+		using T = typename std::decay_t<decltype(av)>::value_type;
+		matrix<T> c(av.size().rows, b.size().cols);
+		gemm(T(1), av, b.get<T>(), T(), view(c));
+		return dyn_matrix(std::move(c));
+	});
+}
+
+inline dyn_matrix transpose(const dyn_view& a)
+{
+	return a.visit([](const auto& av) {
+		using T = typename std::decay_t<decltype(av)>::value_type;
+		matrix<T> result(av.size().cols, av.size().rows);
+		impl::transpose_into(av, result);
+		return dyn_matrix(std::move(result));
+	});
+}
+
+// 1 x cols values for axis rows, rows x 1 for axis cols, in the dtype of a
+inline dyn_matrix reduce(const dyn_view& a, reduce_op op, matrix_axis axis)
+{
+	return a.visit([&](const auto& av) {
+		using T = typename std::decay_t<decltype(av)>::value_type;
+		const std::vector<T> values = reduce(av, op, axis);
+		if (values.empty())
+			return dyn_matrix(matrix<T>());
+		const std::size_t cols = (axis == matrix_axis::rows) ? values.size() : 1;
+		return dyn_matrix(matrix<T>(cols, values.begin(), values.end()));
+	});
+}
+
+
+#endif // !DYN_MATRIX_HPP
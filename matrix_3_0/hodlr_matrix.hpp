@@ -0,0 +1,389 @@
+#pragma once
+#ifndef HODLR_MATRIX_HPP
+#define HODLR_MATRIX_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+
+// Hierarchically off-diagonal low-rank (HODLR) matrix.
+// The index range is split in halves recursively down to leaves of at most leaf_size;
+// leaves are stored densely and both off-diagonal blocks of every split are stored as
+// U * V^T, compressed by adaptive cross approximation (ACA) straight from an element generator,
+// so the dense matrix is never formed. With ranks bounded by r a product costs O(r n log n).
+// Factors are kept transposed (ut is r x rows, vt is r x cols) so every ACA step appends a row.
+// The generator (i, j) -> T is called concurrently from the pool threads.
+template<class T, class Allocator = std::allocator<T>>
+class hodlr_matrix {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+	using matrix_type = matrix<T, Allocator>;
+
+	template<class Generator>
+	explicit hodlr_matrix(size_type n, Generator generator, T tolerance = T(1e-10), size_type leaf_size = 64)
+		: n_{ n }
+	{
+		if (n == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+		if (leaf_size == 0)
+			throw std::invalid_argument{ "leaf size must be greater than zero" };
+
+		build_tree(0, n, 0, leaf_size);
+
+		// every block depends on the generator only, so all nodes are compressed independently
+		parallel_for(0, nodes_.size(), 1, [&](size_type first, size_type last) {
+			for (size_type index = first; index < last; ++index) {
+				node& nd = nodes_[index];
+				if (nd.is_leaf()) {
+					nd.dense = matrix_type(nd.end - nd.begin, nd.end - nd.begin);
+					for (size_type i = nd.begin; i < nd.end; ++i)
+						for (size_type j = nd.begin; j < nd.end; ++j)
+							nd.dense[i - nd.begin][j - nd.begin] = generator(i, j);
+					continue;
+				}
+
+				nd.upper = compress(generator, nd.begin, nd.mid, nd.mid, nd.end, tolerance);
+				nd.lower = compress(generator, nd.mid, nd.end, nd.begin, nd.mid, tolerance);
+			}
+		});
+	}
+
+	matrix_size_type size() const noexcept { return matrix_size_type{ n_, n_ }; }
+
+	// largest rank among the off-diagonal blocks
+	size_type max_rank() const noexcept
+	{
+		size_type result = 0;
+		for (const auto& nd : nodes_)
+			result = std::max({ result, nd.upper.rank, nd.lower.rank });
+		return result;
+	}
+
+	// number of stored scalars, to compare with n * n
+	size_type stored_elements() const noexcept
+	{
+		size_type result = 0;
+		for (const auto& nd : nodes_) {
+			const size_type rows = nd.end - nd.begin;
+			if (nd.is_leaf())
+				result += rows * rows;
+			else
+				result += (nd.upper.rank + nd.lower.rank) * rows;
+		}
+		return result;
+	}
+
+	// y = A * x
+	std::vector<T> multiply(const std::vector<T>& x) const
+	{
+		impl::check_vector_size(x, n_);
+		std::vector<T> y(n_, T());
+		multiply_subtree(0, x.data(), y.data());
+		return y;
+	}
+
+	// Recursive Sherman-Morrison-Woodbury factorization: at every split A = D + U * Z^T with
+	// D = diag(A11, A22), so A^-1 b = D^-1 b - D^-1 U (I + Z^T D^-1 U)^-1 Z^T D^-1 b.
+	// Levels are processed bottom up, the nodes of one level in parallel.
+	void factorize()
+	{
+		if (factorized_)
+			return;
+
+		size_type depth = 0;
+		for (const auto& nd : nodes_)
+			depth = std::max(depth, nd.level);
+
+		for (size_type level = depth + 1; level-- > 0;) {
+			parallel_for(0, nodes_.size(), 1, [&](size_type first, size_type last) {
+				for (size_type index = first; index < last; ++index) {
+					if (nodes_[index].level == level)
+						factorize_node(nodes_[index]);
+				}
+			});
+		}
+		factorized_ = true;
+	}
+
+	bool factorized() const noexcept { return factorized_; }
+
+	// x with A * x = b up to the compression tolerance; factorizes on first use
+	std::vector<T> solve(const std::vector<T>& b)
+	{
+		impl::check_vector_size(b, n_);
+		factorize();
+		std::vector<T> x = b;
+		solve_subtree(0, x.data());
+		return x;
+	}
+
+private:
+	struct low_rank_block {
+		size_type rank = 0;
+		matrix_type ut;
+		matrix_type vt;
+
+		// y += U * (V^T * x)
+		void apply(const T* x, T* y, std::vector<T>& t) const
+		{
+			if (rank == 0)
+				return;
+
+			t.resize(rank);
+			for (size_type k = 0; k < rank; ++k)
+				t[k] = impl::dot_row(vt[k], x, vt.size().cols);
+			for (size_type k = 0; k < rank; ++k)
+				impl::axpy_row(t[k], ut[k], y, ut.size().cols);
+		}
+	};
+
+	struct node {
+		node(size_type first, size_type last, size_type depth)
+			: begin{ first }, mid{ first + (last - first) / 2 }, end{ last }, level{ depth } {}
+
+		size_type begin;
+		size_type mid;
+		size_type end;
+		size_type level;
+		size_type left = 0;   // children indices, 0 for leaves (the root is never a child)
+		size_type right = 0;
+
+		matrix_type dense;       // leaf block
+		matrix_type dense_inv;   // its inverse after factorize()
+		low_rank_block upper;    // A(begin:mid, mid:end)
+		low_rank_block lower;    // A(mid:end, begin:mid)
+
+		// after factorize(): A11^-1 U1 and A22^-1 U2 (stored as rows) and (I + Z^T D^-1 U)^-1
+		matrix_type solved_upper;
+		matrix_type solved_lower;
+		matrix_type capacitance_inv;
+
+		bool is_leaf() const noexcept { return left == 0; }
+	};
+
+	// nodes are appended depth-first so children always follow their parent
+	size_type build_tree(size_type begin, size_type end, size_type level, size_type leaf_size)
+	{
+		const size_type index = nodes_.size();
+		nodes_.emplace_back(begin, end, level);
+		if (end - begin <= leaf_size)
+			return index;
+
+		const size_type mid = nodes_[index].mid;
+		const size_type left = build_tree(begin, mid, level + 1, leaf_size);
+		const size_type right = build_tree(mid, end, level + 1, leaf_size);
+		nodes_[index].left = left;
+		nodes_[index].right = right;
+		return index;
+	}
+
+	// ACA with partial pivoting on A(r0:r1, c0:c1): each step takes one residual row and one residual
+	// column and stops once the new rank-one term is below tolerance times the running Frobenius norm
+	template<class Generator>
+	static low_rank_block compress(Generator& generator, size_type r0, size_type r1, size_type c0, size_type c1, T tolerance)
+	{
+		const size_type rows = r1 - r0;
+		const size_type cols = c1 - c0;
+		const size_type limit = std::min(rows, cols);
+
+		std::vector<std::vector<T>> us;
+		std::vector<std::vector<T>> vs;
+		std::vector<bool> used(rows, false);
+		std::vector<T> row(cols);
+		std::vector<T> col(rows);
+		T norm2 = T();
+		size_type pivot_row = 0;
+
+		while (us.size() < limit) {
+			used[pivot_row] = true;
+			for (size_type j = 0; j < cols; ++j)
+				row[j] = generator(r0 + pivot_row, c0 + j);
+			for (size_type k = 0; k < us.size(); ++k)
+				impl::axpy_row(-us[k][pivot_row], vs[k].data(), row.data(), cols);
+
+			size_type pivot_col = 0;
+			for (size_type j = 1; j < cols; ++j) {
+				if (std::abs(row[j]) > std::abs(row[pivot_col]))
+					pivot_col = j;
+			}
+
+			if (row[pivot_col] != T()) {
+				const T scale = T(1) / row[pivot_col];
+				for (size_type i = 0; i < rows; ++i)
+					col[i] = generator(r0 + i, c0 + pivot_col);
+				for (size_type k = 0; k < us.size(); ++k)
+					impl::axpy_row(-vs[k][pivot_col], us[k].data(), col.data(), rows);
+				for (auto& value : row)
+					value *= scale;
+
+				// |S + u v^T|_F^2 = |S|_F^2 + 2 sum_k (u_k . u)(v_k . v) + |u|^2 |v|^2
+				const T u2 = impl::dot_row(col.data(), col.data(), rows);
+				const T v2 = impl::dot_row(row.data(), row.data(), cols);
+				for (size_type k = 0; k < us.size(); ++k)
+					norm2 += T(2) * impl::dot_row(us[k].data(), col.data(), rows) * impl::dot_row(vs[k].data(), row.data(), cols);
+				norm2 += u2 * v2;
+
+				us.push_back(col);
+				vs.push_back(row);
+				if (u2 * v2 <= tolerance * tolerance * norm2)
+					break;
+			}
+
+			// next pivot row: largest entry of the last column among rows not used yet
+			size_type next = rows;
+			for (size_type i = 0; i < rows; ++i) {
+				if (used[i])
+					continue;
+				if (next == rows || (!us.empty() && std::abs(us.back()[i]) > std::abs(us.back()[next])))
+					next = i;
+			}
+			if (next == rows)
+				break;
+			pivot_row = next;
+		}
+
+		low_rank_block block;
+		block.rank = us.size();
+		if (block.rank == 0)
+			return block;
+
+		block.ut = matrix_type(block.rank, rows);
+		block.vt = matrix_type(block.rank, cols);
+		for (size_type k = 0; k < block.rank; ++k) {
+			std::copy(us[k].begin(), us[k].end(), block.ut[k]);
+			std::copy(vs[k].begin(), vs[k].end(), block.vt[k]);
+		}
+		return block;
+	}
+
+	// subtrees at least this large run their two halves on separate threads
+	size_type parallel_threshold() const noexcept { return 4096; }
+
+	template<class Func>
+	void for_children(const node& nd, Func fn) const
+	{
+		if (nd.end - nd.begin < parallel_threshold()) {
+			fn(nd.left);
+			fn(nd.right);
+			return;
+		}
+		parallel_for(0, 2, 1, [&](size_type first, size_type last) {
+			for (size_type child = first; child < last; ++child)
+				fn(child == 0 ? nd.left : nd.right);
+		});
+	}
+
+	// y[begin:end) += A(begin:end, begin:end) * x[begin:end); x and y point at global index 0
+	void multiply_subtree(size_type index, const T* x, T* y) const
+	{
+		const node& nd = nodes_[index];
+		if (nd.is_leaf()) {
+			const size_type rows = nd.end - nd.begin;
+			for (size_type i = 0; i < rows; ++i)
+				y[nd.begin + i] += impl::dot_row(nd.dense[i], x + nd.begin, rows);
+			return;
+		}
+
+		std::vector<T> t;
+		nd.upper.apply(x + nd.mid, y + nd.begin, t);
+		nd.lower.apply(x + nd.begin, y + nd.mid, t);
+		for_children(nd, [&](size_type child) { multiply_subtree(child, x, y); });
+	}
+
+	// x[begin:end) = A(begin:end, begin:end)^-1 * x[begin:end)
+	void solve_subtree(size_type index, T* x) const
+	{
+		const node& nd = nodes_[index];
+		if (nd.is_leaf()) {
+			const size_type rows = nd.end - nd.begin;
+			std::vector<T> b(x + nd.begin, x + nd.end);
+			for (size_type i = 0; i < rows; ++i)
+				x[nd.begin + i] = impl::dot_row(nd.dense_inv[i], b.data(), rows);
+			return;
+		}
+
+		for_children(nd, [&](size_type child) { solve_subtree(child, x); });
+		apply_correction(nd, x);
+	}
+
+	// x -= D^-1 U (I + Z^T D^-1 U)^-1 Z^T x for x = D^-1 b on the node's range
+	void apply_correction(const node& nd, T* x) const
+	{
+		const size_type r1 = nd.upper.rank;
+		const size_type r2 = nd.lower.rank;
+		if (r1 + r2 == 0)
+			return;
+
+		// Z^T x = [V1^T x_right; V2^T x_left]
+		std::vector<T> t(r1 + r2);
+		for (size_type k = 0; k < r1; ++k)
+			t[k] = impl::dot_row(nd.upper.vt[k], x + nd.mid, nd.end - nd.mid);
+		for (size_type k = 0; k < r2; ++k)
+			t[r1 + k] = impl::dot_row(nd.lower.vt[k], x + nd.begin, nd.mid - nd.begin);
+
+		for (size_type k = 0; k < r1 + r2; ++k) {
+			const T s = impl::dot_row(nd.capacitance_inv[k], t.data(), r1 + r2);
+			if (k < r1)
+				impl::axpy_row(-s, nd.solved_upper[k], x + nd.begin, nd.mid - nd.begin);
+			else
+				impl::axpy_row(-s, nd.solved_lower[k - r1], x + nd.mid, nd.end - nd.mid);
+		}
+	}
+
+	void factorize_node(node& nd)
+	{
+		if (nd.is_leaf()) {
+			nd.dense_inv = inverse(nd.dense);
+			return;
+		}
+
+		const size_type r1 = nd.upper.rank;
+		const size_type r2 = nd.lower.rank;
+		if (r1 + r2 == 0)
+			return;
+
+		// D^-1 U: every column of U1 (row of ut) goes through the solver of the matching child
+		std::vector<T> work(n_, T());
+		auto solve_rows = [&](const low_rank_block& block, size_type child, size_type offset) {
+			const size_type len = block.ut.size().cols;
+			matrix_type solved(block.rank, len);
+			for (size_type k = 0; k < block.rank; ++k) {
+				std::copy_n(block.ut[k], len, work.data() + offset);
+				solve_subtree(child, work.data());
+				std::copy_n(work.data() + offset, len, solved[k]);
+			}
+			return solved;
+		};
+		if (r1 > 0)
+			nd.solved_upper = solve_rows(nd.upper, nd.left, nd.begin);
+		if (r2 > 0)
+			nd.solved_lower = solve_rows(nd.lower, nd.right, nd.mid);
+
+		// I + Z^T D^-1 U = [I, V1^T S2; V2^T S1, I]
+		matrix_type capacitance(r1 + r2, r1 + r2);
+		impl::set_identity(capacitance);
+		for (size_type a = 0; a < r1; ++a)
+			for (size_type b = 0; b < r2; ++b)
+				capacitance[a][r1 + b] = impl::dot_row(nd.upper.vt[a], nd.solved_lower[b], nd.end - nd.mid);
+		for (size_type a = 0; a < r2; ++a)
+			for (size_type b = 0; b < r1; ++b)
+				capacitance[r1 + a][b] = impl::dot_row(nd.lower.vt[a], nd.solved_upper[b], nd.mid - nd.begin);
+		nd.capacitance_inv = inverse(capacitance);
+	}
+
+	size_type n_;
+	std::vector<node> nodes_;
+	bool factorized_ = false;
+};
+
+
+#endif // !HODLR_MATRIX_HPP
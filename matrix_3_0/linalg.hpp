@@ -0,0 +1,647 @@
+#pragma once
+#ifndef LINALG_HPP
+#define LINALG_HPP
+
+#include "matrix.hpp"
+#include "matrix_view.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+
+// Dense BLAS-like kernels over matrix<T>.
+// Rows are contiguous, so every inner loop runs along a row (a[j] += s * b[j])
+// and is left to the compiler to vectorize; outer loops are split over row bands.
+namespace impl {
+
+	constexpr std::size_t gemm_block_k = 256;
+	constexpr std::size_t gemm_block_n = 1024;
+	constexpr std::size_t rows_grain = 16;
+}
+
+// Hardware-dependent block sizes and thread count of the kernels. The defaults suit most
+// current x86-64 parts; autotune.hpp measures better ones for the CPU at hand. Every kernel
+// reads the installed values once per call, so install() between calls is safe.
+struct kernel_tuning {
+	std::size_t gemm_block_k = impl::gemm_block_k;
+	std::size_t gemm_block_n = impl::gemm_block_n;
+	std::size_t gemm_unroll = 1;		// rows of B combined per pass over a row of C: 1, 2 or 4
+	std::size_t transpose_block = 32;
+	std::size_t column_grain = impl::gemm_block_n / 4;	// columns per thread of kernels split over columns
+	std::size_t threads = 0;			// cap on the shared pool, 0 for all of its threads
+
+	static kernel_tuning current()
+	{
+		std::lock_guard<std::mutex> lock(mutex());
+		return installed();
+	}
+
+	bool valid() const noexcept
+	{
+		return gemm_block_k != 0 && gemm_block_n != 0 && transpose_block != 0 && column_grain != 0
+			&& (gemm_unroll == 1 || gemm_unroll == 2 || gemm_unroll == 4);
+	}
+
+	// t is used by all following kernel calls
+	static void install(const kernel_tuning& t)
+	{
+		if (!t.valid())
+			throw std::invalid_argument{ "block sizes must be greater than zero and gemm unroll 1, 2 or 4" };
+
+		std::lock_guard<std::mutex> lock(mutex());
+		installed() = t;
+		thread_pool::instance().set_concurrency(t.threads);
+	}
+
+private:
+	static std::mutex& mutex()
+	{
+		static std::mutex m;
+		return m;
+	}
+
+	static kernel_tuning& installed()
+	{
+		static kernel_tuning t;
+		return t;
+	}
+};
+
+inline bool operator==(const kernel_tuning& a, const kernel_tuning& b) noexcept
+{
+	return a.gemm_block_k == b.gemm_block_k && a.gemm_block_n == b.gemm_block_n && a.gemm_unroll == b.gemm_unroll
+		&& a.transpose_block == b.transpose_block && a.column_grain == b.column_grain && a.threads == b.threads;
+}
+
+inline bool operator!=(const kernel_tuning& a, const kernel_tuning& b) noexcept
+{
+	return !(a == b);
+}
+
+namespace impl {
+
+	template<typename T>
+	void axpy_row(T alpha, const T* x, T* y, std::size_t n) noexcept {
+		for (std::size_t j = 0; j < n; ++j)
+			y[j] += alpha * x[j];
+	}
+
+	// y += a0 * x0 + a1 * x1: one pass over y for two rows
+	template<typename T>
+	void axpy2_row(T a0, const T* x0, T a1, const T* x1, T* y, std::size_t n) noexcept {
+		for (std::size_t j = 0; j < n; ++j)
+			y[j] += a0 * x0[j] + a1 * x1[j];
+	}
+
+	template<typename T>
+	void axpy4_row(const T* a, const T* const* x, T* y, std::size_t n) noexcept {
+		const T* x0 = x[0];
+		const T* x1 = x[1];
+		const T* x2 = x[2];
+		const T* x3 = x[3];
+		for (std::size_t j = 0; j < n; ++j)
+			y[j] += a[0] * x0[j] + a[1] * x1[j] + a[2] * x2[j] + a[3] * x3[j];
+	}
+
+	// four partial sums in a fixed order, the one the AVX2 build of matrix_lib vectorizes, so a
+	// result does not depend on which of the two a CPU runs
+	template<typename T>
+	T dot_row(const T* x, const T* y, std::size_t n) noexcept {
+		T sum[4] = {};
+		std::size_t j = 0;
+		for (; j + 4 <= n; j += 4) {
+			for (std::size_t lane = 0; lane < 4; ++lane)
+				sum[lane] += x[j + lane] * y[j + lane];
+		}
+		for (; j < n; ++j)
+			sum[0] += x[j] * y[j];
+		return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+	}
+
+	template<typename T>
+	void scale_row(T alpha, T* x, std::size_t n) noexcept {
+		if (alpha == T()) {
+			std::fill_n(x, n, T());
+			return;
+		}
+		for (std::size_t j = 0; j < n; ++j)
+			x[j] *= alpha;
+	}
+
+#if defined(MATRIX_EXTERN_TEMPLATES)
+	// float and double row kernels of matrix_lib, which runs them with the widest instruction set
+	// of this CPU (matrix_kernels.cpp); the templates above are the portable fallback. Both add in
+	// the same order and neither fuses multiply-adds, so results are identical on every CPU as long
+	// as the portable code is not built with contraction into FMA (e.g. GCC -march=native without
+	// -ffp-contract=off).
+	void axpy_row(float alpha, const float* x, float* y, std::size_t n) noexcept;
+	void axpy_row(double alpha, const double* x, double* y, std::size_t n) noexcept;
+	void axpy2_row(float a0, const float* x0, float a1, const float* x1, float* y, std::size_t n) noexcept;
+	void axpy2_row(double a0, const double* x0, double a1, const double* x1, double* y, std::size_t n) noexcept;
+	void axpy4_row(const float* a, const float* const* x, float* y, std::size_t n) noexcept;
+	void axpy4_row(const double* a, const double* const* x, double* y, std::size_t n) noexcept;
+	float dot_row(const float* x, const float* y, std::size_t n) noexcept;
+	double dot_row(const double* x, const double* y, std::size_t n) noexcept;
+#endif
+
+	// C = alpha * A * B + beta * C for anything with size() and operator[] returning row pointers
+	template<typename T, typename MA, typename MB, typename MC>
+	void gemm_rows(T alpha, const MA& a, const MB& b, T beta, MC& c) {
+		const auto a_sz = a.size();
+		const auto b_sz = b.size();
+		const auto c_sz = c.size();
+		if (a_sz.cols != b_sz.rows || c_sz.rows != a_sz.rows || c_sz.cols != b_sz.cols)
+			throw std::invalid_argument{ "matrix sizes do not match" };
+
+		const std::size_t n = c_sz.cols;
+		const std::size_t k = a_sz.cols;
+		const kernel_tuning tuning = kernel_tuning::current();
+		const std::size_t block_k = tuning.gemm_block_k;
+		const std::size_t block_n = tuning.gemm_block_n;
+		const std::size_t unroll = tuning.gemm_unroll;
+		parallel_for(0, c_sz.rows, rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				if (beta != T(1))
+					scale_row(beta, c[i], n);
+			}
+
+			// blocking over k and n keeps the touched part of B in cache across the rows of the band
+			for (std::size_t jj = 0; jj < n; jj += block_n) {
+				const std::size_t nb = std::min(block_n, n - jj);
+				for (std::size_t pp = 0; pp < k; pp += block_k) {
+					const std::size_t pe = std::min(k, pp + block_k);
+					for (std::size_t i = first; i < last; ++i) {
+						const T* a_row = a[i];
+						T* c_row = c[i] + jj;
+						std::size_t p = pp;
+						// unrolled passes read several rows of B per write of the row of C
+						if (unroll == 4) {
+							for (; p + 4 <= pe; p += 4) {
+								const T s[4] = { T(alpha * a_row[p]), T(alpha * a_row[p + 1]), T(alpha * a_row[p + 2]), T(alpha * a_row[p + 3]) };
+								if (s[0] == T() && s[1] == T() && s[2] == T() && s[3] == T())
+									continue;
+								const T* x[4] = { b[p] + jj, b[p + 1] + jj, b[p + 2] + jj, b[p + 3] + jj };
+								axpy4_row(s, x, c_row, nb);
+							}
+						}
+						if (unroll >= 2) {
+							for (; p + 2 <= pe; p += 2) {
+								const T s0 = alpha * a_row[p];
+								const T s1 = alpha * a_row[p + 1];
+								if (s0 != T() || s1 != T())
+									axpy2_row(s0, b[p] + jj, s1, b[p + 1] + jj, c_row, nb);
+							}
+						}
+						for (; p < pe; ++p) {
+							const T a_ip = alpha * a_row[p];
+							if (a_ip != T())
+								axpy_row(a_ip, b[p] + jj, c_row, nb);
+						}
+					}
+				}
+			}
+		});
+	}
+
+	template<typename T, typename A>
+	void check_vector_size(const std::vector<T, A>& vec, std::size_t expected) {
+		if (vec.size() != expected)
+			throw std::invalid_argument{ "vector size does not match matrix size" };
+	}
+
+	// copies the upper triangle into the lower one
+	template<typename T, typename A>
+	void mirror_upper(matrix<T, A>& a) {
+		const std::size_t n = a.size().rows;
+		parallel_for(1, n, rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				T* row = a[i];
+				for (std::size_t j = 0; j < i; ++j)
+					row[j] = a[j][i];
+			}
+		});
+	}
+
+	// dst = transpose(src), in square blocks (32 x 32 unless tuned) split over threads;
+	// src and dst are anything with size() and operator[] returning row pointers
+	template<typename MS, typename MD>
+	void transpose_into(const MS& src, MD& dst) {
+		const auto sz = src.size();
+		const std::size_t block = kernel_tuning::current().transpose_block;
+		parallel_for(0, sz.cols, block, [&](std::size_t first, std::size_t last) {
+			for (std::size_t jj = first; jj < last; jj += block) {
+				const std::size_t je = std::min(last, jj + block);
+				for (std::size_t ii = 0; ii < sz.rows; ii += block) {
+					const std::size_t ie = std::min(sz.rows, ii + block);
+					for (std::size_t j = jj; j < je; ++j) {
+						auto* out = dst[j];
+						for (std::size_t i = ii; i < ie; ++i)
+							out[i] = src[i][j];
+					}
+				}
+			}
+		});
+	}
+}
+
+// C = alpha * A * B + beta * C
+template<class T, class A>
+void gemm(T alpha, const matrix<T, A>& a, const matrix<T, A>& b, T beta, matrix<T, A>& c)
+{
+	impl::gemm_rows(alpha, a, b, beta, c);
+}
+
+// the same product on views, e.g. blocks of larger matrices
+template<class T>
+void gemm(T alpha, const matrix_view<const T>& a, const matrix_view<const T>& b, T beta, const matrix_view<T>& c)
+{
+	impl::gemm_rows(alpha, a, b, beta, c);
+}
+
+template<class T, class A>
+matrix<T, A> multiply(const matrix<T, A>& a, const matrix<T, A>& b)
+{
+	matrix<T, A> c(a.size().rows, b.size().cols);
+	gemm(T(1), a, b, T(), c);
+	return c;
+}
+
+template<class T, class A>
+matrix<T, A> transpose(const matrix<T, A>& a)
+{
+	matrix<T, A> result(a.size().cols, a.size().rows);
+	impl::transpose_into(a, result);
+	return result;
+}
+
+// y = alpha * A * x + beta * y
+template<class T, class A, class VA>
+void gemv(T alpha, const matrix<T, A>& a, const std::vector<T, VA>& x, T beta, std::vector<T, VA>& y)
+{
+	const auto a_sz = a.size();
+	impl::check_vector_size(x, a_sz.cols);
+	impl::check_vector_size(y, a_sz.rows);
+
+	parallel_for(0, a_sz.rows, impl::rows_grain * 4, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			const T sum = impl::dot_row(a[i], x.data(), a_sz.cols);
+			y[i] = alpha * sum + (beta == T() ? T() : beta * y[i]);
+		}
+	});
+}
+
+// y = alpha * A^T * x + beta * y, computed as a combination of rows of A
+template<class T, class A, class VA>
+void gemv_transposed(T alpha, const matrix<T, A>& a, const std::vector<T, VA>& x, T beta, std::vector<T, VA>& y)
+{
+	const auto a_sz = a.size();
+	impl::check_vector_size(x, a_sz.rows);
+	impl::check_vector_size(y, a_sz.cols);
+
+	impl::scale_row(beta, y.data(), a_sz.cols);
+	// split over columns so that every thread owns a slice of y
+	parallel_for(0, a_sz.cols, kernel_tuning::current().column_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = 0; i < a_sz.rows; ++i) {
+			const T s = alpha * x[i];
+			if (s != T())
+				impl::axpy_row(s, a[i] + first, y.data() + first, last - first);
+		}
+	});
+}
+
+// A += alpha * x * y^T
+template<class T, class A, class VA>
+void ger(T alpha, const std::vector<T, VA>& x, const std::vector<T, VA>& y, matrix<T, A>& a)
+{
+	const auto a_sz = a.size();
+	impl::check_vector_size(x, a_sz.rows);
+	impl::check_vector_size(y, a_sz.cols);
+
+	parallel_for(0, a_sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i)
+			impl::axpy_row(alpha * x[i], y.data(), a[i], a_sz.cols);
+	});
+}
+
+// A += alpha * x * x^T for symmetric A; the result is exactly symmetric
+template<class T, class A, class VA>
+void syr(T alpha, const std::vector<T, VA>& x, matrix<T, A>& a)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+	impl::check_vector_size(x, a_sz.rows);
+
+	const std::size_t n = a_sz.rows;
+	parallel_for(0, n, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i)
+			impl::axpy_row(alpha * x[i], x.data() + i, a[i] + i, n - i);
+	});
+	impl::mirror_upper(a);
+}
+
+// A += alpha * (x * y^T + y * x^T) for symmetric A; the result is exactly symmetric
+template<class T, class A, class VA>
+void syr2(T alpha, const std::vector<T, VA>& x, const std::vector<T, VA>& y, matrix<T, A>& a)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+	impl::check_vector_size(x, a_sz.rows);
+	impl::check_vector_size(y, a_sz.rows);
+
+	const std::size_t n = a_sz.rows;
+	parallel_for(0, n, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			T* row = a[i] + i;
+			const T xi = alpha * x[i];
+			const T yi = alpha * y[i];
+			for (std::size_t j = 0; j < n - i; ++j)
+				row[j] += xi * y[i + j] + yi * x[i + j];
+		}
+	});
+	impl::mirror_upper(a);
+}
+
+// A += alpha * X * Y^T, X is (rows x k), Y is (cols x k)
+template<class T, class A>
+void rank_k_update(T alpha, const matrix<T, A>& x, const matrix<T, A>& y, matrix<T, A>& a)
+{
+	const auto a_sz = a.size();
+	const auto x_sz = x.size();
+	const auto y_sz = y.size();
+	if (x_sz.rows != a_sz.rows || y_sz.rows != a_sz.cols || x_sz.cols != y_sz.cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	// rows of X and Y are both contiguous, so each element is a dot product of two rows;
+	// blocking over columns of A reuses a band of Y from cache
+	constexpr std::size_t block_cols = 64;
+	const std::size_t k = x_sz.cols;
+	parallel_for(0, a_sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t jj = 0; jj < a_sz.cols; jj += block_cols) {
+			const std::size_t je = std::min(a_sz.cols, jj + block_cols);
+			for (std::size_t i = first; i < last; ++i) {
+				const T* x_row = x[i];
+				T* a_row = a[i];
+				for (std::size_t j = jj; j < je; ++j)
+					a_row[j] += alpha * impl::dot_row(x_row, y[j], k);
+			}
+		}
+	});
+}
+
+namespace impl {
+
+	// Gauss-Jordan elimination with partial pivoting: reduces lu to the identity
+	// and applies the same row operations to rhs, leaving A^-1 * rhs in it
+	template<typename T, typename A>
+	void gauss_jordan(matrix<T, A>& lu, matrix<T, A>& rhs) {
+		const std::size_t n = lu.size().rows;
+		const std::size_t m = rhs.size().cols;
+		assert(lu.size().cols == n);
+		assert(rhs.size().rows == n);
+
+		for (std::size_t col = 0; col < n; ++col) {
+			std::size_t pivot = col;
+			for (std::size_t row = col + 1; row < n; ++row) {
+				if (std::abs(lu[row][col]) > std::abs(lu[pivot][col]))
+					pivot = row;
+			}
+			if (lu[pivot][col] == T())
+				throw std::domain_error{ "matrix is singular" };
+
+			// rows are separate buffers, so a pivot swap exchanges row pointers only
+			std::swap(lu.data()[pivot], lu.data()[col]);
+			std::swap(rhs.data()[pivot], rhs.data()[col]);
+
+			const T scale = T(1) / lu[col][col];
+			impl::scale_row(scale, lu[col], n);
+			impl::scale_row(scale, rhs[col], m);
+
+			parallel_for(0, n, rows_grain, [&](std::size_t first, std::size_t last) {
+				for (std::size_t row = first; row < last; ++row) {
+					if (row == col)
+						continue;
+					const T factor = lu[row][col];
+					if (factor == T())
+						continue;
+					axpy_row(-factor, lu[col], lu[row], n);
+					axpy_row(-factor, rhs[col], rhs[row], m);
+				}
+			});
+		}
+	}
+
+	template<typename T, typename A>
+	void set_identity(matrix<T, A>& a) {
+		const auto a_sz = a.size();
+		for (std::size_t i = 0; i < a_sz.rows; ++i) {
+			std::fill_n(a[i], a_sz.cols, T());
+			if (i < a_sz.cols)
+				a[i][i] = T(1);
+		}
+	}
+
+	template<typename T, typename A>
+	void copy_into(const matrix<T, A>& src, matrix<T, A>& dst) {
+		assert(src.size().rows == dst.size().rows && src.size().cols == dst.size().cols);
+		for (std::size_t i = 0; i < src.size().rows; ++i)
+			std::copy_n(src[i], src.size().cols, dst[i]);
+	}
+}
+
+template<class T, class A>
+matrix<T, A> inverse(const matrix<T, A>& a)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+
+	matrix<T, A> lu = a;
+	matrix<T, A> inv(a_sz.rows, a_sz.rows);
+	impl::set_identity(inv);
+	impl::gauss_jordan(lu, inv);
+	return inv;
+}
+
+// solves A * X = B
+template<class T, class A>
+matrix<T, A> solve(const matrix<T, A>& a, const matrix<T, A>& b)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+	if (b.size().rows != a_sz.rows)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	matrix<T, A> lu = a;
+	matrix<T, A> x = b;
+	impl::gauss_jordan(lu, x);
+	return x;
+}
+
+namespace impl {
+
+	// applies H = I - beta * v * v^T from the left to rows [first, rows) and cols [col_first, cols) of a,
+	// v[0] matching row first: w = v^T * A, then A -= beta * v * w, both as row axpys
+	template<typename T, typename A>
+	void apply_householder(const T* v, T beta, std::size_t first, matrix<T, A>& a, std::size_t col_first, std::vector<T>& w) {
+		const auto a_sz = a.size();
+		const std::size_t n = a_sz.cols - col_first;
+		w.assign(n, T());
+		for (std::size_t i = first; i < a_sz.rows; ++i) {
+			if (v[i - first] != T())
+				axpy_row(v[i - first], a[i] + col_first, w.data(), n);
+		}
+		for (std::size_t i = first; i < a_sz.rows; ++i) {
+			if (v[i - first] != T())
+				axpy_row(-beta * v[i - first], w.data(), a[i] + col_first, n);
+		}
+	}
+}
+
+// thin Householder QR of an (m x n) matrix with m >= n: A = Q * R,
+// Q is (m x n) with orthonormal columns and R is (n x n) upper triangular
+template<class T, class A>
+void qr(const matrix<T, A>& a, matrix<T, A>& q, matrix<T, A>& r)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows < a_sz.cols)
+		throw std::invalid_argument{ "matrix must have at least as many rows as cols" };
+
+	const std::size_t m = a_sz.rows;
+	const std::size_t n = a_sz.cols;
+	matrix<T, A> work = a;
+	matrix<T, A> reflectors(n, m, T());
+	std::vector<T> betas(n, T());
+	std::vector<T> w;
+
+	for (std::size_t k = 0; k < n; ++k) {
+		T* v = reflectors[k];
+		T norm2 = T();
+		for (std::size_t i = k; i < m; ++i) {
+			v[i - k] = work[i][k];
+			norm2 += v[i - k] * v[i - k];
+		}
+		if (norm2 == T())
+			continue;
+
+		const T norm = std::sqrt(norm2);
+		const T alpha = (v[0] > T()) ? -norm : norm;
+		// |v|^2 = |x|^2 - 2 alpha x_0 + alpha^2
+		const T v_norm2 = norm2 - T(2) * alpha * v[0] + alpha * alpha;
+		v[0] -= alpha;
+		betas[k] = T(2) / v_norm2;
+		impl::apply_householder(v, betas[k], k, work, k, w);
+	}
+
+	r = matrix<T, A>(n, n, T());
+	for (std::size_t i = 0; i < n; ++i)
+		std::copy(work[i] + i, work[i] + n, r[i] + i);
+
+	// Q = H_0 * ... * H_{n-1} * I(m x n); H_k leaves the first k columns of the partial product alone
+	q = matrix<T, A>(m, n);
+	impl::set_identity(q);
+	for (std::size_t k = n; k-- > 0;) {
+		if (betas[k] != T())
+			impl::apply_householder(reflectors[k], betas[k], k, q, k, w);
+	}
+}
+
+// lower triangular L with A = L * L^T for symmetric positive definite A; only the lower triangle of A is read.
+// Column j of L is a dot product of row prefixes of L for every row below the diagonal, split over threads.
+template<class T, class A>
+matrix<T, A> cholesky(const matrix<T, A>& a)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+
+	const std::size_t n = a_sz.rows;
+	matrix<T, A> l(n, n, T());
+	for (std::size_t j = 0; j < n; ++j) {
+		const T diag = a[j][j] - impl::dot_row(l[j], l[j], j);
+		if (!(diag > T()))
+			throw std::domain_error{ "matrix is not positive definite" };
+
+		l[j][j] = std::sqrt(diag);
+		const T inv = T(1) / l[j][j];
+		parallel_for(j + 1, n, impl::rows_grain * 4, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i)
+				l[i][j] = (a[i][j] - impl::dot_row(l[i], l[j], j)) * inv;
+		});
+	}
+	return l;
+}
+
+// Given Ainv = A^-1, replaces it with (A + u * v^T)^-1 in O(n^2)
+template<class T, class A, class VA>
+void sherman_morrison_update(matrix<T, A>& a_inv, const std::vector<T, VA>& u, const std::vector<T, VA>& v)
+{
+	const auto a_sz = a_inv.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+
+	std::vector<T, VA> w(a_sz.rows);
+	std::vector<T, VA> z(a_sz.rows);
+	gemv(T(1), a_inv, u, T(), w);
+	gemv_transposed(T(1), a_inv, v, T(), z);
+
+	const T denom = T(1) + impl::dot_row(v.data(), w.data(), a_sz.rows);
+	if (denom == T())
+		throw std::domain_error{ "updated matrix is singular" };
+
+	ger(T(-1) / denom, w, z, a_inv);
+}
+
+// Given Ainv = A^-1, replaces it with (A + U * V^T)^-1 in O(n^2 k), U and V are (n x k)
+template<class T, class A>
+void woodbury_update(matrix<T, A>& a_inv, const matrix<T, A>& u, const matrix<T, A>& v)
+{
+	const auto a_sz = a_inv.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+	if (!same_shape(u.size(), v.size()) || u.size().rows != a_sz.rows)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	const std::size_t k = u.size().cols;
+
+	// W = Ainv * U, Z = Ainv^T * V
+	matrix<T, A> w = multiply(a_inv, u);
+	matrix<T, A> z = multiply(transpose(a_inv), v);
+
+	// S = I + V^T * W
+	matrix<T, A> s = multiply(transpose(v), w);
+	for (std::size_t i = 0; i < k; ++i)
+		s[i][i] += T(1);
+
+	// Ainv -= (W * S^-1) * Z^T
+	const matrix<T, A> ws = multiply(w, inverse(s));
+	rank_k_update(T(-1), ws, z, a_inv);
+}
+
+// Kernels precompiled for float and double by matrix_lib (see matrix.hpp); EXTERN is extern
+// for the declarations below and empty for the definitions in matrix_instantiations.cpp.
+#define MATRIX_LINALG_INSTANTIATIONS(EXTERN, T) \
+	EXTERN template void gemm(T, const matrix<T>&, const matrix<T>&, T, matrix<T>&); \
+	EXTERN template void gemm(T, const matrix_view<const T>&, const matrix_view<const T>&, T, const matrix_view<T>&); \
+	EXTERN template matrix<T> multiply(const matrix<T>&, const matrix<T>&); \
+	EXTERN template matrix<T> transpose(const matrix<T>&); \
+	EXTERN template void gemv(T, const matrix<T>&, const std::vector<T>&, T, std::vector<T>&); \
+	EXTERN template void gemv_transposed(T, const matrix<T>&, const std::vector<T>&, T, std::vector<T>&); \
+	EXTERN template matrix<T> inverse(const matrix<T>&); \
+	EXTERN template matrix<T> solve(const matrix<T>&, const matrix<T>&); \
+	EXTERN template void qr(const matrix<T>&, matrix<T>&, matrix<T>&); \
+	EXTERN template matrix<T> cholesky(const matrix<T>&);
+
+#if defined(MATRIX_EXTERN_TEMPLATES)
+MATRIX_LINALG_INSTANTIATIONS(extern, float)
+MATRIX_LINALG_INSTANTIATIONS(extern, double)
+#endif
+
+
+#endif // !LINALG_HPP
@@ -2,6 +2,8 @@
 #ifndef MATRIX_HPP
 #define MATRIX_HPP
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <scoped_allocator>
@@ -115,7 +117,7 @@ namespace impl {
 				else { // if lhs matrix is not empty - deallocate lhs
 					assert(lhs_rows > 0);
 					assert(lhs_cols > 0);
-					deallocate_matrix<T, AllocRows, AllocCols>(pLhs, lhs_rows, lhs_cols, std::true_type);
+					deallocate_matrix<T, AllocRows, AllocCols>(pLhs, lhs_rows, lhs_cols, std::true_type{});
 				}
 				return;
 			}
@@ -128,7 +130,7 @@ namespace impl {
 			if (pLhs == nullptr) {
 				assert(lhs_rows == 0);
 				assert(lhs_cols == 0);
-				*lhs = make_matrix<T, AllocRows, AllocCols>(rhs, rhs_rows, rhs_cols, std::true_type);
+				*lhs = make_matrix<T, AllocRows, AllocCols>(rhs, rhs_rows, rhs_cols, std::true_type{});
 				return;
 			}
 
@@ -139,7 +141,7 @@ namespace impl {
 			// if count rows in lhs and rhs are equal
 			if (lhs_rows == rhs_rows) {
 				if (lhs_cols == rhs_cols) { // if count cols in lhs and rhs are equal
-					copy_matrix(pLhs, rhs, lhs_rows, lhs_cols, std::true_type);
+					copy_matrix(pLhs, rhs, lhs_rows, lhs_cols, std::true_type{});
 				}
 				else { // if count cols in lhs and rhs are not equal
 					for (std::size_t row = 0; row < lhs_rows; ++row) {
@@ -152,8 +154,8 @@ namespace impl {
 			}
 
 			// if count rows in lhs and rhs are not equal - allocating new matrix
-			deallocate_matrix<T, AllocRows, AllocCols>(pLhs, lhs_rows, lhs_cols, std::true_type);
-			*lhs = make_matrix<T, AllocRows, AllocCols>(rhs, rhs_rows, rhs_cols, std::true_type);
+			deallocate_matrix<T, AllocRows, AllocCols>(pLhs, lhs_rows, lhs_cols, std::true_type{});
+			*lhs = make_matrix<T, AllocRows, AllocCols>(rhs, rhs_rows, rhs_cols, std::true_type{});
 		}
 
 
@@ -365,7 +367,7 @@ namespace impl {
 				else { // if lhs matrix is not empty - deallocate lhs
 					assert(lhs_rows > 0);
 					assert(lhs_cols > 0);
-					deallocate_matrix<T, AllocRows, AllocCols>(pLhs, lhs_rows, lhs_cols, lhs_space_rows, lhs_space_cols, std::false_type);
+					deallocate_matrix<T, AllocRows, AllocCols>(pLhs, lhs_rows, lhs_cols, lhs_space_rows, lhs_space_cols, std::false_type{});
 				}
 				return;
 			}
@@ -378,7 +380,7 @@ namespace impl {
 			if (pLhs == nullptr) {
 				assert(lhs_rows == 0);
 				assert(lhs_cols == 0);
-				*lhs = make_matrix<T, AllocRows, AllocCols>(rhs, rhs_rows, rhs_cols, std::false_type);
+				*lhs = make_matrix<T, AllocRows, AllocCols>(rhs, rhs_rows, rhs_cols, std::false_type{});
 				return;
 			}
 
@@ -389,7 +391,7 @@ namespace impl {
 			// if count rows in lhs and rhs are equal
 			if (lhs_rows == rhs_rows) {
 				if (lhs_cols == rhs_cols) { // if count cols in lhs and rhs are equal
-					copy_matrix(pLhs, rhs, lhs_rows, lhs_cols, std::false_type);
+					copy_matrix(pLhs, rhs, lhs_rows, lhs_cols, std::false_type{});
 				}
 				else { 
 					// if count cols in lhs and rhs are not equal - 
@@ -420,8 +422,8 @@ namespace impl {
 			}
 
 			// if count rows in lhs and rhs are not equal - allocating new matrix
-			deallocate_matrix<T, AllocRows, AllocCols>(pLhs, lhs_rows, lhs_cols, lhs_space_rows, lhs_space_cols, std::false_type);
-			*lhs = make_matrix<T, AllocRows, AllocCols>(rhs, rhs_rows, rhs_cols, std::false_type);
+			deallocate_matrix<T, AllocRows, AllocCols>(pLhs, lhs_rows, lhs_cols, lhs_space_rows, lhs_space_cols, std::false_type{});
+			*lhs = make_matrix<T, AllocRows, AllocCols>(rhs, rhs_rows, rhs_cols, std::false_type{});
 		}
 	}
 
@@ -478,6 +480,12 @@ struct matrix_size_type {
 	std::size_t cols = 0;
 };
 
+// == above compares element counts; shapes match only if rows and cols both do
+constexpr bool same_shape(matrix_size_type a, matrix_size_type b) noexcept
+{
+	return a.rows == b.rows && a.cols == b.cols;
+}
+
 template<class T, class Allocator = std::allocator<T>>
 class matrix {
 public:
@@ -521,7 +529,7 @@ public:
 
 	~matrix() { clear(); }
 
-	matrix(const matrix& other) 
+	matrix(const matrix& other) : alloc_{ other.alloc_.select_on_container_copy_construction() }
 	{
 		if (other.empty()) 
 			return;
@@ -549,6 +557,7 @@ public:
 	}
 
 	T** data() { return elems_; }
+	const T* const* data() const { return elems_; }
 
 	T* operator[](size_type index) noexcept { return elems_[index]; }
 	const T* operator[](size_type index) const noexcept { return elems_[index]; }
@@ -565,6 +574,8 @@ public:
 		std::swap(sz_, other.sz_);
 		std::swap(space_, other.space_);
 		std::swap(elems_, other.elems_);
+		// rows must go back to the allocator that handed them out, so it moves with them
+		std::swap(alloc_, other.alloc_);
 	}
 
 	void clear() { destroy_and_deallocate_elems(space_.rows, space_.cols, sz_.rows - 1, sz_.cols); }
@@ -593,6 +604,7 @@ private:
 		}
 
 		elems_ = alloc_.allocate(rows);
+		std::fill_n(elems_, rows, nullptr);
 		sz_ = matrix_size_type{ rows, cols };
 		space_ = sz_;
 
@@ -618,6 +630,7 @@ private:
 		sz_ = matrix_size_type{ rows, cols };
 		space_ = sz_;
 		elems_ = alloc_.allocate(rows);
+		std::fill_n(elems_, rows, nullptr);
 
 		size_type currRow = 0;
 		size_type currCol = 0;
@@ -641,6 +654,7 @@ private:
 		sz_ = matrix_size_type{ rows, cols };
 		space_ = sz_;
 		elems_ = alloc_.allocate(rows);
+		std::fill_n(elems_, rows, nullptr);
 
 		size_type currRow = 0;
 		size_type currCol = 0;
@@ -673,15 +687,19 @@ private:
 			(alloc_.inner_allocator()).deallocate(elems_[row], countCols);
 		}
 
-		// destructing current row [0...currCol)
-		for (size_type col = 0; col < currCol; ++col) {
-			elems_[currRow][col].~T();
+		// destructing current row [0...currCol), unless its allocation is what failed
+		if (elems_[currRow] != nullptr) {
+			for (size_type col = 0; col < currCol; ++col) {
+				elems_[currRow][col].~T();
+			}
+			(alloc_.inner_allocator()).deallocate(elems_[currRow], countCols);
 		}
-		(alloc_.inner_allocator()).deallocate(elems_[currRow], countCols);
 
-		// deallocating all after current row
+		// rows after the current one were never allocated by a failed construction
 		for (size_type row = currRow + 1; row < countRows; ++row) {
-			(alloc_.inner_allocator()).deallocate(elems_[row], countCols);
+			if (elems_[row] != nullptr) {
+				(alloc_.inner_allocator()).deallocate(elems_[row], countCols);
+			}
 		}
 		alloc_.deallocate(elems_, countRows);
 
@@ -716,5 +734,16 @@ std::ostream& operator<<(std::ostream& os, const matrix<T, A>& mtx)
 	return os;
 }
 
+// With MATRIX_EXTERN_TEMPLATES the common instantiations come precompiled from matrix_lib
+// (matrix_instantiations.cpp) instead of being compiled again in every translation unit.
+// It has to be defined for the whole program, library included.
+#if defined(MATRIX_EXTERN_TEMPLATES)
+extern template class matrix<float>;
+extern template class matrix<double>;
+extern template class matrix<std::int32_t>;
+extern template class matrix<std::int64_t>;
+extern template class matrix<std::uint8_t>;
+#endif
+
 
 #endif // !MATRIX_HPP
@@ -0,0 +1,45 @@
+// Optional C++20 module interface of the core library: import matrix; instead of including
+// matrix.hpp, matrix_view.hpp, parallel.hpp and linalg.hpp. Importers skip parsing those headers,
+// and with MATRIX_EXTERN_TEMPLATES the common instantiations still come from matrix_lib.
+// matrix_lib.vcxproj excludes this file from the build; enable it together with /std:c++20.
+module;
+
+#include "matrix.hpp"
+#include "matrix_view.hpp"
+#include "parallel.hpp"
+#include "linalg.hpp"
+
+export module matrix;
+
+export using ::matrix_size_type;
+export using ::matrix;
+export using ::operator<<;
+
+export using ::matrix_view;
+export using ::view;
+export using ::row_block;
+export using ::block;
+export using ::copy;
+export using ::to_matrix;
+
+export using ::thread_pool;
+export using ::parallel_for;
+export using ::kernel_tuning;
+export using ::operator==;
+export using ::operator!=;
+
+export using ::gemm;
+export using ::multiply;
+export using ::transpose;
+export using ::gemv;
+export using ::gemv_transposed;
+export using ::ger;
+export using ::syr;
+export using ::syr2;
+export using ::rank_k_update;
+export using ::inverse;
+export using ::solve;
+export using ::qr;
+export using ::cholesky;
+export using ::sherman_morrison_update;
+export using ::woodbury_update;
@@ -0,0 +1,321 @@
+// C interface of matrix_c.h. A handle keeps a row table into its buffer, so the kernels see it
+// as a matrix_view and work on foreign memory in place; exceptions become status codes here.
+#if !defined(MATRIX_C_BUILD)
+#define MATRIX_C_BUILD
+#endif
+
+#include "matrix_c.h"
+
+#include "matrix.hpp"
+#include "matrix_view.hpp"
+#include "linalg.hpp"
+#include "reduce.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+struct matrix_handle_s {
+	matrix_dtype dtype = MATRIX_FLOAT64;
+	std::size_t rows = 0;
+	std::size_t cols = 0;
+	std::size_t row_stride = 0;
+	void* data = nullptr;
+	std::unique_ptr<double[]> owned;	// storage of matrix_create, double-aligned for both dtypes
+	std::vector<float*> rows32;
+	std::vector<double*> rows64;
+};
+
+namespace {
+
+	thread_local std::string last_error;
+
+	struct status_error : std::runtime_error {
+		status_error(matrix_status status, const char* what) : std::runtime_error(what), status(status) {}
+		matrix_status status;
+	};
+
+	// runs fn and turns whatever it throws into a status and a message
+	template<typename Func>
+	matrix_status guarded(Func&& fn) noexcept {
+		try {
+			fn();
+			last_error.clear();
+			return MATRIX_OK;
+		}
+		catch (const status_error& e) {
+			last_error = e.what();
+			return e.status;
+		}
+		catch (const std::out_of_range& e) {
+			last_error = e.what();
+			return MATRIX_ERROR_OUT_OF_RANGE;
+		}
+		catch (const std::invalid_argument& e) {
+			last_error = e.what();
+			return MATRIX_ERROR_INVALID_ARGUMENT;
+		}
+		catch (const std::domain_error& e) {
+			last_error = e.what();
+			return MATRIX_ERROR_NUMERICAL;
+		}
+		catch (const std::bad_alloc&) {
+			last_error = "out of memory";
+			return MATRIX_ERROR_OUT_OF_MEMORY;
+		}
+		catch (const std::exception& e) {
+			last_error = e.what();
+			return MATRIX_ERROR_INTERNAL;
+		}
+		catch (...) {
+			last_error = "unknown error";
+			return MATRIX_ERROR_INTERNAL;
+		}
+	}
+
+	void check(bool condition, matrix_status status, const char* what) {
+		if (!condition)
+			throw status_error(status, what);
+	}
+
+	std::size_t element_size(matrix_dtype dtype) {
+		switch (dtype) {
+		case MATRIX_FLOAT32:
+			return sizeof(float);
+		case MATRIX_FLOAT64:
+			return sizeof(double);
+		}
+		throw status_error(MATRIX_ERROR_INVALID_ARGUMENT, "unsupported dtype");
+	}
+
+	std::unique_ptr<matrix_handle_s> make_handle(matrix_dtype dtype, void* data, std::size_t rows, std::size_t cols, std::size_t row_stride) {
+		auto h = std::make_unique<matrix_handle_s>();
+		h->dtype = dtype;
+		h->rows = rows;
+		h->cols = cols;
+		h->row_stride = row_stride;
+		h->data = data;
+		const std::size_t row_bytes = row_stride * element_size(dtype);
+		auto* base = static_cast<unsigned char*>(data);
+		if (dtype == MATRIX_FLOAT32) {
+			h->rows32.resize(rows);
+			for (std::size_t i = 0; i < rows; ++i)
+				h->rows32[i] = reinterpret_cast<float*>(base + i * row_bytes);
+		}
+		else {
+			h->rows64.resize(rows);
+			for (std::size_t i = 0; i < rows; ++i)
+				h->rows64[i] = reinterpret_cast<double*>(base + i * row_bytes);
+		}
+		return h;
+	}
+
+	template<typename T>
+	matrix_view<T> view_of(matrix_handle h) {
+		if constexpr (std::is_same_v<T, float>)
+			return matrix_view<T>(h->rows32.data(), h->rows, 0, h->cols);
+		else
+			return matrix_view<T>(h->rows64.data(), h->rows, 0, h->cols);
+	}
+
+	template<typename T>
+	matrix<T> copy_of(matrix_handle h) {
+		return to_matrix(matrix_view<const T>(view_of<T>(h)));
+	}
+
+	// calls fn with a value of the element type of h
+	template<typename Func>
+	void dispatch(matrix_handle h, Func&& fn) {
+		if (h->dtype == MATRIX_FLOAT32)
+			fn(float());
+		else
+			fn(double());
+	}
+
+	void check_handle(matrix_handle h) {
+		check(h != nullptr, MATRIX_ERROR_INVALID_ARGUMENT, "matrix handle is null");
+	}
+
+	void check_same_dtype(matrix_handle a, matrix_handle b) {
+		check(a->dtype == b->dtype, MATRIX_ERROR_SIZE_MISMATCH, "matrix dtypes do not match");
+	}
+
+	// whether the elements of a and b share memory, also for different handles over one buffer
+	bool overlaps(matrix_handle a, matrix_handle b) {
+		auto range = [](matrix_handle h) {
+			const auto first = reinterpret_cast<std::uintptr_t>(h->data);
+			const std::size_t count = (h->rows == 0 || h->cols == 0) ? 0 : (h->rows - 1) * h->row_stride + h->cols;
+			return std::make_pair(first, first + count * element_size(h->dtype));
+		};
+		const auto ra = range(a);
+		const auto rb = range(b);
+		return ra.first < ra.second && rb.first < rb.second && ra.first < rb.second && rb.first < ra.second;
+	}
+}
+
+extern "C" {
+
+	int matrix_abi_version(void)
+	{
+		return MATRIX_C_ABI_VERSION;
+	}
+
+	const char* matrix_status_string(matrix_status status)
+	{
+		switch (status) {
+		case MATRIX_OK:
+			return "ok";
+		case MATRIX_ERROR_INVALID_ARGUMENT:
+			return "invalid argument";
+		case MATRIX_ERROR_SIZE_MISMATCH:
+			return "size mismatch";
+		case MATRIX_ERROR_OUT_OF_RANGE:
+			return "out of range";
+		case MATRIX_ERROR_OUT_OF_MEMORY:
+			return "out of memory";
+		case MATRIX_ERROR_NUMERICAL:
+			return "numerical error";
+		case MATRIX_ERROR_INTERNAL:
+			return "internal error";
+		}
+		return "unknown status";
+	}
+
+	const char* matrix_last_error(void)
+	{
+		return last_error.c_str();
+	}
+
+	matrix_status matrix_create(matrix_dtype dtype, size_t rows, size_t cols, matrix_handle* out)
+	{
+		return guarded([&] {
+			check(out != nullptr, MATRIX_ERROR_INVALID_ARGUMENT, "output pointer is null");
+			const std::size_t elem = element_size(dtype);
+			check(cols == 0 || rows <= std::numeric_limits<std::size_t>::max() / cols / elem, MATRIX_ERROR_OUT_OF_MEMORY, "matrix is too large");
+			const std::size_t bytes = rows * cols * elem;
+			auto owned = std::make_unique<double[]>((bytes + sizeof(double) - 1) / sizeof(double));
+			auto h = make_handle(dtype, owned.get(), rows, cols, cols);
+			h->owned = std::move(owned);
+			*out = h.release();
+		});
+	}
+
+	matrix_status matrix_wrap(matrix_dtype dtype, void* data, size_t rows, size_t cols, size_t row_stride, matrix_handle* out)
+	{
+		return guarded([&] {
+			check(out != nullptr, MATRIX_ERROR_INVALID_ARGUMENT, "output pointer is null");
+			check(data != nullptr || rows == 0 || cols == 0, MATRIX_ERROR_INVALID_ARGUMENT, "data pointer is null");
+			check(row_stride >= cols, MATRIX_ERROR_INVALID_ARGUMENT, "row stride is smaller than cols");
+			check(reinterpret_cast<std::uintptr_t>(data) % element_size(dtype) == 0, MATRIX_ERROR_INVALID_ARGUMENT, "data is not aligned to its dtype");
+			*out = make_handle(dtype, data, rows, cols, row_stride).release();
+		});
+	}
+
+	void matrix_destroy(matrix_handle m)
+	{
+		delete m;
+	}
+
+	matrix_status matrix_shape(matrix_handle m, size_t* rows, size_t* cols)
+	{
+		return guarded([&] {
+			check_handle(m);
+			if (rows)
+				*rows = m->rows;
+			if (cols)
+				*cols = m->cols;
+		});
+	}
+
+	matrix_status matrix_get_dtype(matrix_handle m, matrix_dtype* dtype)
+	{
+		return guarded([&] {
+			check_handle(m);
+			check(dtype != nullptr, MATRIX_ERROR_INVALID_ARGUMENT, "output pointer is null");
+			*dtype = m->dtype;
+		});
+	}
+
+	matrix_status matrix_data(matrix_handle m, void** data, size_t* row_stride)
+	{
+		return guarded([&] {
+			check_handle(m);
+			if (data)
+				*data = m->data;
+			if (row_stride)
+				*row_stride = m->row_stride;
+		});
+	}
+
+	matrix_status matrix_gemm(double alpha, matrix_handle a, matrix_handle b, double beta, matrix_handle c)
+	{
+		return guarded([&] {
+			check_handle(a);
+			check_handle(b);
+			check_handle(c);
+			check_same_dtype(a, b);
+			check_same_dtype(a, c);
+			check(!overlaps(c, a) && !overlaps(c, b), MATRIX_ERROR_INVALID_ARGUMENT, "result overlaps an operand");
+			check(a->cols == b->rows && c->rows == a->rows && c->cols == b->cols, MATRIX_ERROR_SIZE_MISMATCH, "matrix sizes do not match");
+			dispatch(a, [&](auto zero) {
+				using T = decltype(zero);
+				gemm(static_cast<T>(alpha), matrix_view<const T>(view_of<T>(a)), matrix_view<const T>(view_of<T>(b)), static_cast<T>(beta), view_of<T>(c));
+			});
+		});
+	}
+
+	matrix_status matrix_solve(matrix_handle a, matrix_handle b, matrix_handle x)
+	{
+		return guarded([&] {
+			check_handle(a);
+			check_handle(b);
+			check_handle(x);
+			check_same_dtype(a, b);
+			check_same_dtype(a, x);
+			check(a->rows == a->cols, MATRIX_ERROR_SIZE_MISMATCH, "matrix must be square");
+			check(a->rows == b->rows && x->rows == b->rows && x->cols == b->cols, MATRIX_ERROR_SIZE_MISMATCH, "matrix sizes do not match");
+			dispatch(a, [&](auto zero) {
+				using T = decltype(zero);
+				const matrix<T> result = solve(copy_of<T>(a), copy_of<T>(b));
+				copy(view(result), view_of<T>(x));
+			});
+		});
+	}
+
+	matrix_status matrix_reduce(matrix_handle a, matrix_reduce_op op, matrix_axis_c axis, matrix_handle out)
+	{
+		return guarded([&] {
+			check_handle(a);
+			check_handle(out);
+			check_same_dtype(a, out);
+			check(op >= MATRIX_REDUCE_SUM && op <= MATRIX_REDUCE_MEAN, MATRIX_ERROR_INVALID_ARGUMENT, "unknown reduction");
+			check(axis >= MATRIX_AXIS_ROWS && axis <= MATRIX_AXIS_ALL, MATRIX_ERROR_INVALID_ARGUMENT, "unknown axis");
+
+			const std::size_t count = (axis == MATRIX_AXIS_ROWS) ? a->cols : (axis == MATRIX_AXIS_COLS) ? a->rows : 1;
+			check((out->rows == 1 && out->cols == count) || (out->cols == 1 && out->rows == count), MATRIX_ERROR_SIZE_MISMATCH, "matrix sizes do not match");
+			dispatch(a, [&](auto zero) {
+				using T = decltype(zero);
+				const matrix_view<const T> in(view_of<T>(a));
+				const auto cpp_op = static_cast<reduce_op>(op);
+				std::vector<T> values;
+				if (axis == MATRIX_AXIS_ALL)
+					values.assign(1, reduce_all(in, cpp_op));
+				else
+					values = reduce(in, cpp_op, axis == MATRIX_AXIS_ROWS ? matrix_axis::rows : matrix_axis::cols);
+
+				const matrix_view<T> dst = view_of<T>(out);
+				for (std::size_t k = 0; k < count; ++k)
+					(out->rows == 1 ? dst[0][k] : dst[k][0]) = values[k];
+			});
+		});
+	}
+}
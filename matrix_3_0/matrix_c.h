@@ -0,0 +1,94 @@
+#ifndef MATRIX_C_H
+#define MATRIX_C_H
+
+/*
+ * C interface to the matrix kernels, for callers in other languages.
+ * A matrix_handle describes a row-major block of float32 or float64 elements with a row stride.
+ * matrix_create allocates and owns the block; matrix_wrap borrows a caller's buffer without
+ * copying it, and the buffer has to outlive the handle. Every function returns a matrix_status;
+ * on failure matrix_last_error gives a description, valid until the next call on the same thread.
+ * No C++ exception ever leaves these functions. Enum values and signatures only ever get added to.
+ */
+
+#include <stddef.h>
+
+#if defined(MATRIX_C_STATIC)
+#define MATRIX_C_API
+#elif defined(_WIN32)
+#if defined(MATRIX_C_BUILD)
+#define MATRIX_C_API __declspec(dllexport)
+#else
+#define MATRIX_C_API __declspec(dllimport)
+#endif
+#else
+#define MATRIX_C_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MATRIX_C_ABI_VERSION 1
+
+typedef struct matrix_handle_s* matrix_handle;
+
+typedef enum matrix_status {
+	MATRIX_OK = 0,
+	MATRIX_ERROR_INVALID_ARGUMENT = 1,	/* null pointer, bad dtype or enum value */
+	MATRIX_ERROR_SIZE_MISMATCH = 2,		/* shapes or dtypes of the operands do not fit */
+	MATRIX_ERROR_OUT_OF_RANGE = 3,
+	MATRIX_ERROR_OUT_OF_MEMORY = 4,
+	MATRIX_ERROR_NUMERICAL = 5,			/* singular or not positive definite */
+	MATRIX_ERROR_INTERNAL = 6
+} matrix_status;
+
+/* same values as the dtype enum of the C++ headers */
+typedef enum matrix_dtype {
+	MATRIX_FLOAT32 = 9,
+	MATRIX_FLOAT64 = 10
+} matrix_dtype;
+
+typedef enum matrix_reduce_op {
+	MATRIX_REDUCE_SUM = 0,
+	MATRIX_REDUCE_MIN = 1,
+	MATRIX_REDUCE_MAX = 2,
+	MATRIX_REDUCE_MEAN = 3
+} matrix_reduce_op;
+
+typedef enum matrix_axis_c {
+	MATRIX_AXIS_ROWS = 0,	/* down the rows: one value per column */
+	MATRIX_AXIS_COLS = 1,	/* along each row: one value per row */
+	MATRIX_AXIS_ALL = 2		/* one value */
+} matrix_axis_c;
+
+MATRIX_C_API int matrix_abi_version(void);
+MATRIX_C_API const char* matrix_status_string(matrix_status status);
+MATRIX_C_API const char* matrix_last_error(void);
+
+/* zero-filled rows x cols matrix with rows packed one after another */
+MATRIX_C_API matrix_status matrix_create(matrix_dtype dtype, size_t rows, size_t cols, matrix_handle* out);
+
+/* row i starts at data + i * row_stride elements; row_stride >= cols */
+MATRIX_C_API matrix_status matrix_wrap(matrix_dtype dtype, void* data, size_t rows, size_t cols, size_t row_stride, matrix_handle* out);
+
+/* null is accepted and ignored */
+MATRIX_C_API void matrix_destroy(matrix_handle m);
+
+MATRIX_C_API matrix_status matrix_shape(matrix_handle m, size_t* rows, size_t* cols);
+MATRIX_C_API matrix_status matrix_get_dtype(matrix_handle m, matrix_dtype* dtype);
+MATRIX_C_API matrix_status matrix_data(matrix_handle m, void** data, size_t* row_stride);
+
+/* C = alpha * A * B + beta * C; the memory of C must not overlap A or B, also not through another handle */
+MATRIX_C_API matrix_status matrix_gemm(double alpha, matrix_handle a, matrix_handle b, double beta, matrix_handle c);
+
+/* X = A^-1 * B for square A; X has the shape of B and may be B itself */
+MATRIX_C_API matrix_status matrix_solve(matrix_handle a, matrix_handle b, matrix_handle x);
+
+/* out is a 1 x n or n x 1 matrix (any of the two) of n = cols, rows or 1 values, by axis */
+MATRIX_C_API matrix_status matrix_reduce(matrix_handle a, matrix_reduce_op op, matrix_axis_c axis, matrix_handle out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MATRIX_C_H */
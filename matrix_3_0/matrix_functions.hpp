@@ -0,0 +1,268 @@
+#pragma once
+#ifndef MATRIX_FUNCTIONS_HPP
+#define MATRIX_FUNCTIONS_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+
+// Functions of square matrices built on gemm.
+// All workspaces are allocated up front; iterations multiply into a scratch matrix
+// and swap it in, so no allocation happens inside the loops.
+namespace impl {
+
+	template<typename T, typename A>
+	void check_square(const matrix<T, A>& a) {
+		if (a.size().rows != a.size().cols)
+			throw std::invalid_argument{ "matrix must be square" };
+		if (a.empty())
+			throw std::invalid_argument{ "matrix must not be empty" };
+	}
+
+	// max absolute column sum
+	template<typename T, typename A>
+	T norm_1(const matrix<T, A>& a) {
+		const auto a_sz = a.size();
+		std::vector<T> sums(a_sz.cols, T());
+		for (std::size_t i = 0; i < a_sz.rows; ++i) {
+			const T* row = a[i];
+			for (std::size_t j = 0; j < a_sz.cols; ++j)
+				sums[j] += std::abs(row[j]);
+		}
+		return *std::max_element(sums.begin(), sums.end());
+	}
+
+	// y = alpha * x + beta * y
+	template<typename T, typename A>
+	void axpby(T alpha, const matrix<T, A>& x, T beta, matrix<T, A>& y) {
+		const auto y_sz = y.size();
+		for (std::size_t i = 0; i < y_sz.rows; ++i) {
+			const T* x_row = x[i];
+			T* y_row = y[i];
+			for (std::size_t j = 0; j < y_sz.cols; ++j)
+				y_row[j] = alpha * x_row[j] + beta * y_row[j];
+		}
+	}
+
+	template<typename T, typename A>
+	void add_identity(T alpha, matrix<T, A>& a) {
+		for (std::size_t i = 0; i < a.size().rows; ++i)
+			a[i][i] += alpha;
+	}
+
+	// Pade coefficients b_0..b_m of exp, Higham (2005)
+	constexpr double pade3[] = { 120., 60., 12., 1. };
+	constexpr double pade5[] = { 30240., 15120., 3360., 420., 30., 1. };
+	constexpr double pade7[] = { 17297280., 8648640., 1995840., 277200., 25200., 1512., 56., 1. };
+	constexpr double pade9[] = { 17643225600., 8821612800., 2075673600., 302702400., 30270240.,
+		2162160., 110880., 3960., 90., 1. };
+	constexpr double pade13[] = { 64764752532480000., 32382376266240000., 7771770303897600.,
+		1187353796428800., 129060195264000., 10559470521600., 670442572800.,
+		33522128640., 1323241920., 40840800., 960960., 16380., 182., 1. };
+
+	// largest 1-norm for which the degree m approximant is accurate to double precision
+	constexpr double pade_theta[] = { 1.495585217958292e-2, 2.539398330063230e-1,
+		9.504178996162932e-1, 2.097847961257068e0, 5.371920351148152e0 };
+}
+
+// A^k by binary exponentiation: O(log k) multiplications, three n x n buffers in total
+template<class T, class A>
+matrix<T, A> matrix_power(const matrix<T, A>& a, std::uint64_t k)
+{
+	impl::check_square(a);
+
+	const std::size_t n = a.size().rows;
+	matrix<T, A> result(n, n);
+	if (k == 0) {
+		impl::set_identity(result);
+		return result;
+	}
+
+	matrix<T, A> base = a;
+	matrix<T, A> tmp(n, n);
+	bool result_is_identity = true;
+	for (;;) {
+		if (k & 1) {
+			if (result_is_identity) {
+				impl::copy_into(base, result);
+				result_is_identity = false;
+			}
+			else {
+				gemm(T(1), result, base, T(), tmp);
+				result.swap(tmp);
+			}
+		}
+
+		k >>= 1;
+		if (k == 0)
+			break;
+
+		gemm(T(1), base, base, T(), tmp);
+		base.swap(tmp);
+	}
+	return result;
+}
+
+// exp(A) by scaling and squaring with a Pade approximant of degree 3, 5, 7, 9 or 13
+template<class T, class A>
+matrix<T, A> expm(const matrix<T, A>& a)
+{
+	static_assert(std::is_floating_point_v<T>, "expm requires floating point elements");
+	impl::check_square(a);
+
+	const std::size_t n = a.size().rows;
+	const double norm = static_cast<double>(impl::norm_1(a));
+
+	int degree = 13;
+	const double* b = impl::pade13;
+	constexpr int low_degrees[] = { 3, 5, 7, 9 };
+	const double* low_coefs[] = { impl::pade3, impl::pade5, impl::pade7, impl::pade9 };
+	for (int d = 0; d < 4; ++d) {
+		if (norm <= impl::pade_theta[d]) {
+			degree = low_degrees[d];
+			b = low_coefs[d];
+			break;
+		}
+	}
+
+	int squarings = 0;
+	if (degree == 13 && norm > impl::pade_theta[4])
+		squarings = static_cast<int>(std::ceil(std::log2(norm / impl::pade_theta[4])));
+
+	matrix<T, A> scaled = a;
+	if (squarings > 0) {
+		const T factor = static_cast<T>(std::ldexp(1.0, -squarings));
+		for (std::size_t i = 0; i < n; ++i)
+			impl::scale_row(factor, scaled[i], n);
+	}
+
+	matrix<T, A> a2(n, n);
+	matrix<T, A> u(n, n);
+	matrix<T, A> v(n, n);
+	matrix<T, A> tmp(n, n);
+	gemm(T(1), scaled, scaled, T(), a2);
+
+	if (degree < 13) {
+		// Horner in A^2: U = A * (b_m A^(m-1) + ... + b_1 I), V = b_(m-1) A^(m-1) + ... + b_0 I
+		impl::set_identity(u);
+		impl::set_identity(v);
+		for (std::size_t i = 0; i < n; ++i) {
+			u[i][i] = static_cast<T>(b[degree]);
+			v[i][i] = static_cast<T>(b[degree - 1]);
+		}
+		for (int j = degree - 2; j >= 1; j -= 2) {
+			gemm(T(1), a2, u, T(), tmp);
+			u.swap(tmp);
+			impl::add_identity(static_cast<T>(b[j]), u);
+
+			gemm(T(1), a2, v, T(), tmp);
+			v.swap(tmp);
+			impl::add_identity(static_cast<T>(b[j - 1]), v);
+		}
+	}
+	else {
+		matrix<T, A> a4(n, n);
+		matrix<T, A> a6(n, n);
+		gemm(T(1), a2, a2, T(), a4);
+		gemm(T(1), a4, a2, T(), a6);
+
+		// out = c6 * A^6 + c4 * A^4 + c2 * A^2 + c0 * I
+		auto combine = [&](matrix<T, A>& out, double c6, double c4, double c2, double c0) {
+			for (std::size_t i = 0; i < n; ++i) {
+				T* row = out[i];
+				const T* r6 = a6[i];
+				const T* r4 = a4[i];
+				const T* r2 = a2[i];
+				for (std::size_t j = 0; j < n; ++j)
+					row[j] = static_cast<T>(c6) * r6[j] + static_cast<T>(c4) * r4[j] + static_cast<T>(c2) * r2[j];
+				row[i] += static_cast<T>(c0);
+			}
+		};
+
+		combine(tmp, b[13], b[11], b[9], 0.);
+		combine(u, b[7], b[5], b[3], b[1]);
+		gemm(T(1), a6, tmp, T(1), u);
+
+		combine(tmp, b[12], b[10], b[8], 0.);
+		combine(v, b[6], b[4], b[2], b[0]);
+		gemm(T(1), a6, tmp, T(1), v);
+	}
+	gemm(T(1), scaled, u, T(), tmp);
+	u.swap(tmp);
+
+	// exp(A) ~ (V - U)^-1 * (V + U); tmp = V + U is overwritten by the solution
+	impl::copy_into(v, tmp);
+	impl::axpby(T(1), u, T(1), tmp);
+	impl::axpby(T(-1), u, T(1), v);
+	impl::gauss_jordan(v, tmp);
+
+	for (int i = 0; i < squarings; ++i) {
+		gemm(T(1), tmp, tmp, T(), u);
+		tmp.swap(u);
+	}
+	return tmp;
+}
+
+// principal square root by the Denman-Beavers iteration:
+// Y <- (Y + Z^-1) / 2, Z <- (Z + Y^-1) / 2, Y -> sqrt(A), Z -> sqrt(A)^-1
+template<class T, class A>
+matrix<T, A> sqrtm(const matrix<T, A>& a, std::size_t max_iterations = 100)
+{
+	static_assert(std::is_floating_point_v<T>, "sqrtm requires floating point elements");
+	impl::check_square(a);
+
+	const std::size_t n = a.size().rows;
+	const T tolerance = T(10) * static_cast<T>(n) * std::numeric_limits<T>::epsilon();
+
+	matrix<T, A> y = a;
+	matrix<T, A> z(n, n);
+	matrix<T, A> y_inv(n, n);
+	matrix<T, A> z_inv(n, n);
+	matrix<T, A> lu(n, n);
+	std::vector<T> delta_sums(n);
+	std::vector<T> y_sums(n);
+	impl::set_identity(z);
+
+	for (std::size_t iter = 0; iter < max_iterations; ++iter) {
+		impl::copy_into(y, lu);
+		impl::set_identity(y_inv);
+		impl::gauss_jordan(lu, y_inv);
+
+		impl::copy_into(z, lu);
+		impl::set_identity(z_inv);
+		impl::gauss_jordan(lu, z_inv);
+
+		std::fill(delta_sums.begin(), delta_sums.end(), T());
+		std::fill(y_sums.begin(), y_sums.end(), T());
+		for (std::size_t i = 0; i < n; ++i) {
+			T* y_row = y[i];
+			T* z_row = z[i];
+			const T* yi_row = y_inv[i];
+			const T* zi_row = z_inv[i];
+			for (std::size_t j = 0; j < n; ++j) {
+				const T delta = T(0.5) * (zi_row[j] - y_row[j]);
+				y_row[j] += delta;
+				z_row[j] = T(0.5) * (z_row[j] + yi_row[j]);
+				delta_sums[j] += std::abs(delta);
+				y_sums[j] += std::abs(y_row[j]);
+			}
+		}
+
+		const T delta_norm = *std::max_element(delta_sums.begin(), delta_sums.end());
+		const T y_norm = *std::max_element(y_sums.begin(), y_sums.end());
+		if (delta_norm <= tolerance * y_norm)
+			return y;
+	}
+
+	throw std::domain_error{ "sqrtm did not converge" };
+}
+
+
+#endif // !MATRIX_FUNCTIONS_HPP
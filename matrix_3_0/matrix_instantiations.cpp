@@ -0,0 +1,21 @@
+// Explicit instantiations behind the extern template declarations of matrix.hpp and linalg.hpp.
+// Part of matrix_lib, which is built with MATRIX_EXTERN_TEMPLATES like every program using it.
+#if !defined(MATRIX_EXTERN_TEMPLATES)
+#define MATRIX_EXTERN_TEMPLATES
+#endif
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+template class matrix<float>;
+template class matrix<double>;
+template class matrix<std::int32_t>;
+template class matrix<std::int64_t>;
+template class matrix<std::uint8_t>;
+
+MATRIX_LINALG_INSTANTIATIONS(, float)
+MATRIX_LINALG_INSTANTIATIONS(, double)
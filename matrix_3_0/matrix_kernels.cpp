@@ -0,0 +1,118 @@
+// Row kernels of matrix_lib for float and double. Each call goes to the AVX2 build
+// (matrix_kernels_avx2.cpp) when this CPU and OS support it and to the portable templates of
+// linalg.hpp otherwise, so one binary serves every CPU generation.
+#if !defined(MATRIX_EXTERN_TEMPLATES)
+#define MATRIX_EXTERN_TEMPLATES
+#endif
+
+#include "linalg.hpp"
+
+#include <cstddef>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MATRIX_HAS_AVX2_KERNELS
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+namespace impl {
+
+#if defined(MATRIX_HAS_AVX2_KERNELS)
+	namespace avx2 {
+		void axpy_row(float alpha, const float* x, float* y, std::size_t n) noexcept;
+		void axpy_row(double alpha, const double* x, double* y, std::size_t n) noexcept;
+		void axpy2_row(float a0, const float* x0, float a1, const float* x1, float* y, std::size_t n) noexcept;
+		void axpy2_row(double a0, const double* x0, double a1, const double* x1, double* y, std::size_t n) noexcept;
+		void axpy4_row(const float* a, const float* const* x, float* y, std::size_t n) noexcept;
+		void axpy4_row(const double* a, const double* const* x, double* y, std::size_t n) noexcept;
+		float dot_row(const float* x, const float* y, std::size_t n) noexcept;
+		double dot_row(const double* x, const double* y, std::size_t n) noexcept;
+	}
+
+	namespace {
+
+		// AVX2 in the CPU, and YMM state saved by the OS
+		bool detect_avx2() noexcept {
+#if defined(_MSC_VER)
+			int regs[4];
+			__cpuid(regs, 0);
+			if (regs[0] < 7)
+				return false;
+			__cpuid(regs, 1);
+			const unsigned ecx1 = static_cast<unsigned>(regs[2]);
+			__cpuidex(regs, 7, 0);
+			const unsigned ebx7 = static_cast<unsigned>(regs[1]);
+#else
+			unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+			if (__get_cpuid_max(0, nullptr) < 7)
+				return false;
+			__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+			const unsigned ecx1 = ecx;
+			__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+			const unsigned ebx7 = ebx;
+#endif
+			const bool osxsave = (ecx1 & (1u << 27)) != 0;
+			const bool avx2 = (ebx7 & (1u << 5)) != 0;
+			if (!osxsave || !avx2)
+				return false;
+
+#if defined(_MSC_VER)
+			const unsigned long long xcr0 = _xgetbv(0);
+#else
+			unsigned xcr0_lo, xcr0_hi;
+			__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+			const unsigned long long xcr0 = (static_cast<unsigned long long>(xcr0_hi) << 32) | xcr0_lo;
+#endif
+			return (xcr0 & 0x6) == 0x6;
+		}
+
+		bool use_avx2() noexcept {
+			static const bool supported = detect_avx2();
+			return supported;
+		}
+	}
+
+#define MATRIX_DISPATCH(call, portable) return use_avx2() ? avx2::call : portable
+#else
+#define MATRIX_DISPATCH(call, portable) return portable
+#endif
+
+	void axpy_row(float alpha, const float* x, float* y, std::size_t n) noexcept {
+		MATRIX_DISPATCH(axpy_row(alpha, x, y, n), axpy_row<float>(alpha, x, y, n));
+	}
+
+	void axpy_row(double alpha, const double* x, double* y, std::size_t n) noexcept {
+		MATRIX_DISPATCH(axpy_row(alpha, x, y, n), axpy_row<double>(alpha, x, y, n));
+	}
+
+	void axpy2_row(float a0, const float* x0, float a1, const float* x1, float* y, std::size_t n) noexcept {
+		MATRIX_DISPATCH(axpy2_row(a0, x0, a1, x1, y, n), axpy2_row<float>(a0, x0, a1, x1, y, n));
+	}
+
+	void axpy2_row(double a0, const double* x0, double a1, const double* x1, double* y, std::size_t n) noexcept {
+		MATRIX_DISPATCH(axpy2_row(a0, x0, a1, x1, y, n), axpy2_row<double>(a0, x0, a1, x1, y, n));
+	}
+
+	void axpy4_row(const float* a, const float* const* x, float* y, std::size_t n) noexcept {
+		MATRIX_DISPATCH(axpy4_row(a, x, y, n), axpy4_row<float>(a, x, y, n));
+	}
+
+	void axpy4_row(const double* a, const double* const* x, double* y, std::size_t n) noexcept {
+		MATRIX_DISPATCH(axpy4_row(a, x, y, n), axpy4_row<double>(a, x, y, n));
+	}
+
+	float dot_row(const float* x, const float* y, std::size_t n) noexcept {
+		MATRIX_DISPATCH(dot_row(x, y, n), dot_row<float>(x, y, n));
+	}
+
+	double dot_row(const double* x, const double* y, std::size_t n) noexcept {
+		MATRIX_DISPATCH(dot_row(x, y, n), dot_row<double>(x, y, n));
+	}
+
+#undef MATRIX_DISPATCH
+}
@@ -0,0 +1,70 @@
+// AVX2 builds of the float and double row kernels, called by matrix_kernels.cpp only on CPUs
+// that run them. MSVC gets /arch:AVX2 for this file from matrix_lib.vcxproj, GCC and Clang get it
+// from the pragma. Nothing from the library headers is included here: inline functions compiled
+// with these flags could be picked by the linker for every other caller.
+// The loops are the portable ones of linalg.hpp, vectorized without reassociation, and FMA stays
+// off so no multiply-add is fused: both builds give bit-identical results.
+#if defined(_M_X64) || defined(__x86_64__)
+
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__GNUC__) || defined(__clang__)
+#pragma GCC target("avx2")
+#endif
+
+#include <cstddef>
+
+
+namespace impl {
+	namespace avx2 {
+		namespace {
+
+			template<typename T>
+			void axpy(T alpha, const T* x, T* y, std::size_t n) noexcept {
+				for (std::size_t j = 0; j < n; ++j)
+					y[j] += alpha * x[j];
+			}
+
+			template<typename T>
+			void axpy2(T a0, const T* x0, T a1, const T* x1, T* y, std::size_t n) noexcept {
+				for (std::size_t j = 0; j < n; ++j)
+					y[j] += a0 * x0[j] + a1 * x1[j];
+			}
+
+			template<typename T>
+			void axpy4(const T* a, const T* const* x, T* y, std::size_t n) noexcept {
+				const T* x0 = x[0];
+				const T* x1 = x[1];
+				const T* x2 = x[2];
+				const T* x3 = x[3];
+				for (std::size_t j = 0; j < n; ++j)
+					y[j] += a[0] * x0[j] + a[1] * x1[j] + a[2] * x2[j] + a[3] * x3[j];
+			}
+
+			// four partial sums as in impl::dot_row, so the reduction vectorizes without reassociating
+			template<typename T>
+			T dot(const T* x, const T* y, std::size_t n) noexcept {
+				T sum[4] = {};
+				std::size_t j = 0;
+				for (; j + 4 <= n; j += 4) {
+					for (std::size_t lane = 0; lane < 4; ++lane)
+						sum[lane] += x[j + lane] * y[j + lane];
+				}
+				for (; j < n; ++j)
+					sum[0] += x[j] * y[j];
+				return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+			}
+		}
+
+		void axpy_row(float alpha, const float* x, float* y, std::size_t n) noexcept { axpy(alpha, x, y, n); }
+		void axpy_row(double alpha, const double* x, double* y, std::size_t n) noexcept { axpy(alpha, x, y, n); }
+		void axpy2_row(float a0, const float* x0, float a1, const float* x1, float* y, std::size_t n) noexcept { axpy2(a0, x0, a1, x1, y, n); }
+		void axpy2_row(double a0, const double* x0, double a1, const double* x1, double* y, std::size_t n) noexcept { axpy2(a0, x0, a1, x1, y, n); }
+		void axpy4_row(const float* a, const float* const* x, float* y, std::size_t n) noexcept { axpy4(a, x, y, n); }
+		void axpy4_row(const double* a, const double* const* x, double* y, std::size_t n) noexcept { axpy4(a, x, y, n); }
+		float dot_row(const float* x, const float* y, std::size_t n) noexcept { return dot(x, y, n); }
+		double dot_row(const double* x, const double* y, std::size_t n) noexcept { return dot(x, y, n); }
+	}
+}
+
+#endif
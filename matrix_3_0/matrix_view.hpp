@@ -0,0 +1,131 @@
+#pragma once
+#ifndef MATRIX_VIEW_HPP
+#define MATRIX_VIEW_HPP
+
+#include "matrix.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+
+// Non-owning rectangular window into a matrix: a run of rows of the row table, starting at a
+// column offset. Views reuse the row pointers of the matrix, so taking a row block or a block
+// of one costs nothing and writes go straight to the matrix. A view is invalidated by anything
+// that reallocates the viewed matrix. matrix_view<const T> is the read-only view.
+template<class T>
+class matrix_view {
+public:
+	using value_type = std::remove_const_t<T>;
+	using size_type = std::size_t;
+	using row_pointer = std::conditional_t<std::is_const_v<T>, const value_type* const*, value_type* const*>;
+
+	matrix_view() = default;
+	explicit matrix_view(row_pointer rows, size_type row_count, size_type col_offset, size_type cols) noexcept
+		: rows_(rows), sz_(row_count, cols), col_offset_(col_offset)
+	{
+	}
+
+	// a mutable view converts to a read-only one
+	template<class U, typename = std::enable_if_t<std::is_const_v<T> && std::is_same_v<U, value_type>>>
+	matrix_view(const matrix_view<U>& other) noexcept
+		: rows_(other.row_table()), sz_(other.size()), col_offset_(other.col_offset())
+	{
+	}
+
+	matrix_size_type size() const noexcept { return sz_; }
+	bool empty() const noexcept { return sz_.rows == 0 || sz_.cols == 0; }
+
+	T* operator[](size_type row) const noexcept { return rows_[row] + col_offset_; }
+
+	T& operator()(size_type row, size_type col) const
+	{
+		if (row >= sz_.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+		if (col >= sz_.cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+		return rows_[row][col_offset_ + col];
+	}
+
+	// rows [row, row + rows) and columns [col, col + cols) of this view
+	matrix_view block(size_type row, size_type col, size_type rows, size_type cols) const
+	{
+		if (row + rows > sz_.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+		if (col + cols > sz_.cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+		return matrix_view(rows_ + row, rows, col_offset_ + col, cols);
+	}
+
+	matrix_view row_block(size_type first_row, size_type rows) const { return block(first_row, 0, rows, sz_.cols); }
+
+	row_pointer row_table() const noexcept { return rows_; }
+	size_type col_offset() const noexcept { return col_offset_; }
+
+private:
+	row_pointer rows_ = nullptr;
+	matrix_size_type sz_;
+	size_type col_offset_ = 0;
+};
+
+template<class T, class A>
+matrix_view<T> view(matrix<T, A>& m) noexcept
+{
+	return matrix_view<T>(m.data(), m.size().rows, 0, m.size().cols);
+}
+
+template<class T, class A>
+matrix_view<const T> view(const matrix<T, A>& m) noexcept
+{
+	return matrix_view<const T>(m.data(), m.size().rows, 0, m.size().cols);
+}
+
+template<class T, class A>
+matrix_view<T> row_block(matrix<T, A>& m, std::size_t first_row, std::size_t rows)
+{
+	return view(m).row_block(first_row, rows);
+}
+
+template<class T, class A>
+matrix_view<const T> row_block(const matrix<T, A>& m, std::size_t first_row, std::size_t rows)
+{
+	return view(m).row_block(first_row, rows);
+}
+
+template<class T, class A>
+matrix_view<T> block(matrix<T, A>& m, std::size_t row, std::size_t col, std::size_t rows, std::size_t cols)
+{
+	return view(m).block(row, col, rows, cols);
+}
+
+template<class T, class A>
+matrix_view<const T> block(const matrix<T, A>& m, std::size_t row, std::size_t col, std::size_t rows, std::size_t cols)
+{
+	return view(m).block(row, col, rows, cols);
+}
+
+// dst = src element-wise
+template<class T, class U>
+void copy(const matrix_view<U>& src, const matrix_view<T>& dst)
+{
+	static_assert(!std::is_const_v<T>, "cannot copy into a read-only view");
+	if (!same_shape(src.size(), dst.size()))
+		throw std::invalid_argument{ "matrix sizes do not match" };
+	for (std::size_t i = 0; i < src.size().rows; ++i)
+		std::copy_n(src[i], src.size().cols, dst[i]);
+}
+
+// copy of the viewed elements as a matrix
+template<class T>
+matrix<std::remove_const_t<T>> to_matrix(const matrix_view<T>& v)
+{
+	if (v.empty())
+		return matrix<std::remove_const_t<T>>();
+	matrix<std::remove_const_t<T>> result(v.size().rows, v.size().cols);
+	copy(v, view(result));
+	return result;
+}
+
+
+#endif // !MATRIX_VIEW_HPP
@@ -0,0 +1,478 @@
+#pragma once
+#ifndef MEMORY_BUDGET_HPP
+#define MEMORY_BUDGET_HPP
+
+#include "matrix.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+// Byte budget shared by matrices.
+// matrix<T, budgeted_allocator<T>> charges every row and row table to a budget, and spillable_matrix
+// keeps its row blocks under one. When the usage reaches pressure_ratio * limit the pressure callbacks fire;
+// an allocation that would exceed the limit first spills the least recently used unpinned row blocks
+// of the spillable matrices to their temp files and fails with std::bad_alloc only if that is not enough.
+// All bookkeeping of a budget and of its spillable matrices is serialized by one mutex.
+struct memory_metrics {
+	std::size_t used_bytes = 0;
+	std::size_t peak_bytes = 0;
+	std::size_t limit_bytes = 0;
+	std::uint64_t spilled_bytes = 0;    // written to spill files
+	std::uint64_t faulted_bytes = 0;    // read back from spill files
+	std::uint64_t spill_count = 0;      // blocks evicted
+	std::uint64_t fault_count = 0;      // blocks read back
+	std::chrono::nanoseconds total_fault_time{ 0 };
+	std::chrono::nanoseconds max_fault_time{ 0 };
+};
+
+class memory_budget {
+public:
+	using pressure_callback = std::function<void(std::size_t used_bytes, std::size_t limit_bytes)>;
+
+	explicit memory_budget(std::size_t limit_bytes = std::numeric_limits<std::size_t>::max(), double pressure_ratio = 0.8)
+	{
+		set_limit(limit_bytes, pressure_ratio);
+	}
+
+	memory_budget(const memory_budget&) = delete;
+	memory_budget& operator=(const memory_budget&) = delete;
+
+	// budget used by allocators constructed on this thread outside any scope
+	static memory_budget& global()
+	{
+		static memory_budget budget;
+		return budget;
+	}
+
+	// budget charged by default-constructed budgeted_allocator on the calling thread
+	static memory_budget& current() noexcept
+	{
+		memory_budget* scoped = current_slot();
+		return scoped != nullptr ? *scoped : global();
+	}
+
+	// makes a budget current on this thread for its lifetime, e.g. one per tenant request
+	class scope {
+	public:
+		explicit scope(memory_budget& budget) noexcept : previous_{ current_slot() } { current_slot() = &budget; }
+		~scope() { current_slot() = previous_; }
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+
+	private:
+		memory_budget* previous_;
+	};
+
+	void set_limit(std::size_t limit_bytes, double pressure_ratio = 0.8)
+	{
+		if (!(pressure_ratio > 0.0 && pressure_ratio <= 1.0))
+			throw std::invalid_argument{ "pressure ratio must lie in (0, 1]" };
+
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		metrics_.limit_bytes = limit_bytes;
+		pressure_bytes_ = static_cast<std::size_t>(static_cast<double>(limit_bytes) * pressure_ratio);
+	}
+
+	void add_pressure_callback(pressure_callback callback)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		callbacks_.push_back(std::move(callback));
+	}
+
+	// charges bytes, spilling cold blocks if the limit would be exceeded
+	void acquire(std::size_t bytes)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		if (bytes > metrics_.limit_bytes)
+			throw std::bad_alloc{};
+
+		while (metrics_.used_bytes + bytes > metrics_.limit_bytes) {
+			if (!spill_coldest())
+				throw std::bad_alloc{};
+		}
+
+		const bool below = metrics_.used_bytes < pressure_bytes_;
+		metrics_.used_bytes += bytes;
+		metrics_.peak_bytes = std::max(metrics_.peak_bytes, metrics_.used_bytes);
+		if (below && metrics_.used_bytes >= pressure_bytes_) {
+			for (const auto& callback : callbacks_)
+				callback(metrics_.used_bytes, metrics_.limit_bytes);
+		}
+	}
+
+	void release(std::size_t bytes) noexcept
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		metrics_.used_bytes -= std::min(bytes, metrics_.used_bytes);
+	}
+
+	std::size_t used() const
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		return metrics_.used_bytes;
+	}
+
+	std::size_t limit() const
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		return metrics_.limit_bytes;
+	}
+
+	memory_metrics metrics() const
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		return metrics_;
+	}
+
+private:
+	template<class> friend class spillable_matrix;
+
+	// implemented by spillable_matrix
+	class spill_source {
+	public:
+		virtual ~spill_source() = default;
+		// access tick of the least recently used spillable block, max() if there is none
+		virtual std::uint64_t coldest_tick() const = 0;
+		virtual void spill_coldest() = 0;
+	};
+
+	static memory_budget*& current_slot() noexcept
+	{
+		thread_local memory_budget* slot = nullptr;
+		return slot;
+	}
+
+	bool spill_coldest()
+	{
+		spill_source* victim = nullptr;
+		std::uint64_t coldest = std::numeric_limits<std::uint64_t>::max();
+		for (spill_source* source : sources_) {
+			const std::uint64_t tick = source->coldest_tick();
+			if (tick < coldest) {
+				coldest = tick;
+				victim = source;
+			}
+		}
+		if (victim == nullptr)
+			return false;
+
+		victim->spill_coldest();
+		return true;
+	}
+
+	void add_source(spill_source* source)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		sources_.push_back(source);
+	}
+
+	void remove_source(spill_source* source)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		sources_.erase(std::remove(sources_.begin(), sources_.end(), source), sources_.end());
+	}
+
+	mutable std::recursive_mutex mutex_;
+	memory_metrics metrics_;
+	std::size_t pressure_bytes_ = 0;
+	std::uint64_t tick_ = 0;
+	std::vector<pressure_callback> callbacks_;
+	std::vector<spill_source*> sources_;
+};
+
+// std::allocator that charges a memory_budget; matrix<T, budgeted_allocator<T>> accounts every row
+// and its row table. A default-constructed allocator binds to memory_budget::current().
+template<class T>
+class budgeted_allocator {
+public:
+	using value_type = T;
+
+	budgeted_allocator() noexcept : budget_{ &memory_budget::current() } {}
+	explicit budgeted_allocator(memory_budget& budget) noexcept : budget_{ &budget } {}
+
+	template<class U>
+	budgeted_allocator(const budgeted_allocator<U>& other) noexcept : budget_{ &other.budget() } {}
+
+	T* allocate(std::size_t n)
+	{
+		budget_->acquire(n * sizeof(T));
+		try {
+			return std::allocator<T>().allocate(n);
+		}
+		catch (...) {
+			budget_->release(n * sizeof(T));
+			throw;
+		}
+	}
+
+	void deallocate(T* p, std::size_t n) noexcept
+	{
+		std::allocator<T>().deallocate(p, n);
+		budget_->release(n * sizeof(T));
+	}
+
+	memory_budget& budget() const noexcept { return *budget_; }
+
+	template<class U>
+	bool operator==(const budgeted_allocator<U>& other) const noexcept { return budget_ == &other.budget(); }
+	template<class U>
+	bool operator!=(const budgeted_allocator<U>& other) const noexcept { return !(*this == other); }
+
+private:
+	memory_budget* budget_;
+};
+
+namespace impl {
+
+	inline void seek_file(std::FILE* file, std::uint64_t offset) {
+#if defined(_MSC_VER)
+		const int failed = _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+		const int failed = fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+		if (failed != 0)
+			throw std::runtime_error{ "file seek failed" };
+	}
+}
+
+// Matrix of row blocks whose memory is charged to a budget. Under pressure the least recently used
+// unpinned blocks are written to a private temp file (only if changed since they were last read)
+// and released; touching such a block reads it back. Blocks are materialized on first access.
+// Rows are reached through row_handle, which pins the block so it cannot be spilled while in use.
+template<class T>
+class spillable_matrix : private memory_budget::spill_source {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+
+	static_assert(std::is_trivially_copyable_v<T>, "spilled rows are written byte by byte");
+
+	class row_handle {
+	public:
+		row_handle(row_handle&& other) noexcept : owner_{ other.owner_ }, block_{ other.block_ }, data_{ other.data_ }
+		{
+			other.owner_ = nullptr;
+		}
+		row_handle& operator=(row_handle&&) = delete;
+		~row_handle() { if (owner_ != nullptr) owner_->unpin(block_); }
+
+		T* data() const noexcept { return data_; }
+		T& operator[](size_type col) const noexcept { return data_[col]; }
+
+	private:
+		friend class spillable_matrix;
+		row_handle(spillable_matrix* owner, size_type block, T* data) noexcept : owner_{ owner }, block_{ block }, data_{ data } {}
+
+		spillable_matrix* owner_;
+		size_type block_;
+		T* data_;
+	};
+
+	explicit spillable_matrix(size_type rows, size_type cols, memory_budget& budget = memory_budget::current(), size_type block_rows = 64)
+		: sz_{ rows, cols }, block_rows_{ block_rows }, budget_{ budget }
+	{
+		if (rows == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+		if (cols == 0)
+			throw std::invalid_argument{ "cols count must be greater than zero" };
+		if (block_rows == 0)
+			throw std::invalid_argument{ "block rows count must be greater than zero" };
+
+		blocks_.resize((rows + block_rows - 1) / block_rows);
+		budget_.add_source(this);
+	}
+
+	~spillable_matrix()
+	{
+		budget_.remove_source(this);
+		for (auto& blk : blocks_) {
+			if (blk.data != nullptr)
+				budget_.release(block_bytes());
+		}
+		if (file_ != nullptr)
+			std::fclose(file_);
+	}
+
+	spillable_matrix(const spillable_matrix&) = delete;
+	spillable_matrix& operator=(const spillable_matrix&) = delete;
+
+	matrix_size_type size() const noexcept { return sz_; }
+
+	// pinned writable row; the block is marked as changed
+	row_handle row(size_type index)
+	{
+		check_row(index);
+		std::lock_guard<std::recursive_mutex> lock(budget_.mutex_);
+		const size_type b = index / block_rows_;
+		T* data = fault_in(b);
+		blocks_[b].dirty = true;
+		++blocks_[b].pins;
+		return row_handle(this, b, data + (index % block_rows_) * sz_.cols);
+	}
+
+	// pinned row for reading; the block stays clean
+	row_handle read_row(size_type index)
+	{
+		check_row(index);
+		std::lock_guard<std::recursive_mutex> lock(budget_.mutex_);
+		const size_type b = index / block_rows_;
+		T* data = fault_in(b);
+		++blocks_[b].pins;
+		return row_handle(this, b, data + (index % block_rows_) * sz_.cols);
+	}
+
+	T get(size_type row, size_type col)
+	{
+		check_col(col);
+		return read_row(row)[col];
+	}
+
+	void set(size_type row, size_type col, const T& value)
+	{
+		check_col(col);
+		this->row(row)[col] = value;
+	}
+
+	size_type resident_blocks() const
+	{
+		std::lock_guard<std::recursive_mutex> lock(budget_.mutex_);
+		return static_cast<size_type>(std::count_if(blocks_.begin(), blocks_.end(),
+			[](const block& blk) { return blk.data != nullptr; }));
+	}
+
+private:
+	struct block {
+		std::unique_ptr<T[]> data;
+		std::uint64_t last_access = 0;
+		size_type pins = 0;
+		bool dirty = false;
+		bool on_disk = false;   // the file holds a copy (current unless dirty)
+	};
+
+	size_type block_bytes() const noexcept { return block_rows_ * sz_.cols * sizeof(T); }
+
+	void check_row(size_type row) const
+	{
+		if (row >= sz_.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+	}
+
+	void check_col(size_type col) const
+	{
+		if (col >= sz_.cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+	}
+
+	// called with the budget mutex held
+	T* fault_in(size_type b)
+	{
+		block& blk = blocks_[b];
+		blk.last_access = ++budget_.tick_;
+		if (blk.data != nullptr)
+			return blk.data.get();
+
+		// pinned while acquiring so the budget cannot pick this very block
+		++blk.pins;
+		try {
+			budget_.acquire(block_bytes());
+		}
+		catch (...) {
+			--blk.pins;
+			throw;
+		}
+		--blk.pins;
+
+		// give the bytes back if the block cannot be allocated or read
+		const auto start = std::chrono::steady_clock::now();
+		try {
+			blk.data = std::make_unique<T[]>(block_rows_ * sz_.cols);
+			if (!blk.on_disk)
+				return blk.data.get();
+
+			impl::seek_file(file_, static_cast<std::uint64_t>(b) * block_bytes());
+			if (std::fread(blk.data.get(), 1, block_bytes(), file_) != block_bytes())
+				throw std::runtime_error{ "spill file read failed" };
+		}
+		catch (...) {
+			blk.data.reset();
+			budget_.release(block_bytes());
+			throw;
+		}
+		const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+		memory_metrics& m = budget_.metrics_;
+		m.faulted_bytes += block_bytes();
+		++m.fault_count;
+		m.total_fault_time += elapsed;
+		m.max_fault_time = std::max(m.max_fault_time, elapsed);
+		return blk.data.get();
+	}
+
+	void unpin(size_type b) noexcept
+	{
+		std::lock_guard<std::recursive_mutex> lock(budget_.mutex_);
+		--blocks_[b].pins;
+	}
+
+	std::uint64_t coldest_tick() const override
+	{
+		std::uint64_t coldest = std::numeric_limits<std::uint64_t>::max();
+		for (const auto& blk : blocks_) {
+			if (blk.data != nullptr && blk.pins == 0)
+				coldest = std::min(coldest, blk.last_access);
+		}
+		return coldest;
+	}
+
+	void spill_coldest() override
+	{
+		size_type victim = blocks_.size();
+		for (size_type b = 0; b < blocks_.size(); ++b) {
+			const block& blk = blocks_[b];
+			if (blk.data != nullptr && blk.pins == 0 && (victim == blocks_.size() || blk.last_access < blocks_[victim].last_access))
+				victim = b;
+		}
+		if (victim == blocks_.size())
+			return;
+
+		block& blk = blocks_[victim];
+		if (blk.dirty || !blk.on_disk) {
+			if (file_ == nullptr) {
+				file_ = std::tmpfile();
+				if (file_ == nullptr)
+					throw std::runtime_error{ "cannot create spill file" };
+			}
+			impl::seek_file(file_, static_cast<std::uint64_t>(victim) * block_bytes());
+			if (std::fwrite(blk.data.get(), 1, block_bytes(), file_) != block_bytes())
+				throw std::runtime_error{ "spill file write failed" };
+			std::fflush(file_);
+			budget_.metrics_.spilled_bytes += block_bytes();
+			blk.on_disk = true;
+			blk.dirty = false;
+		}
+		++budget_.metrics_.spill_count;
+		blk.data.reset();
+		budget_.release(block_bytes());
+	}
+
+	matrix_size_type sz_;
+	size_type block_rows_;
+	memory_budget& budget_;
+	std::vector<block> blocks_;
+	std::FILE* file_ = nullptr;
+};
+
+
+#endif // !MEMORY_BUDGET_HPP
@@ -0,0 +1,390 @@
+#pragma once
+#ifndef MODULAR_MATRIX_HPP
+#define MODULAR_MATRIX_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+
+// Matrices over Z/mZ for 2 <= m < 2^32.
+// Elements are stored reduced as uint32 and products are formed in uint64. A runtime modulus
+// reduces with Barrett's method; a compile-time one lets the compiler turn % into the same
+// multiply-and-shift. GEMM reduces lazily: a uint64 accumulator absorbs lazy_terms() products
+// before it has to be reduced once.
+namespace impl {
+
+	// high 64 bits of a 64 x 64 bit product
+	inline std::uint64_t mul_hi(std::uint64_t a, std::uint64_t b) noexcept {
+#if defined(_MSC_VER) && defined(_M_X64)
+		return __umulh(a, b);
+#elif defined(__SIZEOF_INT128__)
+		return static_cast<std::uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#else
+		const std::uint64_t a_lo = a & 0xFFFFFFFFu;
+		const std::uint64_t a_hi = a >> 32;
+		const std::uint64_t b_lo = b & 0xFFFFFFFFu;
+		const std::uint64_t b_hi = b >> 32;
+		const std::uint64_t hi_lo = a_hi * b_lo;
+		const std::uint64_t cross = ((a_lo * b_lo) >> 32) + (hi_lo & 0xFFFFFFFFu) + a_lo * b_hi;
+		return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+	}
+
+	// how many products (m - 1)^2 fit on top of a reduced value in a uint64 accumulator
+	constexpr std::uint64_t lazy_terms_for(std::uint64_t m) noexcept {
+		const std::uint64_t square = (m - 1) * (m - 1);
+		return square == 0 ? ~std::uint64_t{ 0 } : (~std::uint64_t{ 0 } - m) / square;
+	}
+}
+
+class runtime_modulus {
+public:
+	explicit runtime_modulus(std::uint64_t m) : m_{ m }
+	{
+		if (m < 2 || m > 0xFFFFFFFFu)
+			throw std::invalid_argument{ "modulus must be in [2, 2^32)" };
+
+		mu_ = ~std::uint64_t{ 0 } / m;
+		lazy_terms_ = impl::lazy_terms_for(m);
+	}
+
+	std::uint64_t value() const noexcept { return m_; }
+	std::uint64_t lazy_terms() const noexcept { return lazy_terms_; }
+
+	// Barrett: the quotient estimate floor(x * mu / 2^64) is at most one too small
+	std::uint32_t reduce(std::uint64_t x) const noexcept
+	{
+		const std::uint64_t q = impl::mul_hi(x, mu_);
+		const std::uint64_t r = x - q * m_;
+		return static_cast<std::uint32_t>(r >= m_ ? r - m_ : r);
+	}
+
+private:
+	std::uint64_t m_;
+	std::uint64_t mu_;
+	std::uint64_t lazy_terms_;
+};
+
+template<std::uint32_t M>
+class static_modulus {
+public:
+	static_assert(M >= 2, "modulus must be at least 2");
+
+	static constexpr std::uint64_t value() noexcept { return M; }
+	static constexpr std::uint64_t lazy_terms() noexcept { return impl::lazy_terms_for(M); }
+	static constexpr std::uint32_t reduce(std::uint64_t x) noexcept { return static_cast<std::uint32_t>(x % M); }
+};
+
+namespace impl {
+
+	template<typename Modulus>
+	std::uint32_t mod_mul(const Modulus& mod, std::uint32_t a, std::uint32_t b) noexcept {
+		return mod.reduce(static_cast<std::uint64_t>(a) * b);
+	}
+
+	// inverse by the extended Euclidean algorithm; throws if gcd(a, m) != 1
+	template<typename Modulus>
+	std::uint32_t mod_inverse(const Modulus& mod, std::uint32_t a) {
+		std::int64_t t = 0;
+		std::int64_t new_t = 1;
+		std::int64_t r = static_cast<std::int64_t>(mod.value());
+		std::int64_t new_r = a;
+		while (new_r != 0) {
+			const std::int64_t q = r / new_r;
+			t -= q * new_t;
+			std::swap(t, new_t);
+			r -= q * new_r;
+			std::swap(r, new_r);
+		}
+		if (r != 1)
+			throw std::domain_error{ "element is not invertible modulo m" };
+
+		return static_cast<std::uint32_t>(t < 0 ? t + static_cast<std::int64_t>(mod.value()) : t);
+	}
+
+	// row[j] = (row[j] + s * src[j]) mod m, s and src reduced
+	template<typename Modulus>
+	void mod_axpy_row(const Modulus& mod, std::uint32_t s, const std::uint32_t* src, std::uint32_t* row, std::size_t n) noexcept {
+		for (std::size_t j = 0; j < n; ++j)
+			row[j] = mod.reduce(row[j] + static_cast<std::uint64_t>(s) * src[j]);
+	}
+}
+
+template<class Modulus = runtime_modulus>
+class modular_matrix {
+public:
+	using value_type = std::uint32_t;
+	using modulus_type = Modulus;
+	using size_type = std::size_t;
+
+	explicit modular_matrix(size_type rows, size_type cols, Modulus mod = Modulus())
+		: values_(rows, cols, std::uint32_t{ 0 }), mod_{ mod } {}
+
+	// reduces every element of a plain integer matrix
+	template<class T, class A>
+	explicit modular_matrix(const matrix<T, A>& values, Modulus mod = Modulus())
+		: values_(values.size().rows, values.size().cols), mod_{ mod }
+	{
+		const auto sz = values.size();
+		parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				for (std::size_t j = 0; j < sz.cols; ++j)
+					values_[i][j] = reduce_value(values[i][j]);
+			}
+		});
+	}
+
+	std::uint32_t operator()(size_type row, size_type col) const { return values_(row, col); }
+	void set(size_type row, size_type col, std::uint64_t value) { values_(row, col) = mod_.reduce(value); }
+
+	std::uint32_t* operator[](size_type index) noexcept { return values_[index]; }
+	const std::uint32_t* operator[](size_type index) const noexcept { return values_[index]; }
+
+	matrix_size_type size() const noexcept { return values_.size(); }
+	const Modulus& modulus() const noexcept { return mod_; }
+	const matrix<std::uint32_t>& values() const noexcept { return values_; }
+	matrix<std::uint32_t>& values() noexcept { return values_; }
+
+	matrix<std::uint64_t> to_matrix() const
+	{
+		const auto sz = size();
+		matrix<std::uint64_t> result(sz.rows, sz.cols);
+		for (std::size_t i = 0; i < sz.rows; ++i)
+			std::copy_n(values_[i], sz.cols, result[i]);
+		return result;
+	}
+
+	void swap(modular_matrix& other) noexcept
+	{
+		values_.swap(other.values_);
+		std::swap(mod_, other.mod_);
+	}
+
+private:
+	template<class T>
+	std::uint32_t reduce_value(T value) const
+	{
+		if constexpr (std::is_signed_v<T>) {
+			const auto m = static_cast<std::int64_t>(mod_.value());
+			std::int64_t r = static_cast<std::int64_t>(value) % m;
+			return static_cast<std::uint32_t>(r < 0 ? r + m : r);
+		}
+		else {
+			return mod_.reduce(static_cast<std::uint64_t>(value));
+		}
+	}
+
+	matrix<std::uint32_t> values_;
+	Modulus mod_;
+};
+
+namespace impl {
+
+	template<typename Modulus>
+	void check_same_modulus(const modular_matrix<Modulus>& a, const modular_matrix<Modulus>& b) {
+		if (a.modulus().value() != b.modulus().value())
+			throw std::invalid_argument{ "matrices have different moduli" };
+	}
+
+	// c = a * b mod m with lazy reduction; uint64 accumulators per row band, reduced every lazy_terms() products
+	template<typename Modulus>
+	void mod_gemm(const modular_matrix<Modulus>& a, const modular_matrix<Modulus>& b, modular_matrix<Modulus>& c) {
+		const auto& mod = a.modulus();
+		const std::size_t n = b.size().cols;
+		const std::size_t k = a.size().cols;
+		const std::uint64_t lazy_terms = std::max<std::uint64_t>(mod.lazy_terms(), 1);
+
+		const std::size_t block_n = kernel_tuning::current().gemm_block_n;
+
+		parallel_for(0, a.size().rows, rows_grain, [&](std::size_t first, std::size_t last) {
+			std::vector<std::uint64_t> acc(std::min(n, block_n));
+			for (std::size_t jj = 0; jj < n; jj += block_n) {
+				const std::size_t nb = std::min(block_n, n - jj);
+				for (std::size_t i = first; i < last; ++i) {
+					std::fill_n(acc.begin(), nb, std::uint64_t{ 0 });
+					const std::uint32_t* a_row = a[i];
+					std::uint64_t pending = 0;
+					for (std::size_t p = 0; p < k; ++p) {
+						const std::uint64_t s = a_row[p];
+						if (s == 0)
+							continue;
+
+						// 32 x 32 -> 64 bit products, which vectorize as unsigned widening multiplies
+						const std::uint32_t* b_row = b[p] + jj;
+						for (std::size_t j = 0; j < nb; ++j)
+							acc[j] += s * b_row[j];
+
+						if (++pending == lazy_terms) {
+							for (std::size_t j = 0; j < nb; ++j)
+								acc[j] = mod.reduce(acc[j]);
+							pending = 0;
+						}
+					}
+
+					std::uint32_t* c_row = c[i] + jj;
+					for (std::size_t j = 0; j < nb; ++j)
+						c_row[j] = mod.reduce(acc[j]);
+				}
+			}
+		});
+	}
+}
+
+template<class Modulus>
+modular_matrix<Modulus> multiply(const modular_matrix<Modulus>& a, const modular_matrix<Modulus>& b)
+{
+	impl::check_same_modulus(a, b);
+	if (a.size().cols != b.size().rows)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	modular_matrix<Modulus> c(a.size().rows, b.size().cols, a.modulus());
+	impl::mod_gemm(a, b, c);
+	return c;
+}
+
+// A^k mod m by binary exponentiation over three buffers
+template<class Modulus>
+modular_matrix<Modulus> matrix_power(const modular_matrix<Modulus>& a, std::uint64_t k)
+{
+	const auto sz = a.size();
+	if (sz.rows != sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+
+	modular_matrix<Modulus> result(sz.rows, sz.cols, a.modulus());
+	for (std::size_t i = 0; i < sz.rows; ++i)
+		result[i][i] = a.modulus().reduce(1);
+	if (k == 0)
+		return result;
+
+	modular_matrix<Modulus> base = a;
+	modular_matrix<Modulus> tmp(sz.rows, sz.cols, a.modulus());
+	bool result_is_identity = true;
+	for (;;) {
+		if (k & 1) {
+			if (result_is_identity) {
+				result = base;
+				result_is_identity = false;
+			}
+			else {
+				impl::mod_gemm(result, base, tmp);
+				result.swap(tmp);
+			}
+		}
+
+		k >>= 1;
+		if (k == 0)
+			break;
+
+		impl::mod_gemm(base, base, tmp);
+		base.swap(tmp);
+	}
+	return result;
+}
+
+// In-place Gauss-Jordan elimination to reduced row echelon form; returns the rank.
+// Pivots must be invertible, which always holds for a prime modulus; a non-invertible
+// pivot throws std::domain_error. Row swaps exchange row pointers only.
+// If det is not null, it receives the determinant (meaningful for square matrices).
+template<class Modulus>
+std::size_t gaussian_elimination(modular_matrix<Modulus>& a, std::uint32_t* det = nullptr)
+{
+	const auto sz = a.size();
+	const auto& mod = a.modulus();
+	std::uint32_t** rows = a.values().data();
+	std::uint32_t determinant = mod.reduce(1);
+
+	std::size_t rank = 0;
+	for (std::size_t col = 0; col < sz.cols && rank < sz.rows; ++col) {
+		std::size_t pivot = rank;
+		while (pivot < sz.rows && rows[pivot][col] == 0)
+			++pivot;
+		if (pivot == sz.rows)
+			continue;
+
+		if (pivot != rank) {
+			std::swap(rows[pivot], rows[rank]);
+			determinant = determinant == 0 ? 0 : static_cast<std::uint32_t>(mod.value() - determinant);
+		}
+
+		const std::uint32_t pivot_value = rows[rank][col];
+		determinant = impl::mod_mul(mod, determinant, pivot_value);
+		const std::uint32_t inv = impl::mod_inverse(mod, pivot_value);
+		for (std::size_t j = col; j < sz.cols; ++j)
+			rows[rank][j] = impl::mod_mul(mod, rows[rank][j], inv);
+
+		parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				const std::uint32_t factor = rows[i][col];
+				if (i == rank || factor == 0)
+					continue;
+				// subtracting factor * pivot row == adding (m - factor) * pivot row
+				impl::mod_axpy_row(mod, static_cast<std::uint32_t>(mod.value() - factor), rows[rank] + col, rows[i] + col, sz.cols - col);
+			}
+		});
+		++rank;
+	}
+
+	if (det != nullptr)
+		*det = (rank == sz.rows && sz.rows == sz.cols) ? determinant : 0;
+	return rank;
+}
+
+template<class Modulus>
+std::size_t rank(const modular_matrix<Modulus>& a)
+{
+	modular_matrix<Modulus> work = a;
+	return gaussian_elimination(work);
+}
+
+template<class Modulus>
+std::uint32_t determinant(const modular_matrix<Modulus>& a)
+{
+	if (a.size().rows != a.size().cols)
+		throw std::invalid_argument{ "matrix must be square" };
+
+	modular_matrix<Modulus> work = a;
+	std::uint32_t det = 0;
+	gaussian_elimination(work, &det);
+	return det;
+}
+
+// inverse mod m by eliminating [A | I]
+template<class Modulus>
+modular_matrix<Modulus> inverse(const modular_matrix<Modulus>& a)
+{
+	const auto sz = a.size();
+	if (sz.rows != sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+
+	const std::size_t n = sz.rows;
+	modular_matrix<Modulus> augmented(n, 2 * n, a.modulus());
+	for (std::size_t i = 0; i < n; ++i) {
+		std::copy_n(a[i], n, augmented[i]);
+		augmented[i][n + i] = a.modulus().reduce(1);
+	}
+
+	gaussian_elimination(augmented);
+	for (std::size_t i = 0; i < n; ++i) {
+		if (augmented[i][i] != a.modulus().reduce(1))
+			throw std::domain_error{ "matrix is singular modulo m" };
+	}
+
+	modular_matrix<Modulus> result(n, n, a.modulus());
+	for (std::size_t i = 0; i < n; ++i)
+		std::copy_n(augmented[i] + n, n, result[i]);
+	return result;
+}
+
+
+#endif // !MODULAR_MATRIX_HPP
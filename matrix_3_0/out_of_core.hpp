@@ -0,0 +1,334 @@
+#pragma once
+#ifndef OUT_OF_CORE_HPP
+#define OUT_OF_CORE_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "memory_budget.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+
+// Out-of-core kernels over row-major binary files.
+// Work is done tile by tile in RAM: the tile edge is the largest one for which all tile buffers of
+// the algorithm fit the memory budget. The next tiles are read on a background thread while the current
+// ones are multiplied (double buffering) and finished tiles are written back the same way.
+enum class file_mode { create, open };
+
+// rows x cols matrix stored row-major in a file, no header
+template<class T>
+class file_matrix {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+
+	static_assert(std::is_trivially_copyable_v<T>, "file matrices are read and written byte by byte");
+
+	// create makes (or truncates) a file of rows * cols elements; open uses an existing one
+	explicit file_matrix(const std::string& path, size_type rows, size_type cols, file_mode mode = file_mode::open)
+		: sz_{ rows, cols }, path_{ path }
+	{
+		if (rows == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+		if (cols == 0)
+			throw std::invalid_argument{ "cols count must be greater than zero" };
+
+		file_ = std::fopen(path.c_str(), mode == file_mode::create ? "w+b" : "r+b");
+		if (file_ == nullptr)
+			throw std::runtime_error{ "cannot open matrix file " + path };
+
+		if (mode == file_mode::create) {
+			// writing the last byte sizes the file (sparse where the file system allows)
+			const char zero = 0;
+			impl::seek_file(file_, static_cast<std::uint64_t>(rows) * cols * sizeof(T) - 1);
+			if (std::fwrite(&zero, 1, 1, file_) != 1) {
+				std::fclose(file_);
+				throw std::runtime_error{ "cannot size matrix file " + path };
+			}
+		}
+	}
+
+	~file_matrix()
+	{
+		if (file_ != nullptr)
+			std::fclose(file_);
+	}
+
+	file_matrix(const file_matrix&) = delete;
+	file_matrix& operator=(const file_matrix&) = delete;
+
+	matrix_size_type size() const noexcept { return sz_; }
+	const std::string& path() const noexcept { return path_; }
+
+	// dst[0:rows, 0:cols] = this[row:row + rows, col:col + cols]; safe to call from any thread
+	template<class A>
+	void read_tile(size_type row, size_type col, size_type rows, size_type cols, matrix<T, A>& dst)
+	{
+		check_tile(row, col, rows, cols);
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (size_type i = 0; i < rows; ++i) {
+			impl::seek_file(file_, offset(row + i, col));
+			if (std::fread(dst[i], sizeof(T), cols, file_) != cols)
+				throw std::runtime_error{ "matrix file read failed" };
+		}
+	}
+
+	// this[row:row + rows, col:col + cols] = src[0:rows, 0:cols]; safe to call from any thread
+	template<class A>
+	void write_tile(size_type row, size_type col, size_type rows, size_type cols, const matrix<T, A>& src)
+	{
+		check_tile(row, col, rows, cols);
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (size_type i = 0; i < rows; ++i) {
+			impl::seek_file(file_, offset(row + i, col));
+			if (std::fwrite(src[i], sizeof(T), cols, file_) != cols)
+				throw std::runtime_error{ "matrix file write failed" };
+		}
+		std::fflush(file_);
+	}
+
+	template<class A>
+	void assign(const matrix<T, A>& src)
+	{
+		if (!same_shape(src.size(), sz_))
+			throw std::invalid_argument{ "matrix sizes do not match" };
+		write_tile(0, 0, sz_.rows, sz_.cols, src);
+	}
+
+	template<class A = std::allocator<T>>
+	matrix<T, A> to_matrix()
+	{
+		matrix<T, A> result(sz_.rows, sz_.cols);
+		read_tile(0, 0, sz_.rows, sz_.cols, result);
+		return result;
+	}
+
+private:
+	std::uint64_t offset(size_type row, size_type col) const noexcept
+	{
+		return (static_cast<std::uint64_t>(row) * sz_.cols + col) * sizeof(T);
+	}
+
+	void check_tile(size_type row, size_type col, size_type rows, size_type cols) const
+	{
+		if (row + rows > sz_.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+		if (col + cols > sz_.cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+	}
+
+	matrix_size_type sz_;
+	std::string path_;
+	std::FILE* file_ = nullptr;
+	std::mutex mutex_;
+};
+
+namespace impl {
+
+	// largest tile edge for which buffers tiles of T fit in budget_bytes, capped by the matrix extent
+	inline std::size_t out_of_core_tile(std::size_t budget_bytes, std::size_t buffers, std::size_t element_size, std::size_t extent) {
+		const auto edge = static_cast<std::size_t>(std::sqrt(static_cast<double>(budget_bytes / (buffers * element_size))));
+		if (edge == 0)
+			throw std::invalid_argument{ "memory budget is too small for one tile" };
+		return std::min(edge, extent);
+	}
+
+	// c[0:m, 0:n] += alpha * a[0:m, 0:k] * b[0:k, 0:n] on tile buffers
+	template<typename T, typename A>
+	void gemm_tile(T alpha, const matrix<T, A>& a, const matrix<T, A>& b, matrix<T, A>& c,
+		std::size_t m, std::size_t n, std::size_t k) {
+		parallel_for(0, m, rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				const T* a_row = a[i];
+				for (std::size_t p = 0; p < k; ++p) {
+					const T a_ip = alpha * a_row[p];
+					if (a_ip != T())
+						axpy_row(a_ip, b[p], c[i], n);
+				}
+			}
+		});
+	}
+
+	// c[0:m, 0:n] -= a[0:m, 0:k] * b[0:n, 0:k]^T, every element a dot product of two rows
+	template<typename T, typename A>
+	void gemm_nt_tile(const matrix<T, A>& a, const matrix<T, A>& b, matrix<T, A>& c,
+		std::size_t m, std::size_t n, std::size_t k) {
+		parallel_for(0, m, rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				for (std::size_t j = 0; j < n; ++j)
+					c[i][j] -= dot_row(a[i], b[j], k);
+			}
+		});
+	}
+
+	// a[0:n, 0:n] = L with A = L * L^T in place, as cholesky() does it; the upper triangle is zeroed
+	template<typename T, typename A>
+	void cholesky_tile(matrix<T, A>& a, std::size_t n) {
+		for (std::size_t j = 0; j < n; ++j) {
+			const T diag = a[j][j] - dot_row(a[j], a[j], j);
+			if (!(diag > T()))
+				throw std::domain_error{ "matrix is not positive definite" };
+
+			a[j][j] = std::sqrt(diag);
+			std::fill_n(a[j] + j + 1, n - j - 1, T());
+			const T inv = T(1) / a[j][j];
+			parallel_for(j + 1, n, rows_grain * 4, [&](std::size_t first, std::size_t last) {
+				for (std::size_t i = first; i < last; ++i)
+					a[i][j] = (a[i][j] - dot_row(a[i], a[j], j)) * inv;
+			});
+		}
+	}
+
+	// x[0:m, 0:n] = x * l^-T for lower triangular l (n x n): every row solves l * x_row = row by substitution
+	template<typename T, typename A>
+	void trsm_right_lower_transposed(const matrix<T, A>& l, matrix<T, A>& x, std::size_t m, std::size_t n) {
+		parallel_for(0, m, rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				T* row = x[i];
+				for (std::size_t j = 0; j < n; ++j)
+					row[j] = (row[j] - dot_row(l[j], row, j)) / l[j][j];
+			}
+		});
+	}
+}
+
+// C = alpha * A * B + beta * C over file matrices, holding six tiles in RAM:
+// two A and two B tiles (current and prefetched) and two C tiles (computing and being written)
+template<class T>
+void out_of_core_gemm(T alpha, file_matrix<T>& a, file_matrix<T>& b, T beta, file_matrix<T>& c, std::size_t memory_budget_bytes)
+{
+	const auto a_sz = a.size();
+	const auto b_sz = b.size();
+	const auto c_sz = c.size();
+	if (a_sz.cols != b_sz.rows || c_sz.rows != a_sz.rows || c_sz.cols != b_sz.cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+	if (&c == &a || &c == &b)
+		throw std::invalid_argument{ "result must not alias an operand" };
+
+	const std::size_t tile = impl::out_of_core_tile(memory_budget_bytes, 6, sizeof(T),
+		std::max({ a_sz.rows, a_sz.cols, b_sz.cols }));
+	matrix<T> a_tiles[2] = { matrix<T>(tile, tile), matrix<T>(tile, tile) };
+	matrix<T> b_tiles[2] = { matrix<T>(tile, tile), matrix<T>(tile, tile) };
+	matrix<T> c_tiles[2] = { matrix<T>(tile, tile), matrix<T>(tile, tile) };
+	std::future<void> pending_write;
+	std::size_t c_slot = 0;
+
+	for (std::size_t ii = 0; ii < c_sz.rows; ii += tile) {
+		const std::size_t mb = std::min(tile, c_sz.rows - ii);
+		for (std::size_t jj = 0; jj < c_sz.cols; jj += tile) {
+			const std::size_t nb = std::min(tile, c_sz.cols - jj);
+			matrix<T>& c_tile = c_tiles[c_slot];
+			if (beta != T()) {
+				c.read_tile(ii, jj, mb, nb, c_tile);
+				for (std::size_t i = 0; i < mb; ++i)
+					impl::scale_row(beta, c_tile[i], nb);
+			}
+			else {
+				for (std::size_t i = 0; i < mb; ++i)
+					std::fill_n(c_tile[i], nb, T());
+			}
+
+			auto load = [&, ii, jj, mb, nb](std::size_t pp, std::size_t slot) {
+				const std::size_t kb = std::min(tile, a_sz.cols - pp);
+				a.read_tile(ii, pp, mb, kb, a_tiles[slot]);
+				b.read_tile(pp, jj, kb, nb, b_tiles[slot]);
+			};
+
+			std::size_t slot = 0;
+			std::future<void> next = std::async(std::launch::async, load, 0, slot);
+			for (std::size_t pp = 0; pp < a_sz.cols; pp += tile) {
+				next.get();
+				if (pp + tile < a_sz.cols)
+					next = std::async(std::launch::async, load, pp + tile, slot ^ 1);
+				impl::gemm_tile(alpha, a_tiles[slot], b_tiles[slot], c_tile, mb, nb, std::min(tile, a_sz.cols - pp));
+				slot ^= 1;
+			}
+
+			// at most one write in flight; it used the other C buffer
+			if (pending_write.valid())
+				pending_write.get();
+			pending_write = std::async(std::launch::async, [&c, &c_tile, ii, jj, mb, nb] { c.write_tile(ii, jj, mb, nb, c_tile); });
+			c_slot ^= 1;
+		}
+	}
+	if (pending_write.valid())
+		pending_write.get();
+}
+
+// In-place left-looking tiled Cholesky of a symmetric positive definite file matrix: the lower
+// triangle is overwritten with L, tiles above the diagonal are left as they are. For every tile
+// A(i, j) below the diagonal, A(i, j) -= sum_k L(i, k) * L(j, k)^T streams the L tile pairs through
+// a double buffer, then the diagonal tile is factored in RAM or the tile is solved against it.
+// Seven tiles are held: two pairs of L tiles, the diagonal factor and two accumulators.
+template<class T>
+void out_of_core_cholesky(file_matrix<T>& a, std::size_t memory_budget_bytes)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+
+	const std::size_t n = a_sz.rows;
+	const std::size_t tile = impl::out_of_core_tile(memory_budget_bytes, 7, sizeof(T), n);
+	matrix<T> left_tiles[2] = { matrix<T>(tile, tile), matrix<T>(tile, tile) };
+	matrix<T> right_tiles[2] = { matrix<T>(tile, tile), matrix<T>(tile, tile) };
+	matrix<T> accumulators[2] = { matrix<T>(tile, tile), matrix<T>(tile, tile) };
+	matrix<T> diagonal(tile, tile);
+	std::future<void> pending_write;
+	std::size_t acc_slot = 0;
+
+	for (std::size_t jj = 0; jj < n; jj += tile) {
+		const std::size_t nb = std::min(tile, n - jj);
+		for (std::size_t ii = jj; ii < n; ii += tile) {
+			const std::size_t mb = std::min(tile, n - ii);
+			matrix<T>& acc = accumulators[acc_slot];
+			a.read_tile(ii, jj, mb, nb, acc);
+
+			auto load = [&, ii, jj, mb, nb](std::size_t kk, std::size_t slot) {
+				const std::size_t kb = std::min(tile, n - kk);
+				a.read_tile(ii, kk, mb, kb, left_tiles[slot]);
+				a.read_tile(jj, kk, nb, kb, right_tiles[slot]);
+			};
+
+			std::size_t slot = 0;
+			std::future<void> next;
+			if (jj > 0)
+				next = std::async(std::launch::async, load, 0, slot);
+			for (std::size_t kk = 0; kk < jj; kk += tile) {
+				next.get();
+				if (kk + tile < jj)
+					next = std::async(std::launch::async, load, kk + tile, slot ^ 1);
+				impl::gemm_nt_tile(left_tiles[slot], right_tiles[slot], acc, mb, nb, std::min(tile, n - kk));
+				slot ^= 1;
+			}
+
+			if (ii == jj) {
+				impl::cholesky_tile(acc, nb);
+				for (std::size_t i = 0; i < nb; ++i)
+					std::copy_n(acc[i], nb, diagonal[i]);
+			}
+			else {
+				impl::trsm_right_lower_transposed(diagonal, acc, mb, nb);
+			}
+
+			if (pending_write.valid())
+				pending_write.get();
+			pending_write = std::async(std::launch::async, [&a, &acc, ii, jj, mb, nb] { a.write_tile(ii, jj, mb, nb, acc); });
+			acc_slot ^= 1;
+		}
+
+		// the next tile column reads this one
+		pending_write.get();
+	}
+}
+
+
+#endif // !OUT_OF_CORE_HPP
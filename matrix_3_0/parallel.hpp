@@ -0,0 +1,186 @@
+#pragma once
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed-size pool of worker threads used by the matrix kernels.
+// The calling thread always takes part in parallel_for and executes queued tasks
+// while it waits, so nested parallel_for calls cannot deadlock the pool.
+class thread_pool {
+public:
+	explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency())
+	{
+		const std::size_t workers = (threads > 1) ? threads - 1 : 0;
+		workers_.reserve(workers);
+		for (std::size_t i = 0; i < workers; ++i) {
+			workers_.emplace_back([this] { worker_loop(); });
+		}
+	}
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cv_.notify_all();
+		for (auto& worker : workers_) {
+			worker.join();
+		}
+	}
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	// number of threads taking part in parallel_for (workers + calling thread)
+	std::size_t size() const noexcept { return workers_.size() + 1; }
+
+	// caps the threads parallel_for splits work over; 0 lifts the cap
+	void set_concurrency(std::size_t threads) noexcept { concurrency_.store(threads, std::memory_order_relaxed); }
+
+	std::size_t concurrency() const noexcept
+	{
+		const std::size_t cap = concurrency_.load(std::memory_order_relaxed);
+		return (cap == 0) ? size() : std::min(cap, size());
+	}
+
+	// calls fn(begin, end) for consecutive subranges of [first, last) of at least grain elements
+	template<class Func>
+	void parallel_for(std::size_t first, std::size_t last, std::size_t grain, Func&& fn)
+	{
+		if (first >= last)
+			return;
+
+		grain = std::max<std::size_t>(grain, 1);
+		const std::size_t count = last - first;
+		const std::size_t chunks = std::min(concurrency(), (count + grain - 1) / grain);
+		if (chunks <= 1) {
+			fn(first, last);
+			return;
+		}
+
+		const std::size_t chunk_size = (count + chunks - 1) / chunks;
+		std::atomic<std::size_t> pending{ chunks - 1 };
+		std::exception_ptr error;
+		std::mutex error_mutex;
+
+		auto run_chunk = [&](std::size_t begin, std::size_t end) {
+			try {
+				fn(begin, end);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+			}
+		};
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (std::size_t chunk = 1; chunk < chunks; ++chunk) {
+				const std::size_t begin = first + chunk * chunk_size;
+				const std::size_t end = std::min(last, begin + chunk_size);
+				tasks_.emplace_back([&, begin, end] {
+					if (begin < end)
+						run_chunk(begin, end);
+					pending.fetch_sub(1, std::memory_order_acq_rel);
+				});
+			}
+		}
+		cv_.notify_all();
+
+		run_chunk(first, std::min(last, first + chunk_size));
+
+		// help with queued work instead of blocking
+		while (pending.load(std::memory_order_acquire) != 0) {
+			if (!try_run_one())
+				std::this_thread::yield();
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	// queues task for a worker thread without waiting for it; a pool without workers runs it in place
+	void submit(std::function<void()> task)
+	{
+		if (workers_.empty()) {
+			task();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			tasks_.emplace_back(std::move(task));
+		}
+		cv_.notify_one();
+	}
+
+	// pool shared by all kernels
+	static thread_pool& instance()
+	{
+		static thread_pool pool;
+		return pool;
+	}
+
+private:
+	bool try_run_one()
+	{
+		std::function<void()> task;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (tasks_.empty())
+				return false;
+
+			task = std::move(tasks_.front());
+			tasks_.pop_front();
+		}
+		task();
+		return true;
+	}
+
+	void worker_loop()
+	{
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+				if (stop_ && tasks_.empty())
+					return;
+
+				task = std::move(tasks_.front());
+				tasks_.pop_front();
+			}
+			task();
+		}
+	}
+
+private:
+	std::vector<std::thread> workers_;
+	std::deque<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool stop_ = false;
+	std::atomic<std::size_t> concurrency_{ 0 };
+};
+
+
+template<class Func>
+void parallel_for(std::size_t first, std::size_t last, std::size_t grain, Func&& fn)
+{
+	thread_pool::instance().parallel_for(first, last, grain, std::forward<Func>(fn));
+}
+
+
+#endif // !PARALLEL_HPP
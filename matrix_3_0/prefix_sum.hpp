@@ -0,0 +1,177 @@
+#pragma once
+#ifndef PREFIX_SUM_HPP
+#define PREFIX_SUM_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <stdexcept>
+
+
+enum class matrix_axis { rows, cols };
+
+namespace impl {
+
+	// rows: out[i][j] = sum of a[0..i][j]; cols: out[i][j] = sum of a[i][0..j]
+	template<typename T, typename A>
+	void cumsum_rows_inplace(matrix<T, A>& a) {
+		const auto a_sz = a.size();
+		parallel_for(0, a_sz.rows, rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				T* row = a[i];
+				for (std::size_t j = 1; j < a_sz.cols; ++j)
+					row[j] += row[j - 1];
+			}
+		});
+	}
+
+	// adds each row to the next one; threads own column slices, so every access is contiguous
+	template<typename T, typename A>
+	void cumsum_cols_inplace(matrix<T, A>& a) {
+		const auto a_sz = a.size();
+		parallel_for(0, a_sz.cols, kernel_tuning::current().column_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = 1; i < a_sz.rows; ++i) {
+				const T* prev = a[i - 1] + first;
+				T* row = a[i] + first;
+				for (std::size_t j = 0; j < last - first; ++j)
+					row[j] += prev[j];
+			}
+		});
+	}
+
+	inline void check_range(std::size_t r0, std::size_t c0, std::size_t r1, std::size_t c1, matrix_size_type sz) {
+		if (r0 > r1 || r1 > sz.rows)
+			throw std::out_of_range{ "row range is out of this matrix" };
+
+		if (c0 > c1 || c1 > sz.cols)
+			throw std::out_of_range{ "col range is out of this matrix" };
+	}
+}
+
+// running sums along an axis: matrix_axis::rows accumulates down the columns,
+// matrix_axis::cols accumulates along each row
+template<class T, class A>
+matrix<T, A> cumsum(const matrix<T, A>& a, matrix_axis axis)
+{
+	matrix<T, A> result = a;
+	if (axis == matrix_axis::rows)
+		impl::cumsum_cols_inplace(result);
+	else
+		impl::cumsum_rows_inplace(result);
+	return result;
+}
+
+// 2D prefix sums with a zero border: table[i][j] = sum of a[0..i)[0..j).
+// Built in two passes (prefix along rows, then rows added downwards), both along contiguous memory.
+template<class T, class A = std::allocator<T>>
+class summed_area_table {
+public:
+	explicit summed_area_table(const matrix<T, A>& a) : table_(a.size().rows + 1, a.size().cols + 1, T())
+	{
+		const auto a_sz = a.size();
+		if (a.empty())
+			throw std::invalid_argument{ "matrix must not be empty" };
+
+		parallel_for(0, a_sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				const T* src = a[i];
+				T* dst = table_[i + 1];
+				T sum = T();
+				for (std::size_t j = 0; j < a_sz.cols; ++j) {
+					sum += src[j];
+					dst[j + 1] = sum;
+				}
+			}
+		});
+		impl::cumsum_cols_inplace(table_);
+	}
+
+	matrix_size_type size() const noexcept { return matrix_size_type{ table_.size().rows - 1, table_.size().cols - 1 }; }
+
+	// sum over rows [r0, r1) and cols [c0, c1) in O(1)
+	T range_sum(std::size_t r0, std::size_t c0, std::size_t r1, std::size_t c1) const
+	{
+		impl::check_range(r0, c0, r1, c1, size());
+		return table_[r1][c1] - table_[r0][c1] - table_[r1][c0] + table_[r0][c0];
+	}
+
+	const matrix<T, A>& table() const noexcept { return table_; }
+
+private:
+	matrix<T, A> table_;
+};
+
+// 2D Fenwick (binary indexed) tree: point updates and range sums in O(log rows * log cols)
+template<class T, class A = std::allocator<T>>
+class fenwick_tree_2d {
+public:
+	explicit fenwick_tree_2d(std::size_t rows, std::size_t cols) : tree_(rows + 1, cols + 1, T()) {}
+
+	// linear-time build: every node pushes its partial sum to its parent, first along rows, then along cols
+	explicit fenwick_tree_2d(const matrix<T, A>& a) : tree_(a.size().rows + 1, a.size().cols + 1, T())
+	{
+		const auto a_sz = a.size();
+		parallel_for(0, a_sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				T* row = tree_[i + 1];
+				std::copy_n(a[i], a_sz.cols, row + 1);
+				for (std::size_t j = 1; j <= a_sz.cols; ++j) {
+					const std::size_t parent = j + (j & (~j + 1));
+					if (parent <= a_sz.cols)
+						row[parent] += row[j];
+				}
+			}
+		});
+		for (std::size_t i = 1; i <= a_sz.rows; ++i) {
+			const std::size_t parent = i + (i & (~i + 1));
+			if (parent <= a_sz.rows)
+				impl::axpy_row(T(1), tree_[i], tree_[parent], a_sz.cols + 1);
+		}
+	}
+
+	matrix_size_type size() const noexcept { return matrix_size_type{ tree_.size().rows - 1, tree_.size().cols - 1 }; }
+
+	void add(std::size_t row, std::size_t col, const T& delta)
+	{
+		const auto sz = size();
+		if (row >= sz.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+
+		if (col >= sz.cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+
+		for (std::size_t i = row + 1; i <= sz.rows; i += i & (~i + 1)) {
+			T* tree_row = tree_[i];
+			for (std::size_t j = col + 1; j <= sz.cols; j += j & (~j + 1))
+				tree_row[j] += delta;
+		}
+	}
+
+	// sum over rows [0, rows) and cols [0, cols)
+	T prefix_sum(std::size_t rows, std::size_t cols) const
+	{
+		impl::check_range(0, 0, rows, cols, size());
+
+		T sum = T();
+		for (std::size_t i = rows; i > 0; i -= i & (~i + 1)) {
+			const T* tree_row = tree_[i];
+			for (std::size_t j = cols; j > 0; j -= j & (~j + 1))
+				sum += tree_row[j];
+		}
+		return sum;
+	}
+
+	// sum over rows [r0, r1) and cols [c0, c1)
+	T range_sum(std::size_t r0, std::size_t c0, std::size_t r1, std::size_t c1) const
+	{
+		impl::check_range(r0, c0, r1, c1, size());
+		return prefix_sum(r1, c1) - prefix_sum(r0, c1) - prefix_sum(r1, c0) + prefix_sum(r0, c0);
+	}
+
+private:
+	matrix<T, A> tree_;
+};
+
+
+#endif // !PREFIX_SUM_HPP
@@ -0,0 +1,224 @@
+#pragma once
+#ifndef PRODUCTS_HPP
+#define PRODUCTS_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+
+// Lazy Kronecker product A (m x n) (x) B (p x q), an (m*p) x (n*q) operand.
+// Products with it never build the big matrix: reshaping the row-major vector x into X (n x q)
+// gives (A (x) B) x = vec(A * X * B^T), the row-major form of vec(B X A^T).
+// Holds references, so it must not outlive its operands.
+template<class T, class A = std::allocator<T>>
+class kron_expr {
+public:
+	explicit kron_expr(const matrix<T, A>& a, const matrix<T, A>& b) : a_{ a }, b_{ b } {}
+
+	matrix_size_type size() const noexcept
+	{
+		return matrix_size_type{ a_.size().rows * b_.size().rows, a_.size().cols * b_.size().cols };
+	}
+
+	const matrix<T, A>& left() const noexcept { return a_; }
+	const matrix<T, A>& right() const noexcept { return b_; }
+
+	// element (i, j) without materializing
+	T operator()(std::size_t row, std::size_t col) const
+	{
+		const auto sz = size();
+		if (row >= sz.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+
+		if (col >= sz.cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+
+		const auto b_sz = b_.size();
+		return a_[row / b_sz.rows][col / b_sz.cols] * b_[row % b_sz.rows][col % b_sz.cols];
+	}
+
+	// builds the (m*p) x (n*q) matrix; each output row segment is a scaled row of B
+	matrix<T, A> to_matrix() const
+	{
+		const auto a_sz = a_.size();
+		const auto b_sz = b_.size();
+		const auto sz = size();
+		matrix<T, A> result(sz.rows, sz.cols);
+		parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t row = first; row < last; ++row) {
+				const T* a_row = a_[row / b_sz.rows];
+				const T* b_row = b_[row % b_sz.rows];
+				T* dst = result[row];
+				for (std::size_t j = 0; j < a_sz.cols; ++j, dst += b_sz.cols) {
+					const T s = a_row[j];
+					for (std::size_t l = 0; l < b_sz.cols; ++l)
+						dst[l] = s * b_row[l];
+				}
+			}
+		});
+		return result;
+	}
+
+private:
+	const matrix<T, A>& a_;
+	const matrix<T, A>& b_;
+};
+
+template<class T, class A>
+kron_expr<T, A> kron(const matrix<T, A>& a, const matrix<T, A>& b)
+{
+	if (a.empty() || b.empty())
+		throw std::invalid_argument{ "matrix must not be empty" };
+
+	return kron_expr<T, A>(a, b);
+}
+
+// the expression would outlive a temporary operand
+template<class T, class A>
+void kron(matrix<T, A>&& a, const matrix<T, A>& b) = delete;
+template<class T, class A>
+void kron(const matrix<T, A>& a, matrix<T, A>&& b) = delete;
+template<class T, class A>
+void kron(matrix<T, A>&& a, matrix<T, A>&& b) = delete;
+
+// (A (x) B) * x in O(n*q*p + m*n*p) instead of O(m*n*p*q)
+template<class T, class A, class VA>
+std::vector<T, VA> operator*(const kron_expr<T, A>& k, const std::vector<T, VA>& x)
+{
+	const auto& a = k.left();
+	const auto& b = k.right();
+	const auto a_sz = a.size();
+	const auto b_sz = b.size();
+	impl::check_vector_size(x, a_sz.cols * b_sz.cols);
+
+	// T1 = X * B^T (n x p): dot products of rows of X and rows of B
+	matrix<T, A> t1(a_sz.cols, b_sz.rows);
+	parallel_for(0, a_sz.cols, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t j = first; j < last; ++j) {
+			const T* x_row = x.data() + j * b_sz.cols;
+			for (std::size_t k = 0; k < b_sz.rows; ++k)
+				t1[j][k] = impl::dot_row(x_row, b[k], b_sz.cols);
+		}
+	});
+
+	// Y = A * T1 (m x p), stored row-major straight into the result
+	std::vector<T, VA> y(a_sz.rows * b_sz.rows, T());
+	parallel_for(0, a_sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			const T* a_row = a[i];
+			T* y_row = y.data() + i * b_sz.rows;
+			for (std::size_t j = 0; j < a_sz.cols; ++j) {
+				if (a_row[j] != T())
+					impl::axpy_row(a_row[j], t1[j], y_row, b_sz.rows);
+			}
+		}
+	});
+	return y;
+}
+
+// (A (x) B) * M for M of (n*q) x r, applying B to each q-row block of M first
+template<class T, class A>
+matrix<T, A> operator*(const kron_expr<T, A>& k, const matrix<T, A>& m)
+{
+	const auto& a = k.left();
+	const auto& b = k.right();
+	const auto a_sz = a.size();
+	const auto b_sz = b.size();
+	const auto m_sz = m.size();
+	if (m_sz.rows != a_sz.cols * b_sz.cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	const std::size_t r = m_sz.cols;
+
+	// rows [j*p, (j+1)*p) of T hold B * (rows [j*q, (j+1)*q) of M)
+	matrix<T, A> t(a_sz.cols * b_sz.rows, r, T());
+	parallel_for(0, t.size().rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t row = first; row < last; ++row) {
+			const std::size_t j = row / b_sz.rows;
+			const T* b_row = b[row % b_sz.rows];
+			for (std::size_t l = 0; l < b_sz.cols; ++l) {
+				if (b_row[l] != T())
+					impl::axpy_row(b_row[l], m[j * b_sz.cols + l], t[row], r);
+			}
+		}
+	});
+
+	// row (i*p + k) of the result is sum_j A[i][j] * T[j*p + k]
+	matrix<T, A> result(a_sz.rows * b_sz.rows, r, T());
+	parallel_for(0, result.size().rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t row = first; row < last; ++row) {
+			const T* a_row = a[row / b_sz.rows];
+			const std::size_t k = row % b_sz.rows;
+			for (std::size_t j = 0; j < a_sz.cols; ++j) {
+				if (a_row[j] != T())
+					impl::axpy_row(a_row[j], t[j * b_sz.rows + k], result[row], r);
+			}
+		}
+	});
+	return result;
+}
+
+// element-wise product
+template<class T, class A>
+matrix<T, A> hadamard(const matrix<T, A>& a, const matrix<T, A>& b)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != b.size().rows || a_sz.cols != b.size().cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	matrix<T, A> result(a_sz.rows, a_sz.cols);
+	parallel_for(0, a_sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			const T* a_row = a[i];
+			const T* b_row = b[i];
+			T* dst = result[i];
+			for (std::size_t j = 0; j < a_sz.cols; ++j)
+				dst[j] = a_row[j] * b_row[j];
+		}
+	});
+	return result;
+}
+
+// a = a o b without a temporary
+template<class T, class A>
+void hadamard_assign(matrix<T, A>& a, const matrix<T, A>& b)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != b.size().rows || a_sz.cols != b.size().cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+
+	parallel_for(0, a_sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			T* a_row = a[i];
+			const T* b_row = b[i];
+			for (std::size_t j = 0; j < a_sz.cols; ++j)
+				a_row[j] *= b_row[j];
+		}
+	});
+}
+
+// x * y^T
+template<class T, class VA>
+matrix<T> outer(const std::vector<T, VA>& x, const std::vector<T, VA>& y)
+{
+	if (x.empty() || y.empty())
+		throw std::invalid_argument{ "vector must not be empty" };
+
+	matrix<T> result(x.size(), y.size());
+	parallel_for(0, x.size(), impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			const T s = x[i];
+			T* dst = result[i];
+			for (std::size_t j = 0; j < y.size(); ++j)
+				dst[j] = s * y[j];
+		}
+	});
+	return result;
+}
+
+
+#endif // !PRODUCTS_HPP
@@ -0,0 +1,174 @@
+#pragma once
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+
+// Random fillers built on the Philox4x32-10 counter-based generator.
+// Element (i, j) draws from counter (i * cols + j) / 2 of the seed's stream, so every value depends
+// only on the seed and its position: rows can be filled by any number of threads in any order and
+// the result is the same. One Philox block (four 32-bit words) yields two elements.
+class philox4x32 {
+public:
+	using counter_type = std::array<std::uint32_t, 4>;
+	using key_type = std::array<std::uint32_t, 2>;
+
+	static constexpr std::size_t rounds = 10;
+
+	static counter_type generate(counter_type ctr, key_type key) noexcept
+	{
+		for (std::size_t round = 0; round < rounds; ++round) {
+			if (round > 0) {
+				key[0] += 0x9E3779B9u;
+				key[1] += 0xBB67AE85u;
+			}
+			const std::uint64_t p0 = std::uint64_t{ 0xD2511F53u } * ctr[0];
+			const std::uint64_t p1 = std::uint64_t{ 0xCD9E8D57u } * ctr[2];
+			ctr = counter_type{
+				static_cast<std::uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+				static_cast<std::uint32_t>(p1),
+				static_cast<std::uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+				static_cast<std::uint32_t>(p0) };
+		}
+		return ctr;
+	}
+};
+
+namespace impl {
+
+	// every distribution reads its own stream, so equal seeds give unrelated matrices
+	enum class random_stream : std::uint32_t { uniform, normal, bernoulli, sparse_pattern, gaussian_sketch, count_sketch, srht };
+
+	// two doubles in [0, 1) with 53 random bits each
+	inline std::array<double, 2> philox_unit_pair(std::uint64_t seed, random_stream stream, std::uint64_t block) noexcept {
+		const auto words = philox4x32::generate(
+			{ static_cast<std::uint32_t>(block), static_cast<std::uint32_t>(block >> 32), static_cast<std::uint32_t>(stream), 0u },
+			{ static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) });
+
+		constexpr double scale = 1.0 / 9007199254740992.0;  // 2^-53
+		const std::uint64_t hi = (std::uint64_t{ words[0] } << 32) | words[1];
+		const std::uint64_t lo = (std::uint64_t{ words[2] } << 32) | words[3];
+		return { static_cast<double>(hi >> 11) * scale, static_cast<double>(lo >> 11) * scale };
+	}
+
+	// two independent standard normals by Box-Muller
+	inline std::array<double, 2> philox_normal_pair(std::uint64_t seed, random_stream stream, std::uint64_t block) noexcept {
+		constexpr double two_pi = 6.283185307179586476925286766559;
+		const auto u = philox_unit_pair(seed, stream, block);
+		const double radius = std::sqrt(-2.0 * std::log(1.0 - u[0]));
+		return { radius * std::cos(two_pi * u[1]), radius * std::sin(two_pi * u[1]) };
+	}
+
+	// m[i][j] = transform(pair(block)[lane]) where block and lane come from the linear index
+	// (first_row + i) * cols + j; the pair function is evaluated once per block and the inner loop
+	// handles whole blocks. first_row lets a chunk of a larger matrix be generated on its own.
+	template<typename T, typename A, typename Pair, typename Transform>
+	void fill_by_counter(matrix<T, A>& m, Pair pair, Transform transform, std::uint64_t first_row = 0) {
+		const auto sz = m.size();
+		parallel_for(0, sz.rows, rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				T* row = m[i];
+				const std::uint64_t base = (first_row + i) * sz.cols;
+				std::size_t j = 0;
+				if (base % 2 != 0) {
+					row[0] = transform(pair(base / 2)[1]);
+					j = 1;
+				}
+				for (; j + 1 < sz.cols; j += 2) {
+					const auto values = pair((base + j) / 2);
+					row[j] = transform(values[0]);
+					row[j + 1] = transform(values[1]);
+				}
+				if (j < sz.cols)
+					row[j] = transform(pair((base + j) / 2)[0]);
+			}
+		});
+	}
+}
+
+// fills m with values uniformly distributed in [low, high)
+template<class T, class A>
+void random_uniform(matrix<T, A>& m, std::uint64_t seed, T low = T(0), T high = T(1))
+{
+	const double width = static_cast<double>(high) - static_cast<double>(low);
+	impl::fill_by_counter(m,
+		[seed](std::uint64_t block) { return impl::philox_unit_pair(seed, impl::random_stream::uniform, block); },
+		[low, width](double u) { return static_cast<T>(static_cast<double>(low) + width * u); });
+}
+
+// fills m with normally distributed values
+template<class T, class A>
+void random_normal(matrix<T, A>& m, std::uint64_t seed, T mean = T(0), T stddev = T(1))
+{
+	impl::fill_by_counter(m,
+		[seed](std::uint64_t block) { return impl::philox_normal_pair(seed, impl::random_stream::normal, block); },
+		[mean, stddev](double z) { return static_cast<T>(static_cast<double>(mean) + static_cast<double>(stddev) * z); });
+}
+
+// fills m with ones (probability p) and zeros
+template<class T, class A>
+void random_bernoulli(matrix<T, A>& m, std::uint64_t seed, double p = 0.5)
+{
+	if (p < 0.0 || p > 1.0)
+		throw std::invalid_argument{ "probability must lie in [0, 1]" };
+
+	impl::fill_by_counter(m,
+		[seed](std::uint64_t block) { return impl::philox_unit_pair(seed, impl::random_stream::bernoulli, block); },
+		[p](double u) { return u < p ? T(1) : T(0); });
+}
+
+// Haar-distributed random orthogonal (n x n) matrix:
+// Q of the QR decomposition of a Gaussian matrix, with columns signed so that diag(R) > 0
+template<class T = double, class A = std::allocator<T>>
+matrix<T, A> random_orthogonal(std::size_t n, std::uint64_t seed)
+{
+	if (n == 0)
+		throw std::invalid_argument{ "rows count must be greater than zero" };
+
+	matrix<T, A> gaussian(n, n);
+	random_normal(gaussian, seed);
+
+	matrix<T, A> q;
+	matrix<T, A> r;
+	qr(gaussian, q, r);
+	for (std::size_t i = 0; i < n; ++i) {
+		T* row = q[i];
+		for (std::size_t j = 0; j < n; ++j) {
+			if (r[j][j] < T())
+				row[j] = -row[j];
+		}
+	}
+	return q;
+}
+
+// (rows x cols) matrix whose elements are nonzero with probability density, nonzeros standard normal.
+// There is no sparse format, so the result is held densely. The pattern and the values come from
+// separate streams: nonzeros equal random_normal with the same seed, whatever the density.
+template<class T = double, class A = std::allocator<T>>
+matrix<T, A> random_sparse(std::size_t rows, std::size_t cols, double density, std::uint64_t seed)
+{
+	if (density < 0.0 || density > 1.0)
+		throw std::invalid_argument{ "density must lie in [0, 1]" };
+
+	matrix<T, A> result(rows, cols);
+	impl::fill_by_counter(result,
+		[seed, density](std::uint64_t block) {
+			const auto keep = impl::philox_unit_pair(seed, impl::random_stream::sparse_pattern, block);
+			const auto value = impl::philox_normal_pair(seed, impl::random_stream::normal, block);
+			return std::array<double, 2>{ keep[0] < density ? value[0] : 0.0, keep[1] < density ? value[1] : 0.0 };
+		},
+		[](double z) { return static_cast<T>(z); });
+	return result;
+}
+
+
+#endif // !RANDOM_HPP
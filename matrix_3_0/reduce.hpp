@@ -0,0 +1,133 @@
+#pragma once
+#ifndef REDUCE_HPP
+#define REDUCE_HPP
+
+#include "matrix.hpp"
+#include "matrix_view.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+#include "prefix_sum.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+// Reductions of a matrix along an axis or over all of it.
+// matrix_axis::rows reduces down the rows and gives one value per column, matrix_axis::cols
+// reduces along each row and gives one value per row, as in cumsum. Down the rows, threads own
+// column slices and fold whole rows into them, so every access runs along a row.
+enum class reduce_op { sum, min, max, mean };
+
+namespace impl {
+
+	template<typename T>
+	void reduce_into(reduce_op op, const T* x, T* acc, std::size_t n) noexcept {
+		switch (op) {
+		case reduce_op::min:
+			for (std::size_t j = 0; j < n; ++j)
+				acc[j] = std::min(acc[j], x[j]);
+			break;
+		case reduce_op::max:
+			for (std::size_t j = 0; j < n; ++j)
+				acc[j] = std::max(acc[j], x[j]);
+			break;
+		default:
+			for (std::size_t j = 0; j < n; ++j)
+				acc[j] += x[j];
+			break;
+		}
+	}
+
+	template<typename T>
+	T reduce_row(reduce_op op, const T* x, std::size_t n) noexcept {
+		switch (op) {
+		case reduce_op::min:
+			return *std::min_element(x, x + n);
+		case reduce_op::max:
+			return *std::max_element(x, x + n);
+		default: {
+			T sum = T();
+			for (std::size_t j = 0; j < n; ++j)
+				sum += x[j];
+			return sum;
+		}
+		}
+	}
+
+	inline void check_reducible(matrix_size_type sz, reduce_op op) {
+		if ((sz.rows == 0 || sz.cols == 0) && op != reduce_op::sum)
+			throw std::invalid_argument{ "cannot reduce an empty matrix" };
+	}
+}
+
+// one value per column (axis rows) or per row (axis cols)
+template<class T>
+std::vector<std::remove_const_t<T>> reduce(const matrix_view<T>& a, reduce_op op, matrix_axis axis)
+{
+	using value_type = std::remove_const_t<T>;
+	const auto sz = a.size();
+	impl::check_reducible(sz, op);
+
+	std::vector<value_type> result(axis == matrix_axis::rows ? sz.cols : sz.rows);
+	if (axis == matrix_axis::rows) {
+		parallel_for(0, sz.cols, kernel_tuning::current().column_grain, [&](std::size_t first, std::size_t last) {
+			value_type* acc = result.data() + first;
+			const std::size_t n = last - first;
+			std::size_t i = 0;
+			if (op == reduce_op::min || op == reduce_op::max) {
+				std::copy_n(a[0] + first, n, acc);
+				i = 1;
+			}
+			for (; i < sz.rows; ++i)
+				impl::reduce_into(op, a[i] + first, acc, n);
+			if (op == reduce_op::mean) {
+				for (std::size_t j = 0; j < n; ++j)
+					acc[j] /= static_cast<value_type>(sz.rows);
+			}
+		});
+	}
+	else {
+		parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				result[i] = impl::reduce_row(op, a[i], sz.cols);
+				if (op == reduce_op::mean)
+					result[i] /= static_cast<value_type>(sz.cols);
+			}
+		});
+	}
+	return result;
+}
+
+template<class T, class A>
+std::vector<T> reduce(const matrix<T, A>& a, reduce_op op, matrix_axis axis)
+{
+	return reduce(view(a), op, axis);
+}
+
+// single value over every element
+template<class T>
+std::remove_const_t<T> reduce_all(const matrix_view<T>& a, reduce_op op)
+{
+	using value_type = std::remove_const_t<T>;
+	const auto sz = a.size();
+	impl::check_reducible(sz, op);
+	if (sz.rows == 0 || sz.cols == 0)
+		return value_type();
+
+	const std::vector<value_type> per_row = reduce(a, op == reduce_op::mean ? reduce_op::sum : op, matrix_axis::cols);
+	value_type result = impl::reduce_row(op == reduce_op::mean ? reduce_op::sum : op, per_row.data(), per_row.size());
+	if (op == reduce_op::mean)
+		result /= static_cast<value_type>(sz.rows * sz.cols);
+	return result;
+}
+
+template<class T, class A>
+T reduce_all(const matrix<T, A>& a, reduce_op op)
+{
+	return reduce_all(view(a), op);
+}
+
+
+#endif // !REDUCE_HPP
@@ -0,0 +1,350 @@
+#pragma once
+#ifndef RESAMPLE_HPP
+#define RESAMPLE_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+// Image-style geometric operations on matrix<T> holding a single-channel frame.
+// uint8 frames are processed in fixed point (no float buffers) with saturating stores;
+// other element types use floating point weights.
+namespace impl {
+
+	constexpr int bilinear_shift = 11;
+	constexpr int bilinear_one = 1 << bilinear_shift;
+	constexpr int area_shift = 12;
+	constexpr std::uint32_t area_one = 1u << area_shift;
+
+	template<typename T, typename A>
+	void check_target_size(const matrix<T, A>& a, std::size_t rows, std::size_t cols) {
+		if (a.empty())
+			throw std::invalid_argument{ "matrix must not be empty" };
+		if (rows == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+		if (cols == 0)
+			throw std::invalid_argument{ "cols count must be greater than zero" };
+	}
+
+	// source position of each destination pixel centre
+	struct bilinear_tap {
+		std::size_t first;
+		std::size_t second;
+		double weight; // of second
+	};
+
+	inline std::vector<bilinear_tap> bilinear_taps(std::size_t src, std::size_t dst) {
+		std::vector<bilinear_tap> taps(dst);
+		const double scale = static_cast<double>(src) / static_cast<double>(dst);
+		for (std::size_t i = 0; i < dst; ++i) {
+			const double pos = std::min(std::max((i + 0.5) * scale - 0.5, 0.0), static_cast<double>(src - 1));
+			const auto first = static_cast<std::size_t>(pos);
+			taps[i] = bilinear_tap{ first, std::min(first + 1, src - 1), pos - first };
+		}
+		return taps;
+	}
+
+	// out = (top * (one - wy) + bottom * wy) >> (2 * bilinear_shift), saturated to uint8
+	inline void blend_rows_u8(const std::int32_t* top, const std::int32_t* bottom, std::int32_t wy,
+		std::uint8_t* out, std::size_t n) {
+
+		const std::int32_t wt = bilinear_one - wy;
+		constexpr std::int32_t round = 1 << (2 * bilinear_shift - 1);
+		std::size_t j = 0;
+#if defined(__AVX2__)
+		const __m256i v_wt = _mm256_set1_epi32(wt);
+		const __m256i v_wy = _mm256_set1_epi32(wy);
+		const __m256i v_round = _mm256_set1_epi32(round);
+		for (; j + 8 <= n; j += 8) {
+			const __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(top + j));
+			const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bottom + j));
+			__m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(t, v_wt), _mm256_mullo_epi32(b, v_wy));
+			sum = _mm256_srai_epi32(_mm256_add_epi32(sum, v_round), 2 * bilinear_shift);
+			// saturating packs 32 -> 16 -> 8; lanes interleave, so take the low 32 bits of each 128-bit half
+			const __m256i packed16 = _mm256_packus_epi32(sum, sum);
+			const __m256i packed8 = _mm256_packus_epi16(packed16, packed16);
+			const std::uint32_t lo = static_cast<std::uint32_t>(_mm256_extract_epi32(packed8, 0));
+			const std::uint32_t hi = static_cast<std::uint32_t>(_mm256_extract_epi32(packed8, 4));
+			std::copy_n(reinterpret_cast<const std::uint8_t*>(&lo), 4, out + j);
+			std::copy_n(reinterpret_cast<const std::uint8_t*>(&hi), 4, out + j + 4);
+		}
+#endif
+		for (; j < n; ++j) {
+			const std::int32_t value = (top[j] * wt + bottom[j] * wy + round) >> (2 * bilinear_shift);
+			out[j] = static_cast<std::uint8_t>(std::min(std::max(value, 0), 255));
+		}
+	}
+
+	// area weights: every destination pixel covers [i * scale, (i + 1) * scale) of the source
+	struct area_taps {
+		std::vector<std::size_t> offsets;  // taps of pixel i are [offsets[i], offsets[i + 1])
+		std::vector<std::size_t> index;
+		std::vector<double> weight;        // sums to 1 per destination pixel
+	};
+
+	inline area_taps make_area_taps(std::size_t src, std::size_t dst) {
+		area_taps taps;
+		taps.offsets.reserve(dst + 1);
+		const double scale = static_cast<double>(src) / static_cast<double>(dst);
+		for (std::size_t i = 0; i < dst; ++i) {
+			taps.offsets.push_back(taps.index.size());
+			const double begin = i * scale;
+			const double end = std::min((i + 1) * scale, static_cast<double>(src));
+			for (auto s = static_cast<std::size_t>(begin); static_cast<double>(s) < end && s < src; ++s) {
+				const double covered = std::min(end, s + 1.0) - std::max(begin, static_cast<double>(s));
+				if (covered <= 0.0)
+					continue;
+				taps.index.push_back(s);
+				taps.weight.push_back(covered / scale);
+			}
+		}
+		taps.offsets.push_back(taps.index.size());
+		return taps;
+	}
+
+	// fixed point area weights whose sum is exactly area_one per destination pixel
+	inline std::vector<std::uint32_t> fixed_area_weights(const area_taps& taps) {
+		std::vector<std::uint32_t> fixed(taps.weight.size());
+		for (std::size_t i = 0; i + 1 < taps.offsets.size(); ++i) {
+			std::uint32_t sum = 0;
+			const std::size_t first = taps.offsets[i];
+			const std::size_t last = taps.offsets[i + 1];
+			for (std::size_t t = first; t + 1 < last; ++t) {
+				fixed[t] = static_cast<std::uint32_t>(std::lround(taps.weight[t] * area_one));
+				sum += fixed[t];
+			}
+			fixed[last - 1] = area_one - std::min(sum, area_one);
+		}
+		return fixed;
+	}
+
+	template<typename T>
+	void reverse_row(T* row, std::size_t n) noexcept {
+		std::reverse(row, row + n);
+	}
+
+	inline void reverse_row(std::uint8_t* row, std::size_t n) noexcept {
+		std::size_t lo = 0;
+		std::size_t hi = n;
+#if defined(__AVX2__)
+		// swap reversed 32-byte blocks from both ends
+		const __m256i reverse_bytes = _mm256_setr_epi8(
+			15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+			15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+		auto reverse32 = [&](__m256i v) {
+			return _mm256_permute2x128_si256(_mm256_shuffle_epi8(v, reverse_bytes), v, 0x01);
+		};
+		for (; hi - lo >= 64; lo += 32, hi -= 32) {
+			const __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + lo));
+			const __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + hi - 32));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(row + lo), reverse32(right));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(row + hi - 32), reverse32(left));
+		}
+#endif
+		std::reverse(row + lo, row + hi);
+	}
+}
+
+// upside down; only the row table is reversed, O(rows)
+template<class T, class A>
+void flip_vertical(matrix<T, A>& a) noexcept
+{
+	if (a.empty())
+		return;
+
+	std::reverse(a.data(), a.data() + a.size().rows);
+}
+
+// mirror left to right in place
+template<class T, class A>
+void flip_horizontal(matrix<T, A>& a)
+{
+	const auto sz = a.size();
+	parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i)
+			impl::reverse_row(a[i], sz.cols);
+	});
+}
+
+// quarter turns; the result is cols x rows
+template<class T, class A>
+matrix<T, A> rotate_90_clockwise(const matrix<T, A>& a)
+{
+	if (a.empty())
+		throw std::invalid_argument{ "matrix must not be empty" };
+
+	matrix<T, A> result(a.size().cols, a.size().rows);
+	impl::transpose_into(a, result);
+	flip_horizontal(result);
+	return result;
+}
+
+template<class T, class A>
+matrix<T, A> rotate_90_counterclockwise(const matrix<T, A>& a)
+{
+	if (a.empty())
+		throw std::invalid_argument{ "matrix must not be empty" };
+
+	matrix<T, A> result(a.size().cols, a.size().rows);
+	impl::transpose_into(a, result);
+	flip_vertical(result);
+	return result;
+}
+
+template<class T, class A>
+void rotate_180(matrix<T, A>& a)
+{
+	flip_vertical(a);
+	flip_horizontal(a);
+}
+
+// bilinear interpolation with pixel centres aligned (half-pixel offset), edges clamped
+template<class T, class A>
+matrix<T, A> resize_bilinear(const matrix<T, A>& a, std::size_t rows, std::size_t cols)
+{
+	impl::check_target_size(a, rows, cols);
+
+	const auto sz = a.size();
+	const auto x_taps = impl::bilinear_taps(sz.cols, cols);
+	const auto y_taps = impl::bilinear_taps(sz.rows, rows);
+	matrix<T, A> result(rows, cols);
+
+	if constexpr (std::is_same_v<T, std::uint8_t>) {
+		std::vector<std::int32_t> x_weight(cols);
+		for (std::size_t j = 0; j < cols; ++j)
+			x_weight[j] = static_cast<std::int32_t>(std::lround(x_taps[j].weight * impl::bilinear_one));
+
+		parallel_for(0, rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			// horizontally interpolated source rows, scaled by bilinear_one
+			std::vector<std::int32_t> top(cols);
+			std::vector<std::int32_t> bottom(cols);
+			auto interpolate_row = [&](const std::uint8_t* src, std::int32_t* dst) {
+				for (std::size_t j = 0; j < cols; ++j) {
+					const std::int32_t w = x_weight[j];
+					dst[j] = src[x_taps[j].first] * (impl::bilinear_one - w) + src[x_taps[j].second] * w;
+				}
+			};
+
+			std::size_t top_row = sz.rows;
+			std::size_t bottom_row = sz.rows;
+			for (std::size_t i = first; i < last; ++i) {
+				const auto& tap = y_taps[i];
+				if (tap.first == bottom_row && tap.first != top_row) {
+					// moving down by one source row: the previous bottom row becomes the top one
+					top.swap(bottom);
+					top_row = bottom_row;
+					bottom_row = sz.rows;
+				}
+				if (tap.first != top_row) {
+					interpolate_row(a[tap.first], top.data());
+					top_row = tap.first;
+				}
+				if (tap.second != bottom_row) {
+					interpolate_row(a[tap.second], bottom.data());
+					bottom_row = tap.second;
+				}
+
+				const auto wy = static_cast<std::int32_t>(std::lround(tap.weight * impl::bilinear_one));
+				impl::blend_rows_u8(top.data(), bottom.data(), wy, result[i], cols);
+			}
+		});
+	}
+	else {
+		parallel_for(0, rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				const auto& y_tap = y_taps[i];
+				const T* top = a[y_tap.first];
+				const T* bottom = a[y_tap.second];
+				const T wy = static_cast<T>(y_tap.weight);
+				T* dst = result[i];
+				for (std::size_t j = 0; j < cols; ++j) {
+					const auto& x_tap = x_taps[j];
+					const T wx = static_cast<T>(x_tap.weight);
+					const T t = top[x_tap.first] + wx * (top[x_tap.second] - top[x_tap.first]);
+					const T b = bottom[x_tap.first] + wx * (bottom[x_tap.second] - bottom[x_tap.first]);
+					dst[j] = t + wy * (b - t);
+				}
+			}
+		});
+	}
+	return result;
+}
+
+// area (box filter) resampling for downscaling: every output pixel is the coverage-weighted
+// mean of the source pixels under it; upscaling falls back to bilinear
+template<class T, class A>
+matrix<T, A> resize_area(const matrix<T, A>& a, std::size_t rows, std::size_t cols)
+{
+	impl::check_target_size(a, rows, cols);
+
+	const auto sz = a.size();
+	if (rows > sz.rows || cols > sz.cols)
+		return resize_bilinear(a, rows, cols);
+
+	const auto x_taps = impl::make_area_taps(sz.cols, cols);
+	const auto y_taps = impl::make_area_taps(sz.rows, rows);
+	matrix<T, A> result(rows, cols);
+
+	if constexpr (std::is_same_v<T, std::uint8_t>) {
+		// weights in 1/4096: a row sum is at most 255 * 4096, the 2D sum at most 255 * 4096^2 < 2^32
+		const auto x_weight = impl::fixed_area_weights(x_taps);
+		const auto y_weight = impl::fixed_area_weights(y_taps);
+
+		parallel_for(0, rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			std::vector<std::uint32_t> acc(cols);
+			for (std::size_t i = first; i < last; ++i) {
+				std::fill(acc.begin(), acc.end(), 0u);
+				for (std::size_t ty = y_taps.offsets[i]; ty < y_taps.offsets[i + 1]; ++ty) {
+					const std::uint8_t* src = a[y_taps.index[ty]];
+					const std::uint32_t wy = y_weight[ty];
+					for (std::size_t j = 0; j < cols; ++j) {
+						std::uint32_t row_sum = 0;
+						for (std::size_t tx = x_taps.offsets[j]; tx < x_taps.offsets[j + 1]; ++tx)
+							row_sum += src[x_taps.index[tx]] * x_weight[tx];
+						acc[j] += row_sum * wy;
+					}
+				}
+
+				constexpr std::uint32_t round = 1u << (2 * impl::area_shift - 1);
+				std::uint8_t* dst = result[i];
+				for (std::size_t j = 0; j < cols; ++j)
+					dst[j] = static_cast<std::uint8_t>(std::min<std::uint32_t>((acc[j] + round) >> (2 * impl::area_shift), 255u));
+			}
+		});
+	}
+	else {
+		parallel_for(0, rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			std::vector<T> acc(cols);
+			for (std::size_t i = first; i < last; ++i) {
+				std::fill(acc.begin(), acc.end(), T());
+				for (std::size_t ty = y_taps.offsets[i]; ty < y_taps.offsets[i + 1]; ++ty) {
+					const T* src = a[y_taps.index[ty]];
+					const T wy = static_cast<T>(y_taps.weight[ty]);
+					for (std::size_t j = 0; j < cols; ++j) {
+						T row_sum = T();
+						for (std::size_t tx = x_taps.offsets[j]; tx < x_taps.offsets[j + 1]; ++tx)
+							row_sum += src[x_taps.index[tx]] * static_cast<T>(x_taps.weight[tx]);
+						acc[j] += row_sum * wy;
+					}
+				}
+				std::copy(acc.begin(), acc.end(), result[i]);
+			}
+		});
+	}
+	return result;
+}
+
+
+#endif // !RESAMPLE_HPP
@@ -0,0 +1,403 @@
+#pragma once
+#ifndef SHM_MATRIX_HPP
+#define SHM_MATRIX_HPP
+
+#include "matrix.hpp"
+#include "dtype.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Matrix living in a shared memory object that several processes map at the same time.
+// The object starts with a header that records the shape and the element type, so a process
+// opening it by name validates what it maps. Rows are found by offset from the mapping start
+// (data_offset + row * row_stride), never by stored pointers, because every process maps the
+// object at a different address. Rows are padded to a cache line so rows never share one.
+// Concurrent updates go through a seqlock in the header: writers serialize on a spin lock and make
+// the sequence odd while they are inside, readers retry when the sequence was odd or has changed.
+namespace impl {
+
+	constexpr std::uint64_t shm_magic = 0x4d48535852544d31ull;	// "1MTRXSHM"
+	constexpr std::uint32_t shm_layout_version = 1;
+	constexpr std::size_t shm_row_alignment = 64;
+
+	struct shm_header {
+		std::uint64_t magic;
+		std::uint32_t layout_version;
+		dtype type;
+		std::uint32_t element_size;
+		std::uint32_t reserved;
+		std::uint64_t rows;
+		std::uint64_t cols;
+		std::uint64_t row_stride;		// bytes from one row to the next
+		std::uint64_t data_offset;		// bytes from the mapping start to row 0
+		alignas(64) std::atomic<std::uint64_t> sequence;
+		std::atomic<std::uint32_t> writer_lock;
+	};
+
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+		"seqlock atomics must be lock-free to work across processes");
+
+	constexpr std::uint64_t shm_data_offset() noexcept {
+		return (sizeof(shm_header) + shm_row_alignment - 1) / shm_row_alignment * shm_row_alignment;
+	}
+}
+
+template<class T>
+class shm_matrix {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+
+	static_assert(std::is_trivially_copyable_v<T>, "shared matrices hold raw bytes");
+
+	// creates a new shared memory object called name (a leading '/' is added if missing)
+	static shm_matrix create(const std::string& name, size_type rows, size_type cols)
+	{
+		check_shape(rows, cols);
+		const std::uint64_t bytes = mapping_bytes(rows, cols);
+		shm_matrix result;
+		result.name_ = object_name(name);
+#if defined(_WIN32)
+		result.handle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), result.name_.c_str());
+		if (result.handle_ == nullptr || GetLastError() == ERROR_ALREADY_EXISTS)
+			throw std::system_error{ static_cast<int>(GetLastError()), std::system_category(), "cannot create shared matrix " + name };
+#else
+		result.fd_ = ::shm_open(result.name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (result.fd_ < 0)
+			throw std::system_error{ errno, std::generic_category(), "cannot create shared matrix " + name };
+		if (::ftruncate(result.fd_, static_cast<off_t>(bytes)) != 0) {
+			const int error = errno;
+			::shm_unlink(result.name_.c_str());
+			throw std::system_error{ error, std::generic_category(), "cannot size shared matrix " + name };
+		}
+#endif
+		result.map(bytes);
+		result.init_header(rows, cols);
+		return result;
+	}
+
+	// maps an existing shared matrix; throws if it was created with another element type
+	static shm_matrix open(const std::string& name)
+	{
+		shm_matrix result;
+		result.name_ = object_name(name);
+#if defined(_WIN32)
+		result.handle_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, result.name_.c_str());
+		if (result.handle_ == nullptr)
+			throw std::system_error{ static_cast<int>(GetLastError()), std::system_category(), "cannot open shared matrix " + name };
+		result.map(0);
+#else
+		result.fd_ = ::shm_open(result.name_.c_str(), O_RDWR, 0);
+		if (result.fd_ < 0)
+			throw std::system_error{ errno, std::generic_category(), "cannot open shared matrix " + name };
+		result.map_existing();
+#endif
+		result.check_header();
+		return result;
+	}
+
+#if defined(__linux__)
+	// unnamed shared matrix backed by memfd_create; share it via fork or by passing fd() over a socket
+	static shm_matrix anonymous(size_type rows, size_type cols)
+	{
+		check_shape(rows, cols);
+		const std::uint64_t bytes = mapping_bytes(rows, cols);
+		shm_matrix result;
+		result.fd_ = ::memfd_create("matrix", MFD_CLOEXEC);
+		if (result.fd_ < 0)
+			throw std::system_error{ errno, std::generic_category(), "memfd_create failed" };
+		if (::ftruncate(result.fd_, static_cast<off_t>(bytes)) != 0)
+			throw std::system_error{ errno, std::generic_category(), "cannot size shared matrix" };
+		result.map(bytes);
+		result.init_header(rows, cols);
+		return result;
+	}
+#endif
+
+#if !defined(_WIN32)
+	// maps the shared matrix behind a descriptor received from another process (duplicates fd)
+	static shm_matrix from_fd(int fd)
+	{
+		shm_matrix result;
+		result.fd_ = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if (result.fd_ < 0)
+			throw std::system_error{ errno, std::generic_category(), "cannot duplicate shared matrix descriptor" };
+		result.map_existing();
+		result.check_header();
+		return result;
+	}
+
+	int fd() const noexcept { return fd_; }
+#endif
+
+	// removes the name; mappings stay valid until every process has closed them
+	static void remove(const std::string& name)
+	{
+#if !defined(_WIN32)
+		::shm_unlink(object_name(name).c_str());
+#else
+		(void)name;		// named mappings disappear with the last handle
+#endif
+	}
+
+	shm_matrix(shm_matrix&& other) noexcept { swap(other); }
+	shm_matrix& operator=(shm_matrix&& other) noexcept
+	{
+		if (this != &other) {
+			shm_matrix(std::move(other)).swap(*this);
+		}
+		return *this;
+	}
+	shm_matrix(const shm_matrix&) = delete;
+	shm_matrix& operator=(const shm_matrix&) = delete;
+
+	~shm_matrix()
+	{
+#if defined(_WIN32)
+		if (base_ != nullptr)
+			UnmapViewOfFile(base_);
+		if (handle_ != nullptr)
+			CloseHandle(handle_);
+#else
+		if (base_ != nullptr)
+			::munmap(base_, bytes_);
+		if (fd_ >= 0)
+			::close(fd_);
+#endif
+	}
+
+	matrix_size_type size() const noexcept { return matrix_size_type(static_cast<size_type>(header().rows), static_cast<size_type>(header().cols)); }
+	const std::string& name() const noexcept { return name_; }
+	dtype type() const noexcept { return header().type; }
+
+	// completed writes so far
+	std::uint64_t version() const noexcept { return header().sequence.load(std::memory_order_acquire) / 2; }
+
+	// unsynchronized row access; use inside write() / read() when other processes update the matrix
+	T* operator[](size_type row) noexcept { return reinterpret_cast<T*>(row_address(row)); }
+	const T* operator[](size_type row) const noexcept { return reinterpret_cast<const T*>(row_address(row)); }
+
+	T& operator()(size_type row, size_type col) { check_index(row, col); return (*this)[row][col]; }
+	const T& operator()(size_type row, size_type col) const { check_index(row, col); return (*this)[row][col]; }
+
+	// runs fn(*this) as the only writer across all processes and publishes a new version
+	template<class Func>
+	decltype(auto) write(Func&& fn)
+	{
+		auto& h = header();
+		while (h.writer_lock.exchange(1, std::memory_order_acquire) != 0) {
+			while (h.writer_lock.load(std::memory_order_relaxed) != 0)
+				std::this_thread::yield();
+		}
+		struct unlock_guard {
+			impl::shm_header& h;
+			~unlock_guard()
+			{
+				h.sequence.fetch_add(1, std::memory_order_release);
+				h.writer_lock.store(0, std::memory_order_release);
+			}
+		};
+
+		h.sequence.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		unlock_guard guard{ h };
+		return fn(*this);
+	}
+
+	// runs fn(const *this) until it has seen no concurrent write and returns its result;
+	// fn may run several times and must only copy data out
+	template<class Func>
+	auto read(Func&& fn) const
+	{
+		const auto& h = header();
+		for (;;) {
+			const std::uint64_t before = h.sequence.load(std::memory_order_acquire);
+			if (before % 2 != 0) {
+				std::this_thread::yield();
+				continue;
+			}
+			auto result = fn(*this);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (h.sequence.load(std::memory_order_relaxed) == before)
+				return result;
+		}
+	}
+
+	// consistent snapshot of the whole matrix
+	template<class A = std::allocator<T>>
+	matrix<T, A> to_matrix() const
+	{
+		const auto sz = size();
+		matrix<T, A> result(sz.rows, sz.cols);
+		read([&](const shm_matrix& m) {
+			for (size_type i = 0; i < sz.rows; ++i)
+				std::memcpy(result[i], m[i], sz.cols * sizeof(T));
+			return true;
+		});
+		return result;
+	}
+
+	template<class A>
+	void assign(const matrix<T, A>& src)
+	{
+		if (!same_shape(src.size(), size()))
+			throw std::invalid_argument{ "matrix sizes do not match" };
+		write([&](shm_matrix& m) {
+			for (size_type i = 0; i < src.size().rows; ++i)
+				std::memcpy(m[i], src[i], src.size().cols * sizeof(T));
+		});
+	}
+
+private:
+	shm_matrix() = default;
+
+	void swap(shm_matrix& other) noexcept
+	{
+		std::swap(name_, other.name_);
+		std::swap(base_, other.base_);
+		std::swap(bytes_, other.bytes_);
+#if defined(_WIN32)
+		std::swap(handle_, other.handle_);
+#else
+		std::swap(fd_, other.fd_);
+#endif
+	}
+
+	static void check_shape(size_type rows, size_type cols)
+	{
+		if (rows == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+		if (cols == 0)
+			throw std::invalid_argument{ "cols count must be greater than zero" };
+	}
+
+	static std::uint64_t row_stride(size_type cols) noexcept
+	{
+		const std::uint64_t bytes = static_cast<std::uint64_t>(cols) * sizeof(T);
+		return (bytes + impl::shm_row_alignment - 1) / impl::shm_row_alignment * impl::shm_row_alignment;
+	}
+
+	static std::uint64_t mapping_bytes(size_type rows, size_type cols) noexcept
+	{
+		return impl::shm_data_offset() + rows * row_stride(cols);
+	}
+
+	static std::string object_name(const std::string& name)
+	{
+#if defined(_WIN32)
+		return "Local\\" + (name.empty() || name[0] != '/' ? name : name.substr(1));
+#else
+		return (name.empty() || name[0] != '/') ? "/" + name : name;
+#endif
+	}
+
+	void map(std::uint64_t bytes)
+	{
+#if defined(_WIN32)
+		base_ = MapViewOfFile(handle_, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(bytes));
+		if (base_ == nullptr)
+			throw std::system_error{ static_cast<int>(GetLastError()), std::system_category(), "cannot map shared matrix" };
+		MEMORY_BASIC_INFORMATION info{};
+		VirtualQuery(base_, &info, sizeof(info));
+		bytes_ = bytes != 0 ? bytes : info.RegionSize;
+#else
+		void* p = ::mmap(nullptr, static_cast<size_t>(bytes), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+		if (p == MAP_FAILED)
+			throw std::system_error{ errno, std::generic_category(), "cannot map shared matrix" };
+		base_ = p;
+		bytes_ = static_cast<size_t>(bytes);
+#endif
+	}
+
+#if !defined(_WIN32)
+	void map_existing()
+	{
+		struct stat st {};
+		if (::fstat(fd_, &st) != 0)
+			throw std::system_error{ errno, std::generic_category(), "cannot stat shared matrix" };
+		if (static_cast<std::uint64_t>(st.st_size) < impl::shm_data_offset())
+			throw std::invalid_argument{ "shared memory object is not a matrix" };
+		map(static_cast<std::uint64_t>(st.st_size));
+	}
+#endif
+
+	void init_header(size_type rows, size_type cols)
+	{
+		// the object is zero-filled; the atomics start at zero
+		auto* h = new (base_) impl::shm_header{};
+		h->layout_version = impl::shm_layout_version;
+		h->type = impl::dtype_of<T>();
+		h->element_size = sizeof(T);
+		h->rows = rows;
+		h->cols = cols;
+		h->row_stride = row_stride(cols);
+		h->data_offset = impl::shm_data_offset();
+		std::atomic_thread_fence(std::memory_order_release);
+		h->magic = impl::shm_magic;
+	}
+
+	void check_header() const
+	{
+		const auto& h = header();
+		if (h.magic != impl::shm_magic || h.layout_version != impl::shm_layout_version)
+			throw std::invalid_argument{ "shared memory object is not a matrix" };
+		if (h.type != impl::dtype_of<T>() || h.element_size != sizeof(T))
+			throw std::invalid_argument{ "shared matrix element type does not match" };
+		if (h.data_offset + h.rows * h.row_stride > bytes_)
+			throw std::invalid_argument{ "shared matrix is truncated" };
+	}
+
+	impl::shm_header& header() noexcept { return *static_cast<impl::shm_header*>(base_); }
+	const impl::shm_header& header() const noexcept { return *static_cast<const impl::shm_header*>(base_); }
+
+	unsigned char* row_address(size_type row) const noexcept
+	{
+		const auto& h = header();
+		return static_cast<unsigned char*>(base_) + h.data_offset + row * h.row_stride;
+	}
+
+	void check_index(size_type row, size_type col) const
+	{
+		if (row >= header().rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+		if (col >= header().cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+	}
+
+	std::string name_;
+	void* base_ = nullptr;
+	std::size_t bytes_ = 0;
+#if defined(_WIN32)
+	HANDLE handle_ = nullptr;
+#else
+	int fd_ = -1;
+#endif
+};
+
+
+#endif // !SHM_MATRIX_HPP
@@ -0,0 +1,378 @@
+#pragma once
+#ifndef SKETCH_HPP
+#define SKETCH_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+// Randomized sketching and low-rank approximation.
+// Sketches act on the rows of A (Y = S * A, S is (k x m)) so they can be accumulated from row chunks:
+// the column of S belonging to data row i is regenerated from the seed and i, never stored.
+enum class sketch_kind { gaussian, count };
+
+namespace impl {
+
+	// CountSketch hash of data row i: target row of the sketch and sign
+	inline std::pair<std::size_t, bool> count_sketch_hash(std::uint64_t seed, std::uint64_t row, std::size_t k) noexcept {
+		const auto u = philox_unit_pair(seed, random_stream::count_sketch, row);
+		const std::size_t bucket = std::min(k - 1, static_cast<std::size_t>(u[0] * static_cast<double>(k)));
+		return { bucket, u[1] < 0.5 };
+	}
+
+	template<typename T, typename A>
+	T frobenius_norm(const matrix<T, A>& a) {
+		T sum = T();
+		for (std::size_t i = 0; i < a.size().rows; ++i)
+			sum += dot_row(a[i], a[i], a.size().cols);
+		return std::sqrt(sum);
+	}
+
+	// One-sided (Hestenes) Jacobi on the rows of b: rotates pairs of rows until all rows are orthogonal,
+	// accumulating the rotations in j, so that j * b_initial = b with b = diag(s) * V^T.
+	// Rows are contiguous, so every rotation is a pair of row sweeps.
+	template<typename T, typename A>
+	void row_jacobi(matrix<T, A>& b, matrix<T, A>& j, std::size_t max_sweeps = 60) {
+		const std::size_t l = b.size().rows;
+		const std::size_t n = b.size().cols;
+		const T eps = std::numeric_limits<T>::epsilon();
+		set_identity(j);
+
+		auto rotate = [](T* x, T* y, std::size_t count, T c, T s) {
+			for (std::size_t k = 0; k < count; ++k) {
+				const T xk = x[k];
+				const T yk = y[k];
+				x[k] = c * xk - s * yk;
+				y[k] = s * xk + c * yk;
+			}
+		};
+
+		for (std::size_t sweep = 0; sweep < max_sweeps; ++sweep) {
+			bool rotated = false;
+			for (std::size_t p = 0; p + 1 < l; ++p) {
+				for (std::size_t q = p + 1; q < l; ++q) {
+					const T alpha = dot_row(b[p], b[p], n);
+					const T beta = dot_row(b[q], b[q], n);
+					const T gamma = dot_row(b[p], b[q], n);
+					if (gamma == T() || std::abs(gamma) <= eps * std::sqrt(alpha * beta))
+						continue;
+
+					const T zeta = (beta - alpha) / (T(2) * gamma);
+					const T t = (zeta >= T() ? T(1) : T(-1)) / (std::abs(zeta) + std::sqrt(T(1) + zeta * zeta));
+					const T c = T(1) / std::sqrt(T(1) + t * t);
+					const T s = c * t;
+					rotate(b[p], b[q], n, c, s);
+					rotate(j[p], j[q], l, c, s);
+					rotated = true;
+				}
+			}
+			if (!rotated)
+				return;
+		}
+		throw std::domain_error{ "singular value iteration did not converge" };
+	}
+
+	inline void check_sketch_size(std::size_t k, std::size_t limit) {
+		if (k == 0)
+			throw std::invalid_argument{ "sketch size must be greater than zero" };
+		if (k > limit)
+			throw std::invalid_argument{ "sketch size exceeds matrix dimensions" };
+	}
+}
+
+// Accumulates Y = S * A from row chunks of A that are never held together.
+// Chunks may arrive in any order; the result only depends on the seed and the row numbers.
+template<class T, class Allocator = std::allocator<T>>
+class streaming_sketch {
+public:
+	using matrix_type = matrix<T, Allocator>;
+
+	explicit streaming_sketch(std::size_t sketch_rows, std::size_t cols, sketch_kind kind, std::uint64_t seed)
+		: sketch_(sketch_rows, cols, T()), kind_{ kind }, seed_{ seed }
+	{
+		impl::check_sketch_size(sketch_rows, std::numeric_limits<std::size_t>::max());
+	}
+
+	// adds the contribution of rows [first_row, first_row + chunk.rows) of A
+	void add_rows(const matrix_type& chunk, std::uint64_t first_row)
+	{
+		const auto c_sz = chunk.size();
+		const auto y_sz = sketch_.size();
+		if (c_sz.cols != y_sz.cols)
+			throw std::invalid_argument{ "matrix sizes do not match" };
+
+		if (kind_ == sketch_kind::gaussian) {
+			// S^T of the chunk is (rows x k) with entries N(0, 1 / k); Y += (S^T)^T * chunk
+			matrix_type s_t(c_sz.rows, y_sz.rows);
+			const T scale = T(1) / std::sqrt(static_cast<T>(y_sz.rows));
+			const std::uint64_t seed = seed_;
+			impl::fill_by_counter(s_t,
+				[seed](std::uint64_t block) { return impl::philox_normal_pair(seed, impl::random_stream::gaussian_sketch, block); },
+				[scale](double z) { return static_cast<T>(z) * scale; },
+				first_row);
+			gemm(T(1), transpose(s_t), chunk, T(1), sketch_);
+			return;
+		}
+
+		// CountSketch: every data row is added with a random sign to one random sketch row;
+		// threads own column slices of Y so the scattered updates never collide
+		std::vector<std::pair<std::size_t, bool>> hashes(c_sz.rows);
+		for (std::size_t i = 0; i < c_sz.rows; ++i)
+			hashes[i] = impl::count_sketch_hash(seed_, first_row + i, y_sz.rows);
+
+		parallel_for(0, y_sz.cols, kernel_tuning::current().column_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = 0; i < c_sz.rows; ++i) {
+				const T sign = hashes[i].second ? T(1) : T(-1);
+				impl::axpy_row(sign, chunk[i] + first, sketch_[hashes[i].first] + first, last - first);
+			}
+		});
+	}
+
+	const matrix_type& result() const noexcept { return sketch_; }
+	sketch_kind kind() const noexcept { return kind_; }
+
+private:
+	matrix_type sketch_;
+	sketch_kind kind_;
+	std::uint64_t seed_;
+};
+
+// S * A with a (k x m) Gaussian S scaled so that E[S^T S] = I
+template<class T, class A>
+matrix<T, A> gaussian_sketch(const matrix<T, A>& a, std::size_t k, std::uint64_t seed)
+{
+	streaming_sketch<T, A> sketch(k, a.size().cols, sketch_kind::gaussian, seed);
+	sketch.add_rows(a, 0);
+	return sketch.result();
+}
+
+// S * A with a CountSketch S: one nonzero (+-1) per column of S, O(nnz(A)) work
+template<class T, class A>
+matrix<T, A> count_sketch(const matrix<T, A>& a, std::size_t k, std::uint64_t seed)
+{
+	streaming_sketch<T, A> sketch(k, a.size().cols, sketch_kind::count, seed);
+	sketch.add_rows(a, 0);
+	return sketch.result();
+}
+
+// Subsampled randomized Hadamard transform: S = sqrt(m' / k) * R * H * D with random signs D,
+// the orthonormal Walsh-Hadamard transform H over the rows padded to m' = 2^p and k sampled rows R.
+// The butterflies combine whole rows, split over column slices so each thread keeps its slice in cache.
+template<class T, class A>
+matrix<T, A> srht_sketch(const matrix<T, A>& a, std::size_t k, std::uint64_t seed)
+{
+	const auto a_sz = a.size();
+	std::size_t padded = 1;
+	while (padded < a_sz.rows)
+		padded *= 2;
+	impl::check_sketch_size(k, padded);
+
+	matrix<T, A> work(padded, a_sz.cols, T());
+	for (std::size_t i = 0; i < a_sz.rows; ++i) {
+		const bool positive = impl::philox_unit_pair(seed, impl::random_stream::srht, i)[0] < 0.5;
+		const T sign = positive ? T(1) : T(-1);
+		for (std::size_t j = 0; j < a_sz.cols; ++j)
+			work[i][j] = sign * a[i][j];
+	}
+
+	parallel_for(0, a_sz.cols, kernel_tuning::current().column_grain, [&](std::size_t first, std::size_t last) {
+		const std::size_t count = last - first;
+		for (std::size_t half = 1; half < padded; half *= 2) {
+			for (std::size_t block = 0; block < padded; block += 2 * half) {
+				for (std::size_t i = block; i < block + half; ++i) {
+					T* x = work[i] + first;
+					T* y = work[i + half] + first;
+					for (std::size_t j = 0; j < count; ++j) {
+						const T sum = x[j] + y[j];
+						y[j] = x[j] - y[j];
+						x[j] = sum;
+					}
+				}
+			}
+		}
+	});
+
+	// k distinct rows by a partial Fisher-Yates shuffle; the 1 / sqrt(m') of H and
+	// the sqrt(m' / k) of the sampling combine into 1 / sqrt(k)
+	std::vector<std::size_t> order(padded);
+	std::iota(order.begin(), order.end(), std::size_t{ 0 });
+	for (std::size_t i = 0; i < k; ++i) {
+		const double u = impl::philox_unit_pair(seed, impl::random_stream::srht, a_sz.rows + i)[1];
+		const std::size_t pick = i + std::min(padded - i - 1, static_cast<std::size_t>(u * static_cast<double>(padded - i)));
+		std::swap(order[i], order[pick]);
+	}
+
+	matrix<T, A> result(k, a_sz.cols);
+	const T scale = T(1) / std::sqrt(static_cast<T>(k));
+	for (std::size_t i = 0; i < k; ++i) {
+		const T* src = work[order[i]];
+		for (std::size_t j = 0; j < a_sz.cols; ++j)
+			result[i][j] = scale * src[j];
+	}
+	return result;
+}
+
+// (m x l) matrix Q with orthonormal columns whose span approximates the range of A:
+// Q = orth(A * Omega) for a Gaussian (n x l) Omega, refined by power iterations
+// Q = orth(A * orth(A^T * Q)) that sharpen slowly decaying spectra
+template<class T, class A>
+matrix<T, A> randomized_range_finder(const matrix<T, A>& a, std::size_t l,
+	std::size_t power_iterations, std::uint64_t seed)
+{
+	const auto a_sz = a.size();
+	impl::check_sketch_size(l, std::min(a_sz.rows, a_sz.cols));
+
+	matrix<T, A> omega(a_sz.cols, l);
+	random_normal(omega, seed);
+
+	matrix<T, A> q;
+	matrix<T, A> r;
+	qr(multiply(a, omega), q, r);
+	if (power_iterations == 0)
+		return q;
+
+	const matrix<T, A> a_t = transpose(a);
+	matrix<T, A> z;
+	for (std::size_t it = 0; it < power_iterations; ++it) {
+		qr(multiply(a_t, q), z, r);
+		qr(multiply(a, z), q, r);
+	}
+	return q;
+}
+
+// truncated singular value decomposition A ~ U * diag(singular_values) * Vt,
+// singular values in decreasing order
+template<class T, class A = std::allocator<T>>
+struct svd_result {
+	matrix<T, A> u;
+	std::vector<T> singular_values;
+	matrix<T, A> vt;
+};
+
+// Halko-Martinsson-Tropp randomized SVD: project A onto the range found from rank + oversampling
+// random directions, then take the exact SVD of the small (l x n) matrix Q^T * A by one-sided Jacobi
+template<class T, class A>
+svd_result<T, A> randomized_svd(const matrix<T, A>& a, std::size_t rank, std::uint64_t seed,
+	std::size_t oversampling = 10, std::size_t power_iterations = 2)
+{
+	const auto a_sz = a.size();
+	impl::check_sketch_size(rank, std::min(a_sz.rows, a_sz.cols));
+
+	const std::size_t l = std::min(rank + oversampling, std::min(a_sz.rows, a_sz.cols));
+	const matrix<T, A> q = randomized_range_finder(a, l, power_iterations, seed);
+	matrix<T, A> b = multiply(transpose(q), a);
+	matrix<T, A> j(l, l);
+	impl::row_jacobi(b, j);
+
+	std::vector<T> norms(l);
+	for (std::size_t i = 0; i < l; ++i)
+		norms[i] = std::sqrt(impl::dot_row(b[i], b[i], a_sz.cols));
+	std::vector<std::size_t> order(l);
+	std::iota(order.begin(), order.end(), std::size_t{ 0 });
+	std::stable_sort(order.begin(), order.end(), [&](std::size_t x, std::size_t y) { return norms[x] > norms[y]; });
+
+	// B = J^T * diag(s) * Vt, so U = Q * J^T restricted to the kept rows of J
+	svd_result<T, A> result{ matrix<T, A>(), std::vector<T>(rank), matrix<T, A>(rank, a_sz.cols) };
+	matrix<T, A> j_kept(rank, l);
+	for (std::size_t c = 0; c < rank; ++c) {
+		const std::size_t src = order[c];
+		const T s = norms[src];
+		result.singular_values[c] = s;
+		std::copy_n(j[src], l, j_kept[c]);
+		if (s > T()) {
+			for (std::size_t col = 0; col < a_sz.cols; ++col)
+				result.vt[c][col] = b[src][col] / s;
+		}
+	}
+	result.u = multiply(q, transpose(j_kept));
+	return result;
+}
+
+// numerical rank estimate: singular values of a randomized SVD with at most max_rank terms
+// that exceed tolerance times the largest one
+template<class T, class A>
+std::size_t approximate_rank(const matrix<T, A>& a, T tolerance, std::size_t max_rank, std::uint64_t seed)
+{
+	const auto svd = randomized_svd(a, max_rank, seed);
+	if (svd.singular_values.front() == T())
+		return 0;
+
+	const T threshold = tolerance * svd.singular_values.front();
+	return static_cast<std::size_t>(std::count_if(svd.singular_values.begin(), svd.singular_values.end(),
+		[threshold](T s) { return s > threshold; }));
+}
+
+// Nystrom approximation of a symmetric positive semidefinite (n x n) A from l random directions.
+// Returns F (n x l) with A ~ F * F^T. A tiny shift nu keeps Omega^T * A * Omega positive definite
+// and is taken back out of the factor at the end.
+template<class T, class A>
+matrix<T, A> nystrom_approximation(const matrix<T, A>& a, std::size_t l, std::uint64_t seed)
+{
+	const auto a_sz = a.size();
+	if (a_sz.rows != a_sz.cols)
+		throw std::invalid_argument{ "matrix must be square" };
+	impl::check_sketch_size(l, a_sz.rows);
+
+	const std::size_t n = a_sz.rows;
+	matrix<T, A> gaussian(n, l);
+	random_normal(gaussian, seed);
+	matrix<T, A> omega;
+	matrix<T, A> r;
+	qr(gaussian, omega, r);
+
+	// Y = (A + nu I) * Omega
+	matrix<T, A> y = multiply(a, omega);
+	const T nu = std::sqrt(static_cast<T>(n)) * std::numeric_limits<T>::epsilon() * impl::frobenius_norm(y);
+	for (std::size_t i = 0; i < n; ++i)
+		impl::axpy_row(nu, omega[i], y[i], l);
+
+	// C = Omega^T * Y = L * L^T, F = Y * L^-T: every row f of F solves L * f = y by forward substitution
+	matrix<T, A> c = multiply(transpose(omega), y);
+	for (std::size_t i = 0; i < l; ++i) {
+		for (std::size_t k = 0; k < i; ++k)
+			c[i][k] = c[k][i] = (c[i][k] + c[k][i]) / T(2);
+	}
+	const matrix<T, A> chol = cholesky(c);
+
+	matrix<T, A> f(n, l);
+	parallel_for(0, n, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			T* row = f[i];
+			for (std::size_t k = 0; k < l; ++k)
+				row[k] = (y[i][k] - impl::dot_row(chol[k], row, k)) / chol[k][k];
+		}
+	});
+
+	// F * F^T approximates A + nu I. With F^T = J^T * diag(s) * U^T from row Jacobi, the shifted
+	// approximation is U * diag(s^2) * U^T; column k of the result is u_k * sqrt(max(s_k^2 - nu, 0)).
+	matrix<T, A> b = transpose(f);
+	matrix<T, A> j(l, l);
+	impl::row_jacobi(b, j);
+	std::vector<T> scale(l);
+	for (std::size_t k = 0; k < l; ++k) {
+		const T s2 = impl::dot_row(b[k], b[k], n);
+		scale[k] = (s2 > nu) ? std::sqrt((s2 - nu) / s2) : T();
+	}
+	parallel_for(0, n, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			for (std::size_t k = 0; k < l; ++k)
+				f[i][k] = b[k][i] * scale[k];
+		}
+	});
+	return f;
+}
+
+
+#endif // !SKETCH_HPP
@@ -0,0 +1,260 @@
+#pragma once
+#ifndef STENCIL_HPP
+#define STENCIL_HPP
+
+#include "matrix.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+
+// Offset of one neighbour relative to the updated element.
+struct stencil_point {
+	int row;
+	int col;
+};
+
+// A neighbourhood is any type with a static constexpr std::array<stencil_point, N> points;
+// the stencil function receives the neighbour values in the same order.
+struct five_point_stencil {
+	static constexpr std::array<stencil_point, 5> points{ { { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } } };
+};
+
+struct nine_point_stencil {
+	static constexpr std::array<stencil_point, 9> points{ {
+		{ -1, -1 }, { -1, 0 }, { -1, 1 },
+		{ 0, -1 }, { 0, 0 }, { 0, 1 },
+		{ 1, -1 }, { 1, 0 }, { 1, 1 } } };
+};
+
+// how neighbours outside the matrix are read
+enum class boundary_mode { clamp, constant, periodic };
+
+namespace impl {
+
+	constexpr std::size_t stencil_tile_cols = 512;
+
+	template<typename Stencil>
+	constexpr std::size_t stencil_radius() {
+		int radius = 0;
+		for (const auto& point : Stencil::points) {
+			radius = std::max(radius, point.row < 0 ? -point.row : point.row);
+			radius = std::max(radius, point.col < 0 ? -point.col : point.col);
+		}
+		return static_cast<std::size_t>(radius);
+	}
+
+	inline std::ptrdiff_t wrap_index(std::ptrdiff_t index, std::ptrdiff_t size, boundary_mode mode) {
+		if (mode == boundary_mode::clamp)
+			return std::min(std::max<std::ptrdiff_t>(index, 0), size - 1);
+
+		index %= size;
+		return index < 0 ? index + size : index;
+	}
+
+	// element with halo handling, used only on the border of the matrix
+	template<typename T, typename A>
+	T halo_value(const matrix<T, A>& in, std::ptrdiff_t row, std::ptrdiff_t col, boundary_mode mode, const T& fill) {
+		const auto sz = in.size();
+		const auto rows = static_cast<std::ptrdiff_t>(sz.rows);
+		const auto cols = static_cast<std::ptrdiff_t>(sz.cols);
+		if (row >= 0 && row < rows && col >= 0 && col < cols)
+			return in[row][col];
+
+		if (mode == boundary_mode::constant)
+			return fill;
+
+		return in[wrap_index(row, rows, mode)][wrap_index(col, cols, mode)];
+	}
+
+	// monotonic deque over a ring buffer of indices: out[j] = best of src[j .. j + window)
+	template<typename T, typename Compare>
+	void sliding_extreme_row(const T* src, std::size_t n, std::size_t window, T* out,
+		std::vector<std::size_t>& ring, Compare better) {
+
+		std::size_t head = 0;
+		std::size_t count = 0;
+		for (std::size_t j = 0; j < n; ++j) {
+			// drop the index that left the window before pushing, so at most window indices are held
+			if (count > 0 && ring[head] + window <= j) {
+				head = (head + 1) % window;
+				--count;
+			}
+			while (count > 0 && !better(src[ring[(head + count - 1) % window]], src[j]))
+				--count;
+			ring[(head + count) % window] = j;
+			++count;
+
+			if (j + 1 >= window)
+				out[j + 1 - window] = src[ring[head]];
+		}
+	}
+}
+
+// out[i][j] = fn(values of the neighbourhood of in[i][j]).
+// Work is split into row bands over threads and column tiles inside a band, so the neighbour rows
+// of a tile stay in cache; interior tiles read rows directly and only the halo is bounds-checked.
+template<class Stencil, class T, class A, class Func>
+void apply_stencil(const matrix<T, A>& in, matrix<T, A>& out, Func fn,
+	boundary_mode mode = boundary_mode::clamp, const T& fill = T())
+{
+	constexpr auto& points = Stencil::points;
+	constexpr std::size_t count = points.size();
+	constexpr std::size_t radius = impl::stencil_radius<Stencil>();
+
+	const auto sz = in.size();
+	if (out.size().rows != sz.rows || out.size().cols != sz.cols)
+		throw std::invalid_argument{ "matrix sizes do not match" };
+	if (&in == &out)
+		throw std::invalid_argument{ "stencil cannot be applied in place" };
+
+	const bool has_interior_cols = sz.cols > 2 * radius;
+	const std::size_t interior_first = has_interior_cols ? radius : sz.cols;
+	const std::size_t interior_last = has_interior_cols ? sz.cols - radius : sz.cols;
+
+	auto apply_halo = [&](std::size_t i, std::size_t j) {
+		std::array<T, count> values;
+		for (std::size_t k = 0; k < count; ++k) {
+			values[k] = impl::halo_value(in,
+				static_cast<std::ptrdiff_t>(i) + points[k].row,
+				static_cast<std::ptrdiff_t>(j) + points[k].col, mode, fill);
+		}
+		out[i][j] = fn(values);
+	};
+
+	parallel_for(0, sz.rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		for (std::size_t jj = interior_first; jj < interior_last; jj += impl::stencil_tile_cols) {
+			const std::size_t je = std::min(interior_last, jj + impl::stencil_tile_cols);
+			for (std::size_t i = first; i < last; ++i) {
+				if (i < radius || i + radius >= sz.rows) {
+					for (std::size_t j = jj; j < je; ++j)
+						apply_halo(i, j);
+					continue;
+				}
+
+				std::array<const T*, count> src;
+				for (std::size_t k = 0; k < count; ++k)
+					src[k] = in[i + points[k].row] + points[k].col;
+
+				T* dst = out[i];
+				for (std::size_t j = jj; j < je; ++j) {
+					std::array<T, count> values;
+					for (std::size_t k = 0; k < count; ++k)
+						values[k] = src[k][j];
+					dst[j] = fn(values);
+				}
+			}
+		}
+
+		// left and right halo columns
+		for (std::size_t i = first; i < last; ++i) {
+			for (std::size_t j = 0; j < interior_first; ++j)
+				apply_halo(i, j);
+			for (std::size_t j = interior_last; j < sz.cols; ++j)
+				apply_halo(i, j);
+		}
+	});
+}
+
+// runs the stencil for the given number of time steps, double-buffering between grid
+// and one scratch matrix; buffers are exchanged by swapping row tables, never copied
+template<class Stencil, class T, class A, class Func>
+void run_stencil(matrix<T, A>& grid, std::size_t steps, Func fn,
+	boundary_mode mode = boundary_mode::clamp, const T& fill = T())
+{
+	if (steps == 0)
+		return;
+
+	matrix<T, A> scratch(grid.size().rows, grid.size().cols);
+	for (std::size_t step = 0; step < steps; ++step) {
+		apply_stencil<Stencil>(grid, scratch, fn, mode, fill);
+		grid.swap(scratch);
+	}
+}
+
+namespace impl {
+
+	// 2D sliding window: monotonic deque along each row, then van Herk/Gil-Werman
+	// down the columns, which is O(1) per element and runs along contiguous rows
+	template<typename T, typename A, typename Compare>
+	matrix<T, A> sliding_extreme(const matrix<T, A>& a, std::size_t window_rows, std::size_t window_cols, Compare better) {
+		const auto sz = a.size();
+		if (window_rows == 0 || window_cols == 0)
+			throw std::invalid_argument{ "window must not be empty" };
+		if (window_rows > sz.rows || window_cols > sz.cols)
+			throw std::invalid_argument{ "window is larger than the matrix" };
+
+		const std::size_t out_cols = sz.cols - window_cols + 1;
+		const std::size_t out_rows = sz.rows - window_rows + 1;
+
+		matrix<T, A> horizontal(sz.rows, out_cols);
+		parallel_for(0, sz.rows, rows_grain, [&](std::size_t first, std::size_t last) {
+			std::vector<std::size_t> ring(window_cols);
+			for (std::size_t i = first; i < last; ++i)
+				sliding_extreme_row(a[i], sz.cols, window_cols, horizontal[i], ring, better);
+		});
+
+		if (window_rows == 1)
+			return horizontal;
+
+		// within each block of window_rows rows: prefix[i] = best of block start..i,
+		// suffix[i] = best of i..block end; out[i] = best(suffix[i], prefix[i + window_rows - 1])
+		matrix<T, A> prefix(sz.rows, out_cols);
+		matrix<T, A> suffix(sz.rows, out_cols);
+		const std::size_t blocks = (sz.rows + window_rows - 1) / window_rows;
+		auto pick = [&](const T& x, const T& y) { return better(x, y) ? x : y; };
+		parallel_for(0, blocks, 1, [&](std::size_t first, std::size_t last) {
+			for (std::size_t block = first; block < last; ++block) {
+				const std::size_t begin = block * window_rows;
+				const std::size_t end = std::min(sz.rows, begin + window_rows);
+
+				std::copy_n(horizontal[begin], out_cols, prefix[begin]);
+				for (std::size_t i = begin + 1; i < end; ++i) {
+					for (std::size_t j = 0; j < out_cols; ++j)
+						prefix[i][j] = pick(prefix[i - 1][j], horizontal[i][j]);
+				}
+
+				std::copy_n(horizontal[end - 1], out_cols, suffix[end - 1]);
+				for (std::size_t i = end - 1; i-- > begin;) {
+					for (std::size_t j = 0; j < out_cols; ++j)
+						suffix[i][j] = pick(suffix[i + 1][j], horizontal[i][j]);
+				}
+			}
+		});
+
+		matrix<T, A> result(out_rows, out_cols);
+		parallel_for(0, out_rows, rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				const T* s = suffix[i];
+				const T* p = prefix[i + window_rows - 1];
+				T* dst = result[i];
+				for (std::size_t j = 0; j < out_cols; ++j)
+					dst[j] = pick(s[j], p[j]);
+			}
+		});
+		return result;
+	}
+}
+
+// maximum over every window_rows x window_cols window;
+// result[i][j] covers rows [i, i + window_rows) and cols [j, j + window_cols)
+template<class T, class A>
+matrix<T, A> sliding_max(const matrix<T, A>& a, std::size_t window_rows, std::size_t window_cols)
+{
+	return impl::sliding_extreme(a, window_rows, window_cols, std::greater<T>());
+}
+
+// minimum over every window_rows x window_cols window
+template<class T, class A>
+matrix<T, A> sliding_min(const matrix<T, A>& a, std::size_t window_rows, std::size_t window_cols)
+{
+	return impl::sliding_extreme(a, window_rows, window_cols, std::less<T>());
+}
+
+
+#endif // !STENCIL_HPP
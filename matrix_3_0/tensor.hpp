@@ -0,0 +1,503 @@
+#pragma once
+#ifndef TENSOR_HPP
+#define TENSOR_HPP
+
+#include "matrix.hpp"
+#include "matrix_view.hpp"
+#include "linalg.hpp"
+#include "parallel.hpp"
+#include "reduce.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+// N-dimensional arrays, e.g. a batch of matrices as one tensor<float, 3> of {batch, rows, cols}.
+// A tensor owns one row-major block from its allocator (the same parameter as for matrix), so a
+// batch is a single allocation. tensor_view is a shape and per-axis strides over such a block:
+// slices, steps, fixed indices and axis permutations only change those numbers and never copy.
+// reshape needs contiguous data. A 2D view whose columns are contiguous turns into a matrix_view
+// through a row table it owns (tensor_matrix_view), so matrix kernels run on slices in place.
+template<std::size_t N>
+using tensor_shape = std::array<std::size_t, N>;
+
+namespace impl {
+
+	template<std::size_t N>
+	std::size_t element_count(const tensor_shape<N>& shape) noexcept {
+		std::size_t count = 1;
+		for (std::size_t extent : shape)
+			count *= extent;
+		return count;
+	}
+
+	template<std::size_t N>
+	tensor_shape<N> row_major_strides(const tensor_shape<N>& shape) noexcept {
+		tensor_shape<N> strides{};
+		std::size_t stride = 1;
+		for (std::size_t k = N; k-- > 0;) {
+			strides[k] = stride;
+			stride *= shape[k];
+		}
+		return strides;
+	}
+
+	// offset of line r, counting the lines along the last axis in row-major order
+	template<std::size_t N>
+	std::size_t line_offset(const tensor_shape<N>& shape, const tensor_shape<N>& strides, std::size_t r) noexcept {
+		std::size_t offset = 0;
+		for (std::size_t k = N - 1; k-- > 0;) {
+			offset += (r % shape[k]) * strides[k];
+			r /= shape[k];
+		}
+		return offset;
+	}
+
+	// offset of element i of shape in row-major order
+	template<std::size_t N>
+	std::size_t element_offset(const tensor_shape<N>& shape, const tensor_shape<N>& strides, std::size_t i) noexcept {
+		std::size_t offset = 0;
+		for (std::size_t k = N; k-- > 0;) {
+			offset += (i % shape[k]) * strides[k];
+			i /= shape[k];
+		}
+		return offset;
+	}
+
+	inline void check_axis(std::size_t axis, std::size_t n) {
+		if (axis >= n)
+			throw std::out_of_range{ "axis is out of this tensor" };
+	}
+}
+
+template<class T>
+class tensor_matrix_view;
+
+template<class T, std::size_t N>
+class tensor_view {
+public:
+	static_assert(N > 0, "tensor needs at least one axis");
+
+	using value_type = std::remove_const_t<T>;
+	using size_type = std::size_t;
+
+	tensor_view() = default;
+	explicit tensor_view(T* data, const tensor_shape<N>& shape, const tensor_shape<N>& strides) noexcept
+		: data_(data), shape_(shape), strides_(strides)
+	{
+	}
+
+	// a mutable view converts to a read-only one
+	template<class U, typename = std::enable_if_t<std::is_const_v<T> && std::is_same_v<U, value_type>>>
+	tensor_view(const tensor_view<U, N>& other) noexcept
+		: data_(other.data()), shape_(other.shape()), strides_(other.strides())
+	{
+	}
+
+	T* data() const noexcept { return data_; }
+	const tensor_shape<N>& shape() const noexcept { return shape_; }
+	const tensor_shape<N>& strides() const noexcept { return strides_; }
+	size_type extent(size_type axis) const noexcept { return shape_[axis]; }
+	size_type size() const noexcept { return impl::element_count(shape_); }
+	bool empty() const noexcept { return size() == 0; }
+
+	// elements in row-major order with no gaps
+	bool contiguous() const noexcept
+	{
+		std::size_t expected = 1;
+		for (std::size_t k = N; k-- > 0;) {
+			if (shape_[k] != 1 && strides_[k] != expected)
+				return false;
+			expected *= shape_[k];
+		}
+		return true;
+	}
+
+	T& operator[](const tensor_shape<N>& index) const noexcept { return data_[offset(index)]; }
+
+	template<class... I>
+	T& operator()(I... index) const
+	{
+		static_assert(sizeof...(I) == N, "one index per axis");
+		const tensor_shape<N> at{ static_cast<size_type>(index)... };
+		for (std::size_t k = 0; k < N; ++k) {
+			if (at[k] >= shape_[k])
+				throw std::out_of_range{ "index is out of this tensor" };
+		}
+		return data_[offset(at)];
+	}
+
+	// axis k of the result is axis axes[k] of this view
+	tensor_view permute(const tensor_shape<N>& axes) const
+	{
+		std::array<bool, N> seen{};
+		tensor_view result(data_, shape_, strides_);
+		for (std::size_t k = 0; k < N; ++k) {
+			if (axes[k] >= N || seen[axes[k]])
+				throw std::invalid_argument{ "axes are not a permutation" };
+			seen[axes[k]] = true;
+			result.shape_[k] = shape_[axes[k]];
+			result.strides_[k] = strides_[axes[k]];
+		}
+		return result;
+	}
+
+	// count positions along axis starting at first, step apart
+	tensor_view slice(size_type axis, size_type first, size_type count, size_type step = 1) const
+	{
+		impl::check_axis(axis, N);
+		if (step == 0)
+			throw std::invalid_argument{ "step must be greater than zero" };
+		if (count != 0 && (first >= shape_[axis] || (count - 1) * step >= shape_[axis] - first))
+			throw std::out_of_range{ "index is out of this tensor" };
+
+		tensor_view result(data_ + (count != 0 ? first * strides_[axis] : 0), shape_, strides_);
+		result.shape_[axis] = count;
+		result.strides_[axis] = strides_[axis] * step;
+		return result;
+	}
+
+	// the view at position i of axis, one axis less
+	template<std::size_t M = N, typename = std::enable_if_t<(M > 1)>>
+	tensor_view<T, N - 1> index(size_type axis, size_type i) const
+	{
+		impl::check_axis(axis, N);
+		if (i >= shape_[axis])
+			throw std::out_of_range{ "index is out of this tensor" };
+
+		tensor_shape<N - 1> shape{};
+		tensor_shape<N - 1> strides{};
+		for (std::size_t k = 0, r = 0; k < N; ++k) {
+			if (k == axis)
+				continue;
+			shape[r] = shape_[k];
+			strides[r] = strides_[k];
+			++r;
+		}
+		return tensor_view<T, N - 1>(data_ + i * strides_[axis], shape, strides);
+	}
+
+	// the same elements under another shape; the data has to be contiguous
+	template<std::size_t M>
+	tensor_view<T, M> reshape(const tensor_shape<M>& shape) const
+	{
+		if (impl::element_count(shape) != size())
+			throw std::invalid_argument{ "tensor sizes do not match" };
+		if (!contiguous())
+			throw std::invalid_argument{ "reshape needs contiguous data" };
+		return tensor_view<T, M>(data_, shape, impl::row_major_strides(shape));
+	}
+
+	// the plane of row_axis and col_axis through position at (entries of those two axes are ignored)
+	tensor_matrix_view<T> matrix_slice(size_type row_axis, size_type col_axis, const tensor_shape<N>& at) const
+	{
+		impl::check_axis(row_axis, N);
+		impl::check_axis(col_axis, N);
+		if (row_axis == col_axis)
+			throw std::invalid_argument{ "row and col axes must differ" };
+
+		tensor_shape<N> origin = at;
+		origin[row_axis] = 0;
+		origin[col_axis] = 0;
+		for (std::size_t k = 0; k < N; ++k) {
+			if (k != row_axis && k != col_axis && origin[k] >= shape_[k])
+				throw std::out_of_range{ "index is out of this tensor" };
+		}
+		const tensor_view<T, 2> plane(data_ + offset(origin), { shape_[row_axis], shape_[col_axis] }, { strides_[row_axis], strides_[col_axis] });
+		return tensor_matrix_view<T>(plane);
+	}
+
+	template<std::size_t M = N, typename = std::enable_if_t<M == 2>>
+	tensor_matrix_view<T> as_matrix() const { return tensor_matrix_view<T>(*this); }
+
+private:
+	size_type offset(const tensor_shape<N>& index) const noexcept
+	{
+		size_type result = 0;
+		for (std::size_t k = 0; k < N; ++k)
+			result += index[k] * strides_[k];
+		return result;
+	}
+
+	template<class, std::size_t>
+	friend class tensor_view;
+
+	T* data_ = nullptr;
+	tensor_shape<N> shape_{};
+	tensor_shape<N> strides_{};
+};
+
+// A 2D tensor view seen as a matrix_view: keeps the row pointers the view refers to.
+// Columns have to be contiguous; copy a permuted view with contiguous() first otherwise.
+template<class T>
+class tensor_matrix_view {
+public:
+	explicit tensor_matrix_view(const tensor_view<T, 2>& v)
+		: rows_(v.extent(0)), cols_(v.extent(1))
+	{
+		if (v.extent(1) > 1 && v.strides()[1] != 1)
+			throw std::invalid_argument{ "slice columns are not contiguous" };
+		for (std::size_t i = 0; i < rows_.size(); ++i)
+			rows_[i] = v.data() + i * v.strides()[0];
+	}
+
+	// the views point into the row table, so a temporary tensor_matrix_view does not convert
+	matrix_view<T> view() const& noexcept { return matrix_view<T>(rows_.data(), rows_.size(), 0, cols_); }
+	matrix_view<T> view() const&& = delete;
+	operator matrix_view<T>() const& noexcept { return view(); }
+	operator matrix_view<T>() const&& = delete;
+
+	template<class U = T, typename = std::enable_if_t<!std::is_const_v<U>>>
+	operator matrix_view<const U>() const& noexcept { return view(); }
+	template<class U = T, typename = std::enable_if_t<!std::is_const_v<U>>>
+	operator matrix_view<const U>() const&& = delete;
+
+private:
+	std::vector<T*> rows_;
+	std::size_t cols_;
+};
+
+template<class T, std::size_t N, class Allocator = std::allocator<T>>
+class tensor {
+public:
+	using value_type = T;
+	using allocator_type = Allocator;
+	using size_type = std::size_t;
+
+	static_assert(std::is_same_v<T, typename Allocator::value_type>, "allocator must allocate type T");
+
+	tensor() = default;
+	explicit tensor(const tensor_shape<N>& shape, const T& value = T())
+		: shape_(shape), count_(impl::element_count(shape))
+	{
+		if (count_ == 0)
+			return;
+		data_ = alloc_traits::allocate(alloc_, count_);
+		try {
+			std::uninitialized_fill_n(data_, count_, value);
+		}
+		catch (...) {
+			alloc_traits::deallocate(alloc_, data_, count_);
+			throw;
+		}
+	}
+
+	// copy of the viewed elements
+	template<class U, typename = std::enable_if_t<std::is_same_v<std::remove_const_t<U>, T>>>
+	explicit tensor(const tensor_view<U, N>& v)
+		: tensor(v.shape())
+	{
+		assign(v);
+	}
+
+	~tensor() { release(); }
+
+	tensor(const tensor& other) : tensor(other.view()) {}
+	tensor& operator=(const tensor& other)
+	{
+		if (this != &other) {
+			tensor tmp(other);
+			swap(tmp);
+		}
+		return *this;
+	}
+
+	tensor(tensor&& other) noexcept { swap(other); }
+	tensor& operator=(tensor&& other) noexcept
+	{
+		swap(other);
+		return *this;
+	}
+
+	void swap(tensor& other) noexcept
+	{
+		std::swap(shape_, other.shape_);
+		std::swap(count_, other.count_);
+		std::swap(data_, other.data_);
+		std::swap(alloc_, other.alloc_);
+	}
+
+	const tensor_shape<N>& shape() const noexcept { return shape_; }
+	size_type extent(size_type axis) const noexcept { return shape_[axis]; }
+	size_type size() const noexcept { return count_; }
+	bool empty() const noexcept { return count_ == 0; }
+	T* data() noexcept { return data_; }
+	const T* data() const noexcept { return data_; }
+
+	tensor_view<T, N> view() noexcept { return tensor_view<T, N>(data_, shape_, impl::row_major_strides(shape_)); }
+	tensor_view<const T, N> view() const noexcept { return tensor_view<const T, N>(data_, shape_, impl::row_major_strides(shape_)); }
+
+	template<class... I>
+	T& operator()(I... index) { return view()(index...); }
+
+	template<class... I>
+	const T& operator()(I... index) const { return view()(index...); }
+
+	// v element-wise into this tensor of the same shape
+	template<class U>
+	void assign(const tensor_view<U, N>& v)
+	{
+		if (v.shape() != shape_)
+			throw std::invalid_argument{ "tensor sizes do not match" };
+		if (count_ == 0)
+			return;
+
+		// rows along the last axis, split over threads
+		const size_type cols = shape_[N - 1];
+		const size_type rows = count_ / cols;
+		const size_type step = v.strides()[N - 1];
+		parallel_for(0, rows, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t r = first; r < last; ++r) {
+				const auto* src = v.data() + impl::line_offset(v.shape(), v.strides(), r);
+				T* dst = data_ + r * cols;
+				for (std::size_t j = 0; j < cols; ++j)
+					dst[j] = src[j * step];
+			}
+		});
+	}
+
+private:
+	using alloc_traits = std::allocator_traits<Allocator>;
+
+	void release() noexcept
+	{
+		if (data_ == nullptr)
+			return;
+		for (size_type i = 0; i < count_; ++i)
+			alloc_traits::destroy(alloc_, data_ + i);
+		alloc_traits::deallocate(alloc_, data_, count_);
+		data_ = nullptr;
+	}
+
+	tensor_shape<N> shape_{};
+	size_type count_ = 0;
+	T* data_ = nullptr;
+	Allocator alloc_;
+};
+
+// contiguous copy of any view
+template<class T, std::size_t N>
+tensor<std::remove_const_t<T>, N> contiguous(const tensor_view<T, N>& v)
+{
+	return tensor<std::remove_const_t<T>, N>(v);
+}
+
+// op over axis, which is removed from the shape
+template<class T, std::size_t N>
+tensor<std::remove_const_t<T>, N - 1> reduce(const tensor_view<T, N>& t, reduce_op op, std::size_t axis)
+{
+	static_assert(N > 1, "reduce a one-axis tensor with reduce_all");
+	using value_type = std::remove_const_t<T>;
+	impl::check_axis(axis, N);
+	const std::size_t extent = t.extent(axis);
+	if (extent == 0 && op != reduce_op::sum)
+		throw std::invalid_argument{ "cannot reduce an empty tensor" };
+
+	// the plane of the other axes at position 0 of the reduced one
+	tensor_shape<N - 1> shape{};
+	tensor_shape<N - 1> strides{};
+	for (std::size_t k = 0, r = 0; k < N; ++k) {
+		if (k == axis)
+			continue;
+		shape[r] = t.extent(k);
+		strides[r] = t.strides()[k];
+		++r;
+	}
+	const tensor_view<T, N - 1> first_plane(t.data(), shape, strides);
+	tensor<value_type, N - 1> result(shape);
+	if (result.empty() || extent == 0)
+		return result;
+
+	// the reduced axis runs along memory (the last one of a row-major tensor): one contiguous
+	// row fold per result element, split over threads as in reduce() along matrix_axis::cols
+	const std::size_t axis_stride = t.strides()[axis];
+	if (axis_stride == 1) {
+		parallel_for(0, result.size(), impl::rows_grain, [&](std::size_t first, std::size_t last) {
+			for (std::size_t i = first; i < last; ++i) {
+				const T* line = first_plane.data() + impl::element_offset(first_plane.shape(), first_plane.strides(), i);
+				value_type value = impl::reduce_row<value_type>(op, line, extent);
+				if (op == reduce_op::mean)
+					value /= static_cast<value_type>(extent);
+				result.data()[i] = value;
+			}
+		});
+		return result;
+	}
+
+	// otherwise whole lines of the other axes are folded together, strided ones gathered first
+	const std::size_t cols = first_plane.shape()[N - 2];
+	const std::size_t lines = result.size() / cols;
+	const std::size_t step = first_plane.strides()[N - 2];
+	parallel_for(0, lines, impl::rows_grain, [&](std::size_t first, std::size_t last) {
+		std::vector<value_type> gathered(step == 1 ? 0 : cols);
+		for (std::size_t r = first; r < last; ++r) {
+			value_type* acc = result.data() + r * cols;
+			const T* base = first_plane.data() + impl::line_offset(first_plane.shape(), first_plane.strides(), r);
+			for (std::size_t k = 0; k < extent; ++k) {
+				const T* line = base + k * axis_stride;
+				if (step != 1) {
+					for (std::size_t j = 0; j < cols; ++j)
+						gathered[j] = line[j * step];
+					line = gathered.data();
+				}
+				if (k == 0 && op != reduce_op::sum && op != reduce_op::mean)
+					std::copy_n(line, cols, acc);
+				else
+					impl::reduce_into(op, line, acc, cols);
+			}
+			if (op == reduce_op::mean) {
+				for (std::size_t j = 0; j < cols; ++j)
+					acc[j] /= static_cast<value_type>(extent);
+			}
+		}
+	});
+	return result;
+}
+
+template<class T, std::size_t N, class A>
+tensor<T, N - 1> reduce(const tensor<T, N, A>& t, reduce_op op, std::size_t axis)
+{
+	return reduce(t.view(), op, axis);
+}
+
+// op over every element
+template<class T, std::size_t N>
+std::remove_const_t<T> reduce_all(const tensor_view<T, N>& t, reduce_op op)
+{
+	using value_type = std::remove_const_t<T>;
+	if (t.empty()) {
+		if (op != reduce_op::sum)
+			throw std::invalid_argument{ "cannot reduce an empty tensor" };
+		return value_type();
+	}
+	// strided views are packed first, contiguous ones are read in place
+	tensor<value_type, N> packed;
+	if (!t.contiguous())
+		packed = contiguous(t);
+	const value_type* first = packed.empty() ? t.data() : packed.data();
+	const std::size_t count = t.size();
+	switch (op) {
+	case reduce_op::min:
+		return *std::min_element(first, first + count);
+	case reduce_op::max:
+		return *std::max_element(first, first + count);
+	default: {
+		value_type sum = impl::reduce_row(reduce_op::sum, first, count);
+		return (op == reduce_op::mean) ? sum / static_cast<value_type>(count) : sum;
+	}
+	}
+}
+
+template<class T, std::size_t N, class A>
+T reduce_all(const tensor<T, N, A>& t, reduce_op op)
+{
+	return reduce_all(t.view(), op);
+}
+
+
+#endif // !TENSOR_HPP
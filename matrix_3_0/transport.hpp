@@ -0,0 +1,358 @@
+#pragma once
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+
+// Point-to-point messaging between the ranks of a distributed computation.
+// Messages are tagged byte blocks; between two ranks, messages with the same tag arrive in the
+// order they were sent, messages with other tags may be received in any order. send() never
+// waits for the receiver, recv() blocks until the matching message is there.
+// A transport object is used by one thread of its rank.
+class transport {
+public:
+	virtual ~transport() = default;
+
+	virtual int rank() const noexcept = 0;
+	virtual int size() const noexcept = 0;
+
+	virtual void send(int dest, int tag, const void* data, std::size_t bytes) = 0;
+
+	// bytes must match the size of the message sent
+	virtual void recv(int source, int tag, void* data, std::size_t bytes) = 0;
+
+protected:
+	void check_peer(int peer) const
+	{
+		if (peer < 0 || peer >= size())
+			throw std::out_of_range{ "rank is out of this group" };
+	}
+};
+
+namespace impl {
+
+	using message_queue = std::map<std::pair<int, int>, std::deque<std::vector<unsigned char>>>;
+
+	struct local_mailbox {
+		std::mutex mutex;
+		std::condition_variable arrived;
+		message_queue messages;		// by (source, tag)
+	};
+
+	inline void take_message(std::vector<unsigned char>& message, void* data, std::size_t bytes) {
+		if (message.size() != bytes)
+			throw std::runtime_error{ "message size does not match" };
+		if (bytes != 0)
+			std::memcpy(data, message.data(), bytes);
+	}
+}
+
+// Ranks are threads of one process exchanging messages through shared mailboxes.
+class local_transport : public transport {
+public:
+	// one transport per rank, all connected to each other
+	static std::vector<local_transport> group(int size)
+	{
+		if (size <= 0)
+			throw std::invalid_argument{ "group size must be greater than zero" };
+		auto boxes = std::make_shared<std::deque<impl::local_mailbox>>(static_cast<std::size_t>(size));
+		std::vector<local_transport> result;
+		result.reserve(static_cast<std::size_t>(size));
+		for (int rank = 0; rank < size; ++rank)
+			result.push_back(local_transport(boxes, rank, size));
+		return result;
+	}
+
+	int rank() const noexcept override { return rank_; }
+	int size() const noexcept override { return size_; }
+
+	void send(int dest, int tag, const void* data, std::size_t bytes) override
+	{
+		check_peer(dest);
+		const auto* first = static_cast<const unsigned char*>(data);
+		impl::local_mailbox& box = (*boxes_)[static_cast<std::size_t>(dest)];
+		{
+			std::lock_guard<std::mutex> lock(box.mutex);
+			box.messages[{ rank_, tag }].emplace_back(first, first + bytes);
+		}
+		box.arrived.notify_all();
+	}
+
+	void recv(int source, int tag, void* data, std::size_t bytes) override
+	{
+		check_peer(source);
+		impl::local_mailbox& box = (*boxes_)[static_cast<std::size_t>(rank_)];
+		std::unique_lock<std::mutex> lock(box.mutex);
+		auto& queue = box.messages[{ source, tag }];
+		box.arrived.wait(lock, [&] { return !queue.empty(); });
+		std::vector<unsigned char> message = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+		impl::take_message(message, data, bytes);
+	}
+
+private:
+	local_transport(std::shared_ptr<std::deque<impl::local_mailbox>> boxes, int rank, int size)
+		: boxes_(std::move(boxes)), rank_(rank), size_(size)
+	{
+	}
+
+	std::shared_ptr<std::deque<impl::local_mailbox>> boxes_;
+	int rank_;
+	int size_;
+};
+
+#if !defined(_WIN32)
+class socket_transport;
+
+// Unix-domain socket pair between every two ranks, created before the worker processes are forked.
+// Each process then attaches to its rank, which keeps that rank's ends and closes all others.
+class socket_mesh {
+public:
+	explicit socket_mesh(int size)
+		: size_(size), fds_(static_cast<std::size_t>(size) * static_cast<std::size_t>(size), -1)
+	{
+		if (size <= 0)
+			throw std::invalid_argument{ "group size must be greater than zero" };
+		for (int i = 0; i < size; ++i) {
+			for (int j = i + 1; j < size; ++j) {
+				int pair[2];
+				if (::socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+					const int error = errno;
+					close_all();
+					throw std::system_error{ error, std::generic_category(), "socketpair failed" };
+				}
+				fd(i, j) = pair[0];
+				fd(j, i) = pair[1];
+			}
+		}
+	}
+
+	~socket_mesh() { close_all(); }
+
+	socket_mesh(const socket_mesh&) = delete;
+	socket_mesh& operator=(const socket_mesh&) = delete;
+
+	int size() const noexcept { return size_; }
+
+	// transport of rank for this process; call once per process
+	std::unique_ptr<socket_transport> attach(int rank);
+
+private:
+	int& fd(int from, int to) { return fds_[static_cast<std::size_t>(from) * static_cast<std::size_t>(size_) + static_cast<std::size_t>(to)]; }
+
+	void close_all() noexcept
+	{
+		for (int& f : fds_) {
+			if (f >= 0)
+				::close(f);
+			f = -1;
+		}
+	}
+
+	int size_;
+	std::vector<int> fds_;	// fd(i, j): end held by rank i of the pair connecting i and j
+};
+
+// Ranks are processes connected by a socket_mesh. Messages travel as frames (tag, length, payload);
+// a sender thread writes them so send() never blocks on a full socket buffer, and frames read
+// while looking for another tag are kept until they are asked for.
+class socket_transport : public transport {
+public:
+	socket_transport(std::vector<int> peer_fds, int rank)
+		: fds_(std::move(peer_fds)), rank_(rank), pending_(fds_.size())
+	{
+		sender_ = std::thread([this] { send_loop(); });
+	}
+
+	// flushes all queued messages, then closes the sockets
+	~socket_transport()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		queued_.notify_all();
+		sender_.join();
+		for (int f : fds_) {
+			if (f >= 0)
+				::close(f);
+		}
+	}
+
+	socket_transport(const socket_transport&) = delete;
+	socket_transport& operator=(const socket_transport&) = delete;
+
+	int rank() const noexcept override { return rank_; }
+	int size() const noexcept override { return static_cast<int>(fds_.size()); }
+
+	void send(int dest, int tag, const void* data, std::size_t bytes) override
+	{
+		check_peer(dest);
+		const auto* first = static_cast<const unsigned char*>(data);
+		if (dest == rank_) {
+			pending_[static_cast<std::size_t>(dest)][{ dest, tag }].emplace_back(first, first + bytes);
+			return;
+		}
+
+		frame_header header{ static_cast<std::int32_t>(tag), 0, static_cast<std::uint64_t>(bytes) };
+		std::vector<unsigned char> frame(sizeof(header) + bytes);
+		std::memcpy(frame.data(), &header, sizeof(header));
+		if (bytes != 0)
+			std::memcpy(frame.data() + sizeof(header), first, bytes);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (error_ != 0)
+				throw std::system_error{ error_, std::generic_category(), "socket transport send failed" };
+			outgoing_.emplace_back(dest, std::move(frame));
+		}
+		queued_.notify_one();
+	}
+
+	void recv(int source, int tag, void* data, std::size_t bytes) override
+	{
+		check_peer(source);
+		auto& kept = pending_[static_cast<std::size_t>(source)];
+		auto it = kept.find({ source, tag });
+		if (it != kept.end() && !it->second.empty()) {
+			std::vector<unsigned char> message = std::move(it->second.front());
+			it->second.pop_front();
+			impl::take_message(message, data, bytes);
+			return;
+		}
+		if (source == rank_)
+			throw std::runtime_error{ "no message from this rank" };
+
+		const int fd = fds_[static_cast<std::size_t>(source)];
+		for (;;) {
+			frame_header header{};
+			read_fully(fd, &header, sizeof(header));
+			if (header.tag == tag) {
+				if (header.bytes != bytes)
+					throw std::runtime_error{ "message size does not match" };
+				read_fully(fd, data, bytes);
+				return;
+			}
+			std::vector<unsigned char> message(static_cast<std::size_t>(header.bytes));
+			read_fully(fd, message.data(), message.size());
+			kept[{ source, header.tag }].push_back(std::move(message));
+		}
+	}
+
+private:
+	struct frame_header {
+		std::int32_t tag;
+		std::uint32_t reserved;
+		std::uint64_t bytes;
+	};
+
+	static void read_fully(int fd, void* data, std::size_t bytes)
+	{
+		auto* p = static_cast<unsigned char*>(data);
+		while (bytes > 0) {
+			const ssize_t n = ::read(fd, p, bytes);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				throw std::system_error{ errno, std::generic_category(), "socket transport receive failed" };
+			if (n == 0)
+				throw std::runtime_error{ "peer closed the connection" };
+			p += n;
+			bytes -= static_cast<std::size_t>(n);
+		}
+	}
+
+	static int write_fully(int fd, const unsigned char* p, std::size_t bytes) noexcept
+	{
+#if defined(MSG_NOSIGNAL)
+		constexpr int flags = MSG_NOSIGNAL;
+#else
+		constexpr int flags = 0;
+#endif
+		while (bytes > 0) {
+			const ssize_t n = ::send(fd, p, bytes, flags);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				return errno;
+			p += n;
+			bytes -= static_cast<std::size_t>(n);
+		}
+		return 0;
+	}
+
+	void send_loop()
+	{
+		for (;;) {
+			std::pair<int, std::vector<unsigned char>> frame;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				queued_.wait(lock, [this] { return stop_ || !outgoing_.empty(); });
+				if (outgoing_.empty())
+					return;
+				frame = std::move(outgoing_.front());
+				outgoing_.pop_front();
+			}
+			const int error = write_fully(fds_[static_cast<std::size_t>(frame.first)], frame.second.data(), frame.second.size());
+			if (error != 0) {
+				std::lock_guard<std::mutex> lock(mutex_);
+				error_ = error;
+			}
+		}
+	}
+
+	std::vector<int> fds_;		// socket to every peer, -1 for this rank
+	int rank_;
+	std::vector<impl::message_queue> pending_;	// frames read ahead, by source
+	std::deque<std::pair<int, std::vector<unsigned char>>> outgoing_;
+	std::mutex mutex_;
+	std::condition_variable queued_;
+	bool stop_ = false;
+	int error_ = 0;
+	std::thread sender_;
+};
+
+inline std::unique_ptr<socket_transport> socket_mesh::attach(int rank)
+{
+	if (rank < 0 || rank >= size_)
+		throw std::out_of_range{ "rank is out of this group" };
+
+	std::vector<int> peers(static_cast<std::size_t>(size_), -1);
+	for (int i = 0; i < size_; ++i) {
+		for (int j = 0; j < size_; ++j) {
+			int& f = fd(i, j);
+			if (f < 0)
+				continue;
+			if (i == rank)
+				peers[static_cast<std::size_t>(j)] = f;
+			else
+				::close(f);
+			f = -1;
+		}
+	}
+	return std::make_unique<socket_transport>(std::move(peers), rank);
+}
+#endif
+
+
+#endif // !TRANSPORT_HPP
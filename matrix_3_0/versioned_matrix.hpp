@@ -0,0 +1,350 @@
+#pragma once
+#ifndef VERSIONED_MATRIX_HPP
+#define VERSIONED_MATRIX_HPP
+
+#include "matrix.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+
+// Matrix with point-in-time snapshots (MVCC).
+// Every row keeps a chain of buffers ordered by the version in which they were created.
+// A snapshot is a row table (T** layout) pointing into those chains, so taking one costs O(rows)
+// and unchanged rows are shared between all versions. Writing a row that is visible
+// to a live snapshot copies that row only (copy-on-write).
+//
+// Single writer: mutating members and collect_garbage() must be called from one thread.
+// Snapshots may be read and released from any thread.
+template<class T, class Allocator = std::allocator<T>>
+class versioned_matrix {
+public:
+	using value_type = T;
+	using allocator_type = Allocator;
+	using size_type = std::size_t;
+	using version_type = std::uint64_t;
+
+	static_assert(std::is_same_v<T, typename Allocator::value_type>, "allocator must allocate type T");
+
+private:
+	struct row_version {
+		version_type version;
+		T* data;
+	};
+
+	struct shared_state {
+		using alloc_traits = std::allocator_traits<Allocator>;
+
+		explicit shared_state(size_type rows, size_type cols) : sz{ rows, cols }, chains(rows) {}
+		~shared_state()
+		{
+			for (auto& chain : chains) {
+				for (auto& entry : chain) {
+					destroy_row(entry.data);
+				}
+			}
+		}
+
+		T* make_row(const T* src)
+		{
+			T* row = alloc_traits::allocate(alloc, sz.cols);
+			size_type col = 0;
+			try {
+				for (; col < sz.cols; ++col) {
+					alloc_traits::construct(alloc, row + col, src[col]);
+				}
+			}
+			catch (...) {
+				for (size_type i = 0; i < col; ++i) {
+					alloc_traits::destroy(alloc, row + i);
+				}
+				alloc_traits::deallocate(alloc, row, sz.cols);
+				throw;
+			}
+			return row;
+		}
+		T* make_row_with_value(const T& value)
+		{
+			T* row = alloc_traits::allocate(alloc, sz.cols);
+			size_type col = 0;
+			try {
+				for (; col < sz.cols; ++col) {
+					alloc_traits::construct(alloc, row + col, value);
+				}
+			}
+			catch (...) {
+				for (size_type i = 0; i < col; ++i) {
+					alloc_traits::destroy(alloc, row + i);
+				}
+				alloc_traits::deallocate(alloc, row, sz.cols);
+				throw;
+			}
+			return row;
+		}
+		void destroy_row(T* row) noexcept
+		{
+			for (size_type col = 0; col < sz.cols; ++col) {
+				alloc_traits::destroy(alloc, row + col);
+			}
+			alloc_traits::deallocate(alloc, row, sz.cols);
+		}
+
+		// true if some live snapshot sees versions in [first, last)
+		bool is_visible(version_type first, version_type last) const
+		{
+			std::lock_guard<std::mutex> lock(live_mutex);
+			auto it = live.lower_bound(first);
+			return it != live.end() && *it < last;
+		}
+		bool has_live() const
+		{
+			std::lock_guard<std::mutex> lock(live_mutex);
+			return !live.empty();
+		}
+		void register_snapshot(version_type version)
+		{
+			std::lock_guard<std::mutex> lock(live_mutex);
+			live.insert(version);
+		}
+		void release_snapshot(version_type version) noexcept
+		{
+			std::lock_guard<std::mutex> lock(live_mutex);
+			auto it = live.find(version);
+			assert(it != live.end());
+			live.erase(it);
+		}
+
+		matrix_size_type sz;
+		std::vector<std::vector<row_version>> chains;
+		Allocator alloc;
+
+		mutable std::mutex live_mutex;
+		std::multiset<version_type> live;
+	};
+
+public:
+	// read-only view of the matrix as it was at one version
+	class snapshot {
+	public:
+		snapshot() = default;
+		~snapshot() { release(); }
+
+		snapshot(const snapshot&) = delete;
+		snapshot& operator=(const snapshot&) = delete;
+
+		snapshot(snapshot&& other) noexcept { this->swap(other); }
+		snapshot& operator=(snapshot&& other) noexcept
+		{
+			if (this == &other)
+				return *this;
+
+			release();
+			this->swap(other);
+			return *this;
+		}
+
+		const T* const* data() const noexcept { return rows_.data(); }
+
+		const T* operator[](size_type index) const noexcept { return rows_[index]; }
+		const T& operator()(size_type row, size_type col) const { check_index(row, col); return rows_[row][col]; }
+
+		bool empty() const noexcept { return sz_ == matrix_size_type{ 0,0 }; }
+		matrix_size_type size() const noexcept { return sz_; }
+		version_type version() const noexcept { return version_; }
+
+		matrix<T, Allocator> to_matrix() const
+		{
+			matrix<T, Allocator> result(sz_.rows, sz_.cols);
+			for (size_type row = 0; row < sz_.rows; ++row) {
+				std::copy_n(rows_[row], sz_.cols, result[row]);
+			}
+			return result;
+		}
+
+		void swap(snapshot& other) noexcept
+		{
+			std::swap(state_, other.state_);
+			std::swap(rows_, other.rows_);
+			std::swap(sz_, other.sz_);
+			std::swap(version_, other.version_);
+		}
+
+		void release() noexcept
+		{
+			if (state_ == nullptr)
+				return;
+
+			state_->release_snapshot(version_);
+			state_.reset();
+			rows_.clear();
+			sz_ = matrix_size_type{};
+			version_ = 0;
+		}
+
+	private:
+		friend class versioned_matrix;
+
+		void check_index(size_type row, size_type col) const
+		{
+			if (row >= sz_.rows)
+				throw std::out_of_range{ "row is out of this matrix" };
+
+			if (col >= sz_.cols)
+				throw std::out_of_range{ "col is out of this matrix" };
+		}
+
+		std::shared_ptr<shared_state> state_;
+		std::vector<const T*> rows_;
+		matrix_size_type sz_{ 0, 0 };
+		version_type version_ = 0;
+	};
+
+	explicit versioned_matrix(size_type rows, size_type cols, const T& value) { construct_with_value(rows, cols, value); }
+	explicit versioned_matrix(size_type rows, size_type cols) { construct_with_value(rows, cols, T()); }
+
+	template<class A>
+	explicit versioned_matrix(const matrix<T, A>& mtx)
+	{
+		const auto mtx_sz = mtx.size();
+		if (mtx_sz.rows == 0 || mtx_sz.cols == 0)
+			throw std::invalid_argument{ "matrix must not be empty" };
+
+		state_ = std::make_shared<shared_state>(mtx_sz.rows, mtx_sz.cols);
+		for (size_type row = 0; row < mtx_sz.rows; ++row) {
+			state_->chains[row].reserve(1);
+			state_->chains[row].push_back(row_version{ version_, state_->make_row(mtx[row]) });
+		}
+	}
+
+	versioned_matrix(const versioned_matrix&) = delete;
+	versioned_matrix& operator=(const versioned_matrix&) = delete;
+
+	versioned_matrix(versioned_matrix&&) noexcept = default;
+	versioned_matrix& operator=(versioned_matrix&&) noexcept = default;
+
+	// current version
+	const T* operator[](size_type index) const noexcept { return state_->chains[index].back().data; }
+	const T& operator()(size_type row, size_type col) const { check_index(row, col); return (*this)[row][col]; }
+
+	matrix_size_type size() const noexcept { return state_->sz; }
+	version_type version() const noexcept { return version_; }
+
+	// returns a writable pointer to the row, copying it first if a live snapshot can see it
+	T* mutable_row(size_type row)
+	{
+		if (row >= state_->sz.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+
+		auto& chain = state_->chains[row];
+		row_version& head = chain.back();
+		if (head.version == version_ || !state_->is_visible(head.version, version_ + 1))
+			return head.data;
+
+		T* copy = state_->make_row(head.data);
+		try {
+			chain.push_back(row_version{ version_, copy });
+		}
+		catch (...) {
+			state_->destroy_row(copy);
+			throw;
+		}
+		return copy;
+	}
+
+	void set(size_type row, size_type col, const T& value)
+	{
+		check_index(row, col);
+		mutable_row(row)[col] = value;
+	}
+
+	// O(rows): captures the current row table and starts a new version for subsequent writes
+	snapshot take_snapshot()
+	{
+		snapshot snap;
+		snap.rows_.reserve(state_->sz.rows);
+		for (const auto& chain : state_->chains) {
+			snap.rows_.push_back(chain.back().data);
+		}
+		snap.sz_ = state_->sz;
+		snap.version_ = version_;
+
+		state_->register_snapshot(version_);
+		snap.state_ = state_;
+		++version_;
+		return snap;
+	}
+
+	// frees row buffers that are neither current nor visible to any live snapshot;
+	// returns the number of freed buffers
+	size_type collect_garbage()
+	{
+		size_type freed = 0;
+		const bool any_live = state_->has_live();
+		for (auto& chain : state_->chains) {
+			if (chain.size() == 1)
+				continue;
+
+			auto keep = chain.begin();
+			for (auto it = chain.begin(); it != chain.end() - 1; ++it) {
+				const version_type next_version = (it + 1)->version;
+				if (any_live && state_->is_visible(it->version, next_version)) {
+					*keep++ = *it;
+				}
+				else {
+					state_->destroy_row(it->data);
+					++freed;
+				}
+			}
+			*keep++ = chain.back();
+			chain.erase(keep, chain.end());
+		}
+		return freed;
+	}
+
+	// number of row buffers currently held, including the ones kept for snapshots
+	size_type row_buffers() const noexcept
+	{
+		size_type count = 0;
+		for (const auto& chain : state_->chains) {
+			count += chain.size();
+		}
+		return count;
+	}
+
+private:
+	void check_index(size_type row, size_type col) const
+	{
+		if (row >= state_->sz.rows)
+			throw std::out_of_range{ "row is out of this matrix" };
+
+		if (col >= state_->sz.cols)
+			throw std::out_of_range{ "col is out of this matrix" };
+	}
+
+	void construct_with_value(size_type rows, size_type cols, const T& value)
+	{
+		if (rows == 0)
+			throw std::invalid_argument{ "rows count must be greater than zero" };
+
+		if (cols == 0)
+			throw std::invalid_argument{ "cols count must be greater than zero" };
+
+		state_ = std::make_shared<shared_state>(rows, cols);
+		for (size_type row = 0; row < rows; ++row) {
+			state_->chains[row].reserve(1);
+			state_->chains[row].push_back(row_version{ version_, state_->make_row_with_value(value) });
+		}
+	}
+
+private:
+	std::shared_ptr<shared_state> state_;
+	version_type version_ = 0;
+};
+
+
+#endif // !VERSIONED_MATRIX_HPP